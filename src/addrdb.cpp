@@ -19,15 +19,17 @@
 
 namespace {
 
+/** Size of the buffer the databases are read through */
+constexpr uint64_t DB_READ_BUFFER_SIZE = 1 << 20;
+
 template <typename Stream, typename Data>
 bool SerializeDB(Stream& stream, const Data& data)
 {
-    // Write and commit header, data
+    // Write and commit header, data, serialized once and hashed on the way
     try {
-        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << Params().MessageStart() << data;
-        hasher << Params().MessageStart() << data;
-        stream << hasher.GetHash();
+        CHashedSourceWriter<Stream> hashwriter(&stream);
+        hashwriter << Params().MessageStart() << data;
+        stream << hashwriter.GetHash();
     } catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
     }
@@ -109,11 +111,11 @@ bool DeserializeDB(Stream& stream, Data& data, bool fCheckSum = true)
 template <typename Data>
 bool DeserializeFileDB(const fs::path& path, Data& data)
 {
-    // open input file, and associate with CAutoFile
+    // open input file, and stream it through a buffer rather than reading it field by field
     FILE *file = fsbridge::fopen(path, "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
+    if (!file)
         return error("%s: Failed to open file %s", __func__, path.string());
+    CBufferedFile filein(file, DB_READ_BUFFER_SIZE, 0, SER_DISK, CLIENT_VERSION);
 
     return DeserializeDB(filein, data);
 }
@@ -19,19 +19,27 @@ int CAddrInfo::GetTriedBucket(const uint256& nKey, const std::vector<bool> &asma
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetHash().GetCheapHash();
     uint64_t hash2 = (CHashWriter(SER_GETHASH, 0) << nKey << GetGroup(asmap) << (hash1 % ADDRMAN_TRIED_BUCKETS_PER_GROUP)).GetHash().GetCheapHash();
     int tried_bucket = hash2 % ADDRMAN_TRIED_BUCKET_COUNT;
-    uint32_t mapped_as = GetMappedAS(asmap);
-    LogPrint(BCLog::NET, "IP %s mapped to AS%i belongs to tried bucket %i\n", ToStringIP(), mapped_as, tried_bucket);
+    if (LogAcceptCategory(BCLog::NET)) {
+        uint32_t mapped_as = GetMappedAS(asmap);
+        LogPrint(BCLog::NET, "IP %s mapped to AS%i belongs to tried bucket %i\n", ToStringIP(), mapped_as, tried_bucket);
+    }
     return tried_bucket;
 }
 
 int CAddrInfo::GetNewBucket(const uint256& nKey, const CNetAddr& src, const std::vector<bool> &asmap) const
 {
-    std::vector<unsigned char> vchSourceGroupKey = src.GetGroup(asmap);
+    return GetNewBucket(nKey, src.GetGroup(asmap), asmap);
+}
+
+int CAddrInfo::GetNewBucket(const uint256& nKey, const std::vector<unsigned char>& vchSourceGroupKey, const std::vector<bool> &asmap) const
+{
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetGroup(asmap) << vchSourceGroupKey).GetHash().GetCheapHash();
     uint64_t hash2 = (CHashWriter(SER_GETHASH, 0) << nKey << vchSourceGroupKey << (hash1 % ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP)).GetHash().GetCheapHash();
     int new_bucket = hash2 % ADDRMAN_NEW_BUCKET_COUNT;
-    uint32_t mapped_as = GetMappedAS(asmap);
-    LogPrint(BCLog::NET, "IP %s mapped to AS%i belongs to new bucket %i\n", ToStringIP(), mapped_as, new_bucket);
+    if (LogAcceptCategory(BCLog::NET)) {
+        uint32_t mapped_as = GetMappedAS(asmap);
+        LogPrint(BCLog::NET, "IP %s mapped to AS%i belongs to new bucket %i\n", ToStringIP(), mapped_as, new_bucket);
+    }
     return new_bucket;
 }
 
@@ -96,6 +104,7 @@ CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, in
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    m_size = vRandom.size();
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -130,6 +139,7 @@ void CAddrMan::Delete(int nId)
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
+    m_size = vRandom.size();
     mapAddr.erase(info);
     mapInfo.erase(nId);
     nNew--;
@@ -141,32 +151,76 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
-        assert(infoDelete.nRefCount > 0);
-        infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        RemoveFromNew(infoDelete, nUBucket, nUBucketPos);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
     }
 }
 
-void CAddrMan::MakeTried(CAddrInfo& info, int nId)
+void CAddrMan::AddToNew(CAddrInfo& info, int nId, int nUBucket, int nUBucketPos)
 {
-    // remove the entry from all new buckets
-    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-        int pos = info.GetBucketPosition(nKey, true, bucket);
-        if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+    assert(vvNew[nUBucket][nUBucketPos] == -1);
+    assert(info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS);
+    info.vPosNew[info.nRefCount] = CAddrBucketPos(nUBucket, nUBucketPos);
+    info.nRefCount++;
+    vvNew[nUBucket][nUBucketPos] = nId;
+}
+
+void CAddrMan::RemoveFromNew(CAddrInfo& info, int nUBucket, int nUBucketPos)
+{
+    assert(vvNew[nUBucket][nUBucketPos] != -1);
+    vvNew[nUBucket][nUBucketPos] = -1;
+    for (int i = 0; i < info.nRefCount; i++) {
+        if (info.vPosNew[i].bucket == nUBucket && info.vPosNew[i].pos == nUBucketPos) {
+            // Move the last position in place of the removed one
             info.nRefCount--;
+            info.vPosNew[i] = info.vPosNew[info.nRefCount];
+            return;
         }
     }
-    nNew--;
+    assert(false); // the entry wasn't at this position
+}
 
-    assert(info.nRefCount == 0);
+CAddrBucketPos CAddrMan::GetTriedPos(CAddrInfo& info) const
+{
+    if (info.posTried.bucket == -1) {
+        int nKBucket = info.GetTriedBucket(nKey, m_asmap);
+        info.posTried = CAddrBucketPos(nKBucket, info.GetBucketPosition(nKey, false, nKBucket));
+    }
+    return info.posTried;
+}
+
+std::vector<CAddrBucketPos> CAddrMan::GetNewPositions(const std::vector<CAddress>& vAddr, const CNetAddr& source, const uint256& key) const
+{
+    // The group of the source is the same for all the addresses, and the costliest part of
+    // the bucketing with an asmap
+    const std::vector<unsigned char> vchSourceGroupKey = source.GetGroup(m_asmap);
+    std::vector<CAddrBucketPos> vPos(vAddr.size());
+    for (size_t i = 0; i < vAddr.size(); i++) {
+        if (!vAddr[i].IsRoutable())
+            continue;
+        const CAddrInfo info(vAddr[i], source);
+        int nUBucket = info.GetNewBucket(key, vchSourceGroupKey, m_asmap);
+        vPos[i] = CAddrBucketPos(nUBucket, info.GetBucketPosition(key, true, nUBucket));
+    }
+    return vPos;
+}
+
+void CAddrMan::MakeTried(CAddrInfo& info, int nId)
+{
+    // remove the entry from all new buckets
+    while (info.nRefCount > 0) {
+        const CAddrBucketPos pos = info.vPosNew[info.nRefCount - 1];
+        assert(vvNew[pos.bucket][pos.pos] == nId);
+        RemoveFromNew(info, pos.bucket, pos.pos);
+    }
+    nNew--;
 
     // which tried bucket to move the entry to
-    int nKBucket = info.GetTriedBucket(nKey, m_asmap);
-    int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
+    const CAddrBucketPos posTried = GetTriedPos(info);
+    int nKBucket = posTried.bucket;
+    int nKBucketPos = posTried.pos;
 
     // first make space to add it (the existing tried entry there is moved to new, deleting whatever is there).
     if (vvTried[nKBucket][nKBucketPos] != -1) {
@@ -187,8 +241,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         assert(vvNew[nUBucket][nUBucketPos] == -1);
 
         // Enter it into the new set again.
-        infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        AddToNew(infoOld, nIdEvict, nUBucket, nUBucketPos);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
@@ -227,26 +280,15 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
-        int nB = (n + nRnd) % ADDRMAN_NEW_BUCKET_COUNT;
-        int nBpos = info.GetBucketPosition(nKey, true, nB);
-        if (vvNew[nB][nBpos] == nId) {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // if it isn't in any new bucket, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1)
+    if (info.nRefCount == 0)
         return;
 
     // which tried bucket to move the entry to
-    int tried_bucket = info.GetTriedBucket(nKey, m_asmap);
-    int tried_bucket_pos = info.GetBucketPosition(nKey, false, tried_bucket);
+    const CAddrBucketPos posTried = GetTriedPos(info);
+    int tried_bucket = posTried.bucket;
+    int tried_bucket_pos = posTried.pos;
 
     // Will moving this address into tried evict another entry?
     if (test_before_evict && (vvTried[tried_bucket][tried_bucket_pos] != -1)) {
@@ -264,7 +306,32 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     }
 }
 
-bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty)
+bool CAddrMan::Add(const std::vector<CAddress>& vAddr, const CNetAddr& source, int64_t nTimePenalty)
+{
+    uint256 key;
+    {
+        LOCK(cs);
+        key = nKey;
+    }
+    std::vector<CAddrBucketPos> vPos = GetNewPositions(vAddr, source, key);
+
+    LOCK(cs);
+    if (key != nKey) {
+        // Cleared or loaded meanwhile
+        vPos = GetNewPositions(vAddr, source, nKey);
+    }
+    int nAdd = 0;
+    Check();
+    for (size_t i = 0; i < vAddr.size(); i++)
+        nAdd += Add_(vAddr[i], source, nTimePenalty, &vPos[i]) ? 1 : 0;
+    Check();
+    if (nAdd) {
+        LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
+    }
+    return nAdd > 0;
+}
+
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, const CAddrBucketPos* pposNew)
 {
     if (!addr.IsRoutable())
         return false;
@@ -313,8 +380,16 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source, m_asmap);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    int nUBucket, nUBucketPos;
+    // The entries are found by address, the position calculated for the announced port doesn't
+    // hold for an entry with another one
+    if (pposNew && pinfo->GetPort() == addr.GetPort()) {
+        nUBucket = pposNew->bucket;
+        nUBucketPos = pposNew->pos;
+    } else {
+        nUBucket = pinfo->GetNewBucket(nKey, source, m_asmap);
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    }
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
@@ -326,8 +401,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         }
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
-            pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            AddToNew(*pinfo, nId, nUBucket, nUBucketPos);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -438,6 +512,10 @@ int CAddrMan::Check_()
             return -6;
         if (info.nLastSuccess < 0)
             return -8;
+        for (int i = 0; i < info.nRefCount; i++) {
+            if (vvNew[info.vPosNew[i].bucket][info.vPosNew[i].pos] != n)
+                return -20;
+        }
     }
 
     if (setTried.size() != nTried)
@@ -454,6 +532,8 @@ int CAddrMan::Check_()
                      return -17;
                  if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
                      return -18;
+                 if (mapInfo[vvTried[n][i]].posTried.bucket != n || mapInfo[vvTried[n][i]].posTried.pos != i)
+                     return -21;
                  setTried.erase(vvTried[n][i]);
              }
         }
@@ -567,8 +647,9 @@ void CAddrMan::ResolveCollisions_()
             CAddrInfo& info_new = mapInfo[id_new];
 
             // Which tried bucket to move the entry to.
-            int tried_bucket = info_new.GetTriedBucket(nKey, m_asmap);
-            int tried_bucket_pos = info_new.GetBucketPosition(nKey, false, tried_bucket);
+            const CAddrBucketPos posTried = GetTriedPos(info_new);
+            int tried_bucket = posTried.bucket;
+            int tried_bucket_pos = posTried.pos;
             if (!info_new.IsValid()) { // id_new may no longer map to a valid address
                 erase_collision = true;
             } else if (vvTried[tried_bucket][tried_bucket_pos] != -1) { // The position in the tried bucket is not empty
@@ -631,8 +712,9 @@ CAddrInfo CAddrMan::SelectTriedCollision_()
     CAddrInfo& newInfo = mapInfo[id_new];
 
     // which tried bucket to move the entry to
-    int tried_bucket = newInfo.GetTriedBucket(nKey, m_asmap);
-    int tried_bucket_pos = newInfo.GetBucketPosition(nKey, false, tried_bucket);
+    const CAddrBucketPos posTried = GetTriedPos(newInfo);
+    int tried_bucket = posTried.bucket;
+    int tried_bucket_pos = posTried.pos;
 
     int id_old = vvTried[tried_bucket][tried_bucket_pos];
 
@@ -21,6 +21,7 @@
 #include "tinyformat.h"
 #include "util/system.h"
 
+#include <atomic>
 #include <fs.h>
 #include <hash.h>
 #include <iostream>
@@ -30,6 +31,87 @@
 #include <streams.h>
 #include <vector>
 
+/** Stochastic address manager
+ *
+ * Design goals:
+ *  * Keep the address tables in-memory, and asynchronously dump the entire table to peers.dat.
+ *  * Make sure no (localized) attacker can fill the entire table with his nodes/addresses.
+ *
+ * To that end:
+ *  * Addresses are organized into buckets.
+ *    * Addresses that have not yet been tried go into 1024 "new" buckets.
+ *      * Based on the address range (/16 for IPv4) of the source of information, 64 buckets are selected at random.
+ *      * The actual bucket is chosen from one of these, based on the range in which the address itself is located.
+ *      * One single address can occur in up to 8 different buckets to increase selection chances for addresses that
+ *        are seen frequently. The chance for increasing this multiplicity decreases exponentially.
+ *      * When adding a new address to a full bucket, a randomly chosen entry (with a bias favoring less recently seen
+ *        ones) is removed from it first.
+ *    * Addresses of nodes that are known to be accessible go into 256 "tried" buckets.
+ *      * Each address range selects at random 8 of these buckets.
+ *      * The actual bucket is chosen from one of these, based on the full address.
+ *      * When adding a new good address to a full bucket, a randomly chosen entry (with a bias favoring less recently
+ *        tried ones) is evicted from it, back to the "new" buckets.
+ *    * Bucket selection is based on cryptographic hashing, using a randomly-generated 256-bit key, which should not
+ *      be observable by adversaries.
+ *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
+ *      consistency checks for the entire data structure.
+ *    * Every entry remembers its positions in the tables, for moving it between them not to hash it again against
+ *      all the buckets, and the positions of a whole ADDR message are hashed before taking the lock.
+ */
+
+//! total number of buckets for tried addresses
+#define ADDRMAN_TRIED_BUCKET_COUNT_LOG2 8
+
+//! total number of buckets for new addresses
+#define ADDRMAN_NEW_BUCKET_COUNT_LOG2 10
+
+//! maximum allowed number of entries in buckets for new and tried addresses
+#define ADDRMAN_BUCKET_SIZE_LOG2 6
+
+//! over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
+#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 8
+
+//! over how many buckets entries with new addresses originating from a single group are spread
+#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 64
+
+//! in how many buckets for entries with new addresses a single address may occur
+#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 8
+
+//! how old addresses can maximally be
+#define ADDRMAN_HORIZON_DAYS 30
+
+//! after how many failed attempts we give up on a new node
+#define ADDRMAN_RETRIES 3
+
+//! how many successive failures are allowed ...
+#define ADDRMAN_MAX_FAILURES 10
+
+//! ... in at least this many days
+#define ADDRMAN_MIN_FAIL_DAYS 7
+
+//! how recent a successful connection should be before we allow an address to be evicted from tried
+#define ADDRMAN_REPLACEMENT_HOURS 4
+
+//! Convenience
+#define ADDRMAN_TRIED_BUCKET_COUNT (1 << ADDRMAN_TRIED_BUCKET_COUNT_LOG2)
+#define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
+#define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
+
+//! the maximum number of tried addr collisions to store
+#define ADDRMAN_SET_TRIED_COLLISION_SIZE 10
+
+//! the maximum time we'll spend trying to resolve a tried table collision, in seconds
+static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
+
+/** A position in the "new" or "tried" table */
+struct CAddrBucketPos {
+    int16_t bucket{-1};
+    int16_t pos{-1};
+
+    CAddrBucketPos() {}
+    CAddrBucketPos(int bucketIn, int posIn) : bucket(bucketIn), pos(posIn) {}
+};
+
 /**
  * Extended statistics about a CAddress
  */
@@ -55,6 +137,12 @@ private:
     //! reference count in new sets (memory only)
     int nRefCount{0};
 
+    //! the positions in the new tables the entry is at, the first nRefCount ones (memory only)
+    CAddrBucketPos vPosNew[ADDRMAN_NEW_BUCKETS_PER_ADDRESS];
+
+    //! the position of the entry in the tried table, once calculated (memory only)
+    CAddrBucketPos posTried;
+
     //! in tried set? (memory only)
     bool fInTried{false};
 
@@ -85,6 +173,9 @@ public:
     //! Calculate in which "new" bucket this entry belongs, given a certain source
     int GetNewBucket(const uint256& nKey, const CNetAddr& src, const std::vector<bool>& asmap) const;
 
+    //! Calculate in which "new" bucket this entry belongs, given the group of its source
+    int GetNewBucket(const uint256& nKey, const std::vector<unsigned char>& vchSourceGroupKey, const std::vector<bool>& asmap) const;
+
     //! Calculate in which "new" bucket this entry belongs, using its default source
     int GetNewBucket(const uint256& nKey, const std::vector<bool>& asmap) const
     {
@@ -101,76 +192,6 @@ public:
     double GetChance(int64_t nNow = GetAdjustedTime()) const;
 };
 
-/** Stochastic address manager
- *
- * Design goals:
- *  * Keep the address tables in-memory, and asynchronously dump the entire table to peers.dat.
- *  * Make sure no (localized) attacker can fill the entire table with his nodes/addresses.
- *
- * To that end:
- *  * Addresses are organized into buckets.
- *    * Addresses that have not yet been tried go into 1024 "new" buckets.
- *      * Based on the address range (/16 for IPv4) of the source of information, 64 buckets are selected at random.
- *      * The actual bucket is chosen from one of these, based on the range in which the address itself is located.
- *      * One single address can occur in up to 8 different buckets to increase selection chances for addresses that
- *        are seen frequently. The chance for increasing this multiplicity decreases exponentially.
- *      * When adding a new address to a full bucket, a randomly chosen entry (with a bias favoring less recently seen
- *        ones) is removed from it first.
- *    * Addresses of nodes that are known to be accessible go into 256 "tried" buckets.
- *      * Each address range selects at random 8 of these buckets.
- *      * The actual bucket is chosen from one of these, based on the full address.
- *      * When adding a new good address to a full bucket, a randomly chosen entry (with a bias favoring less recently
- *        tried ones) is evicted from it, back to the "new" buckets.
- *    * Bucket selection is based on cryptographic hashing, using a randomly-generated 256-bit key, which should not
- *      be observable by adversaries.
- *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
- *      consistency checks for the entire data structure.
- */
-
-//! total number of buckets for tried addresses
-#define ADDRMAN_TRIED_BUCKET_COUNT_LOG2 8
-
-//! total number of buckets for new addresses
-#define ADDRMAN_NEW_BUCKET_COUNT_LOG2 10
-
-//! maximum allowed number of entries in buckets for new and tried addresses
-#define ADDRMAN_BUCKET_SIZE_LOG2 6
-
-//! over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
-#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 8
-
-//! over how many buckets entries with new addresses originating from a single group are spread
-#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 64
-
-//! in how many buckets for entries with new addresses a single address may occur
-#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 8
-
-//! how old addresses can maximally be
-#define ADDRMAN_HORIZON_DAYS 30
-
-//! after how many failed attempts we give up on a new node
-#define ADDRMAN_RETRIES 3
-
-//! how many successive failures are allowed ...
-#define ADDRMAN_MAX_FAILURES 10
-
-//! ... in at least this many days
-#define ADDRMAN_MIN_FAIL_DAYS 7
-
-//! how recent a successful connection should be before we allow an address to be evicted from tried
-#define ADDRMAN_REPLACEMENT_HOURS 4
-
-//! Convenience
-#define ADDRMAN_TRIED_BUCKET_COUNT (1 << ADDRMAN_TRIED_BUCKET_COUNT_LOG2)
-#define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
-#define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
-
-//! the maximum number of tried addr collisions to store
-#define ADDRMAN_SET_TRIED_COLLISION_SIZE 10
-
-//! the maximum time we'll spend trying to resolve a tried table collision, in seconds
-static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
-
 /**
  * Stochastical (IP) address manager
  */
@@ -188,6 +209,7 @@ private:
         V1_DETERMINISTIC = 1, //!< for pre-asmap files
         V2_ASMAP = 2,         //!< for files including asmap version
         V3_BIP155 = 3,        //!< same as V2_ASMAP plus addresses are in BIP155 format
+        V4_POSITIONS = 4,     //!< same as V3_BIP155 plus the positions of the entries in the tables
     };
 
     //! The maximum format this software knows it can unserialize. Also, we always serialize
@@ -195,7 +217,7 @@ private:
     //! The format (first byte in the serialized stream) can be higher than this and
     //! still this software may be able to unserialize the file - if the second byte
     //! (see `lowest_compatible` in `Unserialize()`) is less or equal to this.
-    static constexpr Format FILE_FORMAT = Format::V3_BIP155;
+    static constexpr Format FILE_FORMAT = Format::V4_POSITIONS;
 
     //! The initial value of a field that is incremented every time an incompatible format
     //! change is made (such that old software versions would not be able to parse and
@@ -216,6 +238,9 @@ private:
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
 
+    //! size of vRandom, readable without the lock
+    std::atomic<size_t> m_size{0};
+
     // number of "tried" entries
     int nTried GUARDED_BY(cs);
 
@@ -260,11 +285,23 @@ protected:
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Put an entry at an empty position of a "new" table.
+    void AddToNew(CAddrInfo& info, int nId, int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Take an entry out of a position of a "new" table, without deleting it.
+    void RemoveFromNew(CAddrInfo& info, int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! The position of an entry in the tried table, calculated on first use.
+    CAddrBucketPos GetTriedPos(CAddrInfo& info) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Calculate the positions of addresses from a given source in the "new" tables, with the given key.
+    std::vector<CAddrBucketPos> GetNewPositions(const std::vector<CAddress>& vAddr, const CNetAddr& source, const uint256& key) const;
+
     //! Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService& addr, bool test_before_evict, int64_t time) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Add an entry to the "new" table.
-    bool Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Add an entry to the "new" table, at the given position if already calculated for the announced address and port.
+    bool Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, const CAddrBucketPos* pposNew = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService& addr, bool fCountFailure, int64_t nTime) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -338,20 +375,24 @@ public:
      * * nTried
      * * number of "new" buckets XOR 2**30
      * * all nNew addrinfos in vvNew
-     * * all nTried addrinfos in vvTried
+     * * all nTried addrinfos in vvTried, since V4_POSITIONS each followed by its position
+     *   (bucket * ADDRMAN_BUCKET_SIZE + position in the bucket, 2 bytes)
      * * for each bucket:
-     *   * number of elements
-     *   * for each element: index
+     *   * before V4_POSITIONS: number of elements, then for each element: index
+     *   * since V4_POSITIONS: bitmap of the occupied positions (8 bytes), then for each
+     *     occupied position: index
+     * * asmap version
      *
      * 2**30 is xorred with the number of buckets to make addrman deserializer v0 detect it
      * as incompatible. This is necessary because it did not check the version number on
      * deserialization.
      *
-     * Notice that vvTried, mapAddr and vVector are never encoded explicitly;
-     * they are instead reconstructed from the other information.
+     * Notice that mapAddr and vVector are never encoded explicitly; they are instead
+     * reconstructed from the other information.
      *
-     * vvNew is serialized, but only used if ADDRMAN_UNKNOWN_BUCKET_COUNT didn't change,
-     * otherwise it is reconstructed as well.
+     * vvNew and vvTried are used as serialized if the number of buckets and the asmap didn't
+     * change, which saves hashing every entry again while loading, otherwise they are
+     * reconstructed as well.
      *
      * This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
      * changes to the ADDRMAN_ parameters without breaking the on-disk structure.
@@ -372,7 +413,7 @@ public:
 
         // Increment `lowest_compatible` if a newly introduced format is incompatible with
         // the previous one.
-        static constexpr uint8_t lowest_compatible = Format::V3_BIP155;
+        static constexpr uint8_t lowest_compatible = Format::V4_POSITIONS;
         s << static_cast<uint8_t>(INCOMPATIBILITY_BASE + lowest_compatible);
 
         s << nKey;
@@ -398,16 +439,18 @@ public:
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
+                s << static_cast<uint16_t>(info.posTried.bucket * ADDRMAN_BUCKET_SIZE + info.posTried.pos);
                 nIds++;
             }
         }
+        static_assert(ADDRMAN_BUCKET_SIZE == 64, "the occupied positions of a bucket are serialized as a 64 bit map");
         for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            int nSize = 0;
+            uint64_t occupied = 0;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1)
-                    nSize++;
+                    occupied |= uint64_t{1} << i;
             }
-            s << nSize;
+            s << occupied;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
                     int nIndex = mapUnkIds[vvNew[bucket][i]];
@@ -480,31 +523,34 @@ public:
         }
         nIdCount = nNew;
 
-        // Deserialize entries from the tried table.
-        int nLost = 0;
+        // Deserialize entries from the tried table, placed once the asmap version is known.
+        std::vector<CAddrInfo> vTried(nTried);
+        std::vector<uint16_t> vTriedPos(nTried, std::numeric_limits<uint16_t>::max());
         for (int n = 0; n < nTried; n++) {
-            CAddrInfo info;
-            s >> info;
-            int nKBucket = info.GetTriedBucket(nKey, m_asmap);
-            int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
-            if (vvTried[nKBucket][nKBucketPos] == -1) {
-                info.nRandomPos = vRandom.size();
-                info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
-            } else {
-                nLost++;
+            s >> vTried[n];
+            if (format >= Format::V4_POSITIONS) {
+                s >> vTriedPos[n];
             }
         }
-        nTried -= nLost;
 
         // Store positions in the new table buckets to apply later (if possible).
         std::map<int, int> entryToBucket; // Represents which entry belonged to which bucket when serializing
+        std::vector<std::pair<int, CAddrBucketPos>> vNewPos; // Entries at each position, since V4_POSITIONS
 
         for (int bucket = 0; bucket < nUBuckets; bucket++) {
+            if (format >= Format::V4_POSITIONS) {
+                uint64_t occupied = 0;
+                s >> occupied;
+                for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                    if (!((occupied >> i) & 1)) continue;
+                    int nIndex = 0;
+                    s >> nIndex;
+                    if (nIndex >= 0 && nIndex < nNew && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT) {
+                        vNewPos.emplace_back(nIndex, CAddrBucketPos(bucket, i));
+                    }
+                }
+                continue;
+            }
             int nSize = 0;
             s >> nSize;
             for (int n = 0; n < nSize; n++) {
@@ -524,25 +570,61 @@ public:
         if (format >= Format::V2_ASMAP) {
             s >> serialized_asmap_version;
         }
+        const bool fSameAsmap = format >= Format::V2_ASMAP && serialized_asmap_version == supplied_asmap_version;
 
-        for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
-            int bucket = entryToBucket[n];
-            int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
-            if (format >= Format::V2_ASMAP && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 &&
-                info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && serialized_asmap_version == supplied_asmap_version) {
-                // Bucketing has not changed, using existing bucket positions for the new table
-                vvNew[bucket][nUBucketPos] = n;
-                info.nRefCount++;
+        int nLost = 0;
+        for (int n = 0; n < nTried; n++) {
+            CAddrInfo& info = vTried[n];
+            CAddrBucketPos pos;
+            if (format >= Format::V4_POSITIONS && fSameAsmap && vTriedPos[n] < ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+                // Bucketing has not changed, using the stored position in the tried table
+                pos = CAddrBucketPos(vTriedPos[n] / ADDRMAN_BUCKET_SIZE, vTriedPos[n] % ADDRMAN_BUCKET_SIZE);
+                info.posTried = pos;
+            } else {
+                pos = GetTriedPos(info);
+            }
+            if (vvTried[pos.bucket][pos.pos] == -1) {
+                info.nRandomPos = vRandom.size();
+                info.fInTried = true;
+                vRandom.push_back(nIdCount);
+                mapInfo[nIdCount] = info;
+                mapAddr[info] = nIdCount;
+                vvTried[pos.bucket][pos.pos] = nIdCount;
+                nIdCount++;
             } else {
-                // In case the new table data cannot be used (format unknown, bucket count wrong or new asmap),
-                // try to give them a reference based on their primary source address.
-                LogPrint(BCLog::ADDRMAN, "Bucketing method was updated, re-bucketing addrman entries from disk\n");
-                bucket = info.GetNewBucket(nKey, m_asmap);
-                nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
-                if (vvNew[bucket][nUBucketPos] == -1) {
-                    vvNew[bucket][nUBucketPos] = n;
-                    info.nRefCount++;
+                nLost++;
+            }
+        }
+        nTried -= nLost;
+
+        if (format >= Format::V4_POSITIONS && fSameAsmap && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT) {
+            // Bucketing has not changed, using the stored positions for the new table, with the
+            // multiplicity of the entries
+            for (const auto& entry : vNewPos) {
+                CAddrInfo& info = mapInfo[entry.first];
+                const CAddrBucketPos& pos = entry.second;
+                if (vvNew[pos.bucket][pos.pos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
+                    AddToNew(info, entry.first, pos.bucket, pos.pos);
+                }
+            }
+        } else {
+            for (int n = 0; n < nNew; n++) {
+                CAddrInfo &info = mapInfo[n];
+                int bucket = entryToBucket[n];
+                int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
+                if (format >= Format::V2_ASMAP && format < Format::V4_POSITIONS && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT &&
+                    vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && fSameAsmap) {
+                    // Bucketing has not changed, using existing bucket positions for the new table
+                    AddToNew(info, n, bucket, nUBucketPos);
+                } else {
+                    // In case the new table data cannot be used (format unknown, bucket count wrong or new asmap),
+                    // try to give them a reference based on their primary source address.
+                    LogPrint(BCLog::ADDRMAN, "Bucketing method was updated, re-bucketing addrman entries from disk\n");
+                    bucket = info.GetNewBucket(nKey, m_asmap);
+                    nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
+                    if (vvNew[bucket][nUBucketPos] == -1) {
+                        AddToNew(info, n, bucket, nUBucketPos);
+                    }
                 }
             }
         }
@@ -561,6 +643,7 @@ public:
         if (nLost + nLostUnk > 0) {
             LogPrint(BCLog::ADDRMAN, "addrman lost %i new and %i tried addresses due to collisions\n", nLostUnk, nLost);
         }
+        m_size = vRandom.size();
 
         Check();
     }
@@ -587,6 +670,7 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        m_size = 0;
     }
 
     CAddrMan()
@@ -602,8 +686,7 @@ public:
     //! Return the number of (unique) addresses in all tables.
     size_t size() const
     {
-        LOCK(cs); // TODO: Cache this in an atomic to avoid this overhead
-        return vRandom.size();
+        return m_size;
     }
 
     //! Consistency check
@@ -633,20 +716,8 @@ public:
         return fRet;
     }
 
-    //! Add multiple addresses.
-    bool Add(const std::vector<CAddress>& vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
-    {
-        LOCK(cs);
-        int nAdd = 0;
-        Check();
-        for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-            nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
-        Check();
-        if (nAdd) {
-            LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
-        }
-        return nAdd > 0;
-    }
+    //! Add multiple addresses, eg the ones of an ADDR message, hashing them into the tables before taking the lock.
+    bool Add(const std::vector<CAddress>& vAddr, const CNetAddr& source, int64_t nTimePenalty = 0);
 
     //! Mark an entry as accessible.
     void Good(const CService& addr, bool test_before_evict = true, int64_t nTime = GetAdjustedTime())
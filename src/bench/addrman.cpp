@@ -0,0 +1,127 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "addrman.h"
+#include "clientversion.h"
+#include "compat.h"
+#include "random.h"
+#include "streams.h"
+
+#include <vector>
+
+// One ADDR message per source, from as many sources as there are addresses in a message, for a
+// million addresses announced: much more than the tables hold, most of them end up evicted.
+static const size_t NUM_SOURCES = 1000;
+static const size_t NUM_ADDRESSES_PER_SOURCE = 1000;
+
+static CNetAddr RandomIPv4(FastRandomContext& rng)
+{
+    struct in_addr addr;
+    // Routable, outside of 0/8, 10/8, 127/8 and the other special ranges
+    addr.s_addr = htonl((uint32_t{1} + rng.randrange(100)) << 24 | rng.randbits(24));
+    return CNetAddr(addr);
+}
+
+struct AddrManBenchData {
+    std::vector<CNetAddr> vSources;
+    std::vector<std::vector<CAddress>> vvAddresses;
+
+    AddrManBenchData()
+    {
+        FastRandomContext rng(true);
+        const int64_t nNow = GetAdjustedTime();
+        vSources.reserve(NUM_SOURCES);
+        vvAddresses.resize(NUM_SOURCES);
+        for (size_t source = 0; source < NUM_SOURCES; source++) {
+            vSources.push_back(RandomIPv4(rng));
+            vvAddresses[source].reserve(NUM_ADDRESSES_PER_SOURCE);
+            for (size_t i = 0; i < NUM_ADDRESSES_PER_SOURCE; i++) {
+                CAddress addr(CService(RandomIPv4(rng), 8333), NODE_NETWORK);
+                addr.nTime = nNow - rng.randrange(7 * 24 * 60 * 60);
+                vvAddresses[source].push_back(addr);
+            }
+        }
+    }
+
+    void FillAddrMan(CAddrMan& addrman) const
+    {
+        for (size_t source = 0; source < NUM_SOURCES; source++) {
+            addrman.Add(vvAddresses[source], vSources[source]);
+        }
+    }
+};
+
+static const AddrManBenchData& GetBenchData()
+{
+    static const AddrManBenchData data;
+    return data;
+}
+
+// A million addresses received in ADDR messages, inserted a message at a time
+static void AddrManAdd(benchmark::State& state)
+{
+    const AddrManBenchData& data = GetBenchData();
+
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        data.FillAddrMan(addrman);
+    }
+}
+
+// Selecting the addresses to connect to, in full tables with a share of them tried
+static void AddrManSelect(benchmark::State& state)
+{
+    const AddrManBenchData& data = GetBenchData();
+    CAddrMan addrman;
+    data.FillAddrMan(addrman);
+    for (int i = 0; i < 10000; i++) {
+        addrman.Good(addrman.Select());
+    }
+
+    while (state.KeepRunning()) {
+        const CAddress addr = addrman.Select();
+        assert(addr.IsValid());
+    }
+}
+
+// Moving the addresses to the tried table as the connections to them succeed
+static void AddrManGood(benchmark::State& state)
+{
+    const AddrManBenchData& data = GetBenchData();
+
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        data.FillAddrMan(addrman);
+        for (int i = 0; i < 10000; i++) {
+            addrman.Good(addrman.Select(true));
+        }
+    }
+}
+
+// Loading full tables from peers.dat
+static void AddrManLoad(benchmark::State& state)
+{
+    const AddrManBenchData& data = GetBenchData();
+    CAddrMan addrman;
+    data.FillAddrMan(addrman);
+    for (int i = 0; i < 10000; i++) {
+        addrman.Good(addrman.Select());
+    }
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addrman;
+
+    while (state.KeepRunning()) {
+        CDataStream ssLoad(ssPeers);
+        CAddrMan addrmanLoaded;
+        ssLoad >> addrmanLoaded;
+        assert(addrmanLoaded.size() == addrman.size());
+    }
+}
+
+BENCHMARK(AddrManAdd, 1);
+BENCHMARK(AddrManSelect, 1000000);
+BENCHMARK(AddrManGood, 2);
+BENCHMARK(AddrManLoad, 20);
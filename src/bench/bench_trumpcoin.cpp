@@ -26,6 +26,8 @@ static const int64_t DEFAULT_PLOT_HEIGHT = 768;
 void InitBLSTests();
 void CleanupBLSTests();
 void CleanupBLSDkgTests();
+std::string GetStakeSimHelp();
+int StakeSimMain();
 
 int main(int argc, char** argv)
 {
@@ -41,7 +43,8 @@ int main(int argc, char** argv)
                   << HelpMessageOpt("-printer=(console|plot)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)"), DEFAULT_BENCH_PRINTER))
                   << HelpMessageOpt("-plot-plotlyurl=<uri>", strprintf(_("URL to use for plotly.js (default: %s)"), DEFAULT_PLOT_PLOTLYURL))
                   << HelpMessageOpt("-plot-width=<x>", strprintf(_("Plot width in pixel (default: %u)"), DEFAULT_PLOT_WIDTH))
-                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT));
+                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT))
+                  << GetStakeSimHelp();
 
         return 0;
     }
@@ -55,6 +58,14 @@ int main(int argc, char** argv)
     SetupEnvironment();
     g_logger->m_print_to_file = false; // don't want to write to debug.log file
 
+    if (gArgs.GetBoolArg("-stakesim", false)) {
+        int ret = StakeSimMain();
+        CleanupBLSDkgTests();
+        CleanupBLSTests();
+        ECC_Stop();
+        return ret;
+    }
+
     int64_t evaluations = gArgs.GetArg("-evals", DEFAULT_BENCH_EVALUATIONS);
     std::string regex_filter = gArgs.GetArg("-filter", DEFAULT_BENCH_FILTER);
     std::string scaling_str = gArgs.GetArg("-scaling", DEFAULT_BENCH_SCALING);
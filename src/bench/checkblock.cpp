@@ -5,8 +5,16 @@
 #include "bench/bench.h"
 #include "bench/data.h"
 
+#include "checkqueue.h"
+#include "key.h"
+#include "keystore.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "validation.h"
 
+#include <boost/thread/thread.hpp>
+
 // These are the two major time-sinks which happen after we have fully received
 // a block off the wire, but before we can relay the block on to peers using
 // compact block relay.
@@ -45,5 +53,92 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// Number of signed P2PKH inputs of the block verified by the script check benchmarks
+static const int SCRIPT_CHECK_INPUTS = 2000;
+
+// Script verification of a block spending SCRIPT_CHECK_INPUTS P2PKH outputs,
+// as done by ConnectBlock through the script check queue with nThreads threads.
+static void ConnectBlockScriptChecks(benchmark::State& state, int nThreads, bool fBatch)
+{
+    const static auto verify_handle = std::make_unique<ECCVerifyHandle>();
+    static bool fSigCacheInit = false;
+    if (!fSigCacheInit) {
+        InitSignatureCache();
+        fSigCacheInit = true;
+    }
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vout.resize(SCRIPT_CHECK_INPUTS, CTxOut(COIN, scriptPubKey));
+    const CTransaction txPrev(txFrom);
+
+    // Ten inputs per spending transaction
+    std::vector<CTransaction> vtx;
+    for (int i = 0; i < SCRIPT_CHECK_INPUTS; i += 10) {
+        CMutableTransaction txTo;
+        txTo.vout.emplace_back(10 * COIN - 1000, scriptPubKey);
+        for (int j = i; j < i + 10; j++) {
+            txTo.vin.emplace_back(COutPoint(txPrev.GetHash(), j));
+        }
+        for (unsigned int j = 0; j < txTo.vin.size(); j++) {
+            bool fSigned = SignSignature(keystore, txPrev, txTo, j, SIGHASH_ALL);
+            assert(fSigned);
+        }
+        vtx.emplace_back(txTo);
+    }
+    std::vector<PrecomputedTransactionData> precomTxData;
+    precomTxData.reserve(vtx.size());
+    for (const CTransaction& tx : vtx) {
+        precomTxData.emplace_back(tx);
+    }
+
+    const bool fBatchPrev = fBatchScriptChecks;
+    fBatchScriptChecks = fBatch;
+    CCheckQueue<CScriptCheck> queue(128);
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread([&]{ queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const CTransaction& tx = vtx[i];
+            std::vector<CScriptCheck> vChecks;
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                vChecks.emplace_back(txPrev.vout[tx.vin[j].prevout.n], tx, j, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG, false, &precomTxData[i]);
+            }
+            control.Add(vChecks);
+        }
+        bool fValid = control.Wait();
+        assert(fValid);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+    fBatchScriptChecks = fBatchPrev;
+}
+
+static void ConnectBlockScriptChecks_1Thread(benchmark::State& state) { ConnectBlockScriptChecks(state, 1, false); }
+static void ConnectBlockScriptChecks_2Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 2, false); }
+static void ConnectBlockScriptChecks_4Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 4, false); }
+static void ConnectBlockScriptChecks_8Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 8, false); }
+static void ConnectBlockScriptChecksBatched_1Thread(benchmark::State& state) { ConnectBlockScriptChecks(state, 1, true); }
+static void ConnectBlockScriptChecksBatched_2Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 2, true); }
+static void ConnectBlockScriptChecksBatched_4Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 4, true); }
+static void ConnectBlockScriptChecksBatched_8Threads(benchmark::State& state) { ConnectBlockScriptChecks(state, 8, true); }
+
 BENCHMARK(DeserializeBlockTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(ConnectBlockScriptChecks_1Thread, 1);
+BENCHMARK(ConnectBlockScriptChecks_2Threads, 1);
+BENCHMARK(ConnectBlockScriptChecks_4Threads, 1);
+BENCHMARK(ConnectBlockScriptChecks_8Threads, 1);
+BENCHMARK(ConnectBlockScriptChecksBatched_1Thread, 1);
+BENCHMARK(ConnectBlockScriptChecksBatched_2Threads, 1);
+BENCHMARK(ConnectBlockScriptChecksBatched_4Threads, 1);
+BENCHMARK(ConnectBlockScriptChecksBatched_8Threads, 1);
@@ -21,7 +21,7 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+static void CCheckQueueSpeed(benchmark::State& state, int nThreads)
 {
     struct PrevectorJob {
         prevector<PREVECTOR_SIZE, uint8_t> p;
@@ -38,7 +38,8 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    // The master thread joins the workers when waiting
+    for (auto x = 0; x < nThreads - 1; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -59,4 +60,18 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CCheckQueueSpeed(state, std::max(MIN_CORES, GetNumCores()) + 1);
+}
+static void CCheckQueueSpeedPrevectorJob_1Thread(benchmark::State& state) { CCheckQueueSpeed(state, 1); }
+static void CCheckQueueSpeedPrevectorJob_2Threads(benchmark::State& state) { CCheckQueueSpeed(state, 2); }
+static void CCheckQueueSpeedPrevectorJob_4Threads(benchmark::State& state) { CCheckQueueSpeed(state, 4); }
+static void CCheckQueueSpeedPrevectorJob_8Threads(benchmark::State& state) { CCheckQueueSpeed(state, 8); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_1Thread, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_2Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_4Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_8Threads, 1400);
@@ -0,0 +1,69 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+#include "bench/data.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+// Number of times the transactions of the benchmark block are replayed, each
+// time with distinct outpoints, to reach a UTXO cache of realistic size.
+static const int COINS_CACHE_REPLAYS = 500;
+
+static uint256 ReplayHash(const uint256& hash, int nReplay)
+{
+    return (CHashWriter(SER_GETHASH, 0) << hash << nReplay).GetHash();
+}
+
+// Replays the UTXO set changes of a real block as ConnectBlock and
+// FlushStateToDisk apply them: the spent coins are fetched from the parent
+// cache (AddCoin on the parent stands for the database reads), spent in the
+// block view (SpendCoin), the new ones are added (AddCoin), and the block view
+// is flushed into the parent (BatchWrite).
+static void CoinsCacheReplayBlock(benchmark::State& state)
+{
+    CDataStream stream(benchmark::data::block2680960, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    while (state.KeepRunning()) {
+        CCoinsView viewDummy;
+        CCoinsViewCache base(&viewDummy);
+        for (int r = 0; r < COINS_CACHE_REPLAYS; r++) {
+            for (const auto& tx : block.vtx) {
+                if (tx->IsCoinBase()) continue;
+                for (const CTxIn& in : tx->vin) {
+                    // The spent outputs look like the ones of the block
+                    const CTxOut& out = tx->vout[in.prevout.n % tx->vout.size()];
+                    base.AddCoin(COutPoint(ReplayHash(in.prevout.hash, r), in.prevout.n), Coin(out, 1, false, false), false);
+                }
+            }
+        }
+
+        CCoinsViewCache cache(&base);
+        for (int r = 0; r < COINS_CACHE_REPLAYS; r++) {
+            for (const auto& tx : block.vtx) {
+                if (!tx->IsCoinBase()) {
+                    for (const CTxIn& in : tx->vin) {
+                        cache.SpendCoin(COutPoint(ReplayHash(in.prevout.hash, r), in.prevout.n));
+                    }
+                }
+                const uint256& txid = ReplayHash(tx->GetHash(), r);
+                for (size_t i = 0; i < tx->vout.size(); i++) {
+                    cache.AddCoin(COutPoint(txid, i), Coin(tx->vout[i], 2, tx->IsCoinBase(), tx->IsCoinStake()), false);
+                }
+            }
+        }
+        bool fFlushed = cache.Flush();
+        assert(fFlushed);
+        assert(base.GetCacheSize() > 0);
+    }
+}
+
+BENCHMARK(CoinsCacheReplayBlock, 5);
@@ -0,0 +1,86 @@
+// Copyright (c) 2021 The TrumpCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "consensus/validation.h"
+#include "sapling/sapling_validation.h"
+#include "sapling/transaction_builder.h"
+#include "util/system.h"
+
+#include <boost/thread/thread.hpp>
+
+// Number of shielded transactions (one spend and two outputs each) in the benchmarked block
+static const int SHIELDED_TXS_PER_BLOCK = 30;
+
+static std::vector<CTransactionRef> CreateShieldedBlockTxs()
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    initZKSNARKS();
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(SHIELDED_TXS_PER_BLOCK);
+    for (int i = 0; i < SHIELDED_TXS_PER_BLOCK; i++) {
+        auto sk = libzcash::SaplingSpendingKey::random();
+        auto fvk = sk.full_viewing_key();
+        auto pa = sk.default_address();
+
+        // Dummy note, committed to a tree of its own
+        libzcash::SaplingNote note(pa, 50 * COIN);
+        SaplingMerkleTree tree;
+        tree.append(note.cmu().get());
+
+        TransactionBuilder builder(consensus);
+        builder.SetFee(COIN);
+        builder.AddSaplingSpend(sk.expanded_spending_key(), note, tree.root(), tree.witness());
+        builder.AddSaplingOutput(fvk.ovk, pa, 30 * COIN);
+        builder.AddSaplingOutput(fvk.ovk, pa, 19 * COIN);
+        vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+    }
+    return vtx;
+}
+
+// Verifies the proofs of a block full of shielded transactions, one
+// transaction after the other (ConnectBlock without script check threads).
+static void SaplingBlockProofsSerial(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vtx = CreateShieldedBlockTxs();
+    while (state.KeepRunning()) {
+        for (const auto& tx : vtx) {
+            CValidationState valState;
+            bool fValid = SaplingValidation::CheckTransactionProofs(*tx, valState, 100);
+            assert(fValid);
+        }
+    }
+}
+
+// Verifies the proofs of the same block through a Sapling check queue,
+// as ConnectBlock does with script check threads.
+static void SaplingBlockProofsParallel(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vtx = CreateShieldedBlockTxs();
+    CCheckQueue<CSaplingProofCheck> queue(1);
+    boost::thread_group tg;
+    for (int i = 0; i < std::max(1, GetNumCores() - 1); i++) {
+        tg.create_thread([&]{ queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CSaplingProofCheck> control(&queue);
+        for (const auto& tx : vtx) {
+            std::vector<CSaplingProofCheck> vChecks(1);
+            CSaplingProofCheck check(*tx, 100);
+            check.swap(vChecks.back());
+            control.Add(vChecks);
+        }
+        bool fValid = control.Wait();
+        assert(fValid);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BENCHMARK(SaplingBlockProofsSerial, 1);
+BENCHMARK(SaplingBlockProofsParallel, 1);
@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "kernel.h"
+#include "random.h"
+
+#include <vector>
+
+// Stakeable coins of the wallet of the kernel search benchmarks
+static const size_t NUM_STAKE_INPUTS = 10000;
+
+// Time slots of the kernel hashes, after the parent block
+static const int STAKE_SLOT = 15;
+
+// A parent block with a v2 stake modifier, and coins staking on top of it. The target is too low
+// for any of them to win: the searches go through all the coins.
+struct StakeKernelBenchData {
+    CBlockIndex indexPrev;
+    CBlockIndex indexFrom;
+    std::vector<CPivStake> vInputs;
+    const unsigned int nBits = 0x03000001;
+
+    StakeKernelBenchData()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        FastRandomContext rng(true);
+        indexFrom.nHeight = 900;
+        indexFrom.nTime = 1600000000;
+        indexPrev.nHeight = 1000;
+        indexPrev.nTime = indexFrom.nTime + 100 * 60;
+        indexPrev.SetStakeModifier(rng.rand256());
+        vInputs.reserve(NUM_STAKE_INPUTS);
+        for (size_t i = 0; i < NUM_STAKE_INPUTS; i++) {
+            vInputs.emplace_back(CTxOut(100 * COIN, CScript()), COutPoint(rng.rand256(), rng.randrange(4)), &indexFrom);
+        }
+    }
+
+    void Prepare(CStakeKernelEngine& engine)
+    {
+        engine.Reset(&indexPrev, nBits);
+        for (CPivStake& stakeInput : vInputs) {
+            engine.AddInput(&stakeInput);
+        }
+    }
+};
+
+// A kernel checked from scratch, as the validation does, for each coin and time slot
+static void StakeKernelCheck(benchmark::State& state)
+{
+    StakeKernelBenchData data;
+    size_t i = 0;
+    int nTime = data.indexPrev.nTime;
+    while (state.KeepRunning()) {
+        if (i == 0) nTime += STAKE_SLOT;
+        CStakeKernel stakeKernel(&data.indexPrev, &data.vInputs[i], data.nBits, nTime);
+        bool fFound = stakeKernel.CheckKernelHash(true);
+        assert(!fFound);
+        i = (i + 1) % NUM_STAKE_INPUTS;
+    }
+}
+
+// A kernel checked from the precomputed message prefix of the coin
+static void StakeKernelPrepared(benchmark::State& state)
+{
+    StakeKernelBenchData data;
+    CStakeKernelEngine engine;
+    data.Prepare(engine);
+    size_t i = 0;
+    int nTime = data.indexPrev.nTime;
+    while (state.KeepRunning()) {
+        if (i == 0) nTime += STAKE_SLOT;
+        int nFound = engine.Search(nTime, i, i + 1);
+        assert(nFound < 0);
+        i = (i + 1) % NUM_STAKE_INPUTS;
+    }
+}
+
+// The kernels of all the coins for a time slot (NUM_STAKE_INPUTS kernels per iteration)
+static void StakeKernelSearch(benchmark::State& state, int nThreads)
+{
+    StakeKernelBenchData data;
+    CStakeKernelEngine engine;
+    data.Prepare(engine);
+    int nTime = data.indexPrev.nTime;
+    while (state.KeepRunning()) {
+        nTime += STAKE_SLOT;
+        int nFound = engine.Search(nTime, 0, engine.Size(), nThreads);
+        assert(nFound < 0);
+    }
+}
+
+static void StakeKernelSearch_1Thread(benchmark::State& state) { StakeKernelSearch(state, 1); }
+static void StakeKernelSearch_4Threads(benchmark::State& state) { StakeKernelSearch(state, 4); }
+
+BENCHMARK(StakeKernelCheck, 200000);
+BENCHMARK(StakeKernelPrepared, 1000000);
+BENCHMARK(StakeKernelSearch_1Thread, 100);
+BENCHMARK(StakeKernelSearch_4Threads, 300);
@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "legacy/stakemodifier.h"
+#include "random.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <vector>
+
+// Blocks of the synthetic chain, all of them with old (v1) stake modifiers on mainnet
+static const int NUM_BLOCKS = 100000;
+
+// Coins aren't looked up in the last blocks: their modifier isn't there yet
+static const int NUM_COIN_HEIGHTS = NUM_BLOCKS - 1000;
+
+// A mainnet-like chain of a block a minute, proof-of-stake after the first blocks, with the v1
+// stake modifiers computed as the validation does.
+struct StakeModifierBenchData {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+
+    StakeModifierBenchData()
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        FastRandomContext rng(true);
+        vHashes.reserve(NUM_BLOCKS);
+        vBlocks.resize(NUM_BLOCKS);
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            CBlockIndex& block = vBlocks[i];
+            vHashes.push_back(rng.rand256());
+            block.phashBlock = &vHashes[i];
+            block.nHeight = i;
+            block.pprev = i > 0 ? &vBlocks[i - 1] : nullptr;
+            block.nTime = i > 0 ? vBlocks[i - 1].nTime + 45 + rng.randrange(30) : 1600000000;
+            if (i > 200) block.SetProofOfStake();
+            block.SetNewStakeModifier();
+        }
+    }
+
+    // The chain made the active one, with a stake modifier cache of its own, for the benchmark
+    void Activate(std::unique_ptr<StakeModifierCache>& cache)
+    {
+        chainActive.SetTip(&vBlocks.back());
+        std::swap(stakeModifierCache, cache);
+    }
+
+    void Deactivate(std::unique_ptr<StakeModifierCache>& cache)
+    {
+        std::swap(stakeModifierCache, cache);
+        chainActive.SetTip(nullptr);
+    }
+};
+
+static StakeModifierBenchData& GetBenchData()
+{
+    static StakeModifierBenchData data;
+    return data;
+}
+
+// The v1 modifier of a new block, from the blocks of the last selection interval
+static void StakeModifierCompute(benchmark::State& state)
+{
+    StakeModifierBenchData& data = GetBenchData();
+    int i = 1;
+    while (state.KeepRunning()) {
+        uint64_t nStakeModifier;
+        bool fGenerated;
+        bool fComputed = ComputeNextStakeModifier(&data.vBlocks[i - 1], nStakeModifier, fGenerated);
+        assert(fComputed);
+        i = i % (NUM_BLOCKS - 1) + 1;
+    }
+}
+
+// The modifier of the kernel of a coin, found walking the chain forward from the coin
+static void OldStakeModifierWalk(benchmark::State& state)
+{
+    StakeModifierBenchData& data = GetBenchData();
+    std::unique_ptr<StakeModifierCache> cache;
+    data.Activate(cache);
+    FastRandomContext rng(true);
+    while (state.KeepRunning()) {
+        const CBlockIndex* pindex = FindOldModifierBlock(&data.vBlocks[rng.randrange(NUM_COIN_HEIGHTS)]);
+        assert(pindex);
+    }
+    data.Deactivate(cache);
+}
+
+// The modifier of the kernel of a coin, looked up in a warm cache
+static void OldStakeModifierCached(benchmark::State& state)
+{
+    StakeModifierBenchData& data = GetBenchData();
+    std::unique_ptr<StakeModifierCache> cache(new StakeModifierCache(nullptr));
+    data.Activate(cache);
+    uint64_t nStakeModifier;
+    for (int i = 0; i < NUM_COIN_HEIGHTS; i++) {
+        GetOldModifier(&data.vBlocks[i], nStakeModifier);
+    }
+    FastRandomContext rng(true);
+    while (state.KeepRunning()) {
+        bool fFound = GetOldModifier(&data.vBlocks[rng.randrange(NUM_COIN_HEIGHTS)], nStakeModifier);
+        assert(fFound);
+    }
+    data.Deactivate(cache);
+}
+
+BENCHMARK(StakeModifierCompute, 20000);
+BENCHMARK(OldStakeModifierWalk, 200000);
+BENCHMARK(OldStakeModifierCached, 5000000);
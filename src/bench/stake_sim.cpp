@@ -0,0 +1,306 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "kernel.h"
+#include "random.h"
+#include "stakeinput.h"
+#include "timedata.h"
+#include "util/system.h"
+#include "utilmoneystr.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <thread>
+
+static const int DEFAULT_STAKESIM_COINS = 1000;
+static const CAmount DEFAULT_STAKESIM_VALUE = 1000 * COIN;
+static const int DEFAULT_STAKESIM_SLOTS = 24 * 60 * 4;
+// About a stake a day for the default coins (one coin in 4.5 million meets the target in a slot)
+static const char* DEFAULT_STAKESIM_BITS = "1a100000";
+static const int64_t DEFAULT_STAKESIM_LOCKHOLD = 0;
+static const int64_t DEFAULT_STAKESIM_LOCKINTERVAL = 100;
+
+// Height of the tip of the chain segment at the start of the simulation, and number of blocks of the
+// segment before it holding the coins
+static const int STAKESIM_START_HEIGHT = 2000;
+static const int STAKESIM_COIN_BLOCKS = 500;
+
+// Outputs of each transaction of the simulated wallet
+static const int STAKESIM_OUTPUTS_PER_TX = 100;
+
+struct StakeSimOptions {
+    int nCoins = DEFAULT_STAKESIM_COINS;
+    CAmount nCoinValue = DEFAULT_STAKESIM_VALUE;
+    int nSlots = DEFAULT_STAKESIM_SLOTS;
+    unsigned int nBits = 0;
+    // Time the simulated validation holds cs_main and cs_wallet, and time between two holds (ms)
+    int64_t nLockHoldMillis = DEFAULT_STAKESIM_LOCKHOLD;
+    int64_t nLockIntervalMillis = DEFAULT_STAKESIM_LOCKINTERVAL;
+
+    StakeSimOptions()
+    {
+        nBits = (unsigned int) strtoul(DEFAULT_STAKESIM_BITS, nullptr, 16);
+    }
+};
+
+/**
+ * Replays the staking of a wallet over the time slots of a regtest chain segment, without network.
+ * Each slot goes through CWallet::CreateCoinStake, as the staker thread does, with the wallet's
+ * coins: the chain moves on with a block of the rest of the network now and then (at the target
+ * spacing, on average), or with the block of a stake found by the wallet. A thread can stand for
+ * the validation, holding cs_main and cs_wallet, for the waits of the staker on them to show.
+ */
+class StakeSimulator
+{
+public:
+    explicit StakeSimulator(const StakeSimOptions& options);
+    ~StakeSimulator();
+
+    /** Stake on the next time slot, returns whether a kernel was found */
+    bool RunSlot();
+
+    /** Kernels hashed per second of search, waits on the locks, stakes found and projected */
+    void PrintReport(std::ostream& os) const;
+
+private:
+    const StakeSimOptions opts;
+    FastRandomContext rng{true};
+
+    std::unique_ptr<CWallet> pwallet;
+    std::vector<CStakeableOutput> availableCoins;
+
+    // The chain segment: stable addresses, as the coins point to their blocks
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vBlocks;
+    int64_t nTimeSlot{0};
+
+    std::atomic<bool> fStopValidation{false};
+    std::thread threadValidation;
+
+    // Statistics
+    int nSlotsRun{0};
+    int nBlocks{0};
+    int nStakes{0};
+    int64_t nKernels{0};
+    int64_t nSearchMicros{0};
+    int64_t nMainWaitMicros{0};
+    int64_t nMainWaitMaxMicros{0};
+    int64_t nWalletWaitMicros{0};
+    int64_t nWalletWaitMaxMicros{0};
+    double dExpectedStakes{0};
+
+    // Chance for a coin to meet the target in a slot (all the coins have the same value)
+    double dCoinStakeProbability{0};
+
+    void AddBlock(int64_t nTime);
+    void ThreadValidation();
+};
+
+StakeSimulator::StakeSimulator(const StakeSimOptions& options) : opts(options)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    // The chain segment, blocks a target spacing apart
+    nTimeSlot = GetTimeSlot(1600000000);
+    for (int i = 0; i <= STAKESIM_START_HEIGHT; i++) {
+        AddBlock(nTimeSlot - (STAKESIM_START_HEIGHT - i) * consensus.nTargetSpacing);
+    }
+    nBlocks = 0;
+
+    // The wallet, its coins in the blocks of the segment old enough to stake
+    pwallet.reset(new CWallet("stakesim", WalletDatabase::CreateMock()));
+    bool fFirstRun;
+    pwallet->LoadWallet(fFirstRun);
+    pwallet->SetupSPKM(true, true);
+    auto res = pwallet->getNewAddress("stakesim");
+    if (!res) throw std::runtime_error("Cannot create staking address");
+    const CScript& scriptStake = GetScriptForDestination(*res.getObjResult());
+
+    availableCoins.reserve(opts.nCoins);
+    for (int nCoin = 0; nCoin < opts.nCoins; nCoin += STAKESIM_OUTPUTS_PER_TX) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(rng.rand256(), 0));
+        for (int i = nCoin; i < std::min(nCoin + STAKESIM_OUTPUTS_PER_TX, opts.nCoins); i++) {
+            tx.vout.emplace_back(opts.nCoinValue, scriptStake);
+        }
+        pwallet->AddToWallet(CWalletTx(pwallet.get(), MakeTransactionRef(tx)));
+        const CWalletTx* wtx = pwallet->GetWalletTx(tx.GetHash());
+        assert(wtx);
+        const CBlockIndex* pindexFrom = &vBlocks[rng.randrange(STAKESIM_COIN_BLOCKS)];
+        for (int i = 0; i < (int) tx.vout.size(); i++) {
+            availableCoins.emplace_back(wtx, i, STAKESIM_START_HEIGHT - pindexFrom->nHeight, pindexFrom);
+        }
+    }
+
+    CPivStake stakeInput(availableCoins[0].tx->tx->vout[0], COutPoint(), availableCoins[0].pindex);
+    CStakeKernel stakeKernel(&vBlocks.back(), &stakeInput, opts.nBits, nTimeSlot);
+    dCoinStakeProbability = std::min(1.0, stakeKernel.GetWeightedTarget().getdouble() / std::pow(2.0, 256));
+
+    if (opts.nLockHoldMillis > 0) {
+        threadValidation = std::thread(&StakeSimulator::ThreadValidation, this);
+    }
+}
+
+StakeSimulator::~StakeSimulator()
+{
+    fStopValidation = true;
+    if (threadValidation.joinable()) threadValidation.join();
+    SetMockTime(0);
+}
+
+void StakeSimulator::AddBlock(int64_t nTime)
+{
+    vHashes.push_back(rng.rand256());
+    vBlocks.emplace_back();
+    CBlockIndex& block = vBlocks.back();
+    block.phashBlock = &vHashes.back();
+    block.pprev = vBlocks.size() > 1 ? &vBlocks[vBlocks.size() - 2] : nullptr;
+    block.nHeight = block.pprev ? block.pprev->nHeight + 1 : 0;
+    block.nTime = nTime;
+    if (block.pprev && Params().GetConsensus().NetworkUpgradeActive(block.nHeight, Consensus::UPGRADE_V3_4)) {
+        block.SetNewStakeModifier(rng.rand256());
+    } else {
+        block.SetStakeModifier(rng.rand256());
+    }
+    nBlocks++;
+}
+
+bool StakeSimulator::RunSlot()
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    nTimeSlot += consensus.nTimeSlotLength;
+    SetMockTime(nTimeSlot);
+
+    // The rest of the network stakes blocks at the target spacing
+    if (rng.randrange(consensus.nTargetSpacing) < (uint64_t) consensus.nTimeSlotLength) {
+        AddBlock(nTimeSlot);
+    }
+
+    // The staker thread reads the tip under cs_main, and the wallet's last block under cs_wallet
+    const CBlockIndex* pindexPrev;
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs_main);
+        pindexPrev = &vBlocks.back();
+    }
+    const int64_t nMainWait = GetTimeMicros() - nTimeStart;
+    nMainWaitMicros += nMainWait;
+    nMainWaitMaxMicros = std::max(nMainWaitMaxMicros, nMainWait);
+    nTimeStart = GetTimeMicros();
+    pwallet->GetLastBlockHeightLockWallet();
+    const int64_t nWalletWait = GetTimeMicros() - nTimeStart;
+    nWalletWaitMicros += nWalletWait;
+    nWalletWaitMaxMicros = std::max(nWalletWaitMaxMicros, nWalletWait);
+
+    dExpectedStakes += 1 - std::pow(1 - dCoinStakeProbability, (double) availableCoins.size());
+
+    CMutableTransaction txCoinStake;
+    int64_t nTxNewTime = 0;
+    nTimeStart = GetTimeMicros();
+    const bool fFound = pwallet->CreateCoinStake(pindexPrev, opts.nBits, txCoinStake, nTxNewTime, &availableCoins, false);
+    nSearchMicros += GetTimeMicros() - nTimeStart;
+    nKernels += pwallet->pStakerStatus->GetLastTries();
+    nSlotsRun++;
+
+    if (fFound) {
+        // Our block: the coin staked is spent (and its outputs immature for the rest of the run)
+        const COutPoint& prevout = txCoinStake.vin[0].prevout;
+        auto it = std::find_if(availableCoins.begin(), availableCoins.end(), [&prevout](const CStakeableOutput& coin) {
+            return coin.i == (int) prevout.n && coin.tx->GetHash() == prevout.hash;
+        });
+        assert(it != availableCoins.end());
+        availableCoins.erase(it);
+        AddBlock(nTxNewTime);
+        nStakes++;
+    }
+    return fFound;
+}
+
+void StakeSimulator::ThreadValidation()
+{
+    while (!fStopValidation) {
+        {
+            LOCK2(cs_main, pwallet->cs_wallet);
+            std::this_thread::sleep_for(std::chrono::milliseconds(opts.nLockHoldMillis));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(opts.nLockIntervalMillis));
+    }
+}
+
+void StakeSimulator::PrintReport(std::ostream& os) const
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const double dDays = (double) nSlotsRun * consensus.nTimeSlotLength / (24 * 60 * 60);
+    const double dSlots = std::max(nSlotsRun, 1);
+    os << strprintf("coins: %d of %s, nBits: %08x\n", opts.nCoins, FormatMoney(opts.nCoinValue), opts.nBits);
+    os << strprintf("slots: %d (%.2f days), blocks: %d, stakes found: %d\n", nSlotsRun, dDays, nBlocks, nStakes);
+    os << strprintf("kernels: %d in %.3fs, %.0f kernels/s, %.3fms per slot\n",
+                    nKernels, nSearchMicros * 1e-6,
+                    nSearchMicros > 0 ? nKernels * 1e6 / nSearchMicros : 0.0,
+                    nSearchMicros * 1e-3 / dSlots);
+    os << strprintf("cs_main wait: %.3fms per slot, %.3fms max\n", nMainWaitMicros * 1e-3 / dSlots, nMainWaitMaxMicros * 1e-3);
+    os << strprintf("cs_wallet wait: %.3fms per slot, %.3fms max\n", nWalletWaitMicros * 1e-3 / dSlots, nWalletWaitMaxMicros * 1e-3);
+    os << strprintf("stakes per day: %.2f found, %.2f projected\n",
+                    dDays > 0 ? nStakes / dDays : 0.0, dDays > 0 ? dExpectedStakes / dDays : 0.0);
+}
+
+std::string GetStakeSimHelp()
+{
+    return HelpMessageGroup(_("Staking simulator options:")) +
+           HelpMessageOpt("-stakesim", _("Instead of running the benchmarks, simulate the staking of a regtest wallet over time slots, and report the kernels hashed per second, the waits on cs_main and cs_wallet, and the stake frequency")) +
+           HelpMessageOpt("-stakesim-coins=<n>", strprintf(_("Number of coins of the wallet (default: %u)"), DEFAULT_STAKESIM_COINS)) +
+           HelpMessageOpt("-stakesim-value=<amt>", strprintf(_("Value of each coin (default: %s)"), FormatMoney(DEFAULT_STAKESIM_VALUE))) +
+           HelpMessageOpt("-stakesim-slots=<n>", strprintf(_("Number of time slots to simulate (default: %u)"), DEFAULT_STAKESIM_SLOTS)) +
+           HelpMessageOpt("-stakesim-bits=<hex>", strprintf(_("Compact target of the kernels (default: %s)"), DEFAULT_STAKESIM_BITS)) +
+           HelpMessageOpt("-stakesim-lockhold=<ms>", strprintf(_("Time a simulated validation thread holds cs_main and cs_wallet, 0 for none (default: %u)"), DEFAULT_STAKESIM_LOCKHOLD)) +
+           HelpMessageOpt("-stakesim-lockinterval=<ms>", strprintf(_("Time between two holds of the locks by the validation thread (default: %u)"), DEFAULT_STAKESIM_LOCKINTERVAL));
+}
+
+int StakeSimMain()
+{
+    StakeSimOptions opts;
+    opts.nCoins = std::max((int) gArgs.GetArg("-stakesim-coins", DEFAULT_STAKESIM_COINS), 1);
+    if (gArgs.IsArgSet("-stakesim-value") && !ParseMoney(gArgs.GetArg("-stakesim-value", ""), opts.nCoinValue)) {
+        std::cerr << "Invalid amount for -stakesim-value\n";
+        return EXIT_FAILURE;
+    }
+    opts.nSlots = std::max((int) gArgs.GetArg("-stakesim-slots", DEFAULT_STAKESIM_SLOTS), 1);
+    const std::string strBits = gArgs.GetArg("-stakesim-bits", DEFAULT_STAKESIM_BITS);
+    if (!IsHex(strBits) || strBits.size() != 8) {
+        std::cerr << "Invalid compact target for -stakesim-bits\n";
+        return EXIT_FAILURE;
+    }
+    opts.nBits = (unsigned int) strtoul(strBits.c_str(), nullptr, 16);
+    opts.nLockHoldMillis = std::max(gArgs.GetArg("-stakesim-lockhold", DEFAULT_STAKESIM_LOCKHOLD), (int64_t) 0);
+    opts.nLockIntervalMillis = std::max(gArgs.GetArg("-stakesim-lockinterval", DEFAULT_STAKESIM_LOCKINTERVAL), (int64_t) 0);
+
+    StakeSimulator sim(opts);
+    for (int i = 0; i < opts.nSlots; i++) {
+        sim.RunSlot();
+    }
+    sim.PrintReport(std::cout);
+    return EXIT_SUCCESS;
+}
+
+// CreateCoinStake over the default wallet, a time slot per iteration
+static void StakeSimSlot(benchmark::State& state)
+{
+    StakeSimulator sim((StakeSimOptions()));
+    while (state.KeepRunning()) {
+        sim.RunSlot();
+    }
+}
+
+BENCHMARK(StakeSimSlot, 500);
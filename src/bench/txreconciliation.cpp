@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "protocol.h"
+#include "random.h"
+#include "streams.h"
+#include "txreconciliation.h"
+#include "version.h"
+
+// Transactions to announce between two peers in a reconciliation round, most of them known to
+// both sides by the time of the reconciliation, as they are also relayed by the other peers.
+static const int RECON_ROUND_TXS = 1000;
+// Of which the ones known to one side only, half of them on each side
+static const int RECON_ROUND_DIFFERENCE = 40;
+// Size of an inv entry, the cost of a flooded announcement
+static const size_t INV_ENTRY_SIZE = 36;
+
+template <typename... Args>
+static size_t MessageSize(const Args&... args)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    SerializeMany(stream, args...);
+    return CMessageHeader::HEADER_SIZE + stream.size();
+}
+
+static size_t InvMessageSize(size_t count)
+{
+    return count == 0 ? 0 : CMessageHeader::HEADER_SIZE + GetSizeOfCompactSize(count) + count * INV_ENTRY_SIZE;
+}
+
+// A reconciliation round between two peers: the request, the sketch of the responder, its decoding
+// by the initiator and the transactions the responder has to announce from the difference.
+// The bytes of the messages it takes, inv messages of the difference included, must stay below
+// the INV_ENTRY_SIZE bytes per transaction that flooding them costs.
+static void TxReconciliationRound(benchmark::State& state)
+{
+    const NodeId peer = 0;
+    TxReconciliationTracker initiator, responder;
+    const uint64_t salt_initiator = initiator.PreRegisterPeer(peer);
+    const uint64_t salt_responder = responder.PreRegisterPeer(peer);
+    initiator.RegisterPeer(peer, false, TXRECONCILIATION_VERSION, salt_responder);
+    responder.RegisterPeer(peer, true, TXRECONCILIATION_VERSION, salt_initiator);
+
+    FastRandomContext rng(true);
+    std::chrono::microseconds now{1};
+    uint64_t nBytes = 0, nTxs = 0;
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < RECON_ROUND_TXS; i++) {
+            const uint256 txid = rng.rand256();
+            if (i >= RECON_ROUND_DIFFERENCE / 2) responder.AddToSet(peer, txid);
+            if (i < RECON_ROUND_DIFFERENCE / 2 || i >= RECON_ROUND_DIFFERENCE) initiator.AddToSet(peer, txid);
+        }
+
+        uint16_t set_size, q;
+        bool fRequest = initiator.InitiateRequest(peer, now, set_size, q);
+        assert(fRequest);
+        now += std::chrono::hours{24};
+        nBytes += MessageSize(set_size, q);
+
+        ReconciliationSketch sketch;
+        responder.HandleRequest(peer, now, set_size, q, sketch);
+        nBytes += MessageSize(sketch);
+
+        bool fSuccess;
+        std::vector<uint256> vInitiatorAnnounce, vResponderAnnounce;
+        std::vector<uint32_t> vAskShortIDs;
+        initiator.HandleSketch(peer, sketch, fSuccess, vInitiatorAnnounce, vAskShortIDs);
+        nBytes += MessageSize(fSuccess, vAskShortIDs);
+        responder.HandleReconciliationDifference(peer, fSuccess, vAskShortIDs, vResponderAnnounce);
+        nBytes += InvMessageSize(vInitiatorAnnounce.size()) + InvMessageSize(vResponderAnnounce.size());
+        nTxs += RECON_ROUND_TXS;
+    }
+
+    assert(nBytes < nTxs * INV_ENTRY_SIZE || nTxs == 0);
+}
+
+BENCHMARK(TxReconciliationRound, 100);
@@ -122,6 +122,8 @@ enum BlockStatus {
     BLOCK_FAILED_VALID = 32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 64, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_ASSUMED_VALID = 128, //! block data neither downloaded nor validated: ancestor of a loaded UTXO snapshot base
 };
 
 // BlockIndex flags
@@ -245,6 +247,8 @@ public:
     //! Raise the validity level of this block index entry.
     //! Returns true if the validity was changed.
     bool RaiseValidity(enum BlockStatus nUpTo);
+    //! Whether the block is below a loaded UTXO snapshot, its validity assumed
+    bool IsAssumedValid() const { return nStatus & BLOCK_ASSUMED_VALID; }
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
     //! Efficiently find an ancestor of this block.
@@ -287,6 +291,15 @@ public:
         if (obj.nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) READWRITE(VARINT_MODE(obj.nFile, VarIntMode::NONNEGATIVE_SIGNED));
         if (obj.nStatus & BLOCK_HAVE_DATA) READWRITE(VARINT(obj.nDataPos));
         if (obj.nStatus & BLOCK_HAVE_UNDO) READWRITE(VARINT(obj.nUndoPos));
+        if (obj.nStatus & BLOCK_ASSUMED_VALID) {
+            // Not computed from the blocks below a loaded UTXO snapshot base: 0 but at the base
+            READWRITE(VARINT(obj.nChainTx));
+            if (obj.nChainTx) {
+                CAmount nChainSaplingValue = obj.nChainSaplingValue ? *obj.nChainSaplingValue : 0;
+                READWRITE(nChainSaplingValue);
+                SER_READ(obj, obj.nChainSaplingValue = nChainSaplingValue);
+            }
+        }
 
         if (nSerVersion >= DBI_SER_VERSION_NO_ZC) {
             // Serialization with CLIENT_VERSION = 4009902+
@@ -42,6 +42,12 @@ void CChainParams::UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, i
     consensus.vUpgrades[idx].nActivationHeight = nActivationHeight;
 }
 
+void CChainParams::UpdateUTXOSnapshotParameters(int nHeight, const CUTXOSnapshotData& snapshot)
+{
+    assert(IsRegTestNet()); // only available for regtest
+    mapUTXOSnapshots[nHeight] = snapshot;
+}
+
 /**
  * Build the genesis block. Note that the output of the genesis coinbase cannot
  * be spent as it did not originally exist in the database.
@@ -241,6 +247,10 @@ public:
         // Reject non-standard transactions by default
         fRequireStandard = true;
 
+        // Snapshots trusted by loadtxoutset: height, {block hash, hash_serialized_2, shielded state hash}
+        // (as returned by dumptxoutset). None yet: loadtxoutset fails until one is added here.
+        mapUTXOSnapshots = {};
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ts";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "tviews";
@@ -367,6 +377,9 @@ public:
 
         fRequireStandard = false;
 
+        // None yet: loadtxoutset fails until one is added here
+        mapUTXOSnapshots = {};
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ptestsapling";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "pviewtestsapling";
@@ -493,6 +506,9 @@ public:
         // Reject non-standard transactions by default
         fRequireStandard = true;
 
+        // Set by -snapshotparams, the test chains aren't known in advance
+        mapUTXOSnapshots = {};
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ptestsapling";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "pviewtestsapling";
@@ -537,3 +553,8 @@ void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivation
     globalChainParams->UpdateNetworkUpgradeParameters(idx, nActivationHeight);
 }
 
+void UpdateUTXOSnapshotParameters(int nHeight, const CUTXOSnapshotData& snapshot)
+{
+    globalChainParams->UpdateUTXOSnapshotParameters(nHeight, snapshot);
+}
+
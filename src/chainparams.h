@@ -15,6 +15,7 @@
 #include "protocol.h"
 #include "uint256.h"
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -24,6 +25,17 @@ struct CDNSSeedData {
     CDNSSeedData(const std::string& strHost, bool supportsServiceBitsFilteringIn = false) : host(strHost), supportsServiceBitsFiltering(supportsServiceBitsFilteringIn) {}
 };
 
+/**
+ * Hashes of a UTXO set snapshot (see dumptxoutset) that loadtxoutset trusts
+ * without validating the blocks it results from.
+ */
+struct CUTXOSnapshotData {
+    uint256 hashBlock;          //!< Block the snapshot was taken at
+    uint256 hashUTXOSet;        //!< Coins, as hash_serialized_2 of gettxoutsetinfo
+    uint256 hashShieldedState;  //!< Sapling anchors and nullifiers, and evo database
+};
+typedef std::map<int, CUTXOSnapshotData> MapUTXOSnapshots;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * TrumpCoin system. There are three: the main network on which people trade goods
@@ -68,8 +80,6 @@ public:
     bool IsTestChain() const { return IsTestnet() || IsRegTestNet(); }
     /** Make miner wait to have peers to avoid wasting work */
     bool MiningRequiresPeers() const { return !IsRegTestNet(); }
-    /** Headers first syncing is disabled */
-    bool HeadersFirstSyncingActive() const { return false; };
     /** Default value for -checkmempool and -checkblockindex argument */
     bool DefaultConsistencyChecks() const { return IsRegTestNet(); }
 
@@ -80,11 +90,14 @@ public:
     const std::string& Bech32HRP(Bech32Type type) const { return bech32HRPs[type]; }
     const std::vector<uint8_t>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** Trusted UTXO set snapshots, by height */
+    const MapUTXOSnapshots& UTXOSnapshots() const { return mapUTXOSnapshots; }
 
     bool IsRegTestNet() const { return NetworkIDString() == CBaseChainParams::REGTEST; }
     bool IsTestnet() const { return NetworkIDString() == CBaseChainParams::TESTNET; }
 
     void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivationHeight);
+    void UpdateUTXOSnapshotParameters(int nHeight, const CUTXOSnapshotData& snapshot);
 protected:
     CChainParams() {}
 
@@ -98,6 +111,7 @@ protected:
     std::string bech32HRPs[MAX_BECH32_TYPES];
     std::vector<uint8_t> vFixedSeeds;
     bool fRequireStandard;
+    MapUTXOSnapshots mapUTXOSnapshots;
 };
 
 /**
@@ -124,4 +138,9 @@ void SelectParams(const std::string& chain);
  */
 void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivationHeight);
 
+/**
+ * Allows trusting a UTXO set snapshot on regtest.
+ */
+void UpdateUTXOSnapshotParameters(int nHeight, const CUTXOSnapshotData& snapshot);
+
 #endif // BITCOIN_CHAINPARAMS_H
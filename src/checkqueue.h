@@ -14,6 +14,20 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Evaluate a batch of checks taken from the queue by a worker, returning
+ * whether all of them succeeded. Check types that can be verified more
+ * cheaply as a group (e.g. CScriptCheck) specialize this.
+ */
+template <typename T>
+bool RunChecksBatch(std::vector<T>& vChecks)
+{
+    for (T& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -114,9 +128,8 @@ private:
                 fOk = fAllOk;
             }
             // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            if (fOk)
+                fOk = RunChecksBatch(vChecks);
             vChecks.clear();
         } while (true);
     }
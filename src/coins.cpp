@@ -10,6 +10,7 @@
 #include "invalid.h"
 #include "logging.h"
 #include "random.h"
+#include "streams.h"
 #include "version.h"
 
 #include <assert.h>
@@ -92,10 +93,39 @@ bool CCoinsViewCache::GetCoin(const COutPoint& outpoint, Coin& coin) const
     return false;
 }
 
+static void CommitCoin(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin, bool fAdd)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    ss << coin.out;
+    if (fAdd) {
+        muhash.Insert(MakeUCharSpan(ss));
+    } else {
+        muhash.Remove(MakeUCharSpan(ss));
+    }
+}
+
+void CCoinsCommitment::Add(const COutPoint& outpoint, const Coin& coin)
+{
+    CommitCoin(muhash, outpoint, coin, true);
+    nTransactionOutputs++;
+    nTotalAmount += coin.out.nValue;
+}
+
+void CCoinsCommitment::Remove(const COutPoint& outpoint, const Coin& coin)
+{
+    CommitCoin(muhash, outpoint, coin, false);
+    nTransactionOutputs--;
+    nTotalAmount -= coin.out.nValue;
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint& outpoint, Coin&& coin, bool possible_overwrite) {
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable()) return;
     if (coin.out.IsZerocoinMint()) return;
+    // The replaced coin leaves the committed set, even if it is only in the base view
+    if (pcommitment && possible_overwrite) FetchCoin(outpoint);
     CCoinsMap::iterator it;
     bool inserted;
     std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
@@ -109,6 +139,10 @@ void CCoinsViewCache::AddCoin(const COutPoint& outpoint, Coin&& coin, bool possi
         }
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
+    if (pcommitment) {
+        if (!it->second.coin.IsSpent()) pcommitment->Remove(outpoint, it->second.coin);
+        pcommitment->Add(outpoint, coin);
+    }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
@@ -135,6 +169,7 @@ void CCoinsViewCache::SpendCoin(const COutPoint& outpoint, Coin* moveout)
 {
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) return;
+    if (pcommitment && !it->second.coin.IsSpent()) pcommitment->Remove(outpoint, it->second.coin);
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     if (moveout) {
         *moveout = std::move(it->second.coin);
@@ -314,6 +349,11 @@ bool CCoinsViewCache::Flush()
             hashSaplingAnchor,
             cacheSaplingAnchors,
             cacheSaplingNullifiers);
+    // Start over with a new pool, giving back the memory of the flushed coins: the map
+    // moved out takes its pool along, and leaves cacheCoins (empty) with a new one.
+    {
+        CCoinsMap flushed(std::move(cacheCoins));
+    }
     cacheCoins.clear();
     cacheSaplingAnchors.clear();
     cacheSaplingNullifiers.clear();
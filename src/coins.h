@@ -9,6 +9,7 @@
 
 #include "compressor.h"
 #include "consensus/consensus.h" // can be removed once policy/ established
+#include "crypto/muhash.h"
 #include "crypto/siphash.h"
 #include "memusage.h"
 #include "sapling/incrementalmerkletree.h"
@@ -174,7 +175,22 @@ struct CNullifiersCacheEntry
 typedef std::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedIdHasher> CAnchorsSaplingMap;
 typedef std::unordered_map<uint256, CNullifiersCacheEntry, SaltedIdHasher> CNullifiersMap;
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and adds the size
+ * of 4 pointers. We do not know the exact node size used in the std::unordered_node implementation
+ * because it is implementation defined. Most implementations have an overhead of 1 or 2 pointers,
+ * so nodes can be connected in a linked list, and in some cases the hash value is stored as well.
+ * Using 4 pointers to make sure the nodes fit the pool, the rest of the allocations (the bucket
+ * arrays) are too large for it and are served by operator new.
+ */
+typedef std::unordered_map<COutPoint,
+                           CCoinsCacheEntry,
+                           SaltedOutpointHasher,
+                           std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                                         alignof(void*)>>
+    CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -278,6 +294,25 @@ public:
 static const unsigned int STANDARD_LOCKTIME_VERIFY_FLAGS = LOCKTIME_VERIFY_SEQUENCE |
                                                            LOCKTIME_MEDIAN_TIME_PAST;
 
+/**
+ * Rolling commitment to a UTXO set: the MuHash of its coins, with their
+ * number and total value. Attached to a CCoinsViewCache, it follows the coins
+ * added to and spent from the cache, so it is kept in sync with the chain
+ * without scanning the set (-coinstatsindex).
+ */
+class CCoinsCommitment
+{
+public:
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs{0};
+    CAmount nTotalAmount{0};
+
+    void Add(const COutPoint& outpoint, const Coin& coin);
+    void Remove(const COutPoint& outpoint, const Coin& coin);
+
+    SERIALIZE_METHODS(CCoinsCommitment, obj) { READWRITE(obj.muhash, obj.nTransactionOutputs, obj.nTotalAmount); }
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -297,6 +332,9 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    //! Commitment updated with the coins added and spent, if any
+    CCoinsCommitment* pcommitment{nullptr};
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -336,6 +374,13 @@ public:
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
 
+    /**
+     * Keep pcommitmentIn up to date with the coins added and spent through
+     * this cache from now on (nullptr to stop). The changes flushed into it
+     * from caches on top of this one are not accounted.
+     */
+    void SetCommitment(CCoinsCommitment* pcommitmentIn) { pcommitment = pcommitmentIn; }
+
     /**
      * Check if we have the given utxo already loaded in this cache.
      * The semantics are the same as HaveCoin(), but no calls to
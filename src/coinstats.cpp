@@ -0,0 +1,83 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2014 The Bitcoin developers
+// Copyright (c) 2015-2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "serialize.h"
+#include "util/system.h"
+#include "validation.h"
+
+#include <boost/thread/thread.hpp> // boost::thread::interrupt
+
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    const Coin& coin = outputs.begin()->second;
+    ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0u);
+}
+
+CCoinsStatsHasher::CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock) :
+    stats(statsIn),
+    ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    stats.hashBlock = hashBlock;
+    ss << hashBlock;
+}
+
+void CCoinsStatsHasher::Add(const COutPoint& key, Coin&& coin)
+{
+    if (!outputs.empty() && key.hash != prevkey) {
+        ApplyStats(stats, ss, prevkey, outputs);
+        outputs.clear();
+    }
+    prevkey = key.hash;
+    outputs[key.n] = std::move(coin);
+}
+
+void CCoinsStatsHasher::Finish()
+{
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+        outputs.clear();
+    }
+    stats.hashSerialized = ss.GetHash();
+}
+
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(pcursor->GetBestBlock())->second->nHeight;
+    }
+    CCoinsStatsHasher hasher(stats, pcursor->GetBestBlock());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            hasher.Add(key, std::move(coin));
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    hasher.Finish();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
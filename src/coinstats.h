@@ -0,0 +1,51 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2014 The Bitcoin developers
+// Copyright (c) 2015-2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TrumpCoin_COINSTATS_H
+#define TrumpCoin_COINSTATS_H
+
+#include "amount.h"
+#include "coins.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <map>
+
+struct CCoinsStats
+{
+    int nHeight{0};
+    uint256 hashBlock{UINT256_ZERO};
+    uint64_t nTransactions{0};
+    uint64_t nTransactionOutputs{0};
+    uint256 hashSerialized{UINT256_ZERO};
+    uint64_t nDiskSize{0};
+    CAmount nTotalAmount{0};
+};
+
+/**
+ * Computes the statistics (and the serialized hash) of a UTXO set, given its
+ * coins in database order (grouped by transaction).
+ */
+class CCoinsStatsHasher
+{
+private:
+    CCoinsStats& stats;
+    CHashWriter ss;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+
+public:
+    CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock);
+
+    void Add(const COutPoint& key, Coin&& coin);
+    //! Complete stats with the coins added so far
+    void Finish();
+};
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+
+#endif // TrumpCoin_COINSTATS_H
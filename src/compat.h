@@ -43,6 +43,7 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
@@ -99,9 +100,18 @@ typedef void* sockopt_arg_type;
 typedef char* sockopt_arg_type;
 #endif
 
+// Peer sockets are waited for with epoll on Linux and with poll() on the other POSIX
+// systems, neither of which is bound by FD_SETSIZE; Windows keeps select().
+#ifndef WIN32
+#define USE_POLL
+#endif
+#ifdef __linux__
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s)
 {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
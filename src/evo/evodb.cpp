@@ -35,7 +35,8 @@ void CEvoDBScopedCommitter::Rollback()
 CEvoDB::CEvoDB(size_t nCacheSize, bool fMemory, bool fWipe) :
         db(fMemory ? "" : (GetDataDir() / "evodb"), nCacheSize, fMemory, fWipe),
         rootBatch(),
-        rootDBTransaction(db, rootBatch),
+        pendingDBTransaction(db, rootBatch),
+        rootDBTransaction(pendingDBTransaction, pendingDBTransaction),
         curDBTransaction(rootDBTransaction, rootDBTransaction)
 {
 }
@@ -54,8 +55,22 @@ void CEvoDB::RollbackCurTransaction()
 
 bool CEvoDB::CommitRootTransaction()
 {
+    DetachRootTransaction();
+    return WritePendingTransaction();
+}
+
+void CEvoDB::DetachRootTransaction()
+{
+    LOCK(cs);
     assert(curDBTransaction.IsClean());
     rootDBTransaction.Commit();
+}
+
+bool CEvoDB::WritePendingTransaction()
+{
+    // Under the lock, so that readers don't miss the changes between the two steps
+    LOCK(cs);
+    pendingDBTransaction.Commit();
     bool ret = db.WriteBatch(rootBatch);
     rootBatch.Clear();
     return ret;
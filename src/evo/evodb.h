@@ -36,10 +36,13 @@ public:
 private:
     CDBWrapper db;
 
-    typedef CDBTransaction<CDBWrapper, CDBBatch> RootTransaction;
+    typedef CDBTransaction<CDBWrapper, CDBBatch> PendingTransaction;
+    typedef CDBTransaction<PendingTransaction, PendingTransaction> RootTransaction;
     typedef CDBTransaction<RootTransaction, RootTransaction> CurTransaction;
 
     CDBBatch rootBatch;
+    //! Changes set aside by DetachRootTransaction, readable until WritePendingTransaction
+    PendingTransaction pendingDBTransaction;
     RootTransaction rootDBTransaction;
     CurTransaction curDBTransaction;
 
@@ -93,10 +96,19 @@ public:
 
     size_t GetMemoryUsage()
     {
-        return rootDBTransaction.GetMemoryUsage();
+        LOCK(cs);
+        return rootDBTransaction.GetMemoryUsage() + pendingDBTransaction.GetMemoryUsage();
     }
 
+    //! Write the changes of the blocks connected so far to the database
     bool CommitRootTransaction();
+    /**
+     * Set the changes of the blocks connected so far aside, to be written by
+     * WritePendingTransaction (e.g. once the coins of the same blocks are).
+     * They stay readable meanwhile, and the next changes are kept apart.
+     */
+    void DetachRootTransaction();
+    bool WritePendingTransaction();
 
     bool VerifyBestBlock(const uint256& hash);
     void WriteBestBlock(const uint256& hash);
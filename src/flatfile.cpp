@@ -10,6 +10,13 @@
 #include "tinyformat.h"
 #include "util/system.h"
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -96,3 +103,69 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+MappedFlatFile::MappedFlatFile(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            m_data = static_cast<const unsigned char*>(addr);
+            m_size = st.st_size;
+        } else {
+            LogPrintf("Unable to map file %s\n", path.string());
+        }
+    }
+    // The mapping stays valid without the descriptor
+    close(fd);
+#endif
+}
+
+MappedFlatFile::~MappedFlatFile()
+{
+#ifndef WIN32
+    if (m_data) munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile> FlatFileMapCache::Get(const FlatFileSeq& seq, const FlatFilePos& pos)
+{
+    if (pos.IsNull() || m_max_files == 0) {
+        return nullptr;
+    }
+    LOCK(m_mutex);
+    for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+        if (it->first == pos.nFile) {
+            m_files.splice(m_files.begin(), m_files, it);
+            return it->second;
+        }
+    }
+    auto mapped = std::make_shared<const MappedFlatFile>(seq.FileName(pos));
+    if (mapped->IsNull()) {
+        return nullptr;
+    }
+    m_files.emplace_front(pos.nFile, mapped);
+    if (m_files.size() > m_max_files) {
+        // Readers still holding it keep it mapped until they are done
+        m_files.pop_back();
+    }
+    return mapped;
+}
+
+void FlatFileMapCache::Invalidate(int nFile)
+{
+    LOCK(m_mutex);
+    m_files.remove_if([nFile](const std::pair<int, std::shared_ptr<const MappedFlatFile>>& file) { return file.first == nFile; });
+}
+
+void FlatFileMapCache::Clear()
+{
+    LOCK(m_mutex);
+    m_files.clear();
+}
@@ -6,10 +6,14 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <list>
+#include <memory>
 #include <string>
 
 #include "fs.h"
 #include "serialize.h"
+#include "span.h"
+#include "sync.h"
 
 struct FlatFilePos
 {
@@ -87,4 +91,51 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/** A read-only memory mapping of a whole file, as large as the file was when mapped. */
+class MappedFlatFile
+{
+private:
+    const unsigned char* m_data{nullptr};
+    size_t m_size{0};
+
+public:
+    /** Map the file at path. The mapping is null if that failed (or isn't supported). */
+    explicit MappedFlatFile(const fs::path& path);
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile&) = delete;
+    MappedFlatFile& operator=(const MappedFlatFile&) = delete;
+
+    bool IsNull() const { return m_data == nullptr; }
+    Span<const unsigned char> GetSpan() const { return Span<const unsigned char>(m_data, m_size); }
+};
+
+/**
+ * Memory mappings of files of a FlatFileSeq that are not written to anymore,
+ * so that reading from them costs no system call. A file written to anyway
+ * must be invalidated. Up to max_files files stay
+ * mapped, the least recently used one being unmapped first (once it is not
+ * being read from anymore).
+ */
+class FlatFileMapCache
+{
+private:
+    const size_t m_max_files;
+    Mutex m_mutex;
+    //! The most recently used first
+    std::list<std::pair<int, std::shared_ptr<const MappedFlatFile>>> m_files GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileMapCache(size_t max_files) : m_max_files(max_files) {}
+
+    /** The mapping of the file of seq at pos, mapping it if needed. nullptr if it can't be mapped. */
+    std::shared_ptr<const MappedFlatFile> Get(const FlatFileSeq& seq, const FlatFilePos& pos);
+
+    /** Unmap a file written to, for the next reads to map it again with the data appended */
+    void Invalidate(int nFile);
+
+    /** Unmap all the files (once they are not being read from anymore) */
+    void Clear();
+};
+
 #endif // BITCOIN_FLATFILE_H
@@ -0,0 +1,327 @@
+// Copyright (c) 2018-2019 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+#include <map>
+
+/* The index database stores, for every indexed block:
+ * - DB_BLOCK_HASH: the filter, its hash and its header, keyed by block hash
+ * and a single record:
+ * - DB_BEST_BLOCK: the locator of the last block of the chain the index is in sync with
+ */
+static constexpr char DB_BLOCK_HASH = 's';
+static constexpr char DB_BEST_BLOCK = 'B';
+
+/** Interval, in blocks, at which the sync thread writes the best block */
+static const int SYNC_COMMIT_INTERVAL = 1000;
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    uint256 header;
+    std::vector<unsigned char> filter;
+
+    SERIALIZE_METHODS(DBVal, obj) { READWRITE(obj.hash, obj.header, obj.filter); }
+};
+
+} // namespace
+
+class BlockFilterIndex::DB : public CDBWrapper
+{
+public:
+    DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe) :
+        CDBWrapper(path, n_cache_size, f_memory, f_wipe) {}
+
+    bool ReadBestBlock(CBlockLocator& locator) const { return Read(DB_BEST_BLOCK, locator); }
+    bool WriteBestBlock(const CBlockLocator& locator) { return Write(DB_BEST_BLOCK, locator); }
+    bool ReadEntry(const uint256& block_hash, DBVal& val) const { return Read(std::make_pair(DB_BLOCK_HASH, block_hash), val); }
+    bool WriteEntry(const uint256& block_hash, const DBVal& val) { return Write(std::make_pair(DB_BLOCK_HASH, block_hash), val); }
+};
+
+static std::map<BlockFilterType, BlockFilterIndex> g_filter_indexes;
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type)
+{
+    const std::string& filter_name = BlockFilterTypeName(filter_type);
+    if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
+
+    fs::path path = GetDataDir() / "indexes" / "blockfilter" / filter_name;
+    fs::create_directories(path);
+
+    m_name = filter_name + " block filter index";
+    m_db = std::make_unique<DB>(path / "db", n_cache_size, f_memory, f_wipe);
+}
+
+BlockFilterIndex::~BlockFilterIndex()
+{
+    Stop();
+}
+
+bool BlockFilterIndex::Start()
+{
+    CBlockLocator locator;
+    if (!m_db->ReadBestBlock(locator)) {
+        locator.SetNull();
+    }
+
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = nullptr;
+        if (!locator.IsNull()) {
+            pindex = FindForkInGlobalIndex(chainActive, locator);
+            // The genesis block is the fallback of FindForkInGlobalIndex, make sure it was indexed
+            DBVal entry;
+            if (pindex && !m_db->ReadEntry(pindex->GetBlockHash(), entry))
+                pindex = nullptr;
+        }
+        m_best_block_index = pindex;
+        m_synced = pindex != nullptr && pindex == chainActive.Tip();
+    }
+
+    RegisterValidationInterface(this);
+
+    m_interrupt.reset();
+    m_thread_sync = std::thread(&TraceThread<std::function<void()>>, "blkfilter",
+                                std::function<void()>(std::bind(&BlockFilterIndex::ThreadSync, this)));
+    return true;
+}
+
+void BlockFilterIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+
+    m_interrupt();
+    if (m_thread_sync.joinable()) {
+        m_thread_sync.join();
+        CommitBestBlock();
+    }
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        DBVal prev_entry;
+        if (!m_db->ReadEntry(pindex->pprev->GetBlockHash(), prev_entry)) {
+            return error("%s: previous block %s is not indexed", __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_entry.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo);
+
+    DBVal entry;
+    entry.hash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prev_header);
+    entry.filter = filter.GetEncodedFilter();
+    if (!m_db->WriteEntry(pindex->GetBlockHash(), entry)) {
+        return error("%s: failed to write the filter of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool BlockFilterIndex::CommitBestBlock()
+{
+    const CBlockIndex* pindex = m_best_block_index.load();
+    if (!pindex) return true;
+
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    if (!m_db->WriteBestBlock(locator)) {
+        return error("%s: failed to commit the best block of the %s", __func__, m_name);
+    }
+    return true;
+}
+
+void BlockFilterIndex::ThreadSync()
+{
+    int nIndexed = 0;
+    while (!m_synced) {
+        if (m_interrupt) {
+            return;
+        }
+
+        const CBlockIndex* pindex_next;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = m_best_block_index.load();
+            if (!pindex) {
+                pindex_next = chainActive.Genesis();
+            } else {
+                pindex_next = chainActive.Next(chainActive.FindFork(pindex));
+            }
+            if (!pindex_next) {
+                // Caught up with the tip while holding cs_main: the blocks connected from now on
+                // are indexed from BlockConnected.
+                m_synced = true;
+                break;
+            }
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex_next)) {
+            LogPrintf("%s: failed to read block %s from disk, stopping the %s\n", __func__,
+                      pindex_next->GetBlockHash().ToString(), m_name);
+            return;
+        }
+        if (!WriteBlock(block, pindex_next)) {
+            LogPrintf("%s: failed to index block %s, stopping the %s\n", __func__,
+                      pindex_next->GetBlockHash().ToString(), m_name);
+            return;
+        }
+        m_best_block_index = pindex_next;
+
+        if (++nIndexed % SYNC_COMMIT_INTERVAL == 0) {
+            LogPrintf("Syncing %s with block chain from height %d\n", m_name, pindex_next->nHeight);
+            CommitBestBlock();
+        }
+    }
+
+    CommitBestBlock();
+    LogPrintf("%s is enabled at height %d\n", m_name, m_best_block_index.load() ? m_best_block_index.load()->nHeight : -1);
+}
+
+void BlockFilterIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    if (!m_synced) {
+        return;
+    }
+
+    // Notifications queued before the sync thread caught up may be for blocks it indexed already
+    const CBlockIndex* best_block_index = m_best_block_index.load();
+    if (best_block_index && best_block_index->GetAncestor(pindex->nHeight) == pindex) {
+        return;
+    }
+
+    if (!WriteBlock(*block, pindex)) {
+        LogPrintf("%s: failed to index block %s, the %s is out of sync\n", __func__,
+                  pindex->GetBlockHash().ToString(), m_name);
+        return;
+    }
+    m_best_block_index = pindex;
+}
+
+void BlockFilterIndex::SetBestChain(const CBlockLocator& locator)
+{
+    if (!m_synced) {
+        return;
+    }
+    // The chain state was flushed, keep the best block of the index close to it
+    CommitBestBlock();
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal entry;
+    if (!m_db->ReadEntry(block_index->GetBlockHash(), entry)) {
+        return false;
+    }
+
+    try {
+        filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(entry.filter));
+    } catch (const std::exception& e) {
+        return error("%s: failed to decode the filter of block %s: %s", __func__, block_index->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal entry;
+    if (!m_db->ReadEntry(block_index->GetBlockHash(), entry)) {
+        return false;
+    }
+
+    header_out = entry.header;
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<BlockFilter>& filters_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return false;
+    }
+
+    // Walk back from the stop block: the filters of the blocks of any branch are available
+    std::vector<BlockFilter> filters(stop_index->nHeight - start_height + 1);
+    const CBlockIndex* pindex = stop_index;
+    for (auto it = filters.rbegin(); it != filters.rend(); ++it, pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, *it)) {
+            return false;
+        }
+    }
+
+    filters_out = std::move(filters);
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                                             std::vector<uint256>& hashes_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return false;
+    }
+
+    std::vector<uint256> hashes(stop_index->nHeight - start_height + 1);
+    const CBlockIndex* pindex = stop_index;
+    for (auto it = hashes.rbegin(); it != hashes.rend(); ++it, pindex = pindex->pprev) {
+        DBVal entry;
+        if (!m_db->ReadEntry(pindex->GetBlockHash(), entry)) {
+            return false;
+        }
+        *it = entry.hash;
+    }
+
+    hashes_out = std::move(hashes);
+    return true;
+}
+
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type)
+{
+    auto it = g_filter_indexes.find(filter_type);
+    return it != g_filter_indexes.end() ? &it->second : nullptr;
+}
+
+void ForEachBlockFilterIndex(std::function<void (BlockFilterIndex&)> fn)
+{
+    for (auto& entry : g_filter_indexes) fn(entry.second);
+}
+
+bool InitBlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    auto result = g_filter_indexes.emplace(std::piecewise_construct,
+                                           std::forward_as_tuple(filter_type),
+                                           std::forward_as_tuple(filter_type,
+                                                                 n_cache_size, f_memory, f_wipe));
+    return result.second;
+}
+
+bool DestroyBlockFilterIndex(BlockFilterType filter_type)
+{
+    return g_filter_indexes.erase(filter_type);
+}
+
+void DestroyAllBlockFilterIndexes()
+{
+    g_filter_indexes.clear();
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2018-2019 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "threadinterrupt.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+class CBlockIndex;
+
+/** Default for -blockfilterindex */
+static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+/** Default for -peerblockfilters, serve the block filters to peers */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/** Interval between compact filter checkpoints. See BIP 157. */
+static constexpr int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * BlockFilterIndex keeps the compact filter of every connected block, along with
+ * its filter hash and header, in a database of its own.
+ *
+ * The entries are keyed by block hash: the filters of blocks disconnected in a
+ * reorg stay in the index, and a reorg only has to index the blocks of the new
+ * branch. Once in sync with the chain the index follows BlockConnected; before
+ * that, a background thread indexes the blocks of the active chain it misses.
+ */
+class BlockFilterIndex final : public CValidationInterface
+{
+private:
+    class DB;
+
+    BlockFilterType m_filter_type;
+    std::string m_name;
+    std::unique_ptr<DB> m_db;
+
+    /// The last block of the chain the index is in sync with, null before the genesis block is indexed.
+    std::atomic<const CBlockIndex*> m_best_block_index{nullptr};
+
+    /// Whether the index caught up with the active chain. Set with cs_main held, so that
+    /// every block connected afterwards is indexed from BlockConnected.
+    std::atomic<bool> m_synced{false};
+
+    std::thread m_thread_sync;
+    CThreadInterrupt m_interrupt;
+
+    /// Compute and store the filter of a block. Its parent must be indexed already.
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    /// Write the locator of the best indexed block, to resume from there on restart.
+    bool CommitBestBlock();
+
+    /// Index the blocks of the active chain until the index is in sync with it.
+    void ThreadSync();
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
+    void SetBestChain(const CBlockLocator& locator) override;
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+    ~BlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+
+    /** Whether the index caught up with the active chain. */
+    bool IsSynced() const { return m_synced; }
+
+    /** Find the block the index resumes from, register for validation notifications and start the sync thread. */
+    bool Start();
+
+    /** Stop the sync thread, unregister and write the best block. */
+    void Stop();
+
+    /** Get a single filter by block. */
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+
+    /** Get a single filter header by block. */
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+
+    /** Get a range of filters between two heights on a chain. */
+    bool LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                           std::vector<BlockFilter>& filters_out) const;
+
+    /** Get a range of filter hashes between two heights on a chain. */
+    bool LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                               std::vector<uint256>& hashes_out) const;
+};
+
+/**
+ * Get a block filter index by type. Returns nullptr if index has not been initialized
+ * or was already destroyed.
+ */
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type);
+
+/** Iterate over all running block filter indexes, invoking fn on each. */
+void ForEachBlockFilterIndex(std::function<void (BlockFilterIndex&)> fn);
+
+/**
+ * Initialize a block filter index for the given type if one does not already exist. Returns true if
+ * a new index is created and false if one has already been initialized.
+ */
+bool InitBlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+/**
+ * Destroy the block filter index with the given type. Returns false if no such index exists. This
+ * just releases the allocated memory and closes the database connection, it does not delete the
+ * index data.
+ */
+bool DestroyBlockFilterIndex(BlockFilterType filter_type);
+
+/** Destroy all open block filter indexes. */
+void DestroyAllBlockFilterIndexes();
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
@@ -28,6 +28,7 @@
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/blockfilterindex.h"
 #include "invalid.h"
 #include "key.h"
 #include "mapport.h"
@@ -49,6 +50,7 @@
 #include "evo/evodb.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#include "txreconciliation.h"
 #include "guiinterface.h"
 #include "guiinterfaceutil.h"
 #include "util/system.h"
@@ -85,7 +87,9 @@
 #include <boost/asio.hpp>
 namespace ip = boost::asio::ip;
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 
@@ -101,10 +105,8 @@ static const bool DEFAULT_PNCONFLOCK = true;
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
-#endif
 
+static std::set<BlockFilterType> g_enabled_filter_types;
 static EvoNotificationInterface* pEvoNotificationInterface = nullptr;
 
 #ifdef WIN32
@@ -276,6 +278,7 @@ void PrepareShutdown()
     // After there are no more peers/RPC left to give us new data which may generate
     // CValidationInterface callbacks, flush them...
     GetMainSignals().FlushBackgroundCallbacks();
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
 
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
@@ -297,10 +300,12 @@ void PrepareShutdown()
         pblocktree.reset();
         zerocoinDB.reset();
         accumulatorCache.reset();
+        stakeModifierCache.reset();
         pSporkDB.reset();
         deterministicPNManager.reset();
         evoDb.reset();
     }
+    DestroyAllBlockFilterIndexes();
 #ifdef ENABLE_WALLET
     for (CWalletRef pwallet : vpwallets) {
         pwallet->Flush(true);
@@ -320,10 +325,10 @@ void PrepareShutdown()
     }
 
 #if ENABLE_ZMQ
-    if (pzmqNotificationInterface) {
-        UnregisterValidationInterface(pzmqNotificationInterface);
-        delete pzmqNotificationInterface;
-        pzmqNotificationInterface = nullptr;
+    if (g_zmq_notification_interface) {
+        UnregisterValidationInterface(g_zmq_notification_interface);
+        delete g_zmq_notification_interface;
+        g_zmq_notification_interface = nullptr;
     }
 #endif
 
@@ -443,6 +448,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is (0-4, default: %u)", DEFAULT_CHECKLEVEL));
 
+    strUsage += HelpMessageOpt("-blockfilterindex=<type>", strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
+            " " + "If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.");
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf("Maintain a commitment to the UTXO set (MuHash) for every block, used by gettxoutsetinfo \"muhash\" (default: %u)", DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf("Specify configuration file (default: %s)", TrumpCoin_CONF_FILENAME));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -452,6 +460,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", "Specify data directory");
     if (showDebug) {
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
+        strUsage += HelpMessageOpt("-backgroundflush", strprintf("Write the coins cache to the database on a background thread, while validation continues (default: %u)", DEFAULT_BACKGROUND_FLUSH));
+        strUsage += HelpMessageOpt("-mmapblocks", strprintf("Read the complete block files through memory mappings, rather than opening them for every block (default: %u)", DEFAULT_MMAP_BLOCKS));
     }
     strUsage += HelpMessageOpt("-paramsdir=<dir>", strprintf("Specify zk params directory (default: %s)", ZC_GetParamsDir().string()));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)", DEFAULT_DEBUGLOGFILE));
@@ -460,9 +470,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-loadblock=<file>", "Imports blocks from external blk000??.dat file on startup");
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf("Set the Maximum reorg depth (default: %u)", DEFAULT_MAX_REORG_DEPTH));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf("Keep at most <n> kilobytes of unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-batchscriptchecks", strprintf("Verify the signatures of each batch of script checks after evaluating its scripts (default: %u)", DEFAULT_BATCH_SCRIPTCHECKS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)", -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf("Specify pid file (default: %s)", TrumpCoin_PID_FILENAME));
@@ -491,11 +504,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-listen", strprintf("Accept connections from outside (default: %u if no -proxy or -connect/-noconnect)", DEFAULT_LISTEN));
     strUsage += HelpMessageOpt("-listenonion", strprintf("Automatically create Tor hidden service (default: %d)", DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf("Maintain at most <n> connections to peers (default: %u)", DEFAULT_MAX_PEER_CONNECTIONS));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-msgthreads=<n>", strprintf("Number of threads processing the messages of different peers concurrently (only %d for now, default: %d)", MAX_MSG_THREADS, DEFAULT_MSG_THREADS));
+    strUsage += HelpMessageOpt("-netthreads=<n>", strprintf("Number of threads serving the peer connections, each one a share of them (1 to %d, default: %d)", MAX_NET_THREADS, DEFAULT_NET_THREADS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)", "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", "Only connect to nodes in network <net> (ipv4, ipv6 or onion)");
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf("Serve compact block filters to peers per BIP 157 (default: %u)", DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf("Listen for connections on <port> (default: %u or testnet: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", "Connect through SOCKS5 proxy");
@@ -504,6 +521,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf("Specify connection timeout in milliseconds (minimum: 1, default: %d)", DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", "Tor control port password (default: empty)");
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf("Announce transactions to the peers supporting it through set reconciliation, flooding them to few outbound peers only (default: %u)", DEFAULT_TXRECONCILIATION_ENABLE));
     strUsage += HelpMessageOpt("-upnp", strprintf("Use UPnP to map the listening port (default: %u)", DEFAULT_UPNP));
 #ifdef USE_NATPMP
     strUsage += HelpMessageOpt("-natpmp", strprintf("Use NAT-PMP to map the listening port (default: %s)", DEFAULT_NATPMP ? "1 when listening and no -proxy" : "0"));
@@ -526,6 +544,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>");
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", "Enable publish raw block in <address>");
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>");
+    strUsage += HelpMessageOpt("-zmqpubhashtxremoved=<address>", "Enable publish hash and removal reason of the transactions removed from the mempool in <address>");
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", "Enable publish hash block and tx sequence in <address>");
+    strUsage += HelpMessageOpt("-zmqpub<topic>hwm=<n>", strprintf("Set the outbound message high water mark of the <topic> notifier, the messages waiting to be sent beyond it are dropped (default: %d)", DEFAULT_ZMQ_SNDHWM));
 #endif
 
     strUsage += HelpMessageGroup("Debugging/Testing options:");
@@ -546,6 +567,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", "Enable spork administration functionality with the appropriate private key.");
         strUsage += HelpMessageOpt("-nuparams=upgradeName:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
+        strUsage += HelpMessageOpt("-snapshotparams=height:blockHash:txoutsetHash:shieldedstateHash", "Trust the given UTXO set snapshot for loadtxoutset, as dumptxoutset reported it (regtest-only)");
     }
     strUsage += HelpMessageOpt("-debug=<category>", strprintf("Output debugging information (default: %u, supplying <category> is optional)", 0) + ". " +
         "If <category> is not supplied, output all debugging information. <category> can be: " + ListLogCategories() + ".");
@@ -560,6 +582,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxscriptcachesize=<n>", strprintf("Limit size of script execution cache to <n> MiB (default: %u)", DEFAULT_MAX_SCRIPT_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)", CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -1047,6 +1070,39 @@ bool InitNUParams()
     return true;
 }
 
+bool InitSnapshotParams()
+{
+    if (gArgs.IsArgSet("-snapshotparams")) {
+        // Allow trusting UTXO set snapshots of test chains
+        if (Params().NetworkIDString() != "regtest") {
+            return UIError(_("UTXO snapshot parameters may only be overridden on regtest."));
+        }
+        for (const std::string& strSnapshot : gArgs.GetArgs("-snapshotparams")) {
+            std::vector<std::string> vSnapshotParams;
+            boost::split(vSnapshotParams, strSnapshot, boost::is_any_of(":"));
+            if (vSnapshotParams.size() != 4) {
+                return UIError(strprintf(_("UTXO snapshot parameters malformed, expecting %s"), "height:blockHash:txoutsetHash:shieldedstateHash"));
+            }
+            int nHeight;
+            if (!ParseInt32(vSnapshotParams[0], &nHeight) || nHeight <= 0) {
+                return UIError(strprintf(_("Invalid UTXO snapshot height (%s)"), vSnapshotParams[0]));
+            }
+            for (size_t i = 1; i < vSnapshotParams.size(); i++) {
+                if (vSnapshotParams[i].size() != 64 || !IsHex(vSnapshotParams[i])) {
+                    return UIError(strprintf(_("Invalid UTXO snapshot hash (%s)"), vSnapshotParams[i]));
+                }
+            }
+            CUTXOSnapshotData snapshot;
+            snapshot.hashBlock = uint256S(vSnapshotParams[1]);
+            snapshot.hashUTXOSet = uint256S(vSnapshotParams[2]);
+            snapshot.hashShieldedState = uint256S(vSnapshotParams[3]);
+            UpdateUTXOSnapshotParameters(nHeight, snapshot);
+            LogPrintf("Trusting the UTXO set snapshot of block %s at height=%d\n", vSnapshotParams[1], nHeight);
+        }
+    }
+    return true;
+}
+
 static std::string ResolveErrMsg(const char * const optname, const std::string& strBind)
 {
     return strprintf(_("Cannot resolve -%s address: '%s'"), optname, strBind);
@@ -1111,8 +1167,13 @@ bool AppInitParameterInteraction()
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + nBind + MIN_CORE_FILEDESCRIPTORS);
+#ifdef USE_POLL
+    int fd_max = nFD;
+#else
+    int fd_max = FD_SETSIZE;
+#endif
+    nMaxConnections = std::max(std::min(nMaxConnections, fd_max - nBind - MIN_CORE_FILEDESCRIPTORS), 0);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return UIError(_("Not enough file descriptors available."));
     if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
@@ -1182,6 +1243,9 @@ bool AppInitParameterInteraction()
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    fBatchScriptChecks = gArgs.GetBoolArg("-batchscriptchecks", DEFAULT_BATCH_SCRIPTCHECKS);
+    fCoinStatsIndex = gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
+    fMapBlockFiles = gArgs.GetBoolArg("-mmapblocks", DEFAULT_MMAP_BLOCKS);
 
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
@@ -1239,11 +1303,36 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    // -blockfilterindex: "0" disables the indexes, "1" (or no value) enables all the filter types
+    const std::string blockfilterindex_value = gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
+        g_enabled_filter_types = AllBlockFilterTypes();
+    } else if (blockfilterindex_value != "0") {
+        for (const std::string& name : gArgs.GetArgs("-blockfilterindex")) {
+            BlockFilterType filter_type;
+            if (!BlockFilterTypeByName(name, filter_type)) {
+                return UIError(strprintf(_("Unknown -blockfilterindex value %s."), name));
+            }
+            g_enabled_filter_types.insert(filter_type);
+        }
+    }
+
+    // Signal NODE_COMPACT_FILTERS if peerblockfilters and basic filters index are both enabled.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (g_enabled_filter_types.count(BlockFilterType::BASIC_FILTER) != 1) {
+            return UIError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     if (!InitNUParams())
         return false;
 
+    if (!InitSnapshotParams())
+        return false;
+
     return true;
 }
 
@@ -1318,11 +1407,14 @@ bool AppInitMain()
     }
 
     InitSignatureCache();
+    InitScriptExecutionCache();
 //downl();
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingProofCheck);
+        }
     }
 
     if (gArgs.IsArgSet("-sporkkey")) // spork priv key
@@ -1352,6 +1444,9 @@ bool AppInitMain()
 #ifdef ENABLE_WALLET
     RegisterWalletRPCCommands(tableRPC);
 #endif
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1576,10 +1671,10 @@ bool AppInitMain()
     }
 
 #if ENABLE_ZMQ
-    pzmqNotificationInterface = CZMQNotificationInterface::Create();
+    g_zmq_notification_interface = CZMQNotificationInterface::Create();
 
-    if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+    if (g_zmq_notification_interface) {
+        RegisterValidationInterface(g_zmq_notification_interface);
     }
 #endif
 
@@ -1598,6 +1693,11 @@ bool AppInitMain()
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nFilterIndexCache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        nFilterIndexCache = std::min(nTotalCache / 8, nMaxFilterIndexCache << 20);
+        nTotalCache -= nFilterIndexCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1605,6 +1705,10 @@ bool AppInitMain()
     int64_t nEvoDbCache = 1024 * 1024 * 16; // TODO
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        LogPrintf("* Using %.1fMiB for %s block filter index database\n",
+                  nFilterIndexCache / g_enabled_filter_types.size() * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
@@ -1630,6 +1734,7 @@ bool AppInitMain()
                 zerocoinDB.reset(new CZerocoinDB(0, false, fReindex));
                 pSporkDB.reset(new CSporkDB(0, false, false));
                 accumulatorCache.reset(new AccumulatorCache(zerocoinDB.get()));
+                stakeModifierCache.reset(new StakeModifierCache(pblocktree.get()));
 
                 deterministicPNManager.reset();
                 evoDb.reset();
@@ -1672,6 +1777,15 @@ bool AppInitMain()
                     break;
                 }
 
+                // The blocks up to a loaded UTXO snapshot base were never downloaded
+                if (pindexSnapshotBase && !g_enabled_filter_types.empty()) {
+                    return UIError(strprintf(_("The chainstate was loaded from a UTXO snapshot, without the blocks that %s needs. Restart without it."), "-blockfilterindex"));
+                }
+                if (pindexSnapshotBase && fReindexChainState) {
+                    strLoadError = strprintf(_("The chainstate was loaded from a UTXO snapshot, without the blocks that %s needs. You will need to rebuild the database using %s."), "-reindex-chainstate", "-reindex");
+                    break;
+                }
+
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk.
                 // This is called again in ThreadImport in the reindex completes.
@@ -1695,6 +1809,12 @@ bool AppInitMain()
                     break;
                 }
 
+                // The blocks up to the base of a UTXO snapshot whose loading didn't complete can't be replayed
+                if (IsSnapshotLoadInterrupted(pcoinsdbview.get())) {
+                    strLoadError = strprintf(_("The loading of a UTXO snapshot was interrupted. You will need to rebuild the database using %s."), "-reindex-chainstate");
+                    break;
+                }
+
                 // ReplayBlocks is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!ReplayBlocks(chainparams, pcoinsdbview.get())) {
                     strLoadError = strprintf(_("Unable to replay blocks. You will need to rebuild the database using %s."), "-reindex");
@@ -1702,6 +1822,7 @@ bool AppInitMain()
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
+                pcoinsdbview->SetBackgroundFlush(gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH));
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
@@ -1758,6 +1879,12 @@ bool AppInitMain()
                         break;
                     }
                 }
+
+                if (!LoadCoinsCommitment()) {
+                    if (ShutdownRequested()) break;
+                    strLoadError = _("Error computing the UTXO set commitment");
+                    break;
+                }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1842,6 +1969,11 @@ bool AppInitMain()
         }
     }
 
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, nFilterIndexCache / g_enabled_filter_types.size(), false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
+
     std::vector<fs::path> vImportFiles;
     for (const std::string& strFile : gArgs.GetArgs("-loadblock")) {
         vImportFiles.emplace_back(strFile);
@@ -2041,6 +2173,10 @@ bool AppInitMain()
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nNetThreads = gArgs.GetArg("-netthreads", DEFAULT_NET_THREADS);
+    connOptions.nMsgThreads = gArgs.GetArg("-msgthreads", DEFAULT_MSG_THREADS);
+    if (connOptions.nMsgThreads < 1 || connOptions.nMsgThreads > MAX_MSG_THREADS)
+        return UIError(strprintf(_("Invalid -msgthreads value %d, only %d is supported for now."), connOptions.nMsgThreads, MAX_MSG_THREADS));
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return UIError(strNodeError);
@@ -7,6 +7,7 @@
 
 #include "kernel.h"
 
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -18,6 +19,9 @@
 #include "zpivchain.h"
 #include "zpiv/zpos.h"
 
+#include <atomic>
+#include <thread>
+
 /**
  * CStakeKernel Constructor
  *
@@ -55,13 +59,30 @@ uint256 CStakeKernel::GetHash() const
     return Hash(ss.begin(), ss.end());
 }
 
-// Check that the kernel hash meets the target required
-bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+// Return a hasher fed with the kernel message up to the time
+CHash256 CStakeKernel::GetPrefixHasher() const
+{
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness;
+    CHash256 hasher;
+    hasher.Write((const unsigned char*)ss.data(), ss.size());
+    return hasher;
+}
+
+// Return the target weighted by the stake value
+arith_uint256 CStakeKernel::GetWeightedTarget() const
 {
-    // Get weighted target
     arith_uint256 bnTarget;
     bnTarget.SetCompact(nBits);
     bnTarget *= (arith_uint256(stakeValue) / 100);
+    return bnTarget;
+}
+
+// Check that the kernel hash meets the target required
+bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+{
+    // Get weighted target
+    const arith_uint256& bnTarget = GetWeightedTarget();
 
     // Check PoS kernel hash
     const arith_uint256& hashProofOfStake = UintToArith256(GetHash());
@@ -84,6 +105,75 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 }
 
 
+/*
+ * Kernel search engine
+ */
+
+void CStakeKernelEngine::Reset(const CBlockIndex* pindexPrev, unsigned int nBits)
+{
+    m_pindex_prev = pindexPrev;
+    m_bits = nBits;
+    m_kernels.clear();
+    m_enabled = 0;
+}
+
+void CStakeKernelEngine::AddInput(CStakeInput* stakeInput)
+{
+    // The time is the only part of the kernel left out
+    CStakeKernel stakeKernel(m_pindex_prev, stakeInput, m_bits, 0);
+    m_kernels.push_back({stakeKernel.GetPrefixHasher(), stakeKernel.GetWeightedTarget(), true});
+    m_enabled++;
+}
+
+uint256 CStakeKernelEngine::GetHash(size_t index, int nTime) const
+{
+    // Complete the message as CStakeKernel::GetHash serializes it
+    unsigned char vchTime[4];
+    WriteLE32(vchTime, (uint32_t) nTime);
+    CHash256 hasher(m_kernels[index].hasherPrefix);
+    uint256 hash;
+    hasher.Write(vchTime, sizeof(vchTime)).Finalize(hash.begin());
+    return hash;
+}
+
+bool CStakeKernelEngine::CheckKernelHash(size_t index, int nTime) const
+{
+    return UintToArith256(GetHash(index, nTime)) < m_kernels[index].bnTarget;
+}
+
+int CStakeKernelEngine::Search(int nTime, size_t nBegin, size_t nEnd, int nThreads) const
+{
+    nEnd = std::min(nEnd, m_kernels.size());
+    if (nBegin >= nEnd) return -1;
+    const size_t nInputs = nEnd - nBegin;
+    nThreads = std::max(1, std::min(nThreads, (int) (nInputs / MIN_INPUTS_PER_THREAD)));
+
+    // Lowest index found so far, the threads searching above it stop
+    std::atomic<size_t> nFound{nEnd};
+    auto searchRange = [&](size_t nFrom, size_t nTo) {
+        for (size_t i = nFrom; i < nTo && i < nFound.load(std::memory_order_relaxed); i++) {
+            if (!m_kernels[i].fEnabled || !CheckKernelHash(i, nTime)) continue;
+            size_t nPrev = nFound.load();
+            while (i < nPrev && !nFound.compare_exchange_weak(nPrev, i)) {}
+            return;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const size_t nChunk = (nInputs + nThreads - 1) / nThreads;
+    for (int t = 1; t < nThreads; t++) {
+        const size_t nFrom = nBegin + t * nChunk;
+        threads.emplace_back(searchRange, nFrom, std::min(nFrom + nChunk, nEnd));
+    }
+    searchRange(nBegin, std::min(nBegin + nChunk, nEnd));
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return nFound < nEnd ? (int) nFound : -1;
+}
+
+
 /*
  * PoS Validation
  */
@@ -104,6 +194,21 @@ static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& st
     return stake != nullptr;
 }
 
+/*
+ * GetStakeTime         Return the time of a block staked now on top of pindexPrev
+ *
+ * @param[in]   pindexPrev      index of the parent block of the block being staked
+ * @param[out]  nTimeTx         new blocktime: the current time slot (the adjusted time on regtest)
+ * @return      bool            false if the time slot is not after the parent block
+ */
+bool GetStakeTime(const CBlockIndex* pindexPrev, int64_t& nTimeTx)
+{
+    // Get the new time slot (and verify it's not the same as previous block)
+    const bool fRegTest = Params().IsRegTestNet();
+    nTimeTx = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    return nTimeTx > pindexPrev->nTime || fRegTest;
+}
+
 /*
  * Stake                Check if stakeInput can stake a block on top of pindexPrev
  *
@@ -117,10 +222,7 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
 {
     if (!stakeInput) return false;
 
-    // Get the new time slot (and verify it's not the same as previous block)
-    const bool fRegTest = Params().IsRegTestNet();
-    nTimeTx = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
-    if (nTimeTx <= pindexPrev->nTime && !fRegTest) return false;
+    if (!GetStakeTime(pindexPrev, nTimeTx)) return false;
 
     // Verify Proof Of Stake
     CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
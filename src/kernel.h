@@ -8,8 +8,12 @@
 #ifndef TrumpCoin_KERNEL_H
 #define TrumpCoin_KERNEL_H
 
+#include "arith_uint256.h"
+#include "hash.h"
 #include "stakeinput.h"
 
+#include <vector>
+
 class CStakeKernel {
 public:
     /**
@@ -25,6 +29,12 @@ public:
     // Return stake kernel hash
     uint256 GetHash() const;
 
+    // Return a hasher fed with the kernel message up to the time, which is all but the last 4 bytes
+    CHash256 GetPrefixHasher() const;
+
+    // Return the target weighted by the stake value
+    arith_uint256 GetWeightedTarget() const;
+
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
@@ -39,8 +49,79 @@ private:
     CAmount stakeValue{0};     // target multiplier
 };
 
+/**
+ * Kernel search over a set of stake inputs, one time slot after the other.
+ *
+ * Only the time of the kernel message changes from a slot to the next: the message up to
+ * the time, and the weighted target, are computed once per input when staking on top of a
+ * new block. Evaluating a slot is then a hash completion per input, split across threads
+ * for large sets.
+ */
+class CStakeKernelEngine
+{
+public:
+    //! Inputs searched by each thread, at least
+    static const size_t MIN_INPUTS_PER_THREAD = 2000;
+
+    /** Drop the inputs, to stake on top of pindexPrev with the difficulty nBits */
+    void Reset(const CBlockIndex* pindexPrev, unsigned int nBits);
+
+    /** Whether the kernels are computed to stake on top of pindexPrev with the difficulty nBits */
+    bool IsPreparedFor(const CBlockIndex* pindexPrev, unsigned int nBits) const
+    {
+        return pindexPrev == m_pindex_prev && nBits == m_bits;
+    }
+
+    /** Append an input, and compute the invariant part of its kernel */
+    void AddInput(CStakeInput* stakeInput);
+
+    /** An input which can't stake anymore (eg. spent), it's skipped by the searches */
+    void Disable(size_t index)
+    {
+        if (m_kernels[index].fEnabled) m_enabled--;
+        m_kernels[index].fEnabled = false;
+    }
+
+    bool IsEnabled(size_t index) const { return m_kernels[index].fEnabled; }
+
+    /** Kernel hash of the input at index for the time nTime */
+    uint256 GetHash(size_t index, int nTime) const;
+
+    /**
+     * Look for the first enabled input, in [nBegin, nEnd), whose kernel meets its target at the
+     * time nTime. Returns its index, or -1 if there is none.
+     */
+    int Search(int nTime, size_t nBegin, size_t nEnd, int nThreads = 1) const;
+
+    size_t Size() const { return m_kernels.size(); }
+    size_t CountEnabled() const { return m_enabled; }
+
+private:
+    struct PreparedKernel {
+        CHash256 hasherPrefix;
+        arith_uint256 bnTarget;
+        bool fEnabled;
+    };
+
+    bool CheckKernelHash(size_t index, int nTime) const;
+
+    const CBlockIndex* m_pindex_prev{nullptr};
+    unsigned int m_bits{0};
+    std::vector<PreparedKernel> m_kernels;
+    size_t m_enabled{0};
+};
+
 /* PoS Validation */
 
+/*
+ * GetStakeTime         Return the time of a block staked now on top of pindexPrev
+ *
+ * @param[in]   pindexPrev      index of the parent block of the block being staked
+ * @param[out]  nTimeTx         new blocktime: the current time slot (the adjusted time on regtest)
+ * @return      bool            false if the time slot is not after the parent block
+ */
+bool GetStakeTime(const CBlockIndex* pindexPrev, int64_t& nTimeTx);
+
 /*
  * Stake                Check if stakeInput can stake a block on top of pindexPrev
  *
@@ -6,7 +6,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "legacy/stakemodifier.h"
-#include "validation.h"   // mapBlockIndex, chainActive
+#include "txdb.h"         // StakeModifierCache
+#include "validation.h"   // chainActive, stakeModifierCache
+
+#include <set>
 
 /*
  * Old Modifier - Only for IBD
@@ -25,11 +28,11 @@ static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
+// already selected blocks in setSelectedBlocks, and with timestamp up to
 // nSelectionIntervalStop.
 static bool SelectBlockFromCandidates(
-    std::vector<std::pair<int64_t, uint256> >& vSortedByTimestamp,
-    std::map<uint256, const CBlockIndex*>& mapSelectedBlocks,
+    const std::vector<std::pair<int64_t, const CBlockIndex*> >& vSortedByTimestamp,
+    const std::set<const CBlockIndex*>& setSelectedBlocks,
     int64_t nSelectionIntervalStop,
     uint64_t nStakeModifierPrev,
     const CBlockIndex** pindexSelected)
@@ -40,10 +43,7 @@ static bool SelectBlockFromCandidates(
     arith_uint256 hashBest = ARITH_UINT256_ZERO;
     *pindexSelected = (const CBlockIndex*)0;
     for (const auto& item : vSortedByTimestamp) {
-        if (!mapBlockIndex.count(item.second))
-            return error("%s : failed to find block index for candidate block %s", __func__, item.second.ToString().c_str());
-
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
+        const CBlockIndex* pindex = item.second;
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
             break;
 
@@ -53,7 +53,7 @@ static bool SelectBlockFromCandidates(
             fFirstRun = false;
         }
 
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (setSelectedBlocks.count(pindex) > 0)
             continue;
 
         // compute the selection hash by hashing an input that is unique to that block
@@ -87,7 +87,7 @@ static bool SelectBlockFromCandidates(
 
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
+const CBlockIndex* FindOldModifierBlock(const CBlockIndex* pindexFrom)
 {
     int64_t nStakeModifierTime = pindexFrom->GetBlockTime();
     const CBlockIndex* pindex = pindexFrom;
@@ -97,13 +97,36 @@ bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
     do {
         if (!pindexNext) {
             // Should never happen
-            return error("%s : Null pindexNext, current block %s ", __func__, pindex->phashBlock->GetHex());
+            error("%s : Null pindexNext, current block %s ", __func__, pindex->phashBlock->GetHex());
+            return nullptr;
         }
         pindex = pindexNext;
         if (pindex->GeneratedStakeModifier()) nStakeModifierTime = pindex->GetBlockTime();
         pindexNext = chainActive[pindex->nHeight + 1];
     } while (nStakeModifierTime < pindexFrom->GetBlockTime() + OLD_MODIFIER_INTERVAL);
 
+    return pindex;
+}
+
+bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
+{
+    // The blocks between the coin and the one holding the modifier decide which one it is: the
+    // block found before, for the coins of this height, holds as long as both are in the active chain.
+    const bool fInActiveChain = chainActive.Contains(pindexFrom);
+    if (fInActiveChain && stakeModifierCache) {
+        const CBlockIndex* pindex = stakeModifierCache->Get(pindexFrom->nHeight);
+        if (pindex && chainActive.Contains(pindex)) {
+            nStakeModifier = pindex->GetStakeModifierV1();
+            return true;
+        }
+    }
+
+    const CBlockIndex* pindex = FindOldModifierBlock(pindexFrom);
+    if (!pindex) return false;
+    if (fInActiveChain && stakeModifierCache) {
+        stakeModifierCache->Set(pindexFrom->nHeight, pindex);
+    }
+
     nStakeModifier = pindex->GetStakeModifierV1();
     return true;
 }
@@ -131,11 +154,11 @@ bool GetOldStakeModifier(CStakeInput* stake, uint64_t& nStakeModifier)
 }
 
 // sort blocks by timestamp, soliving tie with hash (taken as arith_uint)
-static bool sortedByTimestamp(const std::pair<uint64_t, uint256>& a,
-                              const std::pair<uint64_t, uint256>& b)
+static bool sortedByTimestamp(const std::pair<int64_t, const CBlockIndex*>& a,
+                              const std::pair<int64_t, const CBlockIndex*>& b)
 {
     if (a.first == b.first) {
-        return UintToArith256(a.second) < UintToArith256(b.second);
+        return UintToArith256(a.second->GetBlockHash()) < UintToArith256(b.second->GetBlockHash());
     }
     return a.first < b.first;
 }
@@ -182,13 +205,13 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
         return true;
 
     // Sort candidate blocks by timestamp
-    std::vector<std::pair<int64_t, uint256> > vSortedByTimestamp;
+    std::vector<std::pair<int64_t, const CBlockIndex*> > vSortedByTimestamp;
     vSortedByTimestamp.reserve(64 * MODIFIER_INTERVAL  / Params().GetConsensus().nTargetSpacing);
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / MODIFIER_INTERVAL ) * MODIFIER_INTERVAL  - OLD_MODIFIER_INTERVAL;
     const CBlockIndex* pindex = pindexPrev;
 
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart) {
-        vSortedByTimestamp.emplace_back(pindex->GetBlockTime(), pindex->GetBlockHash());
+        vSortedByTimestamp.emplace_back(pindex->GetBlockTime(), pindex);
         pindex = pindex->pprev;
     }
 
@@ -198,20 +221,20 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    std::map<uint256, const CBlockIndex*> mapSelectedBlocks;
+    std::set<const CBlockIndex*> setSelectedBlocks;
     for (int nRound = 0; nRound < std::min(64, (int)vSortedByTimestamp.size()); nRound++) {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
 
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, setSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
             return error("%s : unable to select block at round %d", __func__, nRound);
 
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
 
         // add the selected block from candidates to selected list
-        mapSelectedBlocks.emplace(pindex->GetBlockHash(), pindex);
+        setSelectedBlocks.insert(pindex);
     }
 
     nStakeModifier = nStakeModifierNew;
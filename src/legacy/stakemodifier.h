@@ -13,6 +13,10 @@
 
 // Old Modifier - Only for IBD
 bool GetOldStakeModifier(CStakeInput* stake, uint64_t& nStakeModifier);
+// Block of the active chain holding the old modifier of the kernels of the coins of pindexFrom (nullptr if none)
+const CBlockIndex* FindOldModifierBlock(const CBlockIndex* pindexFrom);
+// Old modifier of the kernels of the coins of pindexFrom, looked up in stakeModifierCache first
+bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier);
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
 #endif // TrumpCoin_LEGACY_MODIFIER_H
@@ -7,6 +7,7 @@
 
 #include "indirectmap.h"
 #include "prevector.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
@@ -221,6 +222,22 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+// Pool-allocated unordered_map: the nodes live in the chunks of the resource,
+// whether they are in use or waiting in the freelists.
+
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+    const ResourceType* pool_resource = m.get_allocator().resource();
+    // The chunks are kept in a std::list (two pointers plus the chunk pointer per node),
+    // and the resource itself in the control block of a shared_ptr.
+    size_t usage_resource = MallocUsage(sizeof(ResourceType)) + MallocUsage(sizeof(stl_shared_counter)) +
+                            MallocUsage(sizeof(void*) * 3) * pool_resource->NumAllocatedChunks();
+    size_t usage_chunks = MallocUsage(pool_resource->ChunkSizeBytes()) * pool_resource->NumAllocatedChunks();
+    return usage_resource + usage_chunks + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 // Dispatch to class method as fallback
 
 template<typename X>
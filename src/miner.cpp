@@ -110,6 +110,31 @@ void CheckForCoins(CWallet* pwallet, std::vector<CStakeableOutput>* availableCoi
     fStakeableCoins = pwallet->StakeableCoins(availableCoins);
 }
 
+// Longest the staker sleeps at once, to stay responsive to the thread interruption
+static const int64_t STAKER_MAX_SLEEP_MILLIS = 1000;
+
+// Milliseconds left before the next time slot begins
+static int64_t GetMillisToNextTimeSlot()
+{
+    const int64_t nNextSlot = GetCurrentTimeSlot() + Params().GetConsensus().nTimeSlotLength;
+    return std::max((nNextSlot - GetAdjustedTime()) * 1000 - GetTimeMillis() % 1000, (int64_t) 0);
+}
+
+// Sleep for nMillis, or until a new best block is connected (if it's not hashTip already)
+static void WaitForNewBestBlock(const uint256& hashTip, int64_t nMillis)
+{
+    const int64_t nDeadline = GetTimeMillis() + nMillis;
+    while (true) {
+        boost::this_thread::interruption_point();
+        const int64_t nSleepMillis = std::min(nDeadline - GetTimeMillis(), STAKER_MAX_SLEEP_MILLIS);
+        if (nSleepMillis <= 0) return;
+        WAIT_LOCK(g_best_block_mutex, lock);
+        if (g_best_block != hashTip) return;
+        g_best_block_cv.wait_for(lock, std::chrono::milliseconds(nSleepMillis));
+        if (g_best_block != hashTip) return;
+    }
+}
+
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 {
     LogPrintf("TrumpCoinMiner started\n");
@@ -143,16 +168,18 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
             while ((g_connman && g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && Params().MiningRequiresPeers())
                     || pwallet->IsLocked() || !fStakeableCoins || patriotnodeSync.NotCompleted()) {
-                MilliSleep(5000);
+                WaitForNewBestBlock(WITH_LOCK(g_best_block_mutex, return g_best_block), 5000);
                 // Do another check here to ensure fStakeableCoins is updated
                 if (!fStakeableCoins) CheckForCoins(pwallet, &availableCoins);
             }
 
-            //search our map of hashed blocks, see if bestblock has been hashed yet
+            // The kernels were searched already for this block and time slot: sleep until the next
+            // slot begins, or a new block comes in (the coinstake is built before the block, in
+            // CreateNewBlock, so nothing else is done until a kernel is found)
             if (pwallet->pStakerStatus &&
                     pwallet->pStakerStatus->GetLastHash() == pindexPrev->GetBlockHash() &&
                     pwallet->pStakerStatus->GetLastTime() >= GetCurrentTimeSlot()) {
-                MilliSleep(2000);
+                WaitForNewBestBlock(pindexPrev->GetBlockHash(), GetMillisToNextTimeSlot());
                 continue;
             }
 
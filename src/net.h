@@ -24,6 +24,7 @@
 #include "utilstrencodings.h"
 #include "threadinterrupt.h"
 
+#include <array>
 #include <atomic>
 #include <cstdint>
 #include <deque>
@@ -78,6 +79,20 @@ static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -netthreads default: number of threads serving the peer sockets */
+static const int DEFAULT_NET_THREADS = 1;
+/** Maximum number of threads serving the peer sockets */
+static const int MAX_NET_THREADS = 16;
+/** -msgthreads default: number of threads processing the messages of the peers */
+static const int DEFAULT_MSG_THREADS = 1;
+/**
+ * Maximum number of threads processing the messages of the peers. The net_processing state (the sync
+ * counters, the blocks in flight and their sources, the recent rejects, the reconciliation states) is
+ * only guarded for one handler thread, so it stays at one until it is guarded for several.
+ */
+static const int MAX_MSG_THREADS = 1;
+/** Maximum number of queued send buffers handed to the kernel in a single call */
+static const int MAX_SEND_IOVECS = 64;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -116,6 +131,22 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** Serialized bytes queued for sending, shared by all the peers the same message is queued for. */
+typedef std::shared_ptr<const std::vector<unsigned char>> CSendBufferRef;
+
+/**
+ * A message serialized once, header (and checksum) included, that can be queued
+ * for any number of peers without copying or hashing its payload again.
+ */
+struct CSharedNetMsg
+{
+    std::string command;
+    CSendBufferRef header;
+    CSendBufferRef data; // null when the payload is empty
+
+    size_t size() const { return header->size() + (data ? data->size() : 0); }
+};
+
 class NetEventsInterface;
 class CConnman
 {
@@ -141,6 +172,8 @@ public:
         NetEventsInterface* m_msgproc = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nNetThreads = DEFAULT_NET_THREADS;
+        int nMsgThreads = DEFAULT_MSG_THREADS;
         std::vector<bool> m_asmap;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
@@ -155,6 +188,9 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
+    /** Serialize the header of a message, to push the result to several peers. */
+    static CSharedNetMsg MakeSharedMessage(CSerializedNetMsg&& msg);
 
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
@@ -311,9 +347,17 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    /** Process the messages of the peers, in order for each peer: several of these threads
+     *  serve different peers concurrently, and never the same peer at the same time. */
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
-    void ThreadSocketHandler();
+    void DisconnectNodes();
+    void NotifyNumConnectionsChanged(unsigned int& nPrevNodeCount);
+    void InactivityCheck(CNode* pnode);
+    void ServiceNode(CNode* pnode, int nEvents);
+    /** Serve the sockets of the peers whose id is nThread modulo nNetThreads; the first
+     *  thread also accepts new connections and disconnects peers. */
+    void ThreadSocketHandler(int nThread);
     void ThreadDNSAddressSeed();
 
     void WakeMessageHandler();
@@ -364,6 +408,8 @@ private:
 
     unsigned int nSendBufferMaxSize{0};
     unsigned int nReceiveFloodSize{0};
+    int nNetThreads{DEFAULT_NET_THREADS};
+    int nMsgThreads{DEFAULT_MSG_THREADS};
 
     std::vector<ListenSocket> vhListenSocket;
     banmap_t setBanned;
@@ -399,8 +445,8 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0{0}, nSeed1{0};
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake{false};
+    /** Incremented to wake the message processor threads, each one compares it to the value it last saw. */
+    uint64_t nMsgProcWake{0};
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -409,10 +455,10 @@ private:
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
-    std::thread threadSocketHandler;
+    std::vector<std::thread> threadSocketHandlers;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover();
@@ -485,6 +531,20 @@ extern RecursiveMutex cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Times spent processing the messages of one command, counted in buckets of powers of ten
+ *  microseconds: <10us, <100us, <1ms, <10ms, <100ms, <1s and >=1s. */
+struct CMsgProcessTimes
+{
+    static const int BUCKETS = 7;
+
+    uint64_t nCount{0};
+    int64_t nTotalMicros{0};
+    std::array<uint64_t, BUCKETS> vBuckets{};
+
+    void Add(int64_t nMicros);
+};
+typedef std::map<std::string, CMsgProcessTimes> mapMsgCmdProcessTimes; //command, processing times
+
 class CNodeStats
 {
 public:
@@ -504,6 +564,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessTimes mapProcessTimesPerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -569,7 +630,7 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBufferRef> vSendMsg;
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -622,9 +683,12 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Whether a message handler thread is processing this node, which keeps its messages in order
+    std::atomic_bool fMsgProcBusy{false};
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessTimes mapProcessTimesPerMsgCmd; // protected by cs_vProcessMsg
 
     std::vector<std::string> vecRequestsFulfilled; //keep track of what client has asked for
 
@@ -633,8 +697,9 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    RecursiveMutex cs_vAddrToSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_vAddrToSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_vAddrToSend);
     bool fGetAddr;
     std::set<uint256> setKnown;
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -687,6 +752,7 @@ private:
     const int nMyStartingHeight;
     int nSendVersion;
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    int nSocketEventsRegistered{-1};  // Used only by SocketHandler thread
 
     mutable RecursiveMutex cs_addrName;
     std::string addrName;
@@ -722,6 +788,8 @@ public:
     }
 
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete);
+    /** Account the time spent processing a message from this node. */
+    void RecordProcessTime(const std::string& strCommand, int64_t nMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -752,6 +820,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -762,6 +831,7 @@ public:
         // because they require ADDRv2 (BIP155) encoding.
         const bool addr_format_supported = m_wants_addrv2 || _addr.IsAddrV1Compatible();
 
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
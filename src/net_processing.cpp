@@ -6,8 +6,10 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
+#include "index/blockfilterindex.h"
 #include "evo/deterministicmns.h"
 #include "patriotnodeman.h"
 #include "patriotnode-payments.h"
@@ -19,6 +21,8 @@
 #include "primitives/transaction.h"
 #include "sporkdb.h"
 #include "streams.h"
+#include "txorphanage.h"
+#include "txreconciliation.h"
 #include "validation.h"
 #include "util/validation.h"
 
@@ -29,28 +33,12 @@ static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SH
 /** the maximum percentage of addresses from our addrman to return in response to a getaddr message. */
 static constexpr size_t MAX_PCT_ADDR_TO_SEND = 23;
 
-struct IteratorComparator
-{
-    template<typename I>
-    bool operator()(const I& a, const I& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-    size_t list_pos;
-};
-RecursiveMutex g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
-std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
-
-void EraseOrphansFor(NodeId peer);
+/** Maximum number of orphans a peer reconsiders before processing its next message */
+static const unsigned int MAX_ORPHANS_RECONSIDERED_PER_MESSAGE = 10;
+/** Number of headers messages not connecting to our block index a peer is allowed in a row, before it is punished. */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** Number of block index entries without their block data a peer is allowed to have created with its headers. */
+static const size_t MAX_HEADERS_WITHOUT_DATA = MAX_HEADERS_AHEAD + MAX_HEADERS_RESULTS;
 
 // Internal stuff
 namespace {
@@ -58,6 +46,9 @@ namespace {
 /** Number of nodes with fSyncStarted. */
 int nSyncStarted = 0;
 
+/** Number of nodes with fHeadersSyncStarted. */
+int nHeadersSyncStarted = 0;
+
 /**
  * Sources of received blocks, to be able to send them reject messages or ban
  * them, if processing happens afterwards. Protected by cs_main.
@@ -87,6 +78,12 @@ std::map<uint256, NodeId> mapBlockSource;
 std::unique_ptr<CRollingBloomFilter> recentRejects;
 uint256 hashRecentRejectsChainTip;
 
+/** Reconciliation state of the peers we announce transactions to through set reconciliation, null unless -txreconciliation. */
+std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
+
+/** Transactions we received with missing inputs */
+TxOrphanage g_orphanage;
+
 /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
 struct QueuedBlock {
     uint256 hash;
@@ -94,6 +91,7 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //! Optional, used for compact blocks.
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -103,6 +101,72 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/**
+ * Blocks received ahead of their parent during parallel download, keyed by the hash of the
+ * parent. Their stake can only be checked against the parent's stake modifier, so they are
+ * processed as soon as it is accepted. Protected by cs_main.
+ */
+struct BlockAwaitingParent {
+    uint256 hash;
+    NodeId nodeid;
+    std::shared_ptr<const CBlock> pblock;
+    size_t nSize;
+};
+std::map<uint256, BlockAwaitingParent> mapBlocksAwaitingParent;
+
+/** Total size of the blocks in mapBlocksAwaitingParent. */
+size_t nBlocksAwaitingParentSize = 0;
+
+/** Peers we asked to announce new blocks with cmpctblock messages, the oldest first. Protected by cs_main. */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+/** The most recently connected block, and its compact encoding once built, for block announcements. */
+Mutex cs_most_recent_block;
+uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+
+/**
+ * The block and cmpctblock messages served last, serialized once per block, command
+ * and send version, and queued as they are for every peer asking for the same block.
+ */
+class CSerializedBlockCache
+{
+private:
+    typedef std::tuple<uint256, int, std::string> Key; // block hash, send version, command
+
+    Mutex cs;
+    // The most recently used first
+    std::list<std::pair<Key, CSharedNetMsg>> lEntries GUARDED_BY(cs);
+    const size_t nMaxEntries;
+
+public:
+    explicit CSerializedBlockCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn) {}
+
+    bool Get(const uint256& hash, int nVersion, const std::string& strCommand, CSharedNetMsg& msg)
+    {
+        const Key key(hash, nVersion, strCommand);
+        LOCK(cs);
+        for (auto it = lEntries.begin(); it != lEntries.end(); ++it) {
+            if (it->first == key) {
+                lEntries.splice(lEntries.begin(), lEntries, it);
+                msg = it->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Put(const uint256& hash, int nVersion, const CSharedNetMsg& msg)
+    {
+        LOCK(cs);
+        lEntries.emplace_front(Key(hash, nVersion, msg.command), msg);
+        if (lEntries.size() > nMaxEntries)
+            lEntries.pop_back();
+    }
+};
+CSerializedBlockCache serializedBlockCache(MAX_SERIALIZED_BLOCK_CACHE_ENTRIES);
+
 } // anon namespace
 
 namespace
@@ -205,14 +269,28 @@ struct CNodeState {
     uint256 hashLastUnknownBlock;
     //! The last full block we both have.
     const CBlockIndex* pindexLastCommonBlock;
-    //! Whether we've started headers synchronization with this peer.
+    //! Whether we've started block synchronization with this peer.
     bool fSyncStarted;
+    //! Whether that synchronization fetches headers (instead of walking the chain with getblocks).
+    bool fHeadersSyncStarted;
+    //! Length of the current run of headers messages from this peer not connecting to our block index.
+    int nUnconnectingHeaders;
+    //! Whether the peer has more headers we didn't accept yet, being MAX_HEADERS_AHEAD of the active chain.
+    bool fHeadersAheadPending;
+    //! The block index entries created from this peer's headers, whose block data we may not have yet.
+    std::vector<const CBlockIndex*> vHeadersWithoutData;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     std::list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
+    //! How many blocks can be in flight from this peer at any given time.
+    int nBlocksInFlightLimit;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants cmpctblocks instead of invs for block announcements.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us cmpctblocks if we request them.
+    bool fProvidesHeaderAndIDs;
 
     CNodeBlocks nodeBlocks;
 
@@ -224,9 +302,15 @@ struct CNodeState {
         hashLastUnknownBlock.SetNull();
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
+        fHeadersSyncStarted = false;
+        nUnconnectingHeaders = 0;
+        fHeadersAheadPending = false;
         nStallingSince = 0;
         nBlocksInFlight = 0;
+        nBlocksInFlightLimit = DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -288,7 +372,7 @@ void MarkBlockAsReceived(const uint256& hash)
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
+std::list<QueuedBlock>::iterator MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
 {
     CNodeState* state = State(nodeid);
     assert(state != nullptr);
@@ -296,11 +380,139 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL};
+    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL, nullptr};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), std::move(newentry));
     state->nBlocksInFlight++;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    return it;
+}
+
+// Requires cs_main.
+/** Ask a peer that just delivered a new block to announce the next ones with cmpctblock messages
+ *  (BIP152 high-bandwidth mode), dropping the oldest such peer beyond MAX_HIGH_BANDWIDTH_CMPCT_PEERS. */
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman)
+{
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs)
+        return;
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    connman->ForNode(nodeid, [connman](CNode* pfrom) {
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_HIGH_BANDWIDTH_CMPCT_PEERS) {
+            connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman](CNode* pnodeStop) {
+                connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+                return true;
+            });
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, true, CMPCTBLOCKS_VERSION));
+        lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        return true;
+    });
+}
+
+/** The compact encoding of the most recently connected block, if that is the given one. */
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> GetMostRecentCompactBlock(const uint256& hash)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hash)
+        return nullptr;
+    if (!most_recent_compact_block)
+        most_recent_compact_block = std::make_shared<const CBlockHeaderAndShortTxIDs>(*most_recent_block);
+    return most_recent_compact_block;
+}
+
+// Requires cs_main.
+/** Adapt the number of blocks that can be in flight from a peer: add one for every block it
+ *  delivers, halve it when it stalls the download window. */
+void UpdateBlocksInFlightLimit(CNodeState* state, bool fStalling)
+{
+    if (fStalling) {
+        state->nBlocksInFlightLimit = std::max(state->nBlocksInFlightLimit / 2, MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    } else {
+        state->nBlocksInFlightLimit = std::min(state->nBlocksInFlightLimit + 1, MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    }
+}
+
+// Requires cs_main.
+bool IsBlockAwaitingParent(const CBlockIndex* pindex)
+{
+    if (pindex->pprev == nullptr)
+        return false;
+    auto it = mapBlocksAwaitingParent.find(pindex->pprev->GetBlockHash());
+    return it != mapBlocksAwaitingParent.end() && it->second.hash == pindex->GetBlockHash();
+}
+
+// Requires cs_main.
+/** Keep a block whose parent hasn't been received yet. Returns false if there is no room for it,
+ *  in which case it will be requested again once the download window reaches it. */
+bool AddBlockAwaitingParent(NodeId nodeid, const std::shared_ptr<const CBlock>& pblock)
+{
+    if (mapBlocksAwaitingParent.count(pblock->hashPrevBlock))
+        return false;
+    size_t nSize = GetSerializeSize(*pblock, PROTOCOL_VERSION);
+    if (nBlocksAwaitingParentSize + nSize > MAX_BLOCKS_AWAITING_PARENT_SIZE)
+        return false;
+    mapBlocksAwaitingParent.emplace(pblock->hashPrevBlock, BlockAwaitingParent{pblock->GetHash(), nodeid, pblock, nSize});
+    nBlocksAwaitingParentSize += nSize;
+    return true;
+}
+
+// Requires cs_main.
+/** Take the block waiting for the given parent, if any. */
+std::shared_ptr<const CBlock> TakeBlockAwaitingParent(const uint256& hashParent, NodeId& nodeid)
+{
+    auto it = mapBlocksAwaitingParent.find(hashParent);
+    if (it == mapBlocksAwaitingParent.end())
+        return nullptr;
+    std::shared_ptr<const CBlock> pblock = it->second.pblock;
+    nodeid = it->second.nodeid;
+    nBlocksAwaitingParentSize -= it->second.nSize;
+    mapBlocksAwaitingParent.erase(it);
+    return pblock;
+}
+
+// Requires cs_main.
+/** Whether our tip is recent enough to fetch announced blocks directly, instead of through the block download window. */
+bool CanDirectFetch()
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().GetConsensus().nTargetSpacing * 20;
+}
+
+/** Process the blocks that were received ahead of the given one, now that it has been processed. */
+void ProcessBlocksAwaitingParent(uint256 hashParent)
+{
+    AssertLockNotHeld(cs_main);
+    while (true) {
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashParent);
+            if (mi == mapBlockIndex.end())
+                return;
+            NodeId nodeid;
+            if (mi->second->nStatus & BLOCK_FAILED_MASK) {
+                // The descendants of an invalid block are invalid as well
+                while ((pblock = TakeBlockAwaitingParent(hashParent, nodeid)))
+                    hashParent = pblock->GetHash();
+                return;
+            }
+            if (!(mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)))
+                return;
+            pblock = TakeBlockAwaitingParent(hashParent, nodeid);
+            if (!pblock)
+                return;
+            mapBlockSource.emplace(pblock->GetHash(), nodeid);
+        }
+        ProcessNewBlock(pblock, nullptr);
+        hashParent = pblock->GetHash();
+    }
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -397,10 +609,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
-            } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
+            } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0 && !IsBlockAwaitingParent(pindex)) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
@@ -444,6 +656,9 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
 
     if (state->fSyncStarted)
         nSyncStarted--;
+    if (state->fHeadersSyncStarted)
+        nHeadersSyncStarted--;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
@@ -451,8 +666,12 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
 
     for (const QueuedBlock& entry : state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
-    EraseOrphansFor(nodeid);
+    {
+        LOCK(g_cs_orphans);
+        g_orphanage.EraseForPeer(nodeid);
+    }
     nPreferredDownload -= state->fPreferredDownload;
+    if (g_txreconciliation) g_txreconciliation->ForgetPeer(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -466,128 +685,15 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlocksInFlightLimit = state->nBlocksInFlightLimit;
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.fTxReconciliation = g_txreconciliation && g_txreconciliation->IsPeerRegistered(nodeid);
     return true;
 }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// mapOrphanTransactions
-//
-
-bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    const uint256& hash = tx->GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 25 orphans, each of which is at most 400,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = tx->GetTotalSize();
-    unsigned int nMaxSize = tx->IsShieldedTx() ? MAX_TX_SIZE_AFTER_SAPLING : MAX_STANDARD_TX_SIZE;
-    if (sz >= nMaxSize) {
-        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size()});
-    assert(ret.second);
-    g_orphan_list.emplace_back(ret.first);
-    for (const CTxIn& txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
-
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-        mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return 0;
-    for (const CTxIn& txin : it->second.tx->vin) {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-
-    size_t old_pos = it->second.list_pos;
-    assert(g_orphan_list[old_pos] == it);
-    if (old_pos + 1 != g_orphan_list.size()) {
-        // Unless we're deleting the last entry in g_orphan_list, move the last
-        // entry to the position we're deleting.
-        auto it_last = g_orphan_list.back();
-        g_orphan_list[old_pos] = it_last;
-        it_last->second.list_pos = old_pos;
-    }
-    g_orphan_list.pop_back();
-
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    LOCK(g_cs_orphans);
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer) {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-        }
-    }
-    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer %d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-{
-    LOCK(g_cs_orphans);
-
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        auto iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end()) {
-            auto maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-            } else {
-                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
-    }
-    FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(g_orphan_list.size());
-        EraseOrphanTx(g_orphan_list[randompos]->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch, const std::string& message) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -658,37 +764,22 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
 {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        g_txreconciliation.reset(new TxReconciliationTracker());
+    }
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
-    LOCK(g_cs_orphans);
-
-    std::vector<uint256> vOrphanErase;
-
-    for (const CTransactionRef& ptx : pblock->vtx) {
-        const CTransaction& tx = *ptx;
-
-        // Which orphan pool entries must we evict?
-        for (size_t j = 0; j < tx.vin.size(); j++) {
-            auto itByPrev = mapOrphanTransactionsByPrev.find(tx.vin[j].prevout);
-            if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
-            for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                const CTransaction& orphanTx = *(*mi)->second.tx;
-                const uint256& orphanHash = orphanTx.GetHash();
-                vOrphanErase.emplace_back(orphanHash);
-            }
-        }
+    {
+        LOCK(cs_most_recent_block);
+        most_recent_block_hash = pindex->GetBlockHash();
+        most_recent_block = pblock;
+        most_recent_compact_block.reset();
     }
 
-    // Erase orphan transactions include or precluded by this block
-    if (!vOrphanErase.empty()) {
-        int nErased = 0;
-        for (uint256& orphanHash : vOrphanErase) {
-            nErased += EraseOrphanTx(orphanHash);
-        }
-        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
-    }
+    LOCK(g_cs_orphans);
+    g_orphanage.EraseForBlock(*pblock);
 }
 
 void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
@@ -727,6 +818,11 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
             // Spam filter
             CheckBlockSpam(it->second, block.GetHash());
         }
+    } else if (state.IsValid() && !IsInitialBlockDownload() && it != mapBlockSource.end() &&
+               mapBlocksInFlight.count(hash) == mapBlocksInFlight.size()) {
+        // The peer gave us a new tip while we weren't downloading anything else:
+        // a good candidate to announce the next blocks to us as compact blocks.
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, connman);
     }
 
     if (it != mapBlockSource.end())
@@ -754,7 +850,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
         {
             LOCK(g_cs_orphans);
-            if (mapOrphanTransactions.count(inv.hash)) return true;
+            if (g_orphanage.HaveTx(inv.hash)) return true;
         }
 
         return recentRejects->contains(inv.hash) ||
@@ -763,8 +859,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
 
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash);
+    case MSG_BLOCK: {
+        // Headers received ahead of the block data don't count
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        return mi != mapBlockIndex.end() && (mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID | BLOCK_FAILED_MASK));
+    }
     case MSG_TXLOCK_REQUEST:
         // deprecated
         return true;
@@ -937,6 +1036,18 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+// Requires cs_main.
+bool static BlockRequestAllowed(const CBlockIndex* pindex)
+{
+    if (chainActive.Contains(pindex))
+        return true;
+    // To prevent fingerprinting attacks, only serve blocks outside of the active
+    // chain if they are valid, and no more than a max reorg depth than the best header
+    // chain we know about.
+    return pindex->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+           (chainActive.Height() - pindex->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -945,29 +1056,36 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     bool send = false;
     BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
     if (mi != mapBlockIndex.end()) {
-        if (chainActive.Contains(mi->second)) {
-            send = true;
-        } else {
-            // To prevent fingerprinting attacks, only send blocks outside of the active
-            // chain if they are valid, and no more than a max reorg depth than the best header
-            // chain we know about.
-            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                   (chainActive.Height() - mi->second->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
-            if (!send) {
-                LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
-            }
+        send = BlockRequestAllowed(mi->second);
+        if (!send) {
+            LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
         }
     }
     // Don't send not-validated blocks
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-        // Send block from disk
-        CBlock block;
-        if (!ReadBlockFromDisk(block, (*mi).second))
-            assert(!"cannot load block from disk");
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        if (inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
+            // Deeper blocks are sent in full: the peer wouldn't have their transactions anyway
+            const bool fCompact = inv.type == MSG_CMPCT_BLOCK && chainActive.Height() - mi->second->nHeight <= MAX_CMPCTBLOCK_DEPTH;
+            const std::string strCommand = fCompact ? NetMsgType::CMPCTBLOCK : NetMsgType::BLOCK;
+            // Serialize the block once for all the peers asking for it
+            CSharedNetMsg msg;
+            if (!serializedBlockCache.Get(inv.hash, pfrom->GetSendVersion(), strCommand, msg)) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, (*mi).second))
+                    assert(!"cannot load block from disk");
+                if (fCompact)
+                    msg = CConnman::MakeSharedMessage(msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+                else
+                    msg = CConnman::MakeSharedMessage(msgMaker.Make(NetMsgType::BLOCK, block));
+                serializedBlockCache.Put(inv.hash, pfrom->GetSendVersion(), msg);
+            }
+            connman->PushMessage(pfrom, msg);
+        }
         else // MSG_FILTERED_BLOCK)
         {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, (*mi).second))
+                assert(!"cannot load block from disk");
             bool send_ = false;
             CMerkleBlock merkleBlock;
             {
@@ -1068,7 +1186,7 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     if (it != pfrom->vRecvGetData.end()) {
         const CInv &inv = *it;
         it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
     }
@@ -1087,7 +1205,373 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     }
 }
 
-bool fRequestedSporksIDB = false;
+/** Hand a block received from a peer (in full, or reconstructed from a compact block) over to
+ *  validation, or keep it until its parent arrives. The parent must be in the block index. */
+void static ProcessReceivedBlock(CNode* pfrom, const std::shared_ptr<CBlock>& pblock)
+{
+    const uint256& hashBlock = pblock->GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
+    bool fNewBlock = false;
+    bool fAwaitingParent = false;
+    {
+        LOCK(cs_main);
+        fNewBlock = !AlreadyHave(inv);
+        if (fNewBlock) {
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId())
+                UpdateBlocksInFlightLimit(State(pfrom->GetId()), false);
+            MarkBlockAsReceived(hashBlock);
+            if (!(mapBlockIndex.at(pblock->hashPrevBlock)->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID))) {
+                // Received ahead of its parent, which is still being downloaded
+                fAwaitingParent = AddBlockAwaitingParent(pfrom->GetId(), pblock);
+                fNewBlock = false;
+            } else {
+                mapBlockSource.emplace(hashBlock, pfrom->GetId());
+            }
+        }
+    }
+    if (fNewBlock) {
+        ProcessNewBlock(pblock, nullptr);
+        ProcessBlocksAwaitingParent(hashBlock);
+
+        // Disconnect node if its running an old protocol version,
+        // used during upgrades, when the node is already connected.
+        pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol());
+    } else if (fAwaitingParent) {
+        LogPrint(BCLog::NET, "%s : Block %s received ahead of its parent, waiting for it\n", __func__, hashBlock.GetHex());
+    } else {
+        LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, hashBlock.GetHex());
+    }
+}
+
+/**
+ * Add the headers of a peer to the block index. The new entries stay there with their difficulty
+ * checked only, until their blocks arrive: a peer getting more than MAX_HEADERS_WITHOUT_DATA of these
+ * (more than the headers accepted MAX_HEADERS_AHEAD of the active chain, and a full headers message)
+ * is banned, and its headers refused.
+ */
+static bool ProcessPeerHeaders(NodeId nodeid, const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<const CBlockIndex*>& vWithoutData = State(nodeid)->vHeadersWithoutData;
+    vWithoutData.erase(std::remove_if(vWithoutData.begin(), vWithoutData.end(), [](const CBlockIndex* pindex) {
+        return pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID);
+    }), vWithoutData.end());
+
+    std::vector<uint256> vNewHashes;
+    for (const CBlockHeader& header : headers) {
+        const uint256 hash = header.GetHash();
+        if (!mapBlockIndex.count(hash))
+            vNewHashes.push_back(hash);
+    }
+    if (vWithoutData.size() + vNewHashes.size() > MAX_HEADERS_WITHOUT_DATA) {
+        return state.DoS(100, error("%s : peer=%d has %u headers without block data", __func__, nodeid, vWithoutData.size() + vNewHashes.size()),
+                         REJECT_INVALID, "too-many-headers-without-data");
+    }
+
+    const bool fAccepted = ProcessNewBlockHeaders(headers, state, ppindex);
+    for (const uint256& hash : vNewHashes) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it != mapBlockIndex.end())
+            vWithoutData.push_back(it->second);
+    }
+    return fAccepted;
+}
+
+/** The orphan transactions, as extra candidates for the reconstruction of compact blocks. */
+std::vector<std::pair<uint256, CTransactionRef>> static GetOrphanTransactionsForReconstruction()
+{
+    LOCK(g_cs_orphans);
+    return g_orphanage.GetAll();
+}
+
+std::atomic<bool> fRequestedSporksIDB{false};
+
+/**
+ * Tier two messages are processed one at a time: with several message handler threads, the
+ * sync state of the patriotnode, budget and spork managers would otherwise be updated
+ * concurrently. They aren't dispatched under cs_main, but the handlers still take it briefly: to
+ * punish the peer (Misbehaving), to clear the inv request (mapAlreadyAskedFor) and to look up
+ * collaterals in the chain.
+ */
+RecursiveMutex cs_tiertwo_messages;
+/**
+ * Validates a getcfilters/getcfheaders/getcfcheckpt request: the node must serve
+ * block filters of the type, and the stop block must be known and allowed to be
+ * served. Peers sending invalid requests are disconnected.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type,
+                                      uint32_t start_height, const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC_FILTER &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (mi == mapBlockIndex.end() || !BlockRequestAllowed(mi->second)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        stop_index = mi->second;
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    for (const auto& filter : filters) {
+        CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+            .Make(NetMsgType::CFILTER, filter);
+        connman->PushMessage(pfrom, std::move(msg));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFHEADERS,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              prev_header,
+              filter_hashes);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFCHECKPT,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              headers);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Announce the transactions a reconciliation found the peer misses, skipping the ones it
+ * announced to us in the meantime and the ones no longer in the mempool.
+ */
+static void AnnounceReconciledTransactions(CNode* pto, const std::vector<uint256>& vTxid, CConnman* connman)
+{
+    CNetMsgMaker msgMaker(pto->GetSendVersion());
+    std::vector<CInv> vInv;
+    {
+        LOCK(pto->cs_inventory);
+        for (const uint256& txid : vTxid) {
+            if (pto->filterInventoryKnown.contains(txid) || !mempool.exists(txid)) continue;
+            pto->filterInventoryKnown.insert(txid);
+            vInv.emplace_back(MSG_TX, txid);
+            if (vInv.size() == MAX_INV_SZ) {
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                vInv.clear();
+            }
+        }
+    }
+    if (!vInv.empty())
+        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
+/**
+ * Reconsider the orphans received from a peer whose parents were accepted in the meantime, at
+ * most MAX_ORPHANS_RECONSIDERED_PER_MESSAGE of them: the children of a transaction are processed
+ * in batches, between the messages of the peers which sent them.
+ */
+static void ProcessOrphanTx(NodeId peer, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+
+    for (unsigned int i = 0; i < MAX_ORPHANS_RECONSIDERED_PER_MESSAGE; i++) {
+        const CTransactionRef porphanTx = g_orphanage.GetTxToReconsider(peer);
+        if (!porphanTx)
+            break;
+        const uint256& orphanHash = porphanTx->GetHash();
+        bool fMissingInputs2 = false;
+        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+        // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+        // anyone relaying LegitTxX banned)
+        CValidationState stateDummy;
+
+        if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2)) {
+            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+            RelayTransaction(*porphanTx, connman);
+            g_orphanage.AddChildrenToWorkSet(*porphanTx);
+            g_orphanage.EraseTx(orphanHash);
+        } else if (!fMissingInputs2) {
+            int nDos = 0;
+            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
+                // Punish peer that gave us an invalid orphan tx
+                Misbehaving(peer, nDos);
+                LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+            }
+            // Has inputs but not accepted to mempool
+            // Probably non-standard or insufficient fee
+            LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+            g_orphanage.EraseTx(orphanHash);
+            assert(recentRejects);
+            recentRejects->insert(orphanHash);
+        }
+        mempool.check(pcoinsTip.get());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1169,6 +1653,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             connman->PushMessage(pfrom, msg_maker.Make(NetMsgType::SENDADDRV2));
         }
 
+        if (g_txreconciliation) {
+            // Offer to reconcile the transactions we announce; the peers not knowing sendtxiblt ignore it.
+            const uint64_t recon_salt = g_txreconciliation->PreRegisterPeer(pfrom->GetId());
+            connman->PushMessage(pfrom, msg_maker.Make(NetMsgType::SENDTXIBLT, TXRECONCILIATION_VERSION, recon_salt));
+        }
+
         connman->PushMessage(pfrom, msg_maker.Make(NetMsgType::VERACK));
 
         pfrom->nServices = nServices;
@@ -1288,6 +1778,25 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
                   (fLogIPs ? strprintf(", peeraddr=%s", pfrom->addr.ToString()) : ""));
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell the peer we understand compact blocks; we only ask the ones that
+            // deliver new blocks first to announce them that way (see BlockChecked).
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
     }
 
 
@@ -1377,9 +1886,23 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    if (pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+                        // First request the headers preceding the announced block. In the normal fully-synced
+                        // case, this is just the announced block itself; otherwise the block download picks
+                        // up the missing blocks from all the peers that have them.
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                        CNodeState* nodestate = State(pfrom->GetId());
+                        if (CanDirectFetch() && nodestate->nBlocksInFlight < nodestate->nBlocksInFlightLimit) {
+                            // Ask for a compact block when the peer can send one, most of its transactions are in our mempool
+                            vToFetch.emplace_back(nodestate->fProvidesHeaderAndIDs ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                        LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    }
                 }
             } else {
                 // Allowed inv request types while we are in IBD
@@ -1424,7 +1947,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    else if (strCommand == NetMsgType::GETBLOCKS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -1462,21 +1985,23 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
 
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
+        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+            LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->GetId());
             return true;
+        }
 
         CBlockIndex* pindex = NULL;
         if (locator.IsNull()) {
@@ -1495,7 +2020,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->GetId());
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -1506,8 +2031,6 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
 
     else if (strCommand == NetMsgType::TX) {
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransaction tx(deserialize, vRecv);
         CTransactionRef ptx = MakeTransactionRef(tx);
 
@@ -1532,63 +2055,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
             mempool.check(pcoinsTip.get());
             RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
+            g_orphanage.AddChildrenToWorkSet(tx);
 
             LogPrint(BCLog::MEMPOOL, "%s : peer=%d %s : accepted %s (poolsz %u txn, %u kB)\n",
                     __func__, pfrom->GetId(), pfrom->cleanSubVer, tx.GetHash().ToString(),
                     mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const CTransactionRef& orphanTx = (*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx->GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(*orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx->vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
-                    } else if (!fMissingInputs2) {
-                        int nDos = 0;
-                        if(stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee
-                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip.get());
-                }
-            }
-
-            for (uint256& hash : vEraseQueue) EraseOrphanTx(hash);
+            // Process the orphan transactions of this peer that depended on this one, the
+            // others are processed between the next messages of their peers
+            ProcessOrphanTx(pfrom->GetId(), connman);
 
         } else if (fMissingInputs) {
             bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
@@ -1615,13 +2090,14 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     pfrom->AddInventoryKnown(_inv);
                     if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
                 }
-                AddOrphanTx(ptx, pfrom->GetId());
+                g_orphanage.AddTx(ptx, pfrom->GetId());
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+                // DoS prevention: do not allow the orphan pool to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                size_t nMaxOrphanSize = (size_t)std::max((int64_t)0, gArgs.GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * 1000;
+                unsigned int nEvicted = g_orphanage.LimitOrphans(nMaxOrphanTx, nMaxOrphanSize);
                 if (nEvicted > 0)
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+                    LogPrint(BCLog::MEMPOOL, "orphan pool overflow, removed %u tx\n", nEvicted);
             } else {
                 LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
             }
@@ -1656,7 +2132,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
     }
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -1673,44 +2149,69 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = NULL;
+
+        LOCK(cs_main);
+
+        uint256 hashLastBlock;
         for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+            if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
                 Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
                 return false;
             }
+            hashLastBlock = header.GetHash();
+        }
+
+        CNodeState* nodestate = State(pfrom->GetId());
+        BlockMap::iterator miPrev = mapBlockIndex.find(headers[0].hashPrevBlock);
+        if (miPrev == mapBlockIndex.end()) {
+            // The headers don't connect to our block index (e.g. an announcement made while we are
+            // far behind); ask for the ones in between. A peer keeping on sending such headers is
+            // made to pay for the getheaders.
+            LogPrint(BCLog::NET, "unconnecting headers, getheaders (%d) to peer=%d\n", pindexBestHeader->nHeight, pfrom->GetId());
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+            if (++nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
+                Misbehaving(pfrom->GetId(), 20, strprintf("%d non-connecting headers", nodestate->nUnconnectingHeaders));
+            }
+            return true;
+        }
+        nodestate->nUnconnectingHeaders = 0;
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0) {
-                        Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
-                    } else {
-                        LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
-                    }
-                    return false;
+        // Only the headers up to MAX_HEADERS_AHEAD of the active chain are accepted, the rest are
+        // asked for again once the blocks caught up
+        const int nMaxHeaders = chainActive.Height() + MAX_HEADERS_AHEAD - miPrev->second->nHeight;
+        if ((int)headers.size() > nMaxHeaders) {
+            LogPrint(BCLog::NET, "headers from peer=%d too far ahead of the active chain (%d), accepting %d of %u\n",
+                     pfrom->GetId(), chainActive.Height(), std::max(nMaxHeaders, 0), headers.size());
+            headers.resize(std::max(nMaxHeaders, 0));
+            nodestate->fHeadersAheadPending = true;
+            if (headers.empty()) return true;
+        }
+
+        CValidationState state;
+        const CBlockIndex* pindexLast = nullptr;
+        if (!ProcessPeerHeaders(pfrom->GetId(), headers, state, &pindexLast)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
+                } else {
+                    LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
                 }
+                return false;
             }
         }
 
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !nodestate->fHeadersAheadPending) {
             // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
+            // The block download window fetches the bodies of these from all peers meanwhile.
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
     }
@@ -1725,6 +2226,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+            if (pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+                // Ask for the headers leading to it, the block download takes it from there
+                CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(pindexBestHeader););
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, locator, hashBlock));
+                return true;
+            }
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1736,22 +2243,171 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 pfrom->vBlockRequested.emplace_back(hashBlock);
             }
         } else {
-            pfrom->AddInventoryKnown(inv);
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
-                    MarkBlockAsReceived(hashBlock);
-                    mapBlockSource.emplace(hashBlock, pfrom->GetId());
+            ProcessReceivedBlock(pfrom, pblock);
+        }
+    }
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint(BCLog::NET, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->GetId());
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                // Ask for the headers leading to it, the block download takes it from there
+                if (!IsInitialBlockDownload())
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hashBlock));
+                return true;
+            }
+
+            CValidationState state;
+            const CBlockIndex* pindex = nullptr;
+            if (!ProcessPeerHeaders(pfrom->GetId(), {cmpctblock.header}, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0) {
+                        Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
+                    } else {
+                        LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
+                    }
+                    return true;
                 }
-                ProcessNewBlock(pblock, nullptr);
+            }
+            if (!pindex)
+                return true;
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
 
-                // Disconnect node if its running an old protocol version,
-                // used during upgrades, when the node is already connected.
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol());
-            } else {
-                LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
+            // Blocks we have, and blocks beyond a parent we don't have yet, are left to the block download
+            if ((pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)) ||
+                    !(pindex->pprev->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)) || !CanDirectFetch())
+                return true;
+
+            CNodeState* nodestate = State(pfrom->GetId());
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end()) {
+                // Requested from another peer, or already being reconstructed
+                if (itInFlight->second.first != pfrom->GetId() || itInFlight->second.second->partialBlock)
+                    return true;
+            } else if (nodestate->nBlocksInFlight >= nodestate->nBlocksInFlightLimit) {
+                return true;
+            }
+
+            std::list<QueuedBlock>::iterator itQueued = MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex);
+            itQueued->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            PartiallyDownloadedBlock& partialBlock = *itQueued->partialBlock;
+            ReadStatus status = partialBlock.InitData(cmpctblock, GetOrphanTransactionsForReconstruction());
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hashBlock); // Reset in-flight state in case Misbehaving does not result in a disconnect
+                Misbehaving(pfrom->GetId(), 100, "invalid compact block");
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            if (status == READ_STATUS_OK) {
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock.IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (!req.indexes.empty()) {
+                    req.blockhash = hashBlock;
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                    return true;
+                }
+                status = partialBlock.FillBlock(*pblock, std::vector<CTransactionRef>());
+            }
+            if (status != READ_STATUS_OK) {
+                // Short ID collision: the block stays in flight, ask for it in full
+                itQueued->partialBlock.reset();
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>(1, CInv(MSG_BLOCK, hashBlock))));
+                return true;
+            }
+        }
+        ProcessReceivedBlock(pfrom, pblock);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block_hash == req.blockhash)
+                pblock = most_recent_block;
+        }
+        if (!pblock) {
+            bool fTooDeep = false;
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+                if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                    LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+                    return true;
+                }
+                fTooDeep = mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH;
+                if (!fTooDeep) {
+                    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                    if (!ReadBlockFromDisk(*pblockRead, mi->second))
+                        assert(!"cannot load block from disk");
+                    pblock = pblockRead;
+                }
+            }
+            if (fTooDeep) {
+                // Nobody reconstructs blocks this old: answer as for a getdata, with the full block
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+                ProcessGetBlockData(pfrom, CInv(MSG_BLOCK, req.blockhash), connman, interruptMsgProc);
+                return true;
+            }
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= pblock->vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100, strprintf("out-of-bound tx index in getblocktxn (%u)", req.indexes[i]));
+                return false;
             }
+            resp.txn[i] = pblock->vtx[req.indexes[i]];
         }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() ||
+                    !itInFlight->second.second->partialBlock) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            ReadStatus status = itInFlight->second.second->partialBlock->FillBlock(*pblock, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case Misbehaving does not result in a disconnect
+                Misbehaving(pfrom->GetId(), 100, "invalid compact block/non-matching block transactions");
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Short ID collision: the block stays in flight, ask for it in full
+                itInFlight->second.second->partialBlock.reset();
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash))));
+                return true;
+            }
+        }
+        ProcessReceivedBlock(pfrom, pblock);
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -1760,7 +2416,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     // Making users (which are behind NAT and can only make outgoing connections) ignore
     // getaddr message mitigates the attack.
     else if ((strCommand == NetMsgType::GETADDR) && (pfrom->fInbound)) {
-        pfrom->vAddrToSend.clear();
+        WITH_LOCK(pfrom->cs_vAddrToSend, pfrom->vAddrToSend.clear());
         std::vector<CAddress> vAddr = connman->GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND, /* network */ nullopt);
         FastRandomContext insecure_rand;
         for (const CAddress& addr : vAddr)
@@ -1913,10 +2569,82 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         pfrom->fRelayTxes = true;
     }
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::SENDTXIBLT) {
+        uint32_t nReconVersion;
+        uint64_t remote_salt;
+        vRecv >> nReconVersion >> remote_salt;
+        if (pfrom->fSuccessfullyConnected) {
+            // sendtxiblt is only valid before the verack
+            LogPrint(BCLog::NET, "sendtxiblt received after verack from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        if (g_txreconciliation) {
+            const bool fRegistered = g_txreconciliation->RegisterPeer(pfrom->GetId(), pfrom->fInbound,
+                                                                      std::min(nReconVersion, TXRECONCILIATION_VERSION), remote_salt);
+            LogPrint(BCLog::NET, "peer=%d %s transaction reconciliation\n", pfrom->GetId(), fRegistered ? "uses" : "can't use");
+        }
+    }
+
+    else if (strCommand == NetMsgType::REQTXIBLT) {
+        uint16_t remote_set_size, q;
+        vRecv >> remote_set_size >> q;
+        ReconciliationSketch sketch;
+        if (!g_txreconciliation || !g_txreconciliation->HandleRequest(pfrom->GetId(), GetTime<std::chrono::microseconds>(), remote_set_size, q, sketch)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10, "unexpected reqtxiblt");
+            return false;
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+    }
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        ReconciliationSketch sketch;
+        vRecv >> sketch;
+        bool fSuccess;
+        std::vector<uint256> vToAnnounce;
+        std::vector<uint32_t> vAskShortIDs;
+        if (!g_txreconciliation || !g_txreconciliation->HandleSketch(pfrom->GetId(), sketch, fSuccess, vToAnnounce, vAskShortIDs)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10, "unexpected sketch");
+            return false;
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: %u to announce, %u to ask\n", pfrom->GetId(),
+                 fSuccess ? "succeeded" : "failed", vToAnnounce.size(), vAskShortIDs.size());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vAskShortIDs));
+        AnnounceReconciledTransactions(pfrom, vToAnnounce, connman);
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess;
+        std::vector<uint32_t> vAskShortIDs;
+        vRecv >> fSuccess >> vAskShortIDs;
+        std::vector<uint256> vToAnnounce;
+        if (!g_txreconciliation || !g_txreconciliation->HandleReconciliationDifference(pfrom->GetId(), fSuccess, vAskShortIDs, vToAnnounce)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10, "unexpected reconcildiff");
+            return false;
+        }
+        AnnounceReconciledTransactions(pfrom, vToAnnounce, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
     else {
         // Tier two msg type search
         const std::vector<std::string>& allMessages = getTierTwoNetMessageTypes();
         if (std::find(allMessages.begin(), allMessages.end(), strCommand) != allMessages.end()) {
+            LOCK(cs_tiertwo_messages);
             // Check if the dispatcher can process this message first. If not, try going with the old flow.
             if (!patriotnodeSync.MessageDispatcher(pfrom, strCommand, vRecv)) {
                 // Probably one the extensions
@@ -1950,12 +2678,28 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, connman, interruptMsgProc);
 
+    bool fHaveOrphans;
+    {
+        LOCK(g_cs_orphans);
+        fHaveOrphans = g_orphanage.HaveTxToReconsider(pfrom->GetId());
+    }
+    if (fHaveOrphans) {
+        LOCK2(cs_main, g_cs_orphans);
+        ProcessOrphanTx(pfrom->GetId(), connman);
+    }
+
     if (pfrom->fDisconnect)
         return false;
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return true;
 
+    // and keeps the orphans of the peer from delaying the others' messages
+    {
+        LOCK(g_cs_orphans);
+        if (g_orphanage.HaveTxToReconsider(pfrom->GetId())) return true;
+    }
+
     // Don't bother if send buffer is too full to respond anyway
     if (pfrom->fPauseSend)
         return false;
@@ -2006,6 +2750,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
         if (interruptMsgProc)
@@ -2027,6 +2772,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         PrintExceptionContinue(NULL, "ProcessMessages()");
     }
+    pfrom->RecordProcessTime(strCommand, GetTimeMicros() - nProcessStart);
 
     if (!fRet)
         LogPrint(BCLog::NET, "ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->GetId());
@@ -2121,6 +2867,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->m_next_addr_send < current_time) {
             pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
 
@@ -2156,16 +2903,32 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to end of initial download.
-            if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
+            // A peer serving headers takes over from one walking the chain with getblocks.
+            const bool fHeadersFirst = pto->nVersion >= HEADERS_FIRST_VERSION;
+            if (((nSyncStarted == 0 || (fHeadersFirst && nHeadersSyncStarted == 0)) && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (fHeadersFirst) {
+                    state.fHeadersSyncStarted = true;
+                    nHeadersSyncStarted++;
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
+        // Resume the headers sync held back by MAX_HEADERS_AHEAD, once the blocks caught up with half of
+        // the headers this peer sent (the best header only follows the blocks received)
+        const CBlockIndex* pindexPeerHeaders = state.pindexBestKnownBlock ? state.pindexBestKnownBlock : chainActive.Tip();
+        if (state.fHeadersAheadPending && pindexPeerHeaders->nHeight - chainActive.Height() < MAX_HEADERS_AHEAD / 2) {
+            state.fHeadersAheadPending = false;
+            LogPrint(BCLog::NET, "resume getheaders (%d) to peer=%d\n", pindexPeerHeaders->nHeight, pto->GetId());
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexPeerHeaders), UINT256_ZERO));
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -2184,6 +2947,24 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
 
             // Add blocks
             for (const uint256& hash : pto->vInventoryBlockToSend) {
+                if (state.fPreferHeaderAndIDs && pto->vInventoryBlockToSend.size() == 1) {
+                    // High-bandwidth compact block peers get a new tip right away, without the inv/getdata round trip
+                    CSharedNetMsg msg;
+                    bool fHaveMsg = serializedBlockCache.Get(hash, pto->GetSendVersion(), NetMsgType::CMPCTBLOCK, msg);
+                    if (!fHaveMsg) {
+                        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = GetMostRecentCompactBlock(hash);
+                        if (pcmpctblock) {
+                            msg = CConnman::MakeSharedMessage(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                            serializedBlockCache.Put(hash, pto->GetSendVersion(), msg);
+                            fHaveMsg = true;
+                        }
+                    }
+                    if (fHaveMsg) {
+                        LogPrint(BCLog::NET, "%s sending cmpctblock %s to peer=%d\n", __func__, hash.ToString(), pto->GetId());
+                        connman->PushMessage(pto, msg);
+                        continue;
+                    }
+                }
                 vInv.emplace_back(CInv(MSG_BLOCK, hash));
                 if (vInv.size() == MAX_INV_SZ) {
                     connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
@@ -2256,6 +3037,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
+                const bool fReconciling = g_txreconciliation && g_txreconciliation->IsPeerRegistered(pto->GetId());
                 LOCK(pto->cs_filter);
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
@@ -2276,6 +3058,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     // todo: back port feerate filter.
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    // Unless it is flooded to the peer, leave it to the next reconciliation
+                    if (fReconciling && !g_txreconciliation->ShouldFloodTo(pto->GetId(), hash) &&
+                        g_txreconciliation->AddToSet(pto->GetId(), hash)) {
+                        continue;
+                    }
                     // Send
                     vInv.emplace_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
@@ -2290,6 +3077,19 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        // Periodically reconcile the transactions to announce with our outbound reconciling peers
+        if (g_txreconciliation) {
+            std::vector<uint256> vToAnnounce;
+            if (g_txreconciliation->ExpireRequest(pto->GetId(), current_time, vToAnnounce)) {
+                LogPrint(BCLog::NET, "reconciliation with peer=%d timed out, %u to announce\n", pto->GetId(), vToAnnounce.size());
+                AnnounceReconciledTransactions(pto, vToAnnounce, connman);
+            }
+            uint16_t local_set_size, q;
+            if (g_txreconciliation->InitiateRequest(pto->GetId(), current_time, local_set_size, q)) {
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQTXIBLT, local_set_size, q));
+            }
+        }
+
         // Detect whether we're stalling
         current_time = GetTime<std::chrono::microseconds>();
         nNow = GetTimeMicros();
@@ -2316,10 +3116,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && fFetch && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && fFetch && state.nBlocksInFlight < state.nBlocksInFlightLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller);
             for (const CBlockIndex* pindex : vToDownload) {
                 vGetData.emplace_back(MSG_BLOCK, pindex->GetBlockHash());
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
@@ -2329,6 +3129,8 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
+                    // Ask less at once from the peer holding back the window
+                    UpdateBlocksInFlightLimit(State(staller), true);
                     LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
                 }
             }
@@ -2358,14 +3160,3 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
     return true;
 }
 
-class CNetProcessingCleanup
-{
-public:
-    CNetProcessingCleanup() {}
-    ~CNetProcessingCleanup() {
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
-    }
-} instance_of_cnetprocessingcleanup;
-
@@ -87,6 +87,8 @@ public:
 
     // memory only
     mutable bool fChecked{false};
+    // merkle root and block signature already verified (block import)
+    mutable bool fPrechecked{false};
 
     CBlock()
     {
@@ -112,6 +114,7 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fPrechecked = false;
         vchBlockSig.clear();
     }
 
@@ -39,6 +39,20 @@ const char* FILTERLOAD = "filterload";
 const char* FILTERADD = "filteradd";
 const char* FILTERCLEAR = "filterclear";
 const char* SENDHEADERS = "sendheaders";
+const char* SENDCMPCT = "sendcmpct";
+const char* CMPCTBLOCK = "cmpctblock";
+const char* GETBLOCKTXN = "getblocktxn";
+const char* BLOCKTXN = "blocktxn";
+const char* GETCFILTERS = "getcfilters";
+const char* CFILTER = "cfilter";
+const char* GETCFHEADERS = "getcfheaders";
+const char* CFHEADERS = "cfheaders";
+const char* GETCFCHECKPT = "getcfcheckpt";
+const char* CFCHECKPT = "cfcheckpt";
+const char* SENDTXIBLT = "sendtxiblt";
+const char* REQTXIBLT = "reqtxiblt";
+const char* SKETCH = "sketch";
+const char* RECONCILDIFF = "reconcildiff";
 const char* SPORK = "spork";
 const char* GETSPORKS = "getsporks";
 const char* PNBROADCAST = "mnb";
@@ -82,6 +96,20 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::FILTERADD,
     NetMsgType::FILTERCLEAR,
     NetMsgType::SENDHEADERS,
+    NetMsgType::SENDCMPCT,
+    NetMsgType::CMPCTBLOCK,
+    NetMsgType::GETBLOCKTXN,
+    NetMsgType::BLOCKTXN,
+    NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,
+    NetMsgType::GETCFHEADERS,
+    NetMsgType::CFHEADERS,
+    NetMsgType::GETCFCHECKPT,
+    NetMsgType::CFCHECKPT,
+    NetMsgType::SENDTXIBLT,
+    NetMsgType::REQTXIBLT,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
     "filtered block", // Should never occur
     "ix",   // deprecated
     "txlvote", // deprecated
@@ -177,7 +205,7 @@ bool operator<(const CInv& a, const CInv& b)
 }
 
 bool CInv::IsPatriotNodeType() const{
-     return type > 2;
+     return type > 2 && type <= MSG_TYPE_MAX;
 }
 
 std::string CInv::GetCommand() const
@@ -200,6 +228,7 @@ std::string CInv::GetCommand() const
         case MSG_PATRIOTNODE_ANNOUNCE: return cmd.append(NetMsgType::PNBROADCAST); // or PNBROADCAST2
         case MSG_PATRIOTNODE_PING: return cmd.append(NetMsgType::PNPING);
         case MSG_DSTX: return cmd.append("dstx"); // Deprecated
+        case MSG_CMPCT_BLOCK: return cmd.append(NetMsgType::CMPCTBLOCK);
         default:
             throw std::out_of_range(strprintf("%s: type=%d unknown type", __func__, type));
     }
@@ -218,6 +218,91 @@ extern const char* FILTERCLEAR;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char* SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * @since protocol version 72002, as described by BIP152.
+ */
+extern const char* SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * @since protocol version 72002, as described by BIP152.
+ */
+extern const char* CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @since protocol version 72002, as described by BIP152.
+ */
+extern const char* GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @since protocol version 72002, as described by BIP152.
+ */
+extern const char* BLOCKTXN;
+/**
+ * getcfilters requests compact filters for a range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFILTERS;
+/**
+ * cfilter is a response to a getcfilters request containing a single compact
+ * filter.
+ */
+extern const char* CFILTER;
+/**
+ * getcfheaders requests a compact filter header and the filter hashes for a
+ * range of blocks, which can then be used to reconstruct the filter headers
+ * for those blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFHEADERS;
+/**
+ * cfheaders is a response to a getcfheaders request containing a filter header
+ * and a vector of filter hashes for each subsequent block in the requested range.
+ */
+extern const char* CFHEADERS;
+/**
+ * getcfcheckpt requests evenly spaced compact filter headers, enabling
+ * parallelized download and validation of the headers between them.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFCHECKPT;
+/**
+ * cfcheckpt is a response to a getcfcheckpt request containing a vector of
+ * evenly spaced filter headers for blocks on the requested chain.
+ */
+extern const char* CFCHECKPT;
+/**
+ * Indicates that a node prefers to relay transactions via set reconciliation,
+ * along with the salt of the short transaction IDs.
+ * Sent after the version message and before the verack. Unlike BIP 330, from
+ * which the flow is taken, the sketches are invertible Bloom lookup tables: the
+ * messages have their own names, so that BIP 330 peers never negotiate it with us.
+ */
+extern const char* SENDTXIBLT;
+/**
+ * Requests a reconciliation of the transactions to announce, with the size
+ * of the set of the requester. Sent by the outbound side of a connection.
+ */
+extern const char* REQTXIBLT;
+/**
+ * Contains the sketch of the set of transactions to announce, in response
+ * to a reqtxiblt message.
+ */
+extern const char* SKETCH;
+/**
+ * Concludes a reconciliation with the short IDs of the transactions the
+ * sender of the sketch has to announce, or its failure.
+ */
+extern const char* RECONCILDIFF;
 /**
  * The spork message is used to send spork values to connected
  * peers
@@ -301,6 +386,10 @@ enum ServiceFlags : uint64_t {
     // that the node doesn't want to receive PatriotNodes messages. (the 1<<3 was not picked as constant because on bitcoin 0.14 is witness and we want that update here )
     NODE_BLOOM_WITHOUT_PN = (1 << 4),
 
+    // NODE_COMPACT_FILTERS means the node will service basic block filter
+    // requests. See BIP157 and BIP158 for details on how this is implemented.
+    NODE_COMPACT_FILTERS = (1 << 6),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -429,7 +518,9 @@ enum GetDataMsg
     MSG_PATRIOTNODE_ANNOUNCE,
     MSG_PATRIOTNODE_PING,
     MSG_DSTX,
-    MSG_TYPE_MAX = MSG_DSTX
+    MSG_TYPE_MAX = MSG_DSTX,
+    // Defined in BIP152, only used in getdata (never relayed in an inv).
+    MSG_CMPCT_BLOCK = 20,
 };
 
 /** inv message data */
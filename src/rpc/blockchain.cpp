@@ -8,7 +8,10 @@
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "coinstats.h"
 #include "core_io.h"
+#include "evo/evodb.h"
+#include "index/blockfilterindex.h"
 #include "consensus/upgrades.h"
 #include "kernel.h"
 #include "key_io.h"
@@ -19,8 +22,10 @@
 #include "sync.h"
 #include "txdb.h"
 #include "util/system.h"
+#include "util/validation.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxo_snapshot.h"
 #include "hash.h"
 #include "validationinterface.h"
 #include "wallet/wallet.h"
@@ -93,9 +98,10 @@ static UniValue ValuePoolDesc(
         const Optional<CAmount> chainValue,
         const Optional<CAmount> valueDelta)
 {
+    // Unknown values (blocks not connected, or below a loaded UTXO snapshot base) are left out
     UniValue rv(UniValue::VOBJ);
-    rv.pushKV("chainValue",  ValueFromAmount(chainValue ? *chainValue : 0));
-    rv.pushKV("valueDelta",  ValueFromAmount(valueDelta ? *valueDelta : 0));
+    if (chainValue) rv.pushKV("chainValue",  ValueFromAmount(*chainValue));
+    if (valueDelta) rv.pushKV("valueDelta",  ValueFromAmount(*valueDelta));
     return rv;
 }
 
@@ -119,7 +125,8 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
     result.pushKV("acc_checkpoint", blockindex->nAccumulatorCheckpoint.GetHex());
     // Sapling shield pool value
-    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->nChainSaplingValue, blockindex->nSaplingValue));
+    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->nChainSaplingValue,
+                                                     blockindex->IsAssumedValid() ? nullopt : Optional<CAmount>(blockindex->nSaplingValue)));
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex *pnext = chainActive.Next(blockindex);
@@ -649,6 +656,72 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",    (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hash\",   (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\""));
+
+    uint256 block_hash(ParseHashV(request.params[0], "blockhash"));
+    std::string filtertype_name = "basic";
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(block_hash);
+        if (mi == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = mi->second;
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        std::string errmsg = "Filter not found.";
+        if (!index->IsSynced()) {
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+        throw JSONRPCError(RPC_MISC_ERROR, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 UniValue getsupplyinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -695,97 +768,86 @@ UniValue getsupplyinfo(const JSONRPCRequest& request)
     return ret;
 }
 
-struct CCoinsStats
-{
-    int nHeight{0};
-    uint256 hashBlock{UINT256_ZERO};
-    uint64_t nTransactions{0};
-    uint64_t nTransactionOutputs{0};
-    uint256 hashSerialized{UINT256_ZERO};
-    uint64_t nDiskSize{0};
-    CAmount nTotalAmount{0};
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    const Coin& coin = outputs.begin()->second;
-    ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-    }
-    ss << VARINT(0u);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless hash_type is \"muhash\".\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"       (string, optional, default=\"hash_serialized_2\") Which UTXO set hash should be calculated:\n"
+            "                      \"hash_serialized_2\" scans the UTXO set at the chain tip,\n"
+            "                      \"muhash\" is read from the commitment stored for each block (requires -coinstatsindex)\n"
+            "2. hash_or_height    (string or numeric, optional) With \"muhash\", the block hash or height of the\n"
+            "                      block to get the statistics of (default: the chain tip)\n"
 
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"height\":n,     (numeric) The block height (index)\n"
+            "  \"bestblock\": \"hex\",   (string) the block hash hex\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (not with \"muhash\")\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash (only with \"hash_serialized_2\")\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash of the UTXO set (only with \"muhash\")\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not with \"muhash\")\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000") +
+            HelpExampleRpc("gettxoutsetinfo", "\"muhash\""));
+
+    const std::string strHashType = request.params.size() > 0 ? request.params[0].get_str() : "hash_serialized_2";
+    if (strHashType != "hash_serialized_2" && strHashType != "muhash") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", strHashType));
+    }
 
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash") {
+        if (!fCoinStatsIndex) {
+            throw JSONRPCError(RPC_MISC_ERROR, "The UTXO set commitments are not maintained, restart with -coinstatsindex");
+        }
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive.Tip();
+            if (request.params.size() > 1) {
+                const UniValue& hash_or_height = request.params[1];
+                int nHeight = -1;
+                if (hash_or_height.isNum() || ParseInt32(hash_or_height.get_str(), &nHeight)) {
+                    if (hash_or_height.isNum()) nHeight = hash_or_height.get_int();
+                    if (nHeight < 0 || nHeight > chainActive.Height()) {
+                        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+                    }
+                    pindex = chainActive[nHeight];
+                } else {
+                    const uint256 hash(ParseHashV(hash_or_height, "hash_or_height"));
+                    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+                    if (it == mapBlockIndex.end()) {
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                    }
+                    pindex = it->second;
+                }
+            }
+        }
+        CBlockCoinsStats stats;
+        if (!GetBlockCoinsStats(pindex, stats)) {
+            throw JSONRPCError(RPC_MISC_ERROR, "No UTXO set commitment for this block (not connected with -coinstatsindex)");
+        }
+        ret.pushKV("height", pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+        ret.pushKV("muhash", stats.hashMuHash.GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        return ret;
+    }
+
+    if (request.params.size() > 1) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 is only available at the chain tip");
+    }
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip.get(), stats)) {
@@ -800,6 +862,185 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the chainstate (unspent transaction outputs, Sapling anchors and nullifiers, evo database)\n"
+            "at the current tip, and the block headers up to it, to a snapshot file, to bootstrap other nodes\n"
+            "with loadtxoutset.\n"
+            "Note this call may take some time, the node doesn't process blocks meanwhile.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) Path to the output file. If relative, will be prefixed by datadir.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,              (numeric) The number of coins written in the snapshot\n"
+            "  \"base_hash\": \"hex\",            (string) The hash of the block at the tip of the chain\n"
+            "  \"base_height\": n,                (numeric) The height of the block at the tip of the chain\n"
+            "  \"path\": \"path\",                (string) The absolute path that the snapshot was written to\n"
+            "  \"txoutset_hash\": \"hash\",       (string) The hash of the coins (hash_serialized_2 of gettxoutsetinfo)\n"
+            "  \"shieldedstate_hash\": \"hash\"   (string) The hash of the Sapling and evo database state\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "utxo.dat") + HelpExampleRpc("dumptxoutset", "utxo.dat"));
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary path and then move into `path` on completion
+    // to avoid confusion due to an interruption.
+    const fs::path temppath = fs::absolute(request.params[0].get_str() + ".incomplete", GetDataDir());
+
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+    }
+
+    FILE* file{fsbridge::fopen(temppath, "wb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file " + temppath.string());
+    }
+
+    SnapshotMetadata metadata;
+    int nHeight;
+    {
+        // Keep the chainstate still while it's written
+        LOCK(cs_main);
+        FlushStateToDisk();
+        const CBlockIndex* pindexBase = mapBlockIndex.at(pcoinsdbview->GetBestBlock());
+        if (!DumpUTXOSnapshot(*pcoinsdbview, evoDb->GetRawDB(), pindexBase, afile, metadata)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the chainstate");
+        }
+        nHeight = pindexBase->nHeight;
+    }
+    afile.fclose();
+    fs::rename(temppath, path);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)metadata.nCoins);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("txoutset_hash", metadata.hashUTXOSet.GetHex());
+    ret.pushKV("shieldedstate_hash", metadata.hashShieldedState.GetHex());
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nLoad a snapshot written by dumptxoutset as the chainstate, instead of downloading and connecting\n"
+            "the blocks up to its base. Only snapshots whose hashes are in the chain parameters are accepted.\n"
+            "The block headers come with the snapshot, the chainstate must still be at the genesis block:\n"
+            "start the node without connections (-connect=0), and add them once the snapshot is loaded.\n"
+            "The blocks below the base are assumed valid and never downloaded: they can't be disconnected\n"
+            "nor served to peers, wallets can't be loaded nor rescanned below the base, and no block filter\n"
+            "index can be built. An interrupted load requires restarting with -reindex-chainstate.\n"
+            "No snapshot is trusted on mainnet and testnet yet, so it fails there: only regtest can trust\n"
+            "snapshots, with -snapshotparams.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) Path to the snapshot file. If relative, will be prefixed by datadir.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,         (numeric) The number of coins loaded from the snapshot\n"
+            "  \"base_hash\": \"hex\",      (string) The hash of the new chain tip\n"
+            "  \"base_height\": n,          (numeric) The height of the new chain tip\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("loadtxoutset", "utxo.dat") + HelpExampleRpc("loadtxoutset", "utxo.dat"));
+
+    const MapUTXOSnapshots& mapSnapshots = Params().UTXOSnapshots();
+    if (mapSnapshots.empty()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "No snapshot is trusted on this network");
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    FILE* file{fsbridge::fopen(path, "rb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file " + path.string());
+    }
+
+    // Check the whole file before touching the chainstate
+    SnapshotMetadata metadata;
+    SnapshotShieldedState shielded;
+    CCoinsStats stats;
+    std::string strError;
+    if (!VerifyUTXOSnapshot(afile, metadata, shielded, stats, strError)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid snapshot: " + strError);
+    }
+    auto itTrusted = mapSnapshots.find(metadata.nHeaders);
+    if (itTrusted == mapSnapshots.end() || itTrusted->second.hashBlock != metadata.hashBlock ||
+            itTrusted->second.hashUTXOSet != metadata.hashUTXOSet ||
+            itTrusted->second.hashShieldedState != metadata.hashShieldedState) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "The snapshot isn't one of the trusted snapshots of the chain parameters");
+    }
+    bool fFilterIndex = false;
+    ForEachBlockFilterIndex([&fFilterIndex](BlockFilterIndex& index) { fFilterIndex = true; });
+    if (fFilterIndex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "A snapshot can't be loaded with -blockfilterindex");
+    }
+#ifdef ENABLE_WALLET
+    if (!vpwallets.empty()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "A snapshot can't be loaded with wallets, which would miss the transactions below its base (-disablewallet)");
+    }
+#endif
+
+    CBlockIndex* pindexBase;
+    {
+        // Keep the blocks from being downloaded and connected meanwhile
+        LOCK(cs_main);
+        if (chainActive.Height() != 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "The chainstate must be at the genesis block to load a snapshot");
+        }
+
+        // The headers, chained to the trusted base block
+        CValidationState state;
+        if (!LoadSnapshotHeaders(afile, metadata, state)) {
+            throw JSONRPCError(RPC_VERIFY_ERROR, "Invalid snapshot block headers: " + FormatStateMessage(state));
+        }
+        pindexBase = mapBlockIndex.at(metadata.hashBlock);
+        if (pindexBase->nStatus & BLOCK_FAILED_MASK) {
+            throw JSONRPCError(RPC_VERIFY_ERROR, "The snapshot base block is invalid");
+        }
+
+        FlushStateToDisk();
+        if (!LoadUTXOSnapshot(afile, metadata, shielded, *pcoinsdbview, *pcoinsTip, evoDb->GetRawDB())) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to load the snapshot, restart with -reindex-chainstate");
+        }
+        if (!ActivateSnapshotChain(pindexBase, shielded.nStakeModifier, shielded.nSaplingPoolValue, shielded.nChainTx)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to set the chain tip to the snapshot base, restart with -reindex-chainstate");
+        }
+        MoneySupply.Update(stats.nTotalAmount, pindexBase->nHeight);
+        if (!LoadCoinsCommitment()) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to compute the UTXO set commitment of the snapshot");
+        }
+    }
+
+    // Check what got written against the snapshot
+    CCoinsStats statsLoaded;
+    if (!GetUTXOStats(pcoinsTip.get(), statsLoaded) || statsLoaded.hashSerialized != metadata.hashUTXOSet) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "The loaded chainstate doesn't match the snapshot, restart with -reindex-chainstate");
+    }
+
+    // Go on with the blocks after the snapshot
+    CValidationState state;
+    ActivateBestChain(state);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_loaded", (int64_t)metadata.nCoins);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", pindexBase->nHeight);
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -999,6 +1240,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "    \"valueDelta\":        (numeric) Change in value held by the Sapling circuit over the chain tip block\n"
             "  },\n"
             "  \"initial_block_downloading\": true|false, (boolean) whether the node is in initial block downloading state or not\n"
+            "  \"coinsflush\": {          (object) last write of the coins cache to the database\n"
+            "    \"time\": xxxxx,          (numeric) the time the write started in seconds since epoch (Jan 1 1970 GMT)\n"
+            "    \"duration\": x.xxx,      (numeric) the duration of the write in seconds\n"
+            "    \"bytes\": xxxxx,         (numeric) the size of the written data\n"
+            "    \"changed\": xxxxx,       (numeric) the number of changed transaction outputs\n"
+            "    \"background\": true|false, (boolean) whether it was written on the background thread\n"
+            "    \"writing\": true|false,  (boolean) whether a background write is currently in progress\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1037,6 +1286,15 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     // Sapling shield pool value
     obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->nChainSaplingValue, pChainTip->nSaplingValue) : 0);
     obj.pushKV("initial_block_downloading", IsInitialBlockDownload());
+    const CCoinsFlushStats flushStats = pcoinsdbview->GetLastFlushStats();
+    UniValue coinsflush(UniValue::VOBJ);
+    coinsflush.pushKV("time", flushStats.nTime);
+    coinsflush.pushKV("duration", flushStats.nDurationMicros * 0.000001);
+    coinsflush.pushKV("bytes", flushStats.nBytes);
+    coinsflush.pushKV("changed", flushStats.nChanged);
+    coinsflush.pushKV("background", flushStats.fBackground);
+    coinsflush.pushKV("writing", pcoinsdbview->IsWriting());
+    obj.pushKV("coinsflush", coinsflush);
     UniValue softforks(UniValue::VARR);
     softforks.push_back(SoftForkDesc("bip65", 5, pChainTip));
     obj.pushKV("softforks",             softforks);
@@ -1163,6 +1421,8 @@ UniValue mempoolInfoToJSON()
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    ret.pushKV("precomputedhits", mempool.GetPrecomputedHits());
+    ret.pushKV("precomputedmisses", mempool.GetPrecomputedMisses());
 
     return ret;
 }
@@ -1183,6 +1443,8 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"precomputedhits\": xxxxx     (numeric) Transactions of connected blocks whose signature hash midstates were reused from the mempool\n"
+            "  \"precomputedmisses\": xxxxx   (numeric) Transactions of connected blocks whose signature hash midstates had to be computed\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -1449,11 +1711,13 @@ UniValue getfeeinfo(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ --------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
     { "blockchain",         "getbestsaplinganchor",   &getbestsaplinganchor,   true,  {} },
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         false, {"blockhash","verbose"} },
     { "blockchain",         "getblockindexstats",     &getblockindexstats,     true,  {"height","range"} },
@@ -1464,7 +1728,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true,  {"force_update"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","hash_or_height"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           true,  {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"nblocks"} },
 
     /* Not shown in help */
@@ -104,6 +104,9 @@ UniValue getinfo(const JSONRPCRequest& request)
                 case NODE_BLOOM_WITHOUT_PN:
                     services+= "BLOOM/";
                     break;
+                case NODE_COMPACT_FILTERS:
+                    services+= "COMPACT_FILTERS/";
+                    break;
                 default:
                     services+= "UNKNOWN/";
             }
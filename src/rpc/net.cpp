@@ -100,6 +100,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"inflight_limit\": n,       (numeric) How many blocks can be asked from this peer at once\n"
+            "    \"txreconciliation\": true|false, (boolean) Whether transactions are announced to this peer through set reconciliation\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -108,6 +110,14 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": {              (json object) The time spent processing the messages of a type received\n"
+            "         \"count\": n,          (numeric) The number of messages processed\n"
+            "         \"total_us\": n,       (numeric) The total processing time, in microseconds\n"
+            "         \"histogram\": [n,...] (array) The number of messages processed in <10us, <100us, <1ms, <10ms, <100ms, <1s and >=1s\n"
+            "       },\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -161,6 +171,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("inflight_limit", statestats.nBlocksInFlightLimit);
+            obj.pushKV("txreconciliation", statestats.fTxReconciliation);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
@@ -178,6 +190,21 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue processTimePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdProcessTimes::value_type &i : stats.mapProcessTimesPerMsgCmd) {
+            if (i.second.nCount == 0)
+                continue;
+            UniValue times(UniValue::VOBJ);
+            times.pushKV("count", i.second.nCount);
+            times.pushKV("total_us", i.second.nTotalMicros);
+            UniValue histogram(UniValue::VARR);
+            for (uint64_t nBucketCount : i.second.vBuckets)
+                histogram.push_back(nBucketCount);
+            times.pushKV("histogram", histogram);
+            processTimePerMsgCmd.pushKV(i.first, times);
+        }
+        obj.pushKV("processtime_per_msg", processTimePerMsgCmd);
+
         ret.push_back(obj);
     }
 
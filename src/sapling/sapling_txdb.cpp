@@ -17,24 +17,69 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
         return true;
     }
 
+    {
+        LOCK(cs_snapshot);
+        if (snapshot) {
+            auto it = snapshot->mapSaplingAnchors.find(rt);
+            if (it != snapshot->mapSaplingAnchors.end()) {
+                if (it->second.entered) tree = it->second.tree;
+                return it->second.entered;
+            }
+        }
+    }
+
     bool read = db.Read(std::make_pair(DB_SAPLING_ANCHOR, rt), tree);
 
     return read;
 }
 
 bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
+    {
+        LOCK(cs_snapshot);
+        if (snapshot) {
+            auto it = snapshot->mapSaplingNullifiers.find(nf);
+            if (it != snapshot->mapSaplingNullifiers.end()) {
+                return it->second.entered;
+            }
+        }
+    }
     bool spent = false;
     return db.Read(std::make_pair(DB_SAPLING_NULLIFIER, nf), spent);
 }
 
 uint256 CCoinsViewDB::GetBestAnchor() const {
+    {
+        LOCK(cs_snapshot);
+        if (snapshot && !snapshot->hashSaplingAnchor.IsNull()) return snapshot->hashSaplingAnchor;
+    }
     uint256 hashBestAnchor;
     if (!db.Read(DB_BEST_SAPLING_ANCHOR, hashBestAnchor))
         return SaplingMerkleTree::empty_root();
     return hashBestAnchor;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+void CCoinsViewDB::GetSaplingState(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors,
+                                   std::vector<uint256>& vNullifiers) const
+{
+    WaitForWrite();
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(DB_SAPLING_ANCHOR);
+    std::pair<char, uint256> key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_SAPLING_ANCHOR) {
+        SaplingMerkleTree tree;
+        if (pcursor->GetValue(tree)) {
+            vAnchors.emplace_back(key.second, tree);
+        }
+        pcursor->Next();
+    }
+    pcursor->Seek(DB_SAPLING_NULLIFIER);
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_SAPLING_NULLIFIER) {
+        vNullifiers.emplace_back(key.second);
+        pcursor->Next();
+    }
+}
+
+void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar, bool fErase)
 {
     size_t count = 0;
     size_t changed = 0;
@@ -48,13 +93,13 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
         }
         count++;
         CNullifiersMap::iterator itOld = it++;
-        mapToUse.erase(itOld);
+        if (fErase) mapToUse.erase(itOld);
     }
     LogPrint(BCLog::COINDB, "Committed %u changed nullifiers (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar, bool fErase)
 {
     size_t count = 0;
     size_t changed = 0;
@@ -71,7 +116,7 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
         }
         count++;
         MapIterator itOld = it++;
-        mapToUse.erase(itOld);
+        if (fErase) mapToUse.erase(itOld);
     }
     LogPrint(BCLog::COINDB, "Committed %u changed sapling anchors (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
 }
@@ -79,10 +124,11 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
 bool CCoinsViewDB::BatchWriteSapling(const uint256& hashSaplingAnchor,
                               CAnchorsSaplingMap& mapSaplingAnchors,
                               CNullifiersMap& mapSaplingNullifiers,
-                              CDBBatch& batch) {
+                              CDBBatch& batch,
+                              bool fErase) {
 
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
-    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR, fErase);
+    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER, fErase);
     if (!hashSaplingAnchor.IsNull())
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
     return true;
@@ -10,6 +10,7 @@
 
 class CTransaction;
 class CValidationState;
+struct PrecomputedTransactionData;
 
 namespace SaplingValidation {
 
@@ -21,10 +22,42 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: if fCheckProofs is false, the zk-SNARK proofs and the binding signature are not verified
+// here. The caller must verify them with CheckTransactionProofs (ContextualCheckBlock does it in parallel).
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, bool fCheckProofs = true);
+
+/** Verify the spend/output proofs and the binding signature of a transaction with Sapling data */
+bool CheckTransactionProofs(const CTransaction& tx, CValidationState& state, int dosLevelPotentiallyRelaxing,
+                            const PrecomputedTransactionData* precomTxData = nullptr);
 
 }; // End SaplingValidation namespace
 
+/**
+ * Closure representing the Sapling proofs verification of one transaction.
+ * Note that this stores a reference to the transaction.
+ */
+class CSaplingProofCheck
+{
+private:
+    const CTransaction* ptx;
+    int nDoSLevel;
+    const PrecomputedTransactionData* precomTxData;
+
+public:
+    CSaplingProofCheck() : ptx(nullptr), nDoSLevel(0), precomTxData(nullptr) {}
+    CSaplingProofCheck(const CTransaction& txIn, int nDoSLevelIn, const PrecomputedTransactionData* precomTxDataIn = nullptr) :
+        ptx(&txIn), nDoSLevel(nDoSLevelIn), precomTxData(precomTxDataIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingProofCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(nDoSLevel, check.nDoSLevel);
+        std::swap(precomTxData, check.precomTxData);
+    }
+};
+
 #endif //TrumpCoin_SAPLING_VALIDATION_H
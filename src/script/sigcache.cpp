@@ -81,6 +81,36 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+void CSignatureBatch::Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, bool store)
+{
+    vEntries.push_back({vchSig, pubkey, sighash, store});
+}
+
+bool CSignatureBatch::Verify(size_t nBegin, size_t nEnd) const
+{
+    assert(nBegin <= nEnd && nEnd <= vEntries.size());
+    // libsecp256k1 offers no ECDSA multi-verification: verify one by one,
+    // skipping the signatures already in the cache.
+    for (size_t i = nBegin; i < nEnd; i++) {
+        const Entry& e = vEntries[i];
+        uint256 entry;
+        signatureCache.ComputeEntry(entry, e.sighash, e.vchSig, e.pubkey);
+        if (signatureCache.Get(entry, !e.store))
+            continue;
+        if (!e.pubkey.Verify(e.sighash, e.vchSig))
+            return false;
+        if (e.store)
+            signatureCache.Set(entry);
+    }
+    return true;
+}
+
+bool BatchingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    batch.Add(vchSig, pubkey, sighash, store);
+    return true;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
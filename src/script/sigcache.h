@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "pubkey.h"
 #include "script/interpreter.h"
 
 #include <vector>
@@ -51,6 +52,49 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Signatures collected from a batch of script evaluations, to be verified
+ * together once all the scripts have been evaluated.
+ */
+class CSignatureBatch
+{
+private:
+    struct Entry {
+        std::vector<unsigned char> vchSig;
+        CPubKey pubkey;
+        uint256 sighash;
+        bool store;
+    };
+    std::vector<Entry> vEntries;
+
+public:
+    void Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, bool store);
+    size_t size() const { return vEntries.size(); }
+    //! Discard the entries added after the first nSize ones
+    void Truncate(size_t nSize) { vEntries.resize(nSize); }
+    //! Verify the signatures in [nBegin, nEnd), consulting (and filling) the signature cache
+    bool Verify(size_t nBegin, size_t nEnd) const;
+    bool Verify() const { return Verify(0, vEntries.size()); }
+};
+
+/**
+ * Signature checker that assumes every signature valid, queuing it in a
+ * CSignatureBatch instead. A script evaluated with this checker is valid
+ * only if it succeeds and all the signatures queued for it are verified:
+ * in that case the evaluation is identical to the one with real results.
+ */
+class BatchingTransactionSignatureChecker : public TransactionSignatureChecker
+{
+private:
+    bool store;
+    CSignatureBatch& batch;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& cachedHashesIn, CSignatureBatch& batchIn) : TransactionSignatureChecker(txToIn, nInIn, amount, cachedHashesIn), store(storeIn), batch(batchIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
 void InitSignatureCache();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,151 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "logging.h"
+#include "netbase.h"
+
+#include <algorithm>
+
+#ifdef USE_POLL
+#include <poll.h>
+#endif
+
+SocketEventsWaiter::SocketEventsWaiter(bool fAllowEpoll)
+{
+#ifdef USE_EPOLL
+    if (fAllowEpoll) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd < 0)
+            LogPrintf("epoll_create1 error %s, falling back to poll\n", NetworkErrorString(WSAGetLastError()));
+        vEpollEvents.resize(256);
+    }
+#endif
+}
+
+SocketEventsWaiter::~SocketEventsWaiter()
+{
+#ifdef USE_EPOLL
+    if (epollfd >= 0)
+        close(epollfd);
+#endif
+}
+
+const char* SocketEventsWaiter::GetBackendName() const
+{
+#ifdef USE_EPOLL
+    if (epollfd >= 0)
+        return "epoll";
+#endif
+#ifdef USE_POLL
+    return "poll";
+#else
+    return "select";
+#endif
+}
+
+void SocketEventsWaiter::Watch(SOCKET hSocket, uint64_t nTag, int nEvents, int& nRegistered)
+{
+#ifdef USE_EPOLL
+    if (epollfd >= 0) {
+        if (nRegistered != nEvents) {
+            struct epoll_event event = {};
+            event.events = ((nEvents & SOCKET_EVENT_RECV) ? EPOLLIN : 0) | ((nEvents & SOCKET_EVENT_SEND) ? EPOLLOUT : 0);
+            event.data.u64 = nTag;
+            if (epoll_ctl(epollfd, nRegistered < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &event) == 0)
+                nRegistered = nEvents;
+            else
+                LogPrintf("epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+        }
+        return;
+    }
+#endif
+    vWatched.push_back(WatchedSocket{hSocket, nTag, nEvents});
+}
+
+bool SocketEventsWaiter::Wait(int64_t nTimeout, std::vector<std::pair<uint64_t, int>>& vReady, CThreadInterrupt& interrupt)
+{
+#ifdef USE_EPOLL
+    if (epollfd >= 0) {
+        int nReady = epoll_wait(epollfd, vEpollEvents.data(), vEpollEvents.size(), nTimeout);
+        if (nReady == SOCKET_ERROR)
+            return WSAGetLastError() == WSAEINTR;
+        for (int i = 0; i < nReady; i++) {
+            const struct epoll_event& event = vEpollEvents[i];
+            int nEvents = 0;
+            if (event.events & EPOLLIN)
+                nEvents |= SOCKET_EVENT_RECV;
+            if (event.events & EPOLLOUT)
+                nEvents |= SOCKET_EVENT_SEND;
+            if (event.events & (EPOLLERR | EPOLLHUP))
+                nEvents |= SOCKET_EVENT_ERROR;
+            vReady.emplace_back(event.data.u64, nEvents);
+        }
+        return true;
+    }
+#endif
+    std::vector<WatchedSocket> vWaiting;
+    vWaiting.swap(vWatched);
+#ifdef USE_POLL
+    std::vector<struct pollfd> vPollFds(vWaiting.size());
+    for (size_t i = 0; i < vWaiting.size(); i++) {
+        vPollFds[i].fd = vWaiting[i].hSocket;
+        vPollFds[i].events = ((vWaiting[i].nEvents & SOCKET_EVENT_RECV) ? POLLIN : 0) | ((vWaiting[i].nEvents & SOCKET_EVENT_SEND) ? POLLOUT : 0);
+    }
+    int nReady = poll(vPollFds.data(), vPollFds.size(), nTimeout);
+    if (nReady == SOCKET_ERROR)
+        return WSAGetLastError() == WSAEINTR;
+    for (size_t i = 0; i < vPollFds.size() && nReady > 0; i++) {
+        if (vPollFds[i].revents == 0)
+            continue;
+        nReady--;
+        int nEvents = 0;
+        if (vPollFds[i].revents & POLLIN)
+            nEvents |= SOCKET_EVENT_RECV;
+        if (vPollFds[i].revents & POLLOUT)
+            nEvents |= SOCKET_EVENT_SEND;
+        if (vPollFds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            nEvents |= SOCKET_EVENT_ERROR;
+        vReady.emplace_back(vWaiting[i].nTag, nEvents);
+    }
+    return true;
+#else
+    if (vWaiting.empty()) {
+        // select() doesn't wait without any socket on Windows
+        interrupt.sleep_for(std::chrono::milliseconds(nTimeout));
+        return true;
+    }
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    for (const WatchedSocket& watched : vWaiting) {
+        FD_SET(watched.hSocket, &fdsetError);
+        if (watched.nEvents & SOCKET_EVENT_RECV)
+            FD_SET(watched.hSocket, &fdsetRecv);
+        if (watched.nEvents & SOCKET_EVENT_SEND)
+            FD_SET(watched.hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, watched.hSocket);
+    }
+    if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout) == SOCKET_ERROR)
+        return false;
+    for (const WatchedSocket& watched : vWaiting) {
+        int nEvents = 0;
+        if (FD_ISSET(watched.hSocket, &fdsetRecv))
+            nEvents |= SOCKET_EVENT_RECV;
+        if (FD_ISSET(watched.hSocket, &fdsetSend))
+            nEvents |= SOCKET_EVENT_SEND;
+        if (FD_ISSET(watched.hSocket, &fdsetError))
+            nEvents |= SOCKET_EVENT_ERROR;
+        if (nEvents)
+            vReady.emplace_back(watched.nTag, nEvents);
+    }
+    return true;
+#endif
+}
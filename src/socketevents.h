@@ -0,0 +1,65 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+#include "threadinterrupt.h"
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/** Socket events the network threads wait for. */
+enum SocketEvent : int {
+    SOCKET_EVENT_RECV = (1 << 0),
+    SOCKET_EVENT_SEND = (1 << 1),
+    SOCKET_EVENT_ERROR = (1 << 2),
+};
+
+/**
+ * Waits for socket events on behalf of one network thread. With epoll, the sockets stay
+ * registered between waits, so that only a change of the events waited for costs a system
+ * call and a wakeup only reports the sockets that are ready. Otherwise the sockets watched
+ * are handed to poll() (select() on Windows) on every wait.
+ */
+class SocketEventsWaiter
+{
+private:
+    struct WatchedSocket {
+        SOCKET hSocket;
+        uint64_t nTag;
+        int nEvents;
+    };
+    std::vector<WatchedSocket> vWatched;
+#ifdef USE_EPOLL
+    int epollfd{-1};
+    std::vector<struct epoll_event> vEpollEvents;
+#endif
+
+public:
+    /** fAllowEpoll false makes the waiter use poll() where epoll would be available. */
+    explicit SocketEventsWaiter(bool fAllowEpoll = true);
+    ~SocketEventsWaiter();
+
+    /** The backend waiting for the sockets: "epoll", "poll" or "select". */
+    const char* GetBackendName() const;
+
+    /**
+     * Watch hSocket for nEvents (errors are always reported) during the next wait, which reports
+     * it by nTag. nRegistered holds the events the socket is registered for across waits: it must
+     * be -1 for a new socket, and stay with the socket until it is closed.
+     */
+    void Watch(SOCKET hSocket, uint64_t nTag, int nEvents, int& nRegistered);
+
+    /** Wait up to nTimeout milliseconds for the watched sockets, and append the tags and events of the ready ones to vReady. */
+    bool Wait(int64_t nTimeout, std::vector<std::pair<uint64_t, int>>& vReady, CThreadInterrupt& interrupt);
+};
+
+#endif // BITCOIN_SOCKETEVENTS_H
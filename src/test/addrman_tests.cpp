@@ -74,6 +74,27 @@ public:
         return std::pair<int, int>(-1, -1);
     }
 
+    //! All the positions of an address in the new table and its position in the tried table, as -1 - (bucket, entry)
+    std::set<std::pair<int, int>> GetPositions(const CAddress& addr)
+    {
+        LOCK(cs);
+        std::set<std::pair<int, int>> positions;
+        const auto it = mapAddr.find(addr);
+        if (it == mapAddr.end()) return positions;
+        const int nId = it->second;
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; ++bucket) {
+            for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
+                if (nId == vvNew[bucket][entry]) positions.emplace(bucket, entry);
+            }
+        }
+        for (int bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; ++bucket) {
+            for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
+                if (nId == vvTried[bucket][entry]) positions.emplace(-1 - bucket, -1 - entry);
+            }
+        }
+        return positions;
+    }
+
     // Simulates connection failure so that we can test eviction of offline nodes
     void SimConnFail(CService& addr)
     {
@@ -780,6 +801,100 @@ BOOST_AUTO_TEST_CASE(addrman_serialization)
     BOOST_CHECK(bucketAndEntry_asmap1_deser_addr1.second != bucketAndEntry_asmap1_deser_addr2.second);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_add_batch)
+{
+    CAddrManTest addrman_single;
+    CAddrManTest addrman_batch;
+
+    // A whole ADDR message is placed where the addresses would be one at a time
+    CNetAddr source = ResolveIP("252.2.2.2");
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 250; i++) {
+        CAddress addr = CAddress(ResolveService("250." + std::to_string(i % 7) + ".1." + std::to_string(i)), NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        vAddr.push_back(addr);
+        addrman_single.Add(addr, source);
+    }
+    std::vector<CAddress> vAddrMessage = vAddr;
+    // Not routable, skipped
+    vAddrMessage.push_back(CAddress(ResolveService("10.0.0.1"), NODE_NONE));
+    BOOST_CHECK(addrman_batch.Add(vAddrMessage, source));
+    BOOST_CHECK_EQUAL(addrman_batch.size(), addrman_single.size());
+    for (const CAddress& addr : vAddr) {
+        BOOST_CHECK(addrman_batch.GetBucketAndEntry(addr) == addrman_single.GetBucketAndEntry(addr));
+    }
+
+    // Announced again, nothing changes
+    addrman_single.Add(vAddr, source);
+    addrman_batch.Add(vAddrMessage, source);
+    BOOST_CHECK_EQUAL(addrman_batch.size(), addrman_single.size());
+
+    // Announced later from another source, on other ports: the entries keep theirs, and are
+    // placed by them
+    CNetAddr source2 = ResolveIP("252.3.3.3");
+    std::vector<CAddress> vAddrPorts;
+    for (const CAddress& addr : vAddr) {
+        CAddress addrPort = CAddress(CService(addr, addr.GetPort() + 1), NODE_NONE);
+        addrPort.nTime = GetAdjustedTime() + 60;
+        vAddrPorts.push_back(addrPort);
+        addrman_single.Add(addrPort, source2);
+    }
+    addrman_batch.Add(vAddrPorts, source2);
+    BOOST_CHECK_EQUAL(addrman_batch.size(), addrman_single.size());
+    size_t nMultiple = 0;
+    for (const CAddress& addr : vAddr) {
+        BOOST_CHECK(addrman_batch.GetPositions(addr) == addrman_single.GetPositions(addr));
+        if (addrman_batch.GetPositions(addr).size() > 1) nMultiple++;
+    }
+    BOOST_CHECK(nMultiple > 0);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialization_positions)
+{
+    CAddrManTest addrman;
+    CAddrManTest addrman_loaded;
+
+    // Addresses heard of from several sources, some of them tried
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 100; i++) {
+        CAddress addr = CAddress(ResolveService("250." + std::to_string(i % 5) + ".2." + std::to_string(i)), NODE_NONE);
+        vAddr.push_back(addr);
+    }
+    for (unsigned int source = 1; source < 40; source++) {
+        int64_t nTime = GetAdjustedTime() - 1000 + source;
+        for (CAddress& addr : vAddr) {
+            addr.nTime = nTime;
+        }
+        addrman.Add(vAddr, ResolveIP("251." + std::to_string(source) + ".1.1"));
+    }
+    for (unsigned int i = 0; i < vAddr.size(); i += 3) {
+        addrman.Good(vAddr[i]);
+    }
+    size_t nMultiple = 0;
+    for (const CAddress& addr : vAddr) {
+        if (addrman.GetPositions(addr).size() > 1) nMultiple++;
+    }
+    BOOST_CHECK(nMultiple > 0);
+
+    // The entries are loaded at the positions they were at, with their multiplicity
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << addrman;
+    stream >> addrman_loaded;
+    BOOST_CHECK_EQUAL(addrman_loaded.size(), addrman.size());
+    for (const CAddress& addr : vAddr) {
+        BOOST_CHECK(addrman_loaded.GetPositions(addr) == addrman.GetPositions(addr));
+    }
+
+    // And keep moving between the tables the same way
+    for (unsigned int i = 1; i < vAddr.size(); i += 3) {
+        addrman.Good(vAddr[i]);
+        addrman_loaded.Good(vAddr[i]);
+    }
+    BOOST_CHECK_EQUAL(addrman_loaded.size(), addrman.size());
+    for (const CAddress& addr : vAddr) {
+        BOOST_CHECK(addrman_loaded.GetPositions(addr) == addrman.GetPositions(addr));
+    }
+}
 
 BOOST_AUTO_TEST_CASE(addrman_selecttriedcollision)
 {
@@ -4,9 +4,13 @@
 
 #include "util/system.h"
 
+#include "memusage.h"
+#include "support/allocators/pool.h"
 #include "support/allocators/zeroafterfree.h"
 #include "test/test_trumpcoin.h"
 
+#include <unordered_map>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
@@ -231,4 +235,91 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource<16, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+    // The first chunk is only allocated when needed
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Blocks carved out of the chunk, rounded up to the alignment
+    void* a = resource.Allocate(8, 8);
+    void* b = resource.Allocate(12, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(static_cast<unsigned char*>(b) - static_cast<unsigned char*>(a), 8);
+
+    // A freed block is served again to the same size class, and only to it
+    resource.Deallocate(b, 12, 8);
+    void* c = resource.Allocate(8, 8);
+    BOOST_CHECK(c != b);
+    void* d = resource.Allocate(16, 8);
+    BOOST_CHECK(d == b);
+
+    // Too large (or overaligned) blocks bypass the pool
+    void* big = resource.Allocate(17, 8);
+    resource.Deallocate(big, 17, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Exhausting the chunk allocates a new one
+    for (int i = 0; i < 1024 / 16; i++) {
+        resource.Allocate(16, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    resource.Deallocate(a, 8, 8);
+    resource.Deallocate(c, 8, 8);
+    resource.Deallocate(d, 16, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_map_tests)
+{
+    typedef std::pair<const uint64_t, uint64_t> value_type;
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<value_type, sizeof(value_type) + sizeof(void*) * 4, alignof(void*)>> Map;
+    Map map;
+    BOOST_CHECK_EQUAL(map.get_allocator().resource()->NumAllocatedChunks(), 0U);
+    for (uint64_t i = 0; i < 100000; i++) {
+        map[i] = i;
+    }
+    const size_t nChunks = map.get_allocator().resource()->NumAllocatedChunks();
+    BOOST_CHECK(nChunks > 0);
+    // All the nodes are accounted for by the chunks
+    BOOST_CHECK(memusage::DynamicUsage(map) >= nChunks * map.get_allocator().resource()->ChunkSizeBytes());
+    BOOST_CHECK(memusage::DynamicUsage(map) >= map.size() * sizeof(value_type));
+
+    // Erased nodes are reused, no new chunk needed
+    for (uint64_t i = 0; i < 100000; i += 2) {
+        map.erase(i);
+    }
+    for (uint64_t i = 0; i < 50000; i++) {
+        map[i + 100000] = i;
+    }
+    BOOST_CHECK_EQUAL(map.get_allocator().resource()->NumAllocatedChunks(), nChunks);
+
+    // A moved-from map keeps working, on a resource of its own
+    const auto* resource = map.get_allocator().resource();
+    Map map2(std::move(map));
+    BOOST_CHECK_EQUAL(map2.size(), 100000U);
+    BOOST_CHECK(map2.get_allocator().resource() == resource);
+    BOOST_CHECK(map.get_allocator().resource() != resource);
+    BOOST_CHECK_EQUAL(map.get_allocator().resource()->NumAllocatedChunks(), 0U);
+    map[1] = 1;
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+    BOOST_CHECK_EQUAL(map2.at(100001), 1U);
+
+    // Copies, and copy assignment targets, don't share the resource either
+    Map map3(map2);
+    BOOST_CHECK(map3.get_allocator().resource() != resource);
+    BOOST_CHECK_EQUAL(map3.size(), map2.size());
+    const auto* resource3 = map3.get_allocator().resource();
+    map3 = map;
+    BOOST_CHECK(map3.get_allocator().resource() == resource3);
+    BOOST_CHECK_EQUAL(map3.size(), 1U);
+
+    // Swapping exchanges the resources along with the nodes
+    map.swap(map2);
+    BOOST_CHECK(map.get_allocator().resource() == resource);
+    BOOST_CHECK_EQUAL(map.size(), 100000U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,214 @@
+// Copyright (c) 2016-2020 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static const std::vector<std::pair<uint256, CTransactionRef>> empty_extra_txn;
+
+static CMutableTransaction SpendingTx(const uint256& hashPrev, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+// A block with a coinbase, an optional coinstake and three other transactions
+static CBlock BuildBlock(bool fProofOfStake)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = fProofOfStake ? 0 : 250 * COIN;
+    if (fProofOfStake)
+        coinbase.vout[0].SetEmpty();
+    block.vtx.emplace_back(MakeTransactionRef(coinbase));
+
+    if (fProofOfStake) {
+        CMutableTransaction coinstake;
+        coinstake.vin.resize(1);
+        coinstake.vin[0].prevout = COutPoint(InsecureRand256(), 1);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+        coinstake.vout[1].nValue = 100 * COIN;
+        block.vtx.emplace_back(MakeTransactionRef(coinstake));
+        block.vchBlockSig = {0x30, 0x44, 0x02, 0x20};
+    }
+
+    uint256 hashPrev = InsecureRand256();
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction tx = SpendingTx(hashPrev, (10 + i) * COIN);
+        hashPrev = tx.GetHash();
+        block.vtx.emplace_back(MakeTransactionRef(tx));
+    }
+
+    block.nVersion = fProofOfStake ? 10 : 4;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+    block.nTime = 1600000000;
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblockRead;
+    stream >> cmpctblockRead;
+    return cmpctblockRead;
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlock(false));
+
+    pool.addUnchecked(block.vtx[2]->GetHash(), entry.FromTx(*block.vtx[2]));
+    pool.addUnchecked(block.vtx[3]->GetHash(), entry.FromTx(*block.vtx[3]));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, empty_extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));  // prefilled coinbase
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(partialBlock.IsTxAvailable(3));
+
+    // Missing transactions must be supplied, in order and no more than needed
+    CBlock block2;
+    {
+        PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+        BOOST_CHECK(partialBlockCopy.FillBlock(block2, {}) == READ_STATUS_INVALID);
+    }
+    {
+        PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+        BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx[1], block.vtx[2]}) == READ_STATUS_INVALID);
+    }
+    {
+        // A transaction that doesn't match the short ID breaks the merkle root
+        PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+        CTransactionRef wrongTx = MakeTransactionRef(SpendingTx(InsecureRand256(), COIN));
+        BOOST_CHECK(partialBlockCopy.FillBlock(block2, {wrongTx}) == READ_STATUS_FAILED);
+    }
+
+    CBlock block3;
+    BOOST_CHECK(partialBlock.FillBlock(block3, {block.vtx[1]}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block3.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(block3.hashMerkleRoot.ToString(), BlockMerkleRoot(block3).ToString());
+}
+
+BOOST_AUTO_TEST_CASE(ExtraTxnTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlock(false));
+
+    // One transaction in the mempool, the others among the extra (orphan) transactions
+    pool.addUnchecked(block.vtx[3]->GetHash(), entry.FromTx(*block.vtx[3]));
+    std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+    extra_txn.emplace_back(block.vtx[1]->GetHash(), block.vtx[1]);
+    extra_txn.emplace_back(block.vtx[2]->GetHash(), block.vtx[2]);
+    extra_txn.emplace_back(block.vtx[3]->GetHash(), block.vtx[3]);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(ProofOfStakeTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlock(true));
+    BOOST_CHECK(block.IsProofOfStake());
+
+    for (size_t i = 2; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i]->GetHash(), entry.FromTx(*block.vtx[i]));
+
+    // The coinbase and the coinstake are prefilled, the block signature travels along
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK(cmpctblock.vchBlockSig == block.vchBlockSig);
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, empty_extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK(block2.IsProofOfStake());
+    BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlock(false));
+    block.vtx.resize(1);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, empty_extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes = {0, 1, 3, 4, std::numeric_limits<uint16_t>::max()};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK(req1.indexes == req2.indexes);
+
+    // Indexes are differentially encoded and must be increasing
+    BlockTransactionsRequest req3;
+    req3.indexes = {1, 1};
+    BOOST_CHECK_THROW(stream << req3, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,139 @@
+// Copyright (c) 2017-2019 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "index/blockfilterindex.h"
+#include "undo.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_index_tests)
+
+// The filter and header stored for a block are the ones built from the block, chained to the parent's
+static bool CheckFilterLookups(BlockFilterIndex& filter_index, const CBlockIndex* block_index, uint256& last_header)
+{
+    BlockFilter expected_filter;
+    {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, block_index)) return false;
+        if (block_index->nHeight > 0 && !UndoReadFromDisk(block_undo, block_index)) return false;
+        expected_filter = BlockFilter(BlockFilterType::BASIC_FILTER, block, block_undo);
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+
+    BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+    BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+    BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight, block_index, filter_hashes));
+
+    if (filters.size() != 1 || filter_hashes.size() != 1) return false;
+
+    BOOST_CHECK(filter.GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_header == expected_filter.ComputeHeader(last_header));
+    BOOST_CHECK(filters[0].GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_hashes[0] == expected_filter.GetHash());
+
+    last_header = filter_header;
+    return true;
+}
+
+static void WaitForSync(BlockFilterIndex& filter_index)
+{
+    // Allow the sync thread up to 10 seconds to catch up
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.IsSynced()) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, TestChain100Setup)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC_FILTER, 1 << 20, true);
+
+    // Nothing is indexed before the index is started
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainActive.Tip());
+    BlockFilter filter;
+    uint256 filter_header;
+    BOOST_CHECK(!filter_index.IsSynced());
+    BOOST_CHECK(!filter_index.LookupFilter(tip, filter));
+    BOOST_CHECK(!filter_index.LookupFilterHeader(tip, filter_header));
+
+    // The sync thread indexes the chain
+    BOOST_REQUIRE(filter_index.Start());
+    WaitForSync(filter_index);
+
+    // The headers are chained from the genesis block's, computed with a null previous header
+    std::vector<const CBlockIndex*> vChain;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            vChain.push_back(pindex);
+        }
+    }
+    uint256 last_header;
+    for (const CBlockIndex* pindex : vChain) {
+        BOOST_CHECK(CheckFilterLookups(filter_index, pindex, last_header));
+    }
+
+    // The whole chain at once
+    std::vector<BlockFilter> filters;
+    BOOST_CHECK(filter_index.LookupFilterRange(0, vChain.back(), filters));
+    BOOST_CHECK_EQUAL(filters.size(), vChain.size());
+    BOOST_CHECK(!filter_index.LookupFilterRange(vChain.back()->nHeight + 1, vChain.back(), filters));
+
+    // A reorg: two blocks of the chain replaced by a branch of four
+    std::vector<const CBlockIndex*> vStale(vChain.end() - 2, vChain.end());
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), mapBlockIndex.at(vStale[0]->GetBlockHash())));
+    }
+    CKey branchKey;
+    branchKey.MakeNewKey(true);
+    for (int i = 0; i < 4; i++) {
+        CreateAndProcessBlock({}, branchKey);
+    }
+    SyncWithValidationInterfaceQueue();
+
+    // The blocks of the new branch are indexed as they are connected, chained to the fork point
+    std::vector<const CBlockIndex*> vBranch;
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE_EQUAL(chainActive.Height(), vStale.back()->nHeight + 2);
+        for (const CBlockIndex* pindex = chainActive.Next(vStale[0]->pprev); pindex; pindex = chainActive.Next(pindex)) {
+            vBranch.push_back(pindex);
+        }
+    }
+    BOOST_CHECK_EQUAL(vBranch.size(), 4U);
+    uint256 fork_header;
+    BOOST_CHECK(filter_index.LookupFilterHeader(vStale[0]->pprev, fork_header));
+    last_header = fork_header;
+    for (const CBlockIndex* pindex : vBranch) {
+        BOOST_CHECK(CheckFilterLookups(filter_index, pindex, last_header));
+    }
+
+    // The filters of the stale blocks are still there, looked up by block hash
+    last_header = fork_header;
+    for (const CBlockIndex* pindex : vStale) {
+        BOOST_CHECK(!WITH_LOCK(cs_main, return chainActive.Contains(pindex)));
+        BOOST_CHECK(CheckFilterLookups(filter_index, pindex, last_header));
+    }
+
+    filter_index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,10 +5,15 @@
 
 #include "test/test_trumpcoin.h"
 
+#include "chain.h"
+#include "chainparams.h"
 #include "coins.h"
+#include "evo/evodb.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
+#include "utxo_snapshot.h"
 #include "utilstrencodings.h"
 #include "random.h"
 
@@ -1320,4 +1325,312 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    db.SetBackgroundFlush(true);
+    CCoinsViewCache cache(&db);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; i++) {
+        COutPoint outpoint(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.out.scriptPubKey = CScript() << OP_TRUE;
+        cache.AddCoin(outpoint, std::move(coin), false);
+        outpoints.push_back(outpoint);
+    }
+    const uint256 hashBlock1 = InsecureRand256();
+    cache.SetBestBlock(hashBlock1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // The state is complete while (and after) being written
+    BOOST_CHECK(db.GetBestBlock() == hashBlock1);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(outpoints[i], coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, (CAmount)i + 1);
+    }
+    bool fAfterWrite = false;
+    db.AfterWrite([&fAfterWrite]() { fAfterWrite = true; });
+    BOOST_CHECK(db.WaitForWrite());
+    BOOST_CHECK(fAfterWrite);
+    BOOST_CHECK(!db.IsWriting());
+    BOOST_CHECK_EQUAL(db.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock1);
+
+    CCoinsFlushStats stats = db.GetLastFlushStats();
+    BOOST_CHECK(stats.fBackground);
+    BOOST_CHECK_EQUAL(stats.nChanged, 1000U);
+    BOOST_CHECK(stats.nBytes > 0);
+
+    // Spends are served from the snapshot as well
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        cache.SpendCoin(outpoints[i]);
+    }
+    const uint256 hashBlock2 = InsecureRand256();
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+    BOOST_CHECK(db.WaitForWrite());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+}
+
+BOOST_AUTO_TEST_CASE(evodb_pending_transaction)
+{
+    // The EvoDB changes of a flush are written once the coins are, see FlushStateToDisk
+    CEvoDB evodb(1 << 20, true, true);
+    const uint256 hashBlock1 = InsecureRand256();
+    const uint256 hashBlock2 = InsecureRand256();
+    evodb.WriteBestBlock(hashBlock1);
+    evodb.DetachRootTransaction();
+
+    // Readable, but not written yet, and kept apart from the next changes
+    uint256 hashRaw;
+    BOOST_CHECK(evodb.VerifyBestBlock(hashBlock1));
+    BOOST_CHECK(!evodb.GetRawDB().Read(EVODB_BEST_BLOCK, hashRaw));
+    BOOST_CHECK(evodb.GetMemoryUsage() > 0);
+    evodb.WriteBestBlock(hashBlock2);
+    BOOST_CHECK(evodb.VerifyBestBlock(hashBlock2));
+
+    BOOST_CHECK(evodb.WritePendingTransaction());
+    BOOST_CHECK(evodb.GetRawDB().Read(EVODB_BEST_BLOCK, hashRaw));
+    BOOST_CHECK(hashRaw == hashBlock1);
+    BOOST_CHECK(evodb.VerifyBestBlock(hashBlock2));
+
+    BOOST_CHECK(evodb.CommitRootTransaction());
+    BOOST_CHECK(evodb.GetRawDB().Read(EVODB_BEST_BLOCK, hashRaw));
+    BOOST_CHECK(hashRaw == hashBlock2);
+    BOOST_CHECK_EQUAL(evodb.GetMemoryUsage(), 0U);
+}
+
+static uint256 FinalizeCommitment(CCoinsCommitment commitment)
+{
+    uint256 hash;
+    commitment.muhash.Finalize(hash);
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(coins_commitment)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    CCoinsViewCache tip(&db);
+    CCoinsCommitment commitment;
+
+    // Block 1: new coins, some of them unspendable
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    {
+        CCoinsViewCache view(&tip);
+        view.SetCommitment(&commitment);
+        for (int i = 0; i < 200; i++) {
+            COutPoint outpoint(InsecureRand256(), InsecureRandRange(3));
+            CScript script = i % 20 == 0 ? CScript() << OP_RETURN : CScript() << OP_TRUE;
+            Coin coin(CTxOut(i + 1, script), 1, i == 1, i == 2);
+            view.AddCoin(outpoint, Coin(coin), false);
+            if (i % 20) coins.emplace_back(outpoint, coin);
+        }
+        view.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(view.Flush());
+    }
+    BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, coins.size());
+    const uint256 hashCommitment1 = FinalizeCommitment(commitment);
+
+    // Block 2: spends, an overwrite, and a coin created and spent in the block
+    const Coin coinOverwrite(CTxOut(1000, CScript() << OP_TRUE), 2, false, false);
+    {
+        CCoinsViewCache view(&tip);
+        view.SetCommitment(&commitment);
+        for (size_t i = 0; i < coins.size(); i += 3) {
+            view.SpendCoin(coins[i].first);
+        }
+        BOOST_CHECK(view.HaveCoin(coins[1].first));
+        view.AddCoin(coins[1].first, Coin(coinOverwrite), true);
+        const COutPoint outpoint(InsecureRand256(), 0);
+        view.AddCoin(outpoint, Coin(CTxOut(7, CScript() << OP_TRUE), 2, false, false), false);
+        view.SpendCoin(outpoint);
+        // Spending twice has no effect
+        view.SpendCoin(coins[0].first);
+        view.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(view.Flush());
+    }
+
+    // Written along with the coins, it matches a scan of the database
+    db.SetCommitment(commitment);
+    BOOST_CHECK(tip.Flush());
+    CCoinsCommitment scanned;
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_CHECK(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        scanned.Add(key, coin);
+    }
+    BOOST_CHECK_EQUAL(scanned.nTransactionOutputs, commitment.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(scanned.nTotalAmount, commitment.nTotalAmount);
+    BOOST_CHECK(FinalizeCommitment(scanned) == FinalizeCommitment(commitment));
+    uint256 hashBlock;
+    CCoinsCommitment read;
+    BOOST_CHECK(db.ReadCommitment(hashBlock, read));
+    BOOST_CHECK(hashBlock == db.GetBestBlock());
+    BOOST_CHECK(FinalizeCommitment(read) == FinalizeCommitment(commitment));
+
+    // Undoing block 2, as DisconnectBlock does, gets back to the commitment of block 1
+    {
+        CCoinsViewCache view(&tip);
+        view.SetCommitment(&commitment);
+        view.AddCoin(coins[1].first, Coin(coins[1].second), true);
+        for (size_t i = 0; i < coins.size(); i += 3) {
+            view.AddCoin(coins[i].first, Coin(coins[i].second), false);
+        }
+    }
+    BOOST_CHECK(FinalizeCommitment(commitment) == hashCommitment1);
+}
+
+BOOST_AUTO_TEST_CASE(utxo_snapshot_roundtrip)
+{
+    const fs::path path = SetDataDir("utxo_snapshot") / "utxo.dat";
+
+    // Source chainstate: coins, a Sapling anchor and nullifier, and an evo record
+    CCoinsViewDB sourcedb(1 << 20, true, true);
+    CDBWrapper sourceevodb(GetDataDir() / "evodb_source", 1 << 20, true, true);
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    CCoinsViewCache cache(&sourcedb);
+    for (int i = 0; i < 1000; i++) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandRange(3));
+        Coin coin(CTxOut(i + 1, CScript() << OP_TRUE), i, i % 10 == 0, false);
+        cache.AddCoin(outpoint, Coin(coin), false);
+        coins.emplace_back(outpoint, coin);
+    }
+    SaplingMerkleTree tree;
+    tree.append(GetRandHash());
+    cache.PushAnchor(tree);
+    const uint256 nf = InsecureRand256();
+    {
+        CCoinsMap mapCoins;
+        CAnchorsSaplingMap mapAnchors;
+        CNullifiersMap mapNullifiers;
+        mapNullifiers[nf].entered = true;
+        mapNullifiers[nf].flags = CNullifiersCacheEntry::DIRTY;
+        BOOST_CHECK(cache.BatchWrite(mapCoins, cache.GetBestBlock(), cache.GetBestAnchor(), mapAnchors, mapNullifiers));
+    }
+    // The chainstate is at the last of three blocks after the genesis block
+    std::vector<CBlockHeader> vHeaders(4);
+    vHeaders[0] = Params().GenesisBlock().GetBlockHeader();
+    for (size_t i = 1; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = CBlockHeader::CURRENT_VERSION;
+        vHeaders[i].hashPrevBlock = vHeaders[i - 1].GetHash();
+        vHeaders[i].hashMerkleRoot = InsecureRand256();
+        vHeaders[i].nTime = vHeaders[i - 1].nTime + 60;
+    }
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    for (const CBlockHeader& header : vHeaders) {
+        vHashes.push_back(header.GetHash());
+        vIndex.emplace_back(CBlock(header));
+    }
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i > 0 ? &vIndex[i - 1] : nullptr);
+    }
+    const CBlockIndex* pindexBase = &vIndex.back();
+    vIndex.back().nChainTx = 5;
+    vIndex.back().nChainSaplingValue = 7 * COIN;
+    const uint256 hashBlock = pindexBase->GetBlockHash();
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+    sourceevodb.Write(std::make_pair('e', hashBlock), 42);
+
+    SnapshotMetadata metadata;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(DumpUTXOSnapshot(sourcedb, sourceevodb, pindexBase, file, metadata));
+    }
+    BOOST_CHECK(metadata.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(metadata.nHeaders, 3U);
+    BOOST_CHECK_EQUAL(metadata.nCoins, coins.size());
+
+    // Load it into an empty chainstate
+    CCoinsViewDB db(1 << 20, true, true);
+    CDBWrapper evodb(GetDataDir() / "evodb", 1 << 20, true, true);
+    CCoinsViewCache tip(&db);
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadataRead;
+        SnapshotShieldedState shielded;
+        CCoinsStats stats;
+        std::string strError;
+        BOOST_CHECK(VerifyUTXOSnapshot(file, metadataRead, shielded, stats, strError));
+        BOOST_CHECK(metadataRead.hashUTXOSet == metadata.hashUTXOSet);
+        BOOST_CHECK_EQUAL(stats.nTransactionOutputs, coins.size());
+        BOOST_CHECK_EQUAL(shielded.nSaplingPoolValue, 7 * COIN);
+        BOOST_CHECK_EQUAL(shielded.nChainTx, 5U);
+        // The headers, for LoadSnapshotHeaders, need a block index
+        for (uint32_t i = 0; i < metadataRead.nHeaders; i++) {
+            CBlockHeader header;
+            file >> header;
+            BOOST_CHECK(header.GetHash() == vHashes[i + 1]);
+        }
+        BOOST_CHECK(LoadUTXOSnapshot(file, metadataRead, shielded, db, tip, evodb));
+    }
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (const auto& entry : coins) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(entry.first, coin));
+        BOOST_CHECK(coin == entry.second);
+    }
+    BOOST_CHECK(db.GetBestAnchor() == tree.root());
+    SaplingMerkleTree treeRead;
+    BOOST_CHECK(db.GetSaplingAnchorAt(tree.root(), treeRead));
+    BOOST_CHECK(db.GetNullifier(nf));
+    int nValue = 0;
+    BOOST_CHECK(evodb.Read(std::make_pair('e', hashBlock), nValue));
+    BOOST_CHECK_EQUAL(nValue, 42);
+
+    // The loaded chainstate dumps to the same snapshot
+    SnapshotMetadata metadataLoaded;
+    {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "utxo2.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(DumpUTXOSnapshot(db, evodb, pindexBase, file, metadataLoaded));
+    }
+    BOOST_CHECK(metadataLoaded.hashUTXOSet == metadata.hashUTXOSet);
+    BOOST_CHECK(metadataLoaded.hashShieldedState == metadata.hashShieldedState);
+
+    // A snapshot with a byte flipped at nPos is refused
+    auto VerifyTampered = [&path](long nPos) {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, nPos, SEEK_SET);
+        const int ch = fgetc(file);
+        fseek(file, nPos, SEEK_SET);
+        fputc(ch ^ 0x01, file);
+        fclose(file);
+
+        CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadataRead;
+        SnapshotShieldedState shielded;
+        CCoinsStats stats;
+        std::string strError;
+        return VerifyUTXOSnapshot(afile, metadataRead, shielded, stats, strError);
+    };
+
+    // A tampered header, then a tampered coin (the header restored)
+    long nPos = ::GetSerializeSize(metadata, PROTOCOL_VERSION) + 40;
+    BOOST_CHECK(!VerifyTampered(nPos));
+    BOOST_CHECK(VerifyTampered(nPos));
+    for (size_t i = 1; i < vHeaders.size(); i++) {
+        nPos += ::GetSerializeSize(vHeaders[i], PROTOCOL_VERSION);
+    }
+    BOOST_CHECK(!VerifyTampered(nPos));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "flatfile.h"
+#include "streams.h"
 #include "test/test_trumpcoin.h"
 
 #include <boost/test/unit_test.hpp>
@@ -120,4 +121,60 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "m", 16 * 1024);
+
+    // Three files, each with its number at position 4
+    for (int nFile = 0; nFile < 3; nFile++) {
+        CAutoFile file(seq.Open(FlatFilePos(nFile, 0)), SER_DISK, CLIENT_VERSION);
+        file << (uint32_t)0 << nFile << std::string("end");
+    }
+
+    FlatFileMapCache cache(2);
+    std::shared_ptr<const MappedFlatFile> first = cache.Get(seq, FlatFilePos(0, 4));
+    BOOST_REQUIRE(first);
+    for (int nFile = 0; nFile < 3; nFile++) {
+        std::shared_ptr<const MappedFlatFile> mapped = cache.Get(seq, FlatFilePos(nFile, 4));
+        BOOST_REQUIRE(mapped);
+        BOOST_CHECK_EQUAL(mapped->GetSpan().size(), fs::file_size(seq.FileName(FlatFilePos(nFile, 0))));
+        SpanReader reader(SER_DISK, CLIENT_VERSION, mapped->GetSpan().subspan(4));
+        int n;
+        std::string str;
+        reader >> n >> str;
+        BOOST_CHECK_EQUAL(n, nFile);
+        BOOST_CHECK_EQUAL(str, "end");
+        BOOST_CHECK(reader.empty());
+        BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    }
+    // The first file was unmapped from the cache, but stays valid while used
+    BOOST_CHECK(cache.Get(seq, FlatFilePos(0, 4)) != first);
+    BOOST_CHECK_EQUAL(first->GetSpan()[4], 0);
+    BOOST_CHECK(cache.Get(seq, FlatFilePos(2, 4)) == cache.Get(seq, FlatFilePos(2, 0)));
+
+    // Appended to, the file is mapped again once invalidated, with the new data
+    std::shared_ptr<const MappedFlatFile> last = cache.Get(seq, FlatFilePos(2, 4));
+    const size_t nSizeOld = last->GetSpan().size();
+    {
+        CAutoFile file(seq.Open(FlatFilePos(2, nSizeOld)), SER_DISK, CLIENT_VERSION);
+        file << std::string("more");
+    }
+    BOOST_CHECK(cache.Get(seq, FlatFilePos(2, 4)) == last);
+    cache.Invalidate(2);
+    std::shared_ptr<const MappedFlatFile> appended = cache.Get(seq, FlatFilePos(2, nSizeOld));
+    BOOST_REQUIRE(appended && appended != last);
+    BOOST_CHECK_EQUAL(last->GetSpan().size(), nSizeOld);
+    SpanReader reader(SER_DISK, CLIENT_VERSION, appended->GetSpan().subspan(nSizeOld));
+    std::string str;
+    reader >> str;
+    BOOST_CHECK_EQUAL(str, "more");
+
+    // Missing files and null positions aren't mapped
+    BOOST_CHECK(!cache.Get(seq, FlatFilePos(3, 0)));
+    BOOST_CHECK(!cache.Get(seq, FlatFilePos()));
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -101,6 +101,42 @@ BOOST_AUTO_TEST_CASE(SaplingToSapling)
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
 }
 
+BOOST_AUTO_TEST_CASE(DeferredProofsVerification)
+{
+    auto consensusParams = Params().GetConsensus();
+
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto expsk = sk.expanded_spending_key();
+    auto fvk = sk.full_viewing_key();
+    auto pa = sk.default_address();
+
+    auto testNote = GetTestSaplingNote(pa, 40000000);
+    auto builder = TransactionBuilder(consensusParams);
+    builder.AddSaplingSpend(expsk, testNote.note, testNote.tree.root(), testNote.tree.witness());
+    builder.SetFee(10000000);
+    builder.AddSaplingOutput(fvk.ovk, pa, 29900000, {});
+    CMutableTransaction mtx(builder.Build().GetTxOrThrow());
+
+    // Valid proofs pass both the inline and the queued verification
+    const CTransaction tx(mtx);
+    CValidationState state;
+    BOOST_CHECK(SaplingValidation::CheckTransactionProofs(tx, state, 100));
+    BOOST_CHECK(CSaplingProofCheck(tx, 100)());
+
+    // Corrupt the output proof
+    mtx.sapData->vShieldedOutput[0].zkproof[0] ^= 0x01;
+    const CTransaction txBad(mtx);
+
+    // Skipping the proofs, the contextual checks pass
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(txBad, state, Params(), 3, true, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // ..but the deferred verification catches the bad proof
+    BOOST_CHECK(!CSaplingProofCheck(txBad, 100)());
+    BOOST_CHECK(!SaplingValidation::CheckTransactionProofs(txBad, state, 100));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-output-description-invalid");
+}
+
 BOOST_AUTO_TEST_CASE(ThrowsOnTransparentInputWithoutKeyStore)
 {
     auto builder = TransactionBuilder(Params().GetConsensus());
@@ -5,6 +5,7 @@
 #include "test/test_trumpcoin.h"
 
 #include "policy/feerate.h"
+#include "script/interpreter.h"
 #include "txmempool.h"
 #include "util/system.h"
 
@@ -579,4 +580,39 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolPrecomputedTxDataTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_11;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    CMutableTransaction tx2 = tx1;
+    tx2.vout[0].nValue = 5 * COIN;
+
+    // Entry added with its signature hash midstates, as AcceptToMemoryPool does
+    const CTransaction tx1Final(tx1);
+    CTxMemPoolEntry entry1 = entry.FromTx(tx1Final);
+    auto precomTxData = std::make_shared<PrecomputedTransactionData>(tx1Final);
+    entry1.SetPrecomputedTxData(precomTxData);
+    pool.addUnchecked(tx1Final.GetHash(), entry1);
+    // ...and one without them
+    pool.addUnchecked(tx2.GetHash(), entry.FromTx(tx2));
+
+    BOOST_CHECK(pool.GetPrecomputedTxData(tx1Final.GetHash()) == precomTxData);
+    BOOST_CHECK(pool.GetPrecomputedTxData(tx2.GetHash()) == nullptr);
+    BOOST_CHECK(pool.GetPrecomputedTxData(UINT256_ZERO) == nullptr);
+    BOOST_CHECK_EQUAL(pool.GetPrecomputedHits(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetPrecomputedMisses(), 2U);
+
+    // The data outlives the entry for whoever still holds it
+    pool.removeRecursive(tx1Final);
+    BOOST_CHECK(pool.GetPrecomputedTxData(tx1Final.GetHash()) == nullptr);
+    BOOST_CHECK(precomTxData->hashOutputs == PrecomputedTransactionData(tx1Final).hashOutputs);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
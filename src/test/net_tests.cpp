@@ -702,4 +702,50 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(MsgProcessTimes_Buckets)
+{
+    CMsgProcessTimes times;
+    times.Add(0);
+    times.Add(9);
+    times.Add(10);
+    times.Add(12345);
+    times.Add(std::numeric_limits<int32_t>::max());
+
+    BOOST_CHECK_EQUAL(times.nCount, 5U);
+    BOOST_CHECK_EQUAL(times.nTotalMicros, 0 + 9 + 10 + 12345 + (int64_t)std::numeric_limits<int32_t>::max());
+    BOOST_CHECK_EQUAL(times.vBuckets[0], 2U); // < 10us
+    BOOST_CHECK_EQUAL(times.vBuckets[1], 1U); // < 100us
+    BOOST_CHECK_EQUAL(times.vBuckets[4], 1U); // < 100ms
+    BOOST_CHECK_EQUAL(times.vBuckets[CMsgProcessTimes::BUCKETS - 1], 1U); // the rest
+}
+
+BOOST_AUTO_TEST_CASE(SharedMessage_Header)
+{
+    std::vector<unsigned char> payload(1000, 0x42);
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    msg.data = payload;
+    CSharedNetMsg shared = CConnman::MakeSharedMessage(std::move(msg));
+
+    BOOST_CHECK_EQUAL(shared.command, NetMsgType::BLOCK);
+    BOOST_CHECK(*shared.data == payload);
+    BOOST_CHECK_EQUAL(shared.size(), CMessageHeader::HEADER_SIZE + payload.size());
+
+    CDataStream ss(*shared.header, SER_NETWORK, INIT_PROTO_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    ss >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    BOOST_CHECK(memcmp(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+
+    // Empty payloads only queue the header
+    CSerializedNetMsg empty;
+    empty.command = NetMsgType::VERACK;
+    CSharedNetMsg sharedEmpty = CConnman::MakeSharedMessage(std::move(empty));
+    BOOST_CHECK(!sharedEmpty.data);
+    BOOST_CHECK_EQUAL(sharedEmpty.size(), CMessageHeader::HEADER_SIZE);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "netbase.h"
+#include "socketevents.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
+BOOST_FIXTURE_TEST_SUITE(socketevents_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(socketevents_backend)
+{
+    SocketEventsWaiter waiter;
+    SocketEventsWaiter waiterNoEpoll(false);
+#if defined(USE_EPOLL)
+    BOOST_CHECK_EQUAL(std::string(waiter.GetBackendName()), "epoll");
+    BOOST_CHECK_EQUAL(std::string(waiterNoEpoll.GetBackendName()), "poll");
+#elif defined(USE_POLL)
+    BOOST_CHECK_EQUAL(std::string(waiter.GetBackendName()), "poll");
+    BOOST_CHECK_EQUAL(std::string(waiterNoEpoll.GetBackendName()), "poll");
+#else
+    BOOST_CHECK_EQUAL(std::string(waiter.GetBackendName()), "select");
+    BOOST_CHECK_EQUAL(std::string(waiterNoEpoll.GetBackendName()), "select");
+#endif
+}
+
+#ifndef WIN32
+
+// Connected sockets, the events of the first one being waited for, the second one used as its peer
+struct SocketPair {
+    SOCKET hSockets[2];
+    int nRegistered{-1};
+
+    SocketPair()
+    {
+        int fds[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        hSockets[0] = fds[0];
+        hSockets[1] = fds[1];
+    }
+
+    ~SocketPair()
+    {
+        CloseSocket(hSockets[0]);
+        CloseSocket(hSockets[1]);
+    }
+};
+
+// The events reported for nTag by a wait, 0 if it isn't reported
+static int WaitFor(SocketEventsWaiter& waiter, uint64_t nTag, int64_t nTimeout)
+{
+    CThreadInterrupt interrupt;
+    std::vector<std::pair<uint64_t, int>> vReady;
+    BOOST_CHECK(waiter.Wait(nTimeout, vReady, interrupt));
+    int nEvents = 0;
+    for (const auto& ready : vReady) {
+        if (ready.first == nTag) nEvents |= ready.second;
+    }
+    return nEvents;
+}
+
+static void CheckReadiness(bool fAllowEpoll)
+{
+    SocketEventsWaiter waiter(fAllowEpoll);
+    SocketPair idle, active;
+    const uint64_t nTagIdle = 1, nTagActive = (uint64_t)1 << 63 | 2;
+    const char data[] = "data";
+
+    // Nothing to receive yet
+    waiter.Watch(idle.hSockets[0], nTagIdle, SOCKET_EVENT_RECV, idle.nRegistered);
+    waiter.Watch(active.hSockets[0], nTagActive, SOCKET_EVENT_RECV, active.nRegistered);
+    BOOST_CHECK_EQUAL(WaitFor(waiter, nTagActive, 0), 0);
+
+    // Only the socket with data to receive is reported, by its tag
+    BOOST_REQUIRE_EQUAL(send(active.hSockets[1], data, sizeof(data), 0), (ssize_t)sizeof(data));
+    waiter.Watch(idle.hSockets[0], nTagIdle, SOCKET_EVENT_RECV, idle.nRegistered);
+    waiter.Watch(active.hSockets[0], nTagActive, SOCKET_EVENT_RECV, active.nRegistered);
+    CThreadInterrupt interrupt;
+    std::vector<std::pair<uint64_t, int>> vReady;
+    BOOST_CHECK(waiter.Wait(1000, vReady, interrupt));
+    BOOST_REQUIRE_EQUAL(vReady.size(), 1U);
+    BOOST_CHECK_EQUAL(vReady[0].first, nTagActive);
+    BOOST_CHECK_EQUAL(vReady[0].second, SOCKET_EVENT_RECV);
+
+    // Once the data is received, waiting for room to send instead
+    char buf[sizeof(data)];
+    BOOST_REQUIRE_EQUAL(recv(active.hSockets[0], buf, sizeof(buf), 0), (ssize_t)sizeof(data));
+    waiter.Watch(idle.hSockets[0], nTagIdle, SOCKET_EVENT_RECV, idle.nRegistered);
+    waiter.Watch(active.hSockets[0], nTagActive, SOCKET_EVENT_SEND, active.nRegistered);
+    BOOST_CHECK_EQUAL(WaitFor(waiter, nTagActive, 1000), SOCKET_EVENT_SEND);
+
+    // A peer closing the connection wakes the receive side up
+    CloseSocket(idle.hSockets[1]);
+    waiter.Watch(idle.hSockets[0], nTagIdle, SOCKET_EVENT_RECV, idle.nRegistered);
+    waiter.Watch(active.hSockets[0], nTagActive, 0, active.nRegistered);
+    BOOST_CHECK(WaitFor(waiter, nTagIdle, 1000) & (SOCKET_EVENT_RECV | SOCKET_EVENT_ERROR));
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_readiness)
+{
+    CheckReadiness(true);
+    CheckReadiness(false);
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socketevents_epoll_registration)
+{
+    SocketEventsWaiter waiter;
+    SocketPair pair;
+    const char data[] = "data";
+
+    // The socket stays registered across waits, and is only re-registered on a change of events
+    waiter.Watch(pair.hSockets[0], 7, SOCKET_EVENT_RECV, pair.nRegistered);
+    BOOST_CHECK_EQUAL(pair.nRegistered, SOCKET_EVENT_RECV);
+    BOOST_REQUIRE_EQUAL(send(pair.hSockets[1], data, sizeof(data), 0), (ssize_t)sizeof(data));
+    BOOST_CHECK_EQUAL(WaitFor(waiter, 7, 1000), SOCKET_EVENT_RECV);
+    BOOST_CHECK_EQUAL(WaitFor(waiter, 7, 1000), SOCKET_EVENT_RECV);
+
+    waiter.Watch(pair.hSockets[0], 7, SOCKET_EVENT_RECV | SOCKET_EVENT_SEND, pair.nRegistered);
+    BOOST_CHECK_EQUAL(pair.nRegistered, SOCKET_EVENT_RECV | SOCKET_EVENT_SEND);
+    BOOST_CHECK_EQUAL(WaitFor(waiter, 7, 1000), SOCKET_EVENT_RECV | SOCKET_EVENT_SEND);
+}
+#endif
+
+#endif // WIN32
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "legacy/stakemodifier.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+// Blocks a minute apart, each one generating a stake modifier, on top of pprev
+static void BuildBlocks(std::vector<uint256>& vHashes, std::vector<CBlockIndex>& vBlocks, CBlockIndex* pprev, int nBlocks)
+{
+    vHashes.reserve(nBlocks);
+    vBlocks.resize(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockIndex& block = vBlocks[i];
+        vHashes.push_back(InsecureRand256());
+        block.phashBlock = &vHashes[i];
+        block.pprev = i > 0 ? &vBlocks[i - 1] : pprev;
+        block.nHeight = block.pprev ? block.pprev->nHeight + 1 : 0;
+        block.nTime = block.pprev ? block.pprev->nTime + 30 + InsecureRandRange(60) : 1600000000;
+        block.SetStakeModifier(insecure_rand_ctx.rand64(), true);
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(stakemodifier_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(stake_modifier_cache_db)
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+    BuildBlocks(vHashes, vBlocks, nullptr, 200);
+
+    StakeModifierCache cache(pblocktree.get());
+    for (int i = 0; i < 100; i++) {
+        cache.Set(i, &vBlocks[i + 50]);
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 100U);
+    BOOST_CHECK(cache.Get(100) == nullptr);
+    BOOST_CHECK(cache.Get(-1) == nullptr);
+    cache.Flush();
+
+    // Read back, without the blocks missing from the index
+    StakeModifierCache cacheLoaded(pblocktree.get());
+    BOOST_CHECK(cacheLoaded.Load([&](const uint256& hash) -> const CBlockIndex* {
+        for (int i = 0; i < 120; i++) {
+            if (vHashes[i] == hash) return &vBlocks[i];
+        }
+        return nullptr;
+    }));
+    BOOST_CHECK_EQUAL(cacheLoaded.Size(), 70U);
+    for (int i = 0; i < 70; i++) {
+        BOOST_CHECK(cacheLoaded.Get(i) == &vBlocks[i + 50]);
+    }
+    BOOST_CHECK(cacheLoaded.Get(70) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_cache_reorg)
+{
+    std::vector<uint256> vHashes, vHashesFork;
+    std::vector<CBlockIndex> vBlocks, vBlocksFork;
+    BuildBlocks(vHashes, vBlocks, nullptr, 1000);
+
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+    std::unique_ptr<StakeModifierCache> cache(new StakeModifierCache(nullptr));
+    std::swap(stakeModifierCache, cache);
+    chainActive.SetTip(&vBlocks.back());
+
+    // The modifiers looked up are the ones found walking the chain, and are cached
+    uint64_t nStakeModifier;
+    for (int i = 0; i < 900; i++) {
+        BOOST_CHECK(GetOldModifier(&vBlocks[i], nStakeModifier));
+        const CBlockIndex* pindex = FindOldModifierBlock(&vBlocks[i]);
+        BOOST_CHECK(pindex && pindex->nHeight > i);
+        BOOST_CHECK_EQUAL(nStakeModifier, pindex->GetStakeModifierV1());
+        BOOST_CHECK(stakeModifierCache->Get(i) == pindex);
+    }
+
+    // After a reorg, the modifiers in the blocks disconnected aren't used anymore
+    BuildBlocks(vHashesFork, vBlocksFork, &vBlocks[499], 500);
+    chainActive.SetTip(&vBlocksFork.back());
+    for (int i = 400; i < 500; i++) {
+        BOOST_CHECK(GetOldModifier(&vBlocks[i], nStakeModifier));
+        const CBlockIndex* pindex = FindOldModifierBlock(&vBlocks[i]);
+        BOOST_CHECK(pindex && chainActive.Contains(pindex));
+        BOOST_CHECK_EQUAL(nStakeModifier, pindex->GetStakeModifierV1());
+        BOOST_CHECK(stakeModifierCache->Get(i) == pindex);
+    }
+
+    // Coins of the disconnected blocks aren't cached
+    const CBlockIndex* pindexCached = stakeModifierCache->Get(600);
+    BOOST_CHECK(GetOldModifier(&vBlocks[600], nStakeModifier));
+    BOOST_CHECK(stakeModifierCache->Get(600) == pindexCached);
+
+    chainActive.SetTip(pindexTipOld);
+    std::swap(stakeModifierCache, cache);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -47,6 +47,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     BLSInit();
     SetupEnvironment();
     InitSignatureCache();
+    InitScriptExecutionCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
     evoDb.reset(new CEvoDB(1 << 20, true, true));
@@ -107,8 +108,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             BOOST_CHECK(ok);
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingProofCheck);
+        }
         peerLogic.reset(new PeerLogicValidation(connman));
 }
 
@@ -17,6 +17,7 @@
 #include "policy/policy.h"
 #include "script/script.h"
 #include "script/script_error.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "validation.h"
 
@@ -395,6 +396,60 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_batch_script_checks)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction mtx;
+    for (uint32_t i = 0; i < 10; i++) {
+        mtx.vin.emplace_back(COutPoint(uint256S("0100"), i));
+    }
+    mtx.vout.emplace_back(9000, CScript() << OP_1);
+    for (uint32_t i = 0; i < mtx.vin.size(); i++) {
+        BOOST_CHECK(SignSignature(keystore, scriptPubKey, mtx, i, 1000, SIGHASH_ALL));
+    }
+    // A copy with the signature of the last input made invalid (but still DER)
+    CMutableTransaction mtxBad = mtx;
+    std::vector<unsigned char> vchSig(mtxBad.vin[9].scriptSig.begin() + 1, mtxBad.vin[9].scriptSig.begin() + 1 + mtxBad.vin[9].scriptSig[0]);
+    vchSig[10] ^= 0x01;
+    mtxBad.vin[9].scriptSig = CScript() << vchSig << ToByteVector(key.GetPubKey());
+
+    const CTransaction tx(mtx), txBad(mtxBad);
+    PrecomputedTransactionData precomTxData(tx), precomTxDataBad(txBad);
+    const CTxOut prevOut(1000, scriptPubKey);
+
+    auto runChecks = [&](const CTransaction& txTo, PrecomputedTransactionData& precom) {
+        std::vector<CScriptCheck> vChecks;
+        for (uint32_t i = 0; i < txTo.vin.size(); i++) {
+            vChecks.emplace_back(prevOut, txTo, i, SCRIPT_VERIFY_P2SH, false, &precom);
+        }
+        return RunChecksBatch(vChecks);
+    };
+
+    for (bool fBatch : {false, true}) {
+        fBatchScriptChecks = fBatch;
+        BOOST_CHECK(runChecks(tx, precomTxData));
+        BOOST_CHECK(!runChecks(txBad, precomTxDataBad));
+    }
+    fBatchScriptChecks = DEFAULT_BATCH_SCRIPTCHECKS;
+
+    // Signatures queued in a batch
+    CSignatureBatch batch;
+    BOOST_CHECK(CScriptCheck(prevOut, tx, 0, SCRIPT_VERIFY_P2SH, false, &precomTxData).VerifyDeferred(batch));
+    BOOST_CHECK_EQUAL(batch.size(), 1);
+    BOOST_CHECK(CScriptCheck(prevOut, txBad, 9, SCRIPT_VERIFY_P2SH, false, &precomTxDataBad).VerifyDeferred(batch));
+    BOOST_CHECK_EQUAL(batch.size(), 2);
+    BOOST_CHECK(batch.Verify(0, 1));
+    BOOST_CHECK(!batch.Verify(1, 2));
+    BOOST_CHECK(!batch.Verify());
+    batch.Truncate(1);
+    BOOST_CHECK(batch.Verify());
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard)
 {
     LOCK(cs_main);
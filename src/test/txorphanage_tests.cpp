@@ -0,0 +1,248 @@
+// Copyright (c) 2011-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "arith_uint256.h"
+#include "keystore.h"
+#include "net_processing.h"
+#include "primitives/block.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txorphanage.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txorphanage_tests, BasicTestingSetup)
+
+class TxOrphanageTest : public TxOrphanage
+{
+public:
+    CTransactionRef RandomOrphan() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+    {
+        auto it = std::next(m_orphans.begin(), InsecureRandRange(m_orphans.size()));
+        return it->second.tx;
+    }
+
+    size_t CountPeerOrphans(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+    {
+        auto it = m_peers.find(peer);
+        return it == m_peers.end() ? 0 : it->second.orphans.size();
+    }
+};
+
+static void MakeNewKeyWithFastRandomContext(CKey& key)
+{
+    std::vector<unsigned char> keydata;
+    keydata = insecure_rand_ctx.randbytes(32);
+    key.Set(keydata.data(), keydata.data() + keydata.size(), /*fCompressedIn*/ true);
+    assert(key.IsValid());
+}
+
+// A transaction spending the given outpoints, with an output of nSize bytes
+static CTransactionRef MakeOrphan(const std::vector<COutPoint>& vPrevouts, size_t nSize = 0)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : vPrevouts) {
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptSig << OP_1;
+    }
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(nSize, 0);
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
+{
+    // This test had non-deterministic coverage due to
+    // randomly selected seeds.
+    // This seed is chosen so that all branches of the function
+    // ecdsa_signature_parse_der_lax are executed during this test.
+    // Specifically branches that run only when an ECDSA
+    // signature's R and S values have leading zeros.
+    insecure_rand_ctx = FastRandomContext(ArithToUint256(arith_uint256(33)));
+
+    TxOrphanageTest orphanage;
+    CKey key;
+    MakeNewKeyWithFastRandomContext(key);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    LOCK(g_cs_orphans);
+
+    // 50 orphan transactions:
+    for (int i = 0; i < 50; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+        orphanage.AddTx(MakeTransactionRef(tx), i);
+    }
+
+    // ... and 50 that depend on other orphans:
+    for (int i = 0; i < 50; i++)
+    {
+        CTransactionRef txPrev = orphanage.RandomOrphan();
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = txPrev->GetHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
+
+        orphanage.AddTx(MakeTransactionRef(tx), i);
+    }
+
+    // This really-big orphan should be ignored:
+    for (int i = 0; i < 10; i++)
+    {
+        CTransactionRef txPrev = orphanage.RandomOrphan();
+
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        tx.vin.resize(2777);
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+        {
+            tx.vin[j].prevout.n = j;
+            tx.vin[j].prevout.hash = txPrev->GetHash();
+        }
+        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
+        // Re-use same signature for other inputs
+        // (they don't have to be valid for this test)
+        for (unsigned int j = 1; j < tx.vin.size(); j++)
+            tx.vin[j].scriptSig = tx.vin[0].scriptSig;
+
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
+    }
+
+    // Test EraseForPeer:
+    for (NodeId i = 0; i < 3; i++)
+    {
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(i), 0U);
+    }
+
+    // Test LimitOrphans() function:
+    orphanage.LimitOrphans(40, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0, std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphan_size_limit)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    // Peer 0 floods big orphans, peer 1 sends a few small ones
+    const size_t nBigSize = MakeOrphan({COutPoint()}, 5000)->GetTotalSize();
+    const size_t nSmallSize = MakeOrphan({COutPoint()})->GetTotalSize();
+    for (int i = 0; i < 20; i++) {
+        BOOST_CHECK(orphanage.AddTx(MakeOrphan({COutPoint(InsecureRand256(), 0)}, 5000), 0));
+    }
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK(orphanage.AddTx(MakeOrphan({COutPoint(InsecureRand256(), 0)}), 1));
+    }
+    BOOST_CHECK_EQUAL(orphanage.TotalSize(), 20 * nBigSize + 5 * nSmallSize);
+
+    // The eviction to honour the size limit falls on the peer with the largest orphans
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 10 * nBigSize + 5 * nSmallSize), 10U);
+    BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(0), 10U);
+    BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(1), 5U);
+
+    // The other peers' orphans go once it holds less than them
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 5 * nSmallSize), 10U);
+    BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(0), 0U);
+    BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(1), 5U);
+    orphanage.LimitOrphans(100, 0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphan_expiry)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    const int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+    CTransactionRef tx = MakeOrphan({COutPoint(InsecureRand256(), 0)});
+    BOOST_CHECK(orphanage.AddTx(tx, 0));
+    BOOST_CHECK(!orphanage.AddTx(tx, 1));
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 100000), 0U);
+    BOOST_CHECK(orphanage.HaveTx(tx->GetHash()));
+
+    // Expired orphans are erased at the next sweep, not counted as evicted
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME + ORPHAN_TX_EXPIRE_INTERVAL);
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 100000), 0U);
+    BOOST_CHECK(!orphanage.HaveTx(tx->GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.CountPeerOrphans(0), 0U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(orphan_work_set)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    // A parent with two outputs, children from two peers, and a grandchild
+    CMutableTransaction parent;
+    parent.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    parent.vout.resize(2);
+    const uint256 parentHash = parent.GetHash();
+
+    CTransactionRef child0 = MakeOrphan({COutPoint(parentHash, 0)});
+    CTransactionRef child1 = MakeOrphan({COutPoint(parentHash, 1)});
+    CTransactionRef grandchild = MakeOrphan({COutPoint(child0->GetHash(), 0)});
+    BOOST_CHECK(orphanage.AddTx(child0, 0));
+    BOOST_CHECK(orphanage.AddTx(child1, 1));
+    BOOST_CHECK(orphanage.AddTx(grandchild, 0));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(0));
+    BOOST_CHECK(orphanage.GetTxToReconsider(0) == nullptr);
+
+    // Each child is reconsidered by the peer it came from
+    orphanage.AddChildrenToWorkSet(CTransaction(parent));
+    BOOST_CHECK(orphanage.HaveTxToReconsider(0));
+    BOOST_CHECK(orphanage.HaveTxToReconsider(1));
+    BOOST_CHECK(orphanage.GetTxToReconsider(0) == child0);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(0));
+
+    // Once a child is accepted, its own children are to be reconsidered
+    orphanage.AddChildrenToWorkSet(*child0);
+    orphanage.EraseTx(child0->GetHash());
+    BOOST_CHECK(orphanage.GetTxToReconsider(0) == grandchild);
+
+    // Erased orphans leave the work set
+    orphanage.EraseForPeer(1);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+
+    // A block spending the grandchild's input erases it
+    CBlock block;
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(child0->GetHash(), 0));
+    block.vtx.push_back(MakeTransactionRef(spend));
+    orphanage.EraseForBlock(block);
+    BOOST_CHECK(!orphanage.HaveTx(grandchild->GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,272 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_trumpcoin.h"
+
+#include "streams.h"
+#include "txreconciliation.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+static std::vector<uint32_t> RandomShortIDs(size_t count)
+{
+    std::set<uint32_t> ids;
+    while (ids.size() < count) {
+        uint32_t id = InsecureRand32();
+        if (id != 0) ids.insert(id);
+    }
+    return std::vector<uint32_t>(ids.begin(), ids.end());
+}
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    const size_t nCommon = 500;
+    const size_t nDifference = 40;
+    const std::vector<uint32_t> ids = RandomShortIDs(nCommon + nDifference);
+
+    // The first half of the difference in the first set only, the other half in the second one only.
+    // The sketch is oversized, for the test not to depend on the rare failures to decode.
+    const size_t nCells = ReconciliationSketch::CellsForCapacity(4 * nDifference);
+    ReconciliationSketch sketch1(nCells), sketch2(nCells);
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i >= nDifference || i < nDifference / 2) sketch1.Toggle(ids[i]);
+        if (i >= nDifference / 2) sketch2.Toggle(ids[i]);
+    }
+
+    // Serialization round trip
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << sketch2;
+    BOOST_CHECK_EQUAL(stream.size(), GetSizeOfCompactSize(nCells) + nCells * 8);
+    ReconciliationSketch sketch2Read;
+    stream >> sketch2Read;
+    BOOST_CHECK_EQUAL(sketch2Read.GetCellCount(), nCells);
+
+    sketch1 ^= sketch2Read;
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(sketch1.Decode(vDecoded));
+    std::sort(vDecoded.begin(), vDecoded.end());
+    std::vector<uint32_t> vExpected(ids.begin(), ids.begin() + nDifference);
+    std::sort(vExpected.begin(), vExpected.end());
+    BOOST_CHECK(vDecoded == vExpected);
+
+    // Equal sets cancel out
+    ReconciliationSketch sketch3(nCells);
+    for (uint32_t id : ids) sketch3.Toggle(id);
+    ReconciliationSketch sketch4(sketch3);
+    sketch3 ^= sketch4;
+    BOOST_CHECK(sketch3.IsEmpty());
+    BOOST_CHECK(sketch3.Decode(vDecoded));
+    BOOST_CHECK(vDecoded.empty());
+}
+
+BOOST_AUTO_TEST_CASE(sketch_overflow)
+{
+    // A difference much larger than the capacity can't be decoded
+    const size_t nCells = ReconciliationSketch::CellsForCapacity(10);
+    ReconciliationSketch sketch(nCells);
+    for (uint32_t id : RandomShortIDs(100)) sketch.Toggle(id);
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(!sketch.Decode(vDecoded));
+
+    BOOST_CHECK(ReconciliationSketch::IsValidCellCount(0));
+    BOOST_CHECK(ReconciliationSketch::IsValidCellCount(nCells));
+    BOOST_CHECK(!ReconciliationSketch::IsValidCellCount(nCells + 1));
+    BOOST_CHECK(!ReconciliationSketch::IsValidCellCount(ReconciliationSketch::SKETCH_HASHES));
+    BOOST_CHECK(!ReconciliationSketch::IsValidCellCount(ReconciliationSketch::CellsForCapacity(MAX_SKETCH_CAPACITY) + ReconciliationSketch::SKETCH_HASHES));
+}
+
+BOOST_AUTO_TEST_CASE(capacity_estimate)
+{
+    const uint16_t q = RECON_Q * Q_PRECISION;
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(0, 0, q), 1U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(100, 20, q), 85U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(20, 100, q), 85U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(60000, 0, q), MAX_SKETCH_CAPACITY);
+}
+
+// Set up a connection between two trackers, the first one being the outbound side
+static void Connect(TxReconciliationTracker& initiator, TxReconciliationTracker& responder, NodeId id)
+{
+    const uint64_t salt_initiator = initiator.PreRegisterPeer(id);
+    const uint64_t salt_responder = responder.PreRegisterPeer(id);
+    BOOST_CHECK(initiator.RegisterPeer(id, false, TXRECONCILIATION_VERSION, salt_responder));
+    BOOST_CHECK(responder.RegisterPeer(id, true, TXRECONCILIATION_VERSION, salt_initiator));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_registration)
+{
+    TxReconciliationTracker tracker;
+    // No sendtxiblt was sent to the peer
+    BOOST_CHECK(!tracker.RegisterPeer(0, true, TXRECONCILIATION_VERSION, 1));
+    // Unsupported version
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(!tracker.RegisterPeer(0, true, 0, 1));
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+
+    tracker.PreRegisterPeer(1);
+    BOOST_CHECK(tracker.RegisterPeer(1, true, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(tracker.IsPeerRegistered(1));
+    // A transaction isn't flooded to inbound peers, but always to peers not reconciling
+    BOOST_CHECK(!tracker.ShouldFloodTo(1, InsecureRand256()));
+    BOOST_CHECK(tracker.ShouldFloodTo(2, InsecureRand256()));
+    BOOST_CHECK(!tracker.AddToSet(2, InsecureRand256()));
+
+    // A single outbound peer gets every transaction
+    tracker.PreRegisterPeer(3);
+    BOOST_CHECK(tracker.RegisterPeer(3, false, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(tracker.ShouldFloodTo(3, InsecureRand256()));
+
+    tracker.ForgetPeer(1);
+    BOOST_CHECK(!tracker.IsPeerRegistered(1));
+
+    // Only the initiator requests, and only responders answer requests
+    uint16_t set_size, q;
+    ReconciliationSketch sketch;
+    BOOST_CHECK(!tracker.InitiateRequest(1, std::chrono::microseconds{1}, set_size, q));
+    BOOST_CHECK(!tracker.HandleRequest(3, std::chrono::microseconds{1}, 0, q, sketch));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_reconciliation)
+{
+    TxReconciliationTracker initiator, responder;
+    Connect(initiator, responder, 7);
+
+    std::vector<uint256> vInitiatorOnly, vResponderOnly;
+    for (int i = 0; i < 200; i++) {
+        const uint256 txid = InsecureRand256();
+        if (i < 10) {
+            vInitiatorOnly.push_back(txid);
+            BOOST_CHECK(initiator.AddToSet(7, txid));
+        } else if (i < 25) {
+            vResponderOnly.push_back(txid);
+            BOOST_CHECK(responder.AddToSet(7, txid));
+        } else {
+            BOOST_CHECK(initiator.AddToSet(7, txid));
+            BOOST_CHECK(responder.AddToSet(7, txid));
+        }
+    }
+
+    uint16_t set_size, q;
+    BOOST_CHECK(initiator.InitiateRequest(7, std::chrono::microseconds{1}, set_size, q));
+    BOOST_CHECK_EQUAL(set_size, 185);
+    // Only one request at a time
+    BOOST_CHECK(!initiator.InitiateRequest(7, std::chrono::hours{24}, set_size, q));
+
+    // Oversize the sketch (q = 1), for the test not to depend on the rare failures to decode
+    ReconciliationSketch sketch;
+    BOOST_CHECK(responder.HandleRequest(7, std::chrono::microseconds{1}, set_size, Q_PRECISION, sketch));
+
+    bool fSuccess = false;
+    std::vector<uint256> vToAnnounce;
+    std::vector<uint32_t> vAskShortIDs;
+    BOOST_CHECK(initiator.HandleSketch(7, sketch, fSuccess, vToAnnounce, vAskShortIDs));
+    BOOST_CHECK(fSuccess);
+    std::sort(vToAnnounce.begin(), vToAnnounce.end());
+    std::sort(vInitiatorOnly.begin(), vInitiatorOnly.end());
+    BOOST_CHECK(vToAnnounce == vInitiatorOnly);
+    BOOST_CHECK_EQUAL(vAskShortIDs.size(), vResponderOnly.size());
+
+    BOOST_CHECK(responder.HandleReconciliationDifference(7, fSuccess, vAskShortIDs, vToAnnounce));
+    std::sort(vToAnnounce.begin(), vToAnnounce.end());
+    std::sort(vResponderOnly.begin(), vResponderOnly.end());
+    BOOST_CHECK(vToAnnounce == vResponderOnly);
+    BOOST_CHECK(!responder.HandleReconciliationDifference(7, fSuccess, vAskShortIDs, vToAnnounce));
+
+    // Next round: the responder has nothing to announce, the initiator announces everything
+    const uint256 txid = InsecureRand256();
+    BOOST_CHECK(initiator.AddToSet(7, txid));
+    BOOST_CHECK(initiator.InitiateRequest(7, std::chrono::hours{24}, set_size, q));
+    BOOST_CHECK(responder.HandleRequest(7, std::chrono::hours{24}, set_size, q, sketch));
+    BOOST_CHECK_EQUAL(sketch.GetCellCount(), 0U);
+    BOOST_CHECK(initiator.HandleSketch(7, sketch, fSuccess, vToAnnounce, vAskShortIDs));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(vToAnnounce == std::vector<uint256>{txid});
+    BOOST_CHECK(vAskShortIDs.empty());
+}
+
+BOOST_AUTO_TEST_CASE(tracker_reconciliation_failure)
+{
+    TxReconciliationTracker initiator, responder;
+    Connect(initiator, responder, 0);
+
+    // The initiator announces a small set, the sketch can't hold the actual difference
+    std::set<uint256> setResponder;
+    for (int i = 0; i < 400; i++) {
+        const uint256 txid = InsecureRand256();
+        setResponder.insert(txid);
+        BOOST_CHECK(responder.AddToSet(0, txid));
+    }
+    const uint256 txid = InsecureRand256();
+    BOOST_CHECK(initiator.AddToSet(0, txid));
+
+    ReconciliationSketch sketch;
+    uint16_t set_size, q;
+    BOOST_CHECK(initiator.InitiateRequest(0, std::chrono::microseconds{1}, set_size, q));
+    BOOST_CHECK(responder.HandleRequest(0, std::chrono::microseconds{1}, 400, 0, sketch));
+
+    bool fSuccess = true;
+    std::vector<uint256> vToAnnounce;
+    std::vector<uint32_t> vAskShortIDs;
+    BOOST_CHECK(initiator.HandleSketch(0, sketch, fSuccess, vToAnnounce, vAskShortIDs));
+    BOOST_CHECK(!fSuccess);
+    BOOST_CHECK(vToAnnounce == std::vector<uint256>{txid});
+
+    // Both sides fall back to announcing their whole sets
+    BOOST_CHECK(responder.HandleReconciliationDifference(0, fSuccess, vAskShortIDs, vToAnnounce));
+    BOOST_CHECK(std::set<uint256>(vToAnnounce.begin(), vToAnnounce.end()) == setResponder);
+}
+
+BOOST_AUTO_TEST_CASE(tracker_reconciliation_timeout)
+{
+    TxReconciliationTracker initiator, responder;
+    Connect(initiator, responder, 5);
+
+    std::set<uint256> setInitiator, setResponder;
+    for (int i = 0; i < 20; i++) {
+        const uint256 txid = InsecureRand256();
+        if (i < 10) {
+            setInitiator.insert(txid);
+            BOOST_CHECK(initiator.AddToSet(5, txid));
+        } else {
+            setResponder.insert(txid);
+            BOOST_CHECK(responder.AddToSet(5, txid));
+        }
+    }
+
+    // Nothing to give up before a request, nor before the timeout
+    const std::chrono::microseconds start{std::chrono::hours{24}};
+    std::vector<uint256> vToAnnounce;
+    BOOST_CHECK(!initiator.ExpireRequest(5, start, vToAnnounce));
+    uint16_t set_size, q;
+    BOOST_CHECK(initiator.InitiateRequest(5, start, set_size, q));
+    BOOST_CHECK(!initiator.ExpireRequest(5, start + RECON_RESPONSE_TIMEOUT - std::chrono::microseconds{1}, vToAnnounce));
+    BOOST_CHECK(!initiator.InitiateRequest(5, start + RECON_RESPONSE_TIMEOUT, set_size, q));
+
+    // The sketch never comes: the initiator floods its set and can request again
+    BOOST_CHECK(initiator.ExpireRequest(5, start + RECON_RESPONSE_TIMEOUT, vToAnnounce));
+    BOOST_CHECK(std::set<uint256>(vToAnnounce.begin(), vToAnnounce.end()) == setInitiator);
+    BOOST_CHECK(!initiator.ExpireRequest(5, start + RECON_RESPONSE_TIMEOUT, vToAnnounce));
+    ReconciliationSketch sketch;
+    bool fSuccess;
+    std::vector<uint32_t> vAskShortIDs;
+    BOOST_CHECK(!initiator.HandleSketch(5, sketch, fSuccess, vToAnnounce, vAskShortIDs));
+    BOOST_CHECK(initiator.InitiateRequest(5, start + std::chrono::hours{24}, set_size, q));
+    BOOST_CHECK_EQUAL(set_size, 0);
+
+    // A new request while the responder waits for the reconcildiff sketches the pending snapshot again
+    BOOST_CHECK(responder.HandleRequest(5, start, 0, q, sketch));
+    BOOST_CHECK(responder.HandleRequest(5, start, 0, q, sketch));
+    BOOST_CHECK(sketch.GetCellCount() > 0);
+
+    // The reconcildiff never comes: the responder floods the snapshot
+    BOOST_CHECK(!responder.ExpireRequest(5, start + RECON_RESPONSE_TIMEOUT - std::chrono::microseconds{1}, vToAnnounce));
+    BOOST_CHECK(responder.ExpireRequest(5, start + RECON_RESPONSE_TIMEOUT, vToAnnounce));
+    BOOST_CHECK(std::set<uint256>(vToAnnounce.begin(), vToAnnounce.end()) == setResponder);
+    BOOST_CHECK(!responder.HandleReconciliationDifference(5, true, vAskShortIDs, vToAnnounce));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "test/test_trumpcoin.h"
 
 #include "consensus/validation.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "random.h"
 #include "script/standard.h"
@@ -86,4 +87,52 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_cache, TestChain100Setup)
+{
+    // Make sure that the scripts of a transaction accepted to the memory pool
+    // are not checked again when connecting a block, as long as the flags match.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CTransaction tx(spend);
+
+    LOCK(cs_main);
+    const unsigned int blockFlags = GetBlockScriptFlags(chainActive.Tip());
+    CCoinsViewCache coins(pcoinsTip.get());
+    PrecomputedTransactionData precomTxData(tx);
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+
+    // Not cached yet: the script check is queued
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, blockFlags, true, true, precomTxData, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+
+    BOOST_CHECK(ToMemPool(spend));
+
+    // Different flags: still checked
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, true, precomTxData, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+
+    // Block flags: cached by AcceptToMemoryPool, nothing left to check
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, blockFlags, true, true, precomTxData, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
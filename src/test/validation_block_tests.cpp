@@ -165,4 +165,74 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()));
 }
 
+BOOST_AUTO_TEST_CASE(processnewblockheaders_ahead_of_data)
+{
+    BOOST_CHECK(ProcessNewBlock(std::make_shared<CBlock>(Params().GenesisBlock()), nullptr));
+
+    // A chain whose headers are received before the blocks
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    std::vector<CBlockHeader> headers;
+    uint256 hashPrev = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 10; i++) {
+        blocks.emplace_back(GoodBlock(hashPrev));
+        headers.emplace_back(blocks.back()->GetBlockHeader());
+        hashPrev = blocks.back()->GetHash();
+    }
+
+    CValidationState state;
+    const CBlockIndex* pindexLast = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, &pindexLast));
+    BOOST_CHECK(pindexLast != nullptr && pindexLast->GetBlockHash() == hashPrev);
+    {
+        LOCK(cs_main);
+        // The best header only follows the blocks whose stake was checked
+        BOOST_CHECK(pindexBestHeader == chainActive.Tip());
+        BOOST_CHECK(!(pindexLast->nStatus & BLOCK_HAVE_DATA));
+        BOOST_CHECK(pindexLast->vStakeModifier.empty());
+    }
+
+    // A header that doesn't connect to the block index is rejected
+    CBlockHeader headerOrphan = headers[0];
+    headerOrphan.hashPrevBlock = InsecureRand256();
+    CValidationState stateOrphan;
+    BOOST_CHECK(!ProcessNewBlockHeaders({headerOrphan}, stateOrphan));
+    BOOST_CHECK_EQUAL(stateOrphan.GetRejectReason(), "prevblk-not-found");
+
+    // A block can't be accepted ahead of its parent, as its stake is checked against the parent's
+    BOOST_CHECK(!ProcessNewBlock(blocks[1], nullptr));
+
+    // Received in order, the blocks connect and get their stake modifiers
+    for (const auto& pblock : blocks) {
+        BOOST_CHECK(ProcessNewBlock(pblock, nullptr));
+    }
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip() == pindexLast);
+    BOOST_CHECK(pindexBestHeader == pindexLast);
+    for (const CBlockIndex* pindex = pindexLast; pindex->pprev; pindex = pindex->pprev) {
+        BOOST_CHECK(pindex->nStatus & BLOCK_HAVE_DATA);
+        BOOST_CHECK(!pindex->vStakeModifier.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(processnewblockheaders_fork_depth)
+{
+    BOOST_CHECK(ProcessNewBlock(std::make_shared<CBlock>(Params().GenesisBlock()), nullptr));
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    uint256 hashPrev = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 10; i++) {
+        blocks.emplace_back(GoodBlock(hashPrev));
+        BOOST_CHECK(ProcessNewBlock(blocks.back(), nullptr));
+        hashPrev = blocks.back()->GetHash();
+    }
+
+    // Headers forking deeper than -maxreorg are rejected, the shallower forks accepted
+    gArgs.ForceSetArg("-maxreorg", "3");
+    CValidationState stateDeep;
+    BOOST_CHECK(!ProcessNewBlockHeaders({GoodBlock(blocks[3]->GetHash())->GetBlockHeader()}, stateDeep));
+    BOOST_CHECK_EQUAL(stateDeep.GetRejectReason(), "bad-fork-too-deep");
+    CValidationState stateShallow;
+    BOOST_CHECK(ProcessNewBlockHeaders({GoodBlock(blocks[8]->GetHash())->GetBlockHeader()}, stateShallow));
+    gArgs.ForceSetArg("-maxreorg", std::to_string(DEFAULT_MAX_REORG_DEPTH));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
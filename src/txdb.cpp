@@ -6,12 +6,14 @@
 
 #include "txdb.h"
 
+#include "memusage.h"
 #include "random.h"
 #include "pow.h"
 #include "uint256.h"
 #include "util/system.h"
 #include "util/vector.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -27,6 +29,9 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_COINS_COMMITMENT = 'U';
+static const char DB_BLOCK_COINS_STATS = 'u';
+static const char DB_STAKE_MODIFIER_BLOCK = 'm';
 // static const char DB_MONEY_SUPPLY = 'M';
 
 namespace {
@@ -47,18 +52,67 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    WaitForWrite();
+}
+
+CCoinsViewDB::Snapshot::Snapshot(CCoinsMap& mapCoinsIn, const uint256& hashBlockIn, const uint256& hashSaplingAnchorIn,
+                                 CAnchorsSaplingMap& mapSaplingAnchorsIn, CNullifiersMap& mapSaplingNullifiersIn) :
+        mapCoins(std::move(mapCoinsIn)),
+        hashBlock(hashBlockIn),
+        hashSaplingAnchor(hashSaplingAnchorIn),
+        mapSaplingAnchors(std::move(mapSaplingAnchorsIn)),
+        mapSaplingNullifiers(std::move(mapSaplingNullifiersIn))
+{
+    // The coins take their pool along: the cache goes on with a new one, and the
+    // writer thread is the only user of this one until it releases it.
+    // Accounted as CCoinsViewCache does, with the scripts stored out of the nodes (cachedCoinsUsage).
+    nUsage = memusage::DynamicUsage(mapCoins) + memusage::DynamicUsage(mapSaplingAnchors) + memusage::DynamicUsage(mapSaplingNullifiers);
+    for (const auto& entry : mapCoins) {
+        nUsage += entry.second.coin.DynamicMemoryUsage();
+    }
+    for (const auto& entry : mapSaplingAnchors) {
+        nUsage += entry.second.tree.DynamicMemoryUsage();
+    }
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
+    {
+        LOCK(cs_snapshot);
+        if (snapshot) {
+            CCoinsMap::const_iterator it = snapshot->mapCoins.find(outpoint);
+            if (it != snapshot->mapCoins.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    // Not changed since the last completed write
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint& outpoint) const
 {
+    {
+        LOCK(cs_snapshot);
+        if (snapshot) {
+            CCoinsMap::const_iterator it = snapshot->mapCoins.find(outpoint);
+            if (it != snapshot->mapCoins.end()) {
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
+    {
+        LOCK(cs_snapshot);
+        if (snapshot) return snapshot->hashBlock;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return UINT256_ZERO;
@@ -73,21 +127,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
-                              const uint256& hashBlock,
-                              const uint256& hashSaplingAnchor,
-                              CAnchorsSaplingMap& mapSaplingAnchors,
-                              CNullifiersMap& mapSaplingNullifiers)
+void CCoinsViewDB::WriteHeadBlocks(CDBBatch& batch, const uint256& hashBlock) const
 {
-    CDBBatch batch;
-    size_t count = 0;
-    size_t changed = 0;
-    size_t batch_size = (size_t) gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
-    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
-    assert(!hashBlock.IsNull());
-
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
+    uint256 old_tip;
+    if (!db.Read(DB_BEST_BLOCK, old_tip)) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
@@ -96,12 +139,24 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
         }
     }
 
-    // In the first batch, mark the database as being in the middle of a
-    // transition from old_tip to hashBlock.
+    // Mark the database as being in the middle of a transition from old_tip to hashBlock.
     // A vector is used for future extensibility, as we may want to support
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
+}
+
+bool CCoinsViewDB::WriteChanges(CDBBatch& batch, CCoinsMap& mapCoins, const uint256& hashBlock,
+                                const uint256& hashSaplingAnchor, CAnchorsSaplingMap& mapSaplingAnchors,
+                                CNullifiersMap& mapSaplingNullifiers, const CCoinsCommitment* pcommitment,
+                                bool fErase, CCoinsFlushStats& stats)
+{
+    size_t count = 0;
+    size_t changed = 0;
+    size_t batch_size = (size_t) gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+    stats.nTime = GetTime();
+    const int64_t nStart = GetTimeMicros();
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -114,9 +169,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            stats.nBytes += batch.SizeEstimate();
             db.WriteBatch(batch);
             batch.Clear();
             if (crash_simulate) {
@@ -130,18 +186,188 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     }
 
     // Write Sapling
-    BatchWriteSapling(hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers, batch);
+    BatchWriteSapling(hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers, batch, fErase);
 
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (pcommitment) batch.Write(DB_COINS_COMMITMENT, std::make_pair(hashBlock, *pcommitment));
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    stats.nBytes += batch.SizeEstimate();
     bool ret = db.WriteBatch(batch);
+    stats.nChanged = changed;
+    stats.nDurationMicros = GetTimeMicros() - nStart;
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
+                              const uint256& hashBlock,
+                              const uint256& hashSaplingAnchor,
+                              CAnchorsSaplingMap& mapSaplingAnchors,
+                              CNullifiersMap& mapSaplingNullifiers)
+{
+    assert(!hashBlock.IsNull());
+
+    // One write at a time, in order
+    if (!WaitForWrite())
+        return false;
+
+    CDBBatch batch;
+    // In the first batch, mark the database as being in the middle of a
+    // transition to hashBlock.
+    WriteHeadBlocks(batch, hashBlock);
+
+    std::unique_ptr<CCoinsCommitment> commitment = WITH_LOCK(cs_snapshot, return std::move(pendingCommitment));
+
+    if (!fBackgroundFlush) {
+        CCoinsFlushStats stats;
+        bool ret = WriteChanges(batch, mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers, commitment.get(), true, stats);
+        LOCK(cs_snapshot);
+        lastFlushStats = stats;
+        return ret;
+    }
+
+    // Write the marker now: from here on, the database is known to be
+    // transitioning to hashBlock, whenever the background write gets interrupted.
+    if (!db.WriteBatch(batch))
+        return false;
+
+    LOCK(cs_writer);
+    {
+        LOCK(cs_snapshot);
+        snapshot.reset(new Snapshot(mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers));
+        snapshot->commitment = std::move(commitment);
+    }
+    // The passed maps are left empty, as a regular write would do
+    mapCoins.clear();
+    mapSaplingAnchors.clear();
+    mapSaplingNullifiers.clear();
+    threadWriter = std::thread(&CCoinsViewDB::ThreadWriteSnapshot, this);
+    return true;
+}
+
+void CCoinsViewDB::ThreadWriteSnapshot()
+{
+    util::ThreadRename("trumpcoin-coinsflush");
+    CCoinsFlushStats stats;
+    stats.fBackground = true;
+    bool ret = false;
+    // Readers only look entries up, the snapshot isn't modified while being written
+    Snapshot* pSnapshot = WITH_LOCK(cs_snapshot, return snapshot.get());
+    try {
+        CDBBatch batch;
+        ret = WriteChanges(batch, pSnapshot->mapCoins, pSnapshot->hashBlock, pSnapshot->hashSaplingAnchor,
+                           pSnapshot->mapSaplingAnchors, pSnapshot->mapSaplingNullifiers, pSnapshot->commitment.get(), false, stats);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Error writing to coin database: %s\n", __func__, e.what());
+    }
+
+    std::unique_ptr<Snapshot> written;
+    std::vector<std::function<void()>> vTasks;
+    {
+        LOCK(cs_snapshot);
+        lastFlushStats = stats;
+        if (!ret) {
+            // Keep serving the changes from memory, the node is going to shut down
+            fWriteFailed = true;
+            vAfterWrite.clear();
+            return;
+        }
+        written = std::move(snapshot);
+        vTasks.swap(vAfterWrite);
+    }
+    LogPrint(BCLog::COINDB, "Background write of the coins cache took %.2fs\n", stats.nDurationMicros * 0.000001);
+    // Release the memory out of the lock
+    written.reset();
+    for (const auto& task : vTasks) {
+        task();
+    }
+}
+
+bool CCoinsViewDB::WaitForWrite() const
+{
+    {
+        LOCK(cs_writer);
+        if (threadWriter.joinable()) threadWriter.join();
+    }
+    LOCK(cs_snapshot);
+    return !fWriteFailed;
+}
+
+void CCoinsViewDB::AfterWrite(std::function<void()> func)
+{
+    {
+        LOCK(cs_snapshot);
+        if (snapshot && !fWriteFailed) {
+            vAfterWrite.emplace_back(std::move(func));
+            return;
+        }
+    }
+    func();
+}
+
+bool CCoinsViewDB::IsWriting() const
+{
+    LOCK(cs_snapshot);
+    return snapshot != nullptr;
+}
+
+size_t CCoinsViewDB::DynamicMemoryUsage() const
+{
+    LOCK(cs_snapshot);
+    return snapshot ? snapshot->nUsage : 0;
+}
+
+CCoinsFlushStats CCoinsViewDB::GetLastFlushStats() const
+{
+    LOCK(cs_snapshot);
+    return lastFlushStats;
+}
+
+void CCoinsViewDB::SetCommitment(const CCoinsCommitment& commitment)
+{
+    LOCK(cs_snapshot);
+    pendingCommitment.reset(new CCoinsCommitment(commitment));
+}
+
+bool CCoinsViewDB::ReadCommitment(uint256& hashBlock, CCoinsCommitment& commitment) const
+{
+    std::pair<uint256, CCoinsCommitment> entry;
+    if (!db.Read(DB_COINS_COMMITMENT, entry))
+        return false;
+    hashBlock = entry.first;
+    commitment = entry.second;
+    return true;
+}
+
+bool CCoinsViewDB::WriteCoinsTowards(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (!WaitForWrite())
+        return false;
+
+    CDBBatch batch;
+    WriteHeadBlocks(batch, hashBlock);
+    size_t batch_size = (size_t) gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
+        }
+        it = mapCoins.erase(it);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -182,6 +408,12 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // Iterate over a complete state. The tasks run after a background write
+    // don't wait, as they start once the snapshot is written.
+    if (IsWriting()) {
+        WaitForWrite();
+    }
+
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -260,6 +492,47 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteBlockCoinsStats(const uint256& hashBlock, const CBlockCoinsStats& stats)
+{
+    return Write(std::make_pair(DB_BLOCK_COINS_STATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::ReadBlockCoinsStats(const uint256& hashBlock, CBlockCoinsStats& stats)
+{
+    return Read(std::make_pair(DB_BLOCK_COINS_STATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteStakeModifierBlocks(const std::vector<std::pair<int, uint256> >& vect)
+{
+    CDBBatch batch;
+    for (const auto& it : vect) {
+        batch.Write(std::make_pair(DB_STAKE_MODIFIER_BLOCK, it.first), it.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadStakeModifierBlocks(std::vector<std::pair<int, uint256> >& vect)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_STAKE_MODIFIER_BLOCK, 0));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, int> key;
+        if (pcursor->GetKey(key) && key.first == DB_STAKE_MODIFIER_BLOCK) {
+            uint256 hashBlock;
+            if (pcursor->GetValue(hashBlock)) {
+                vect.emplace_back(key.second, hashBlock);
+                pcursor->Next();
+            } else {
+                return error("%s : failed to read value", __func__);
+            }
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -311,6 +584,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
                 pindexNew->nNonce = diskindex.nNonce;
                 pindexNew->nStatus = diskindex.nStatus;
                 pindexNew->nTx = diskindex.nTx;
+                // Only stored below a loaded UTXO snapshot base
+                pindexNew->nChainTx = diskindex.nChainTx;
+                pindexNew->nChainSaplingValue = diskindex.nChainSaplingValue;
 
                 // sapling
                 pindexNew->nSaplingValue  = diskindex.nSaplingValue;
@@ -599,3 +875,62 @@ void AccumulatorCache::Wipe()
     mapCheckpoints.clear();
     db->WipeAccChecksums();
 }
+
+bool StakeModifierCache::Load(std::function<const CBlockIndex*(const uint256&)> lookupBlockIndex)
+{
+    if (!db) return true;
+    std::vector<std::pair<int, uint256> > vect;
+    if (!db->ReadStakeModifierBlocks(vect)) return false;
+
+    LOCK(cs);
+    vModifierBlocks.clear();
+    vDirty.clear();
+    for (const auto& it : vect) {
+        // Blocks not in the index anymore are found again when needed
+        const CBlockIndex* pindex = lookupBlockIndex(it.second);
+        if (!pindex || it.first < 0) continue;
+        if ((size_t) it.first >= vModifierBlocks.size()) vModifierBlocks.resize(it.first + 1, nullptr);
+        vModifierBlocks[it.first] = pindex;
+    }
+    LogPrintf("%s: Total stake modifier records: %d\n", __func__, vect.size());
+    return true;
+}
+
+const CBlockIndex* StakeModifierCache::Get(int nHeightFrom) const
+{
+    LOCK(cs);
+    if (nHeightFrom < 0 || (size_t) nHeightFrom >= vModifierBlocks.size()) return nullptr;
+    return vModifierBlocks[nHeightFrom];
+}
+
+void StakeModifierCache::Set(int nHeightFrom, const CBlockIndex* pindexModifier)
+{
+    assert(nHeightFrom >= 0 && pindexModifier);
+    LOCK(cs);
+    if ((size_t) nHeightFrom >= vModifierBlocks.size()) vModifierBlocks.resize(nHeightFrom + 1, nullptr);
+    vModifierBlocks[nHeightFrom] = pindexModifier;
+    vDirty.push_back(nHeightFrom);
+}
+
+void StakeModifierCache::Flush()
+{
+    std::vector<std::pair<int, uint256> > vect;
+    {
+        LOCK(cs);
+        if (!db || vDirty.empty()) return;
+        vect.reserve(vDirty.size());
+        for (int nHeightFrom : vDirty) {
+            vect.emplace_back(nHeightFrom, vModifierBlocks[nHeightFrom]->GetBlockHash());
+        }
+        vDirty.clear();
+    }
+    if (!db->WriteStakeModifierBlocks(vect)) {
+        LogPrintf("%s: failed to write %d stake modifier records\n", __func__, vect.size());
+    }
+}
+
+size_t StakeModifierCache::Size() const
+{
+    LOCK(cs);
+    return std::count_if(vModifierBlocks.begin(), vModifierBlocks.end(), [](const CBlockIndex* pindex) { return pindex != nullptr; });
+}
@@ -12,9 +12,13 @@
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "sync.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -39,6 +43,30 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to all block filter index caches combined (MiB)
+static const int64_t nMaxFilterIndexCache = 1024;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+
+/** Statistics of the last write of the coins cache to the database */
+struct CCoinsFlushStats
+{
+    int64_t nTime = 0;          //!< Time the write was started
+    int64_t nDurationMicros = 0;
+    uint64_t nBytes = 0;        //!< Size of the written batches
+    uint64_t nChanged = 0;      //!< Number of changed outputs
+    bool fBackground = false;
+};
+
+/** Commitment to the UTXO set as of a block, in the block tree DB (-coinstatsindex) */
+struct CBlockCoinsStats
+{
+    uint256 hashMuHash;
+    uint64_t nTransactionOutputs{0};
+    CAmount nTotalAmount{0};
+
+    SERIALIZE_METHODS(CBlockCoinsStats, obj) { READWRITE(obj.hashMuHash, obj.nTransactionOutputs, obj.nTotalAmount); }
+};
 
 struct CDiskTxPos : public FlatFilePos
 {
@@ -72,8 +100,49 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CDBWrapper db;
 
+private:
+    /**
+     * Cache changes handed to the background writer. They stay readable, and
+     * take precedence over the database, until they are completely written.
+     */
+    struct Snapshot
+    {
+        CCoinsMap mapCoins;
+        uint256 hashBlock;
+        uint256 hashSaplingAnchor;
+        CAnchorsSaplingMap mapSaplingAnchors;
+        CNullifiersMap mapSaplingNullifiers;
+        std::unique_ptr<CCoinsCommitment> commitment;
+        size_t nUsage;
+
+        Snapshot(CCoinsMap& mapCoinsIn, const uint256& hashBlockIn, const uint256& hashSaplingAnchorIn,
+                 CAnchorsSaplingMap& mapSaplingAnchorsIn, CNullifiersMap& mapSaplingNullifiersIn);
+    };
+
+    bool fBackgroundFlush{false};
+    mutable Mutex cs_snapshot;
+    std::unique_ptr<Snapshot> snapshot GUARDED_BY(cs_snapshot);
+    //! Tasks to run once the snapshot is written
+    std::vector<std::function<void()>> vAfterWrite GUARDED_BY(cs_snapshot);
+    bool fWriteFailed GUARDED_BY(cs_snapshot){false};
+    //! Commitment to write along with the next changes
+    std::unique_ptr<CCoinsCommitment> pendingCommitment GUARDED_BY(cs_snapshot);
+    CCoinsFlushStats lastFlushStats GUARDED_BY(cs_snapshot);
+    mutable Mutex cs_writer;
+    mutable std::thread threadWriter GUARDED_BY(cs_writer);
+
+    //! Write the changes to the database. If fErase, the written entries are removed from the maps.
+    bool WriteChanges(CDBBatch& batch, CCoinsMap& mapCoins, const uint256& hashBlock,
+                      const uint256& hashSaplingAnchor, CAnchorsSaplingMap& mapSaplingAnchors,
+                      CNullifiersMap& mapSaplingNullifiers, const CCoinsCommitment* pcommitment,
+                      bool fErase, CCoinsFlushStats& stats);
+    //! Mark the database as being in the middle of a transition to hashBlock (see GetHeadBlocks)
+    void WriteHeadBlocks(CDBBatch& batch, const uint256& hashBlock) const;
+    void ThreadWriteSnapshot();
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB() override;
 
     bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
     bool HaveCoin(const COutPoint& outpoint) const override;
@@ -85,12 +154,45 @@ public:
     bool Upgrade();
     size_t EstimateSize() const override;
 
+    /**
+     * In background mode the changes are moved to a snapshot, and written by a
+     * dedicated thread while the caller goes on (a previous write in progress
+     * is waited for first). The head blocks marker is written before returning,
+     * so an interrupted write gets replayed by ReplayBlocks on startup.
+     */
     bool BatchWrite(CCoinsMap& mapCoins,
                     const uint256& hashBlock,
                     const uint256& hashSaplingAnchor,
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
 
+    //! Enable writing the flushed caches on a background thread
+    void SetBackgroundFlush(bool fBackground) { fBackgroundFlush = fBackground; }
+    //! Wait for the background write in progress, if any. Returns false if it failed.
+    bool WaitForWrite() const;
+    //! Run func after the write in progress completes (on the writer thread), or now if there is none
+    void AfterWrite(std::function<void()> func);
+    //! Whether a background write is in progress
+    bool IsWriting() const;
+    //! Memory held by the changes being written in background, as CCoinsViewCache::DynamicMemoryUsage counts it
+    size_t DynamicMemoryUsage() const;
+    CCoinsFlushStats GetLastFlushStats() const;
+
+    /**
+     * Write commitment along with the next BatchWrite, atomically with its
+     * best block: it must be the commitment to the UTXO set at that block.
+     */
+    void SetCommitment(const CCoinsCommitment& commitment);
+    //! The commitment last written, and the block it was made at
+    bool ReadCommitment(uint256& hashBlock, CCoinsCommitment& commitment) const;
+
+    /**
+     * Write coins on the way to hashBlock, without completing the transition:
+     * the database stays marked as moving to hashBlock (see GetHeadBlocks)
+     * until a BatchWrite to it. Used to load UTXO snapshots in parts.
+     */
+    bool WriteCoinsTowards(CCoinsMap& mapCoins, const uint256& hashBlock);
+
     // Sapling, the implementation of the following functions can be found in sapling_txdb.cpp.
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     bool GetNullifier(const uint256 &nf) const override;
@@ -98,7 +200,11 @@ public:
     bool BatchWriteSapling(const uint256& hashSaplingAnchor,
                            CAnchorsSaplingMap& mapSaplingAnchors,
                            CNullifiersMap& mapSaplingNullifiers,
-                           CDBBatch& batch);
+                           CDBBatch& batch,
+                           bool fErase = true);
+    //! All the Sapling anchors and nullifiers of the database
+    void GetSaplingState(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors,
+                         std::vector<uint256>& vNullifiers) const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -144,6 +250,11 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    bool WriteBlockCoinsStats(const uint256& hashBlock, const CBlockCoinsStats& stats);
+    bool ReadBlockCoinsStats(const uint256& hashBlock, CBlockCoinsStats& stats);
+    /** Old (v1) stake modifiers: height of the coins --> hash of the block holding the modifier of their kernels **/
+    bool WriteStakeModifierBlocks(const std::vector<std::pair<int, uint256> >& vect);
+    bool ReadStakeModifierBlocks(std::vector<std::pair<int, uint256> >& vect);
     bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -196,4 +307,31 @@ public:
     void Wipe();
 };
 
+/**
+ * The blocks holding the old (v1) stake modifiers, by height of the coins of the kernels, so that
+ * checking a kernel doesn't walk the chain forward from its coin to find the modifier.
+ * Entries are only valid while both blocks are in the active chain: the callers check it.
+ */
+class StakeModifierCache
+{
+private:
+    // underlying database (nullptr for an in-memory cache)
+    CBlockTreeDB* db{nullptr};
+    mutable Mutex cs;
+    // height of the coins --> block holding the modifier (nullptr if unknown)
+    std::vector<const CBlockIndex*> vModifierBlocks GUARDED_BY(cs);
+    // heights set since the last flush
+    std::vector<int> vDirty GUARDED_BY(cs);
+
+public:
+    explicit StakeModifierCache(CBlockTreeDB* _db) : db(_db) {}
+
+    // Read the database, once the block index is loaded
+    bool Load(std::function<const CBlockIndex*(const uint256&)> lookupBlockIndex);
+    const CBlockIndex* Get(int nHeightFrom) const;
+    void Set(int nHeightFrom, const CBlockIndex* pindexModifier);
+    void Flush();
+    size_t Size() const;
+};
+
 #endif // BITCOIN_TXDB_H
@@ -13,6 +13,7 @@
 #include "evo/providertx.h"
 #include "policy/fees.h"
 #include "reverse_iterate.h"
+#include "script/interpreter.h"
 #include "streams.h"
 #include "timedata.h"
 #include "util/system.h"
@@ -46,6 +47,13 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSigOpCountWithAncestors = sigOpCount;
 }
 
+void CTxMemPoolEntry::SetPrecomputedTxData(const std::shared_ptr<PrecomputedTransactionData>& _precomTxData)
+{
+    nUsageSize -= memusage::DynamicUsage(precomTxData);
+    precomTxData = _precomTxData;
+    nUsageSize += memusage::DynamicUsage(precomTxData);
+}
+
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
     nModFeesWithDescendants += newFeeDelta - feeDelta;
@@ -993,7 +1001,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         else {
             CValidationState state;
             PrecomputedTransactionData precomTxData(tx);
-            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, precomTxData, NULL));
+            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, false, precomTxData, NULL));
             UpdateCoins(tx, mempoolDuplicate, 1000000);
         }
     }
@@ -1009,7 +1017,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(stepsSinceLastRemove < waitingOnDependants.size());
         } else {
             PrecomputedTransactionData precomTxData(entry->GetTx());
-            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, precomTxData, NULL));
+            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, false, precomTxData, NULL));
             UpdateCoins(entry->GetTx(), mempoolDuplicate, 1000000);
             stepsSinceLastRemove = 0;
         }
@@ -1143,6 +1151,18 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     return GetInfo(i);
 }
 
+std::shared_ptr<PrecomputedTransactionData> CTxMemPool::GetPrecomputedTxData(const uint256& hash)
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end() || !i->GetPrecomputedTxData()) {
+        nPrecomputedMisses++;
+        return nullptr;
+    }
+    nPrecomputedHits++;
+    return i->GetPrecomputedTxData();
+}
+
 bool CTxMemPool::existsProviderTxConflict(const CTransaction &tx) const
 {
     if (!tx.IsSpecialTx()) return false;
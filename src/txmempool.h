@@ -7,6 +7,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <set>
@@ -27,6 +28,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 
 class CAutoFile;
+struct PrecomputedTransactionData;
 class CBLSPublicKey;
 
 
@@ -66,6 +68,7 @@ private:
     bool spendsCoinbaseOrCoinstake; //! keep track of transactions that spend a coinbase or a coinstake
     unsigned int sigOpCount; //! Legacy sig ops plus P2SH sig op count
     int64_t feeDelta; //! Used for determining the priority of the transaction for mining in a block
+    std::shared_ptr<PrecomputedTransactionData> precomTxData; //! Signature hash midstates, reused when the tx gets mined
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -98,7 +101,10 @@ public:
     unsigned int GetSigOpCount() const { return sigOpCount; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
+    const std::shared_ptr<PrecomputedTransactionData>& GetPrecomputedTxData() const { return precomTxData; }
 
+    // Attaches the signature hash midstates computed while validating the tx (before it enters the pool)
+    void SetPrecomputedTxData(const std::shared_ptr<PrecomputedTransactionData>& _precomTxData);
     // Adjusts the descendant state, if this entry is not dirty.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
     // Adjusts the ancestor state
@@ -405,6 +411,10 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    //! Lookups of signature hash midstates of mined transactions (see GetPrecomputedTxData)
+    std::atomic<uint64_t> nPrecomputedHits{0};
+    std::atomic<uint64_t> nPrecomputedMisses{0};
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -652,6 +662,11 @@ public:
 
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
+    /** Return the signature hash midstates cached in the entry of the tx (nullptr if not in the pool).
+     *  Used when connecting a block, so that transactions already seen skip the midstates hashing. */
+    std::shared_ptr<PrecomputedTransactionData> GetPrecomputedTxData(const uint256& hash);
+    uint64_t GetPrecomputedHits() const { return nPrecomputedHits; }
+    uint64_t GetPrecomputedMisses() const { return nPrecomputedMisses; }
     std::vector<TxMempoolInfo> infoAll() const;
 
     bool existsProviderTxConflict(const CTransaction &tx) const;
@@ -0,0 +1,240 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "consensus/consensus.h"
+#include "logging.h"
+#include "net_processing.h"
+#include "random.h"
+#include "utiltime.h"
+#include "validation.h"
+
+RecursiveMutex g_cs_orphans;
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    const uint256& hash = tx->GetHash();
+    if (m_orphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    // 25 orphans, each of which is at most 400,000 bytes big is
+    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    unsigned int sz = tx->GetTotalSize();
+    unsigned int nMaxSize = tx->IsShieldedTx() ? MAX_TX_SIZE_AFTER_SAPLING : MAX_STANDARD_TX_SIZE;
+    if (sz >= nMaxSize) {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    PeerOrphans& peer_orphans = m_peers[peer];
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, peer_orphans.orphans.size()});
+    assert(ret.second);
+    OrphanTx* orphan = &ret.first->second;
+    peer_orphans.orphans.push_back(orphan);
+    peer_orphans.total_size += sz;
+    m_total_size += sz;
+    for (const CTxIn& txin : tx->vin) {
+        m_outpoint_to_orphans[txin.prevout].insert(orphan);
+    }
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
+        m_orphans.size(), m_outpoint_to_orphans.size());
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256& txid) const
+{
+    AssertLockHeld(g_cs_orphans);
+    return m_orphans.count(txid);
+}
+
+int TxOrphanage::EraseTx(const uint256& txid)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    auto it = m_orphans.find(txid);
+    if (it == m_orphans.end())
+        return 0;
+    OrphanTx* orphan = &it->second;
+    for (const CTxIn& txin : orphan->tx->vin) {
+        auto itPrev = m_outpoint_to_orphans.find(txin.prevout);
+        if (itPrev == m_outpoint_to_orphans.end())
+            continue;
+        itPrev->second.erase(orphan);
+        if (itPrev->second.empty())
+            m_outpoint_to_orphans.erase(itPrev);
+    }
+
+    auto itPeer = m_peers.find(orphan->fromPeer);
+    assert(itPeer != m_peers.end());
+    PeerOrphans& peer_orphans = itPeer->second;
+    size_t old_pos = orphan->peer_list_pos;
+    assert(peer_orphans.orphans[old_pos] == orphan);
+    if (old_pos + 1 != peer_orphans.orphans.size()) {
+        // Unless we're deleting the last entry of the peer's list, move the last
+        // entry to the position we're deleting.
+        OrphanTx* last = peer_orphans.orphans.back();
+        peer_orphans.orphans[old_pos] = last;
+        last->peer_list_pos = old_pos;
+    }
+    peer_orphans.orphans.pop_back();
+    const size_t sz = orphan->tx->GetTotalSize();
+    peer_orphans.total_size -= sz;
+    m_total_size -= sz;
+    if (peer_orphans.orphans.empty()) {
+        m_peers.erase(itPeer);
+    } else {
+        peer_orphans.work_set.erase(txid);
+    }
+
+    m_orphans.erase(it);
+    return 1;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    auto itPeer = m_peers.find(peer);
+    if (itPeer == m_peers.end())
+        return;
+
+    // Erasing the last orphan of the peer erases its entry
+    std::vector<uint256> vErase;
+    vErase.reserve(itPeer->second.orphans.size());
+    for (const OrphanTx* orphan : itPeer->second.orphans) {
+        vErase.push_back(orphan->tx->GetHash());
+    }
+    int nErased = 0;
+    for (const uint256& hash : vErase) {
+        nErased += EraseTx(hash);
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer %d\n", nErased, peer);
+}
+
+void TxOrphanage::EraseForBlock(const CBlock& block)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<uint256> vOrphanErase;
+
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+
+        // Which orphan pool entries must we evict?
+        for (const CTxIn& txin : tx.vin) {
+            auto itByPrev = m_outpoint_to_orphans.find(txin.prevout);
+            if (itByPrev == m_outpoint_to_orphans.end()) continue;
+            for (const OrphanTx* orphan : itByPrev->second) {
+                vOrphanErase.push_back(orphan->tx->GetHash());
+            }
+        }
+    }
+
+    // Erase orphan transactions included or precluded by this block
+    if (!vOrphanErase.empty()) {
+        int nErased = 0;
+        for (const uint256& orphanHash : vOrphanErase) {
+            nErased += EraseTx(orphanHash);
+        }
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    }
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans, size_t max_total_size)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (m_next_sweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        std::vector<uint256> vExpired;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        for (const auto& entry : m_orphans) {
+            if (entry.second.nTimeExpire <= nNow) {
+                vExpired.push_back(entry.first);
+            } else {
+                nMinExpTime = std::min(entry.second.nTimeExpire, nMinExpTime);
+            }
+        }
+        int nErased = 0;
+        for (const uint256& hash : vExpired) {
+            nErased += EraseTx(hash);
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        m_next_sweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
+    }
+    FastRandomContext rng;
+    while (m_orphans.size() > max_orphans || m_total_size > max_total_size) {
+        // Evict a random orphan of the peer with the largest total size of orphans
+        const PeerOrphans* largest = nullptr;
+        for (const auto& entry : m_peers) {
+            if (!largest || entry.second.total_size > largest->total_size) largest = &entry.second;
+        }
+        size_t randompos = rng.randrange(largest->orphans.size());
+        EraseTx(largest->orphans[randompos]->tx->GetHash());
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    const uint256& hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const auto itByPrev = m_outpoint_to_orphans.find(COutPoint(hash, i));
+        if (itByPrev == m_outpoint_to_orphans.end()) continue;
+        for (const OrphanTx* orphan : itByPrev->second) {
+            m_peers.at(orphan->fromPeer).work_set.insert(orphan->tx->GetHash());
+        }
+    }
+}
+
+bool TxOrphanage::HaveTxToReconsider(NodeId peer) const
+{
+    AssertLockHeld(g_cs_orphans);
+
+    auto itPeer = m_peers.find(peer);
+    return itPeer != m_peers.end() && !itPeer->second.work_set.empty();
+}
+
+CTransactionRef TxOrphanage::GetTxToReconsider(NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    auto itPeer = m_peers.find(peer);
+    if (itPeer == m_peers.end() || itPeer->second.work_set.empty())
+        return nullptr;
+
+    std::set<uint256>& work_set = itPeer->second.work_set;
+    const uint256 hash = *work_set.begin();
+    work_set.erase(work_set.begin());
+    // Orphans leave the work set when erased
+    return m_orphans.at(hash).tx;
+}
+
+std::vector<std::pair<uint256, CTransactionRef>> TxOrphanage::GetAll() const
+{
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<std::pair<uint256, CTransactionRef>> vOrphans;
+    vOrphans.reserve(m_orphans.size());
+    for (const auto& entry : m_orphans) {
+        vOrphans.emplace_back(entry.first, entry.second.tx);
+    }
+    return vOrphans;
+}
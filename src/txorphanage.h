@@ -0,0 +1,104 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include "coins.h"
+#include "net.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Guards the orphan transactions */
+extern RecursiveMutex g_cs_orphans;
+
+/**
+ * A class to track orphan transactions (failed on TX_MISSING_INPUTS).
+ *
+ * The orphans are indexed by txid, by the outpoints they spend and by the peer which sent them,
+ * so that erasing the orphans of a disconnected peer or finding the children of an accepted
+ * transaction doesn't walk the whole pool. When over its limits, the pool evicts a random orphan
+ * of the peer with the largest total size of orphans, for a single peer not to push the
+ * orphans of the others out.
+ */
+class TxOrphanage
+{
+public:
+    /** Add a new orphan transaction, returns false if it was already there or is too big. */
+    bool AddTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Whether we have an orphan transaction with this txid */
+    bool HaveTx(const uint256& txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase an orphan by txid, returns the number of orphans erased (0 or 1). */
+    int EraseTx(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase all the orphans announced by a peer (eg, after that peer disconnects) */
+    void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase all the orphans included in or invalidated by a new block */
+    void EraseForBlock(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Erase the expired orphans, then evict orphans until there are at most max_orphans of them
+     * and their total size is at most max_total_size. Returns the number of orphans evicted.
+     */
+    unsigned int LimitOrphans(unsigned int max_orphans, size_t max_total_size) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * A transaction was accepted: its orphan children are to be reconsidered, by the peer each of
+     * them was received from.
+     */
+    void AddChildrenToWorkSet(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Whether there are orphans of this peer to reconsider */
+    bool HaveTxToReconsider(NodeId peer) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Take the next orphan of this peer to reconsider, nullptr if there is none. */
+    CTransactionRef GetTxToReconsider(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** All the orphans, as extra candidates for the reconstruction of compact blocks */
+    std::vector<std::pair<uint256, CTransactionRef>> GetAll() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_orphans.size(); }
+    size_t TotalSize() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_total_size; }
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        /** Position in the orphan list of the peer, for constant time removal and random eviction */
+        size_t peer_list_pos;
+    };
+
+    struct PeerOrphans {
+        std::vector<OrphanTx*> orphans;
+        size_t total_size{0};
+        /** Orphans to reconsider, as one of their parents was accepted */
+        std::set<uint256> work_set;
+    };
+
+    /** Map from txid to orphan transaction. Pointers to the entries are stable: they're used by the other indexes */
+    std::unordered_map<uint256, OrphanTx, SaltedIdHasher> m_orphans GUARDED_BY(g_cs_orphans);
+
+    /** Map from an outpoint to the orphans spending it */
+    std::unordered_map<COutPoint, std::set<OrphanTx*>, SaltedOutpointHasher> m_outpoint_to_orphans GUARDED_BY(g_cs_orphans);
+
+    /** The orphans of each peer, and the orphans it has to reconsider */
+    std::unordered_map<NodeId, PeerOrphans> m_peers GUARDED_BY(g_cs_orphans);
+
+    size_t m_total_size GUARDED_BY(g_cs_orphans){0};
+
+    /** When the expired orphans are to be looked for */
+    int64_t m_next_sweep GUARDED_BY(g_cs_orphans){0};
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
@@ -0,0 +1,355 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "crypto/siphash.h"
+#include "hash.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+/** Tag of the hash combining the salts of both sides into the keys of the short IDs */
+static const std::string RECON_SALT_TAG = "Tx Relay Salting";
+
+static inline uint32_t Mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+ReconciliationSketch::ReconciliationSketch(size_t nCells) : cells(nCells)
+{
+    assert(nCells % SKETCH_HASHES == 0);
+}
+
+uint32_t ReconciliationSketch::GetCellIndex(uint32_t shortid, unsigned int nHash) const
+{
+    // Each hash function maps into a partition of its own, so that an element never falls twice in
+    // the same cell.
+    const uint64_t nPartition = cells.size() / SKETCH_HASHES;
+    const uint64_t hash = Mix32(shortid + nHash * 0x9e3779b9U);
+    return nHash * nPartition + ((hash * nPartition) >> 32);
+}
+
+uint32_t ReconciliationSketch::GetCheck(uint32_t shortid)
+{
+    return Mix32(shortid ^ 0x5bd1e995);
+}
+
+size_t ReconciliationSketch::CellsForCapacity(uint32_t capacity)
+{
+    const size_t nCells = capacity + capacity / 2 + MIN_SKETCH_CELLS;
+    return (nCells + SKETCH_HASHES - 1) / SKETCH_HASHES * SKETCH_HASHES;
+}
+
+bool ReconciliationSketch::IsValidCellCount(size_t nCells)
+{
+    if (nCells == 0) return true;
+    return nCells >= MIN_SKETCH_CELLS && nCells % SKETCH_HASHES == 0 &&
+           nCells <= CellsForCapacity(MAX_SKETCH_CAPACITY);
+}
+
+bool ReconciliationSketch::IsEmpty() const
+{
+    return std::all_of(cells.begin(), cells.end(), [](const Cell& cell) { return cell.IsEmpty(); });
+}
+
+void ReconciliationSketch::Toggle(uint32_t shortid)
+{
+    assert(shortid != 0);
+    const uint32_t check = GetCheck(shortid);
+    for (unsigned int i = 0; i < SKETCH_HASHES; i++) {
+        Cell& cell = cells[GetCellIndex(shortid, i)];
+        cell.keySum ^= shortid;
+        cell.checkSum ^= check;
+    }
+}
+
+ReconciliationSketch& ReconciliationSketch::operator^=(const ReconciliationSketch& other)
+{
+    assert(cells.size() == other.cells.size());
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].keySum ^= other.cells[i].keySum;
+        cells[i].checkSum ^= other.cells[i].checkSum;
+    }
+    return *this;
+}
+
+bool ReconciliationSketch::Decode(std::vector<uint32_t>& elements) const
+{
+    elements.clear();
+    ReconciliationSketch sketch(*this);
+
+    std::vector<uint32_t> vPure;
+    for (size_t i = 0; i < sketch.cells.size(); i++) {
+        if (sketch.IsPure(sketch.cells[i])) vPure.push_back(i);
+    }
+
+    while (!vPure.empty()) {
+        const Cell& cell = sketch.cells[vPure.back()];
+        vPure.pop_back();
+        if (!sketch.IsPure(cell)) continue;
+
+        // A cell may only look pure, which can't go on for more elements than cells
+        if (elements.size() == sketch.cells.size()) return false;
+
+        const uint32_t shortid = cell.keySum;
+        const uint32_t check = GetCheck(shortid);
+        elements.push_back(shortid);
+        for (unsigned int i = 0; i < SKETCH_HASHES; i++) {
+            const uint32_t nIndex = sketch.GetCellIndex(shortid, i);
+            Cell& other = sketch.cells[nIndex];
+            other.keySum ^= shortid;
+            other.checkSum ^= check;
+            if (sketch.IsPure(other)) vPure.push_back(nIndex);
+        }
+    }
+
+    return sketch.IsEmpty();
+}
+
+uint32_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q)
+{
+    const uint64_t nDifference = local_set_size > remote_set_size ? local_set_size - remote_set_size
+                                                                   : remote_set_size - local_set_size;
+    const uint64_t nSmaller = std::min(local_set_size, remote_set_size);
+    const uint64_t nEstimate = nDifference + nSmaller * q / Q_PRECISION + 1;
+    return std::min<uint64_t>(nEstimate, MAX_SKETCH_CAPACITY);
+}
+
+uint32_t TxReconciliationTracker::PeerState::GetShortID(const uint256& txid) const
+{
+    const uint32_t shortid = SipHashUint256(k0, k1, txid);
+    // 0 is the content of an empty cell
+    return shortid != 0 ? shortid : 1;
+}
+
+ReconciliationSketch TxReconciliationTracker::PeerState::BuildSketch(const std::set<uint256>& setTx, size_t nCells) const
+{
+    ReconciliationSketch sketch(nCells);
+    for (const uint256& txid : setTx) {
+        sketch.Toggle(GetShortID(txid));
+    }
+    return sketch;
+}
+
+TxReconciliationTracker::TxReconciliationTracker() :
+    fanout_k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    fanout_k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId nodeid)
+{
+    const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(cs);
+    mapPendingSalts[nodeid] = salt;
+    return salt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId nodeid, bool fInbound, uint32_t nVersion, uint64_t remote_salt)
+{
+    LOCK(cs);
+    auto it = mapPendingSalts.find(nodeid);
+    if (it == mapPendingSalts.end()) return false;
+    const uint64_t local_salt = it->second;
+    mapPendingSalts.erase(it);
+
+    // The peer talks the lowest of our versions
+    if (nVersion < 1) return false;
+
+    CHashWriter hasher(SER_GETHASH, 0);
+    hasher << RECON_SALT_TAG << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt);
+    const uint256 hash = hasher.GetHash();
+
+    PeerState state;
+    state.fInitiator = !fInbound;
+    state.k0 = hash.GetUint64(0);
+    state.k1 = hash.GetUint64(1);
+    if (!mapStates.emplace(nodeid, std::move(state)).second) return false;
+    if (!fInbound) nInitiators++;
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId nodeid)
+{
+    LOCK(cs);
+    mapPendingSalts.erase(nodeid);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return;
+    if (it->second.fInitiator) nInitiators--;
+    mapStates.erase(it);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId nodeid) const
+{
+    LOCK(cs);
+    return mapStates.count(nodeid);
+}
+
+bool TxReconciliationTracker::ShouldFloodTo(NodeId nodeid, const uint256& txid) const
+{
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return true;
+    if (!it->second.fInitiator) return false;
+    if (nInitiators <= OUTBOUND_FANOUT_DESTINATIONS) return true;
+    // Every peer draws a transaction independently, a transaction is flooded to the expected
+    // number of peers without having to choose them all at once.
+    return SipHashUint256Extra(fanout_k0, fanout_k1, txid, nodeid) % nInitiators < OUTBOUND_FANOUT_DESTINATIONS;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId nodeid, const uint256& txid)
+{
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (state.setLocal.size() >= MAX_RECON_SET_SIZE) return false;
+    state.setLocal.insert(txid);
+    return true;
+}
+
+bool TxReconciliationTracker::InitiateRequest(NodeId nodeid, std::chrono::microseconds now, uint16_t& local_set_size, uint16_t& q)
+{
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (!state.fInitiator || state.fRequestInFlight || now < state.nNextRequest) return false;
+
+    state.nNextRequest = PoissonNextSend(now, RECON_REQUEST_INTERVAL);
+    state.fRequestInFlight = true;
+    state.nRequestTime = now;
+    local_set_size = std::min<size_t>(state.setLocal.size(), std::numeric_limits<uint16_t>::max());
+    q = RECON_Q * Q_PRECISION;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleRequest(NodeId nodeid, std::chrono::microseconds now, uint16_t remote_set_size, uint16_t q, ReconciliationSketch& sketch_out)
+{
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (state.fInitiator) return false;
+    if (state.fRequestInFlight) {
+        // The peer timed out waiting for our sketch, none of the snapshot was announced
+        state.setLocal.insert(state.setSnapshot.begin(), state.setSnapshot.end());
+        state.setSnapshot.clear();
+    }
+
+    if (state.setLocal.empty()) {
+        // Nothing to reconcile on our side, the initiator announces its whole set
+        sketch_out = ReconciliationSketch();
+    } else {
+        const uint32_t capacity = EstimateSketchCapacity(state.setLocal.size(), remote_set_size, q);
+        sketch_out = state.BuildSketch(state.setLocal, ReconciliationSketch::CellsForCapacity(capacity));
+    }
+    // The transactions added from now on wait for the next request
+    state.setSnapshot.swap(state.setLocal);
+    state.setLocal.clear();
+    state.fRequestInFlight = true;
+    state.nRequestTime = now;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId nodeid, const ReconciliationSketch& remote_sketch, bool& fSuccess,
+                                           std::vector<uint256>& txs_to_announce, std::vector<uint32_t>& ask_shortids)
+{
+    txs_to_announce.clear();
+    ask_shortids.clear();
+
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (!state.fInitiator || !state.fRequestInFlight) return false;
+    if (!ReconciliationSketch::IsValidCellCount(remote_sketch.GetCellCount())) return false;
+    state.fRequestInFlight = false;
+
+    fSuccess = true;
+    if (remote_sketch.GetCellCount() == 0) {
+        // The peer has nothing to announce to us
+        txs_to_announce.assign(state.setLocal.begin(), state.setLocal.end());
+    } else {
+        std::map<uint32_t, uint256> mapLocalShortIDs;
+        for (const uint256& txid : state.setLocal) {
+            mapLocalShortIDs.emplace(state.GetShortID(txid), txid);
+        }
+
+        ReconciliationSketch sketch = state.BuildSketch(state.setLocal, remote_sketch.GetCellCount());
+        sketch ^= remote_sketch;
+        std::vector<uint32_t> vDifference;
+        fSuccess = sketch.Decode(vDifference);
+        if (fSuccess) {
+            for (uint32_t shortid : vDifference) {
+                auto itLocal = mapLocalShortIDs.find(shortid);
+                if (itLocal != mapLocalShortIDs.end()) {
+                    txs_to_announce.push_back(itLocal->second);
+                } else {
+                    ask_shortids.push_back(shortid);
+                }
+            }
+        } else {
+            txs_to_announce.assign(state.setLocal.begin(), state.setLocal.end());
+        }
+    }
+    state.setLocal.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId nodeid, bool fSuccess, const std::vector<uint32_t>& ask_shortids,
+                                                             std::vector<uint256>& txs_to_announce)
+{
+    txs_to_announce.clear();
+
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (state.fInitiator || !state.fRequestInFlight) return false;
+    state.fRequestInFlight = false;
+
+    if (fSuccess) {
+        std::map<uint32_t, uint256> mapSnapshotShortIDs;
+        for (const uint256& txid : state.setSnapshot) {
+            mapSnapshotShortIDs.emplace(state.GetShortID(txid), txid);
+        }
+        for (uint32_t shortid : ask_shortids) {
+            auto itSnapshot = mapSnapshotShortIDs.find(shortid);
+            if (itSnapshot != mapSnapshotShortIDs.end()) {
+                txs_to_announce.push_back(itSnapshot->second);
+            }
+        }
+    } else {
+        txs_to_announce.assign(state.setSnapshot.begin(), state.setSnapshot.end());
+    }
+    state.setSnapshot.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::ExpireRequest(NodeId nodeid, std::chrono::microseconds now, std::vector<uint256>& txs_to_announce)
+{
+    txs_to_announce.clear();
+
+    LOCK(cs);
+    auto it = mapStates.find(nodeid);
+    if (it == mapStates.end()) return false;
+    PeerState& state = it->second;
+    if (!state.fRequestInFlight || now < state.nRequestTime + RECON_RESPONSE_TIMEOUT) return false;
+    state.fRequestInFlight = false;
+
+    std::set<uint256>& setPending = state.fInitiator ? state.setLocal : state.setSnapshot;
+    txs_to_announce.assign(setPending.begin(), setPending.end());
+    setPending.clear();
+    return true;
+}
@@ -0,0 +1,211 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "net.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+
+/** Default for -txreconciliation, announce transactions to the peers supporting it through set reconciliation */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the transaction reconciliation protocol we support */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Average delay between two reconciliations we initiate with an outbound peer */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{8};
+/** Time after which a reconciliation the peer doesn't go on with is given up, and the set flooded */
+static constexpr std::chrono::seconds RECON_RESPONSE_TIMEOUT{30};
+/** Number of the outbound reconciling peers a transaction is still flooded to, for fast propagation */
+static const size_t OUTBOUND_FANOUT_DESTINATIONS = 1;
+/** Maximum number of transactions waiting for the next reconciliation with a peer, the others are flooded */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Coefficient of the smaller set size in the estimate of the set difference (see the Erlay paper) */
+static constexpr double RECON_Q = 0.25;
+/** q is sent as a fixed point number with this precision */
+static const uint16_t Q_PRECISION = (2 << 14) - 1;
+/** Maximum number of differences a sketch is built for, bounding the size of a sketch message */
+static const uint32_t MAX_SKETCH_CAPACITY = 2048;
+
+/**
+ * Sketch of a set of 32-bit short transaction IDs, an invertible Bloom lookup table.
+ *
+ * Every element is xor-ed into one cell of each of the SKETCH_HASHES partitions of the table,
+ * along with a check value derived from it. Subtracting the sketch of another set, built with the
+ * same number of cells, cancels the common elements: the difference is recovered by repeatedly
+ * taking the element out of a cell holding a single one, as long as it has about 1.5 cells per
+ * element of the difference. The MIN_SKETCH_CELLS extra cells make it unlikely for a few elements
+ * of a small difference to share all their cells, which can't be decoded.
+ */
+class ReconciliationSketch
+{
+public:
+    static const unsigned int SKETCH_HASHES = 4;
+    static const unsigned int MIN_SKETCH_CELLS = 8 * SKETCH_HASHES;
+
+    struct Cell {
+        uint32_t keySum{0};
+        uint32_t checkSum{0};
+
+        bool IsEmpty() const { return keySum == 0 && checkSum == 0; }
+        SERIALIZE_METHODS(Cell, obj) { READWRITE(obj.keySum, obj.checkSum); }
+    };
+
+private:
+    std::vector<Cell> cells;
+
+    uint32_t GetCellIndex(uint32_t shortid, unsigned int nHash) const;
+    static uint32_t GetCheck(uint32_t shortid);
+    bool IsPure(const Cell& cell) const { return cell.keySum != 0 && cell.checkSum == GetCheck(cell.keySum); }
+
+public:
+    ReconciliationSketch() {}
+    /** Construct an empty sketch of nCells cells, see CellsForCapacity. */
+    explicit ReconciliationSketch(size_t nCells);
+
+    /** Number of cells of a sketch able to decode a difference of up to capacity elements. */
+    static size_t CellsForCapacity(uint32_t capacity);
+    /** Whether a sketch received from a peer has a number of cells we could have built it with, 0 for an empty set. */
+    static bool IsValidCellCount(size_t nCells);
+
+    size_t GetCellCount() const { return cells.size(); }
+    bool IsEmpty() const;
+
+    /** Add (or remove, both are the same) an element. 0 cannot be an element. */
+    void Toggle(uint32_t shortid);
+
+    /** Cancel the elements of another sketch, which must have the same number of cells. */
+    ReconciliationSketch& operator^=(const ReconciliationSketch& other);
+
+    /**
+     * Recover the elements of the sketch, i.e. the symmetric difference of two sets once one's
+     * sketch was subtracted from the other. Returns false if the sketch holds too many of them.
+     */
+    bool Decode(std::vector<uint32_t>& elements) const;
+
+    SERIALIZE_METHODS(ReconciliationSketch, obj) { READWRITE(obj.cells); }
+};
+
+/** Estimate the size of the difference between two sets, i.e. the capacity of the sketch to reconcile them. */
+uint32_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q);
+
+/**
+ * TxReconciliationTracker keeps the reconciliation state of the peers we relay transactions to
+ * through set reconciliation, following the flow of BIP 330 but not its wire format (see
+ * ReconciliationSketch), hence its own sendtxiblt and reqtxiblt messages.
+ *
+ * Both sides of a connection announce a random salt with sendtxiblt before the verack; the short
+ * IDs of the transactions are salted with both. Transactions to be announced to a reconciling peer
+ * are kept in its reconciliation set, except for the few outbound peers each transaction is still
+ * flooded to. Periodically, the outbound side of a connection (the initiator) sends reqtxiblt with
+ * the size of its set; the inbound side answers with the sketch of its own set and waits for the
+ * reconcildiff message telling which of its transactions the initiator misses. The initiator
+ * announces its transactions the peer misses through inv, as usual. If the sketch can't be decoded,
+ * or the peer doesn't answer within RECON_RESPONSE_TIMEOUT, both sides fall back to announcing
+ * their whole sets.
+ */
+class TxReconciliationTracker
+{
+private:
+    struct PeerState {
+        /** Whether we initiate the reconciliations, i.e. the peer is an outbound connection */
+        bool fInitiator;
+        /** SipHash keys of the short IDs, derived from both salts */
+        uint64_t k0;
+        uint64_t k1;
+        /** Transactions to announce to the peer at the next reconciliation */
+        std::set<uint256> setLocal;
+        /** Responder: the transactions sketched for the pending request, until its reconcildiff */
+        std::set<uint256> setSnapshot;
+        /** Whether a reconciliation is in progress: the initiator waits for the sketch, the responder for the reconcildiff */
+        bool fRequestInFlight{false};
+        /** When the reconciliation in progress started */
+        std::chrono::microseconds nRequestTime{0};
+        /** Initiator: when to send the next request */
+        std::chrono::microseconds nNextRequest{0};
+
+        uint32_t GetShortID(const uint256& txid) const;
+        /** The sketch of the given set of transactions */
+        ReconciliationSketch BuildSketch(const std::set<uint256>& setTx, size_t nCells) const;
+    };
+
+    mutable Mutex cs;
+    /** Salts we sent to the peers, until they send theirs */
+    std::map<NodeId, uint64_t> mapPendingSalts GUARDED_BY(cs);
+    std::map<NodeId, PeerState> mapStates GUARDED_BY(cs);
+    /** Number of registered peers we initiate the reconciliations with */
+    size_t nInitiators GUARDED_BY(cs){0};
+    /** SipHash keys of the selection of the peers a transaction is flooded to */
+    const uint64_t fanout_k0;
+    const uint64_t fanout_k1;
+
+public:
+    TxReconciliationTracker();
+
+    /** Generate the salt to send to a peer in sendtxiblt. */
+    uint64_t PreRegisterPeer(NodeId nodeid);
+
+    /**
+     * Register a peer which sent sendtxiblt, once we sent ours. Returns false if the peer can't
+     * reconcile with us, either because we didn't announce support or because of its version.
+     */
+    bool RegisterPeer(NodeId nodeid, bool fInbound, uint32_t nVersion, uint64_t remote_salt);
+
+    void ForgetPeer(NodeId nodeid);
+
+    bool IsPeerRegistered(NodeId nodeid) const;
+
+    /**
+     * Whether a transaction should be announced to a registered peer by flooding: it is flooded to
+     * about OUTBOUND_FANOUT_DESTINATIONS outbound peers, whatever their number.
+     */
+    bool ShouldFloodTo(NodeId nodeid, const uint256& txid) const;
+
+    /** Keep a transaction for the next reconciliation with a peer. Returns false if it must be flooded instead. */
+    bool AddToSet(NodeId nodeid, const uint256& txid);
+
+    /**
+     * Initiator: whether it's time to request a reconciliation from the peer, along with the fields
+     * of the reqtxiblt message.
+     */
+    bool InitiateRequest(NodeId nodeid, std::chrono::microseconds now, uint16_t& local_set_size, uint16_t& q);
+
+    /**
+     * Responder: sketch our set for a reqtxiblt of the peer, and keep it until its reconcildiff.
+     * A request received while waiting for a reconcildiff means the peer gave up the previous
+     * reconciliation: its transactions are sketched again. Returns false if the request is unexpected.
+     */
+    bool HandleRequest(NodeId nodeid, std::chrono::microseconds now, uint16_t remote_set_size, uint16_t q, ReconciliationSketch& sketch_out);
+
+    /**
+     * Initiator: reconcile our set with the sketch of the peer. On success, fills the transactions
+     * of ours the peer misses and the short IDs of the transactions it has to announce to us; on
+     * failure, our whole set is to be announced. Returns false on an unexpected or malformed sketch.
+     */
+    bool HandleSketch(NodeId nodeid, const ReconciliationSketch& remote_sketch, bool& fSuccess,
+                      std::vector<uint256>& txs_to_announce, std::vector<uint32_t>& ask_shortids);
+
+    /**
+     * Responder: the transactions of the pending request the peer misses, all of them if the
+     * reconciliation failed. Returns false if no request is pending.
+     */
+    bool HandleReconciliationDifference(NodeId nodeid, bool fSuccess, const std::vector<uint32_t>& ask_shortids,
+                                        std::vector<uint256>& txs_to_announce);
+
+    /**
+     * Give up the reconciliation in progress with a peer if it started more than
+     * RECON_RESPONSE_TIMEOUT ago, filling the transactions to announce instead: the initiator's
+     * set, or the responder's snapshot. Returns false if there is nothing to give up.
+     */
+    bool ExpireRequest(NodeId nodeid, std::chrono::microseconds now, std::vector<uint256>& txs_to_announce);
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
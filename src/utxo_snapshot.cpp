@@ -0,0 +1,237 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "utxo_snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "dbwrapper.h"
+#include "hash.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "util/system.h"
+#include "util/validation.h"
+#include "validation.h"
+
+#include <boost/thread/thread.hpp> // boost::thread::interrupt
+
+//! Number of coins written to the database at once while loading a snapshot
+static const uint64_t SNAPSHOT_COINS_PER_WRITE = 200000;
+
+uint256 SnapshotShieldedState::GetHash() const
+{
+    return SerializeHash(*this);
+}
+
+bool DumpUTXOSnapshot(CCoinsViewDB& coinsdb, CDBWrapper& evodb, const CBlockIndex* pindexBase, CAutoFile& file,
+                      SnapshotMetadata& metadata)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(coinsdb.Cursor());
+    assert(pcursor);
+
+    if (pcursor->GetBestBlock() != pindexBase->GetBlockHash()) {
+        return error("%s: the chainstate isn't at block %s", __func__, pindexBase->GetBlockHash().GetHex());
+    }
+    if (pindexBase->nHeight == 0) {
+        return error("%s: the chainstate is at the genesis block", __func__);
+    }
+    if (!pindexBase->nChainTx || !pindexBase->nChainSaplingValue) {
+        return error("%s: unknown transaction count or shielded pool value at block %s", __func__, pindexBase->GetBlockHash().GetHex());
+    }
+
+    metadata = SnapshotMetadata();
+    metadata.hashBlock = pindexBase->GetBlockHash();
+    metadata.nHeaders = pindexBase->nHeight;
+    // Written again once the coins are counted and hashed
+    file << metadata;
+
+    std::vector<const CBlockIndex*> vChain(metadata.nHeaders);
+    for (const CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+        vChain[pindex->nHeight - 1] = pindex;
+    }
+    for (const CBlockIndex* pindex : vChain) {
+        file << pindex->GetBlockHeader();
+    }
+
+    CCoinsStats stats;
+    CCoinsStatsHasher hasher(stats, metadata.hashBlock);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+            return error("%s: unable to read value", __func__);
+        }
+        file << key << coin;
+        hasher.Add(key, std::move(coin));
+        metadata.nCoins++;
+        pcursor->Next();
+    }
+    hasher.Finish();
+    metadata.hashUTXOSet = stats.hashSerialized;
+
+    SnapshotShieldedState shielded;
+    shielded.hashBestAnchor = coinsdb.GetBestAnchor();
+    coinsdb.GetSaplingState(shielded.vAnchors, shielded.vNullifiers);
+    std::unique_ptr<CDBIterator> pevocursor(evodb.NewIterator());
+    for (pevocursor->SeekToFirst(); pevocursor->Valid(); pevocursor->Next()) {
+        const CDataStream ssKey = pevocursor->GetKey();
+        const CDataStream ssValue = pevocursor->GetValue();
+        shielded.vEvoRecords.emplace_back(std::vector<unsigned char>(ssKey.begin(), ssKey.end()),
+                                          std::vector<unsigned char>(ssValue.begin(), ssValue.end()));
+    }
+    shielded.nStakeModifier = pindexBase->GetStakeModifierV2();
+    shielded.nSaplingPoolValue = *pindexBase->nChainSaplingValue;
+    shielded.nChainTx = pindexBase->nChainTx;
+    file << shielded;
+    metadata.hashShieldedState = shielded.GetHash();
+
+    if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+        return error("%s: unable to rewind the snapshot file", __func__);
+    }
+    file << metadata;
+    return true;
+}
+
+bool VerifyUTXOSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotShieldedState& shielded,
+                        CCoinsStats& stats, std::string& strError)
+{
+    try {
+        file >> metadata;
+        if (metadata.nVersion != SnapshotMetadata::CURRENT_VERSION) {
+            strError = strprintf("unsupported snapshot version %d", metadata.nVersion);
+            return false;
+        }
+        if (metadata.nHeaders == 0) {
+            strError = "no block headers";
+            return false;
+        }
+        const long nHeadersPos = ftell(file.Get());
+
+        // The headers chain from the genesis block to the base block
+        uint256 hashPrev = Params().GenesisBlock().GetHash();
+        for (uint32_t i = 0; i < metadata.nHeaders; i++) {
+            boost::this_thread::interruption_point();
+            CBlockHeader header;
+            file >> header;
+            if (header.hashPrevBlock != hashPrev) {
+                strError = strprintf("the block header at height %d doesn't follow the previous one", i + 1);
+                return false;
+            }
+            hashPrev = header.GetHash();
+        }
+        if (hashPrev != metadata.hashBlock) {
+            strError = "the block headers don't lead to the snapshot base block";
+            return false;
+        }
+
+        CCoinsStatsHasher hasher(stats, metadata.hashBlock);
+        for (uint64_t i = 0; i < metadata.nCoins; i++) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            file >> key >> coin;
+            hasher.Add(key, std::move(coin));
+        }
+        hasher.Finish();
+        file >> shielded;
+
+        // Each outpoint once (outputs of a transaction are grouped, and the group hashed)
+        if (stats.nTransactionOutputs != metadata.nCoins || stats.hashSerialized != metadata.hashUTXOSet) {
+            strError = "the coins don't match the snapshot hash";
+            return false;
+        }
+        if (shielded.GetHash() != metadata.hashShieldedState) {
+            strError = "the shielded state doesn't match the snapshot hash";
+            return false;
+        }
+        // A coinbase a block at least, the genesis block included
+        if (shielded.nChainTx <= metadata.nHeaders) {
+            strError = "too few transactions in the chain";
+            return false;
+        }
+        if (nHeadersPos < 0 || fseek(file.Get(), nHeadersPos, SEEK_SET) != 0) {
+            strError = "unable to rewind the snapshot file";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to read the snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadSnapshotHeaders(CAutoFile& file, const SnapshotMetadata& metadata, CValidationState& state)
+{
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.reserve(MAX_HEADERS_RESULTS);
+    try {
+        for (uint32_t i = 0; i < metadata.nHeaders; i++) {
+            CBlockHeader header;
+            file >> header;
+            vHeaders.push_back(header);
+            if (vHeaders.size() == MAX_HEADERS_RESULTS || i + 1 == metadata.nHeaders) {
+                if (!ProcessNewBlockHeaders(vHeaders, state)) {
+                    return error("%s: invalid block header: %s", __func__, FormatStateMessage(state));
+                }
+                vHeaders.clear();
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: unable to read the snapshot: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, const SnapshotShieldedState& shielded,
+                      CCoinsViewDB& coinsdb, CCoinsViewCache& coinsTip, CDBWrapper& evodb)
+{
+    CCoinsMap mapCoins;
+    try {
+        for (uint64_t i = 0; i < metadata.nCoins; i++) {
+            COutPoint key;
+            Coin coin;
+            file >> key >> coin;
+            CCoinsCacheEntry& entry = mapCoins[key];
+            entry.coin = std::move(coin);
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            // The last part completes the transition, with the rest of the state
+            if (mapCoins.size() >= SNAPSHOT_COINS_PER_WRITE && i + 1 < metadata.nCoins) {
+                if (!coinsdb.WriteCoinsTowards(mapCoins, metadata.hashBlock)) {
+                    return error("%s: unable to write the coins", __func__);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: unable to read the snapshot: %s", __func__, e.what());
+    }
+
+    CDBBatch batch;
+    for (const auto& record : shielded.vEvoRecords) {
+        batch.Write(CDataStream(record.first, SER_DISK, CLIENT_VERSION), CDataStream(record.second, SER_DISK, CLIENT_VERSION));
+    }
+    if (!evodb.WriteBatch(batch, true)) {
+        return error("%s: unable to write the evo database", __func__);
+    }
+
+    CAnchorsSaplingMap mapSaplingAnchors;
+    for (const auto& anchor : shielded.vAnchors) {
+        CAnchorsSaplingCacheEntry& entry = mapSaplingAnchors[anchor.first];
+        entry.entered = true;
+        entry.tree = anchor.second;
+        entry.flags = CAnchorsSaplingCacheEntry::DIRTY;
+    }
+    CNullifiersMap mapSaplingNullifiers;
+    for (const uint256& nf : shielded.vNullifiers) {
+        CNullifiersCacheEntry& entry = mapSaplingNullifiers[nf];
+        entry.entered = true;
+        entry.flags = CNullifiersCacheEntry::DIRTY;
+    }
+    if (!coinsTip.BatchWrite(mapCoins, metadata.hashBlock, shielded.hashBestAnchor, mapSaplingAnchors, mapSaplingNullifiers)) {
+        return error("%s: unable to write the coins", __func__);
+    }
+    return coinsTip.Flush();
+}
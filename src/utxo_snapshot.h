@@ -0,0 +1,107 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TrumpCoin_UTXO_SNAPSHOT_H
+#define TrumpCoin_UTXO_SNAPSHOT_H
+
+#include "amount.h"
+#include "coinstats.h"
+#include "sapling/incrementalmerkletree.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class CAutoFile;
+class CBlockIndex;
+class CCoinsViewCache;
+class CCoinsViewDB;
+class CDBWrapper;
+class CValidationState;
+
+/**
+ * Header of a UTXO set snapshot file (dumptxoutset, loadtxoutset).
+ * It has a fixed size, as it's written again once the coins are.
+ *
+ * The file goes on with the headers of the blocks after the genesis block up
+ * to hashBlock, then the coins (outpoint, coin), in database order, followed
+ * by a SnapshotShieldedState.
+ */
+class SnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 3;
+
+    uint32_t nVersion{CURRENT_VERSION};
+    //! Best block of the chainstate the snapshot was taken from
+    uint256 hashBlock;
+    //! Number of block headers, the height of hashBlock
+    uint32_t nHeaders{0};
+    uint64_t nCoins{0};
+    //! hash_serialized_2 of gettxoutsetinfo at hashBlock
+    uint256 hashUTXOSet;
+    //! Hash of the SnapshotShieldedState
+    uint256 hashShieldedState;
+
+    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.nVersion, obj.hashBlock, obj.nHeaders, obj.nCoins, obj.hashUTXOSet, obj.hashShieldedState); }
+};
+
+/**
+ * The chainstate besides the coins: Sapling anchors and nullifiers, the evo database records,
+ * and what the blocks up to the snapshot base would have told about it.
+ */
+class SnapshotShieldedState
+{
+public:
+    uint256 hashBestAnchor;
+    std::vector<std::pair<uint256, SaplingMerkleTree>> vAnchors;
+    std::vector<uint256> vNullifiers;
+    //! Raw key/value records
+    std::vector<std::pair<std::vector<unsigned char>, std::vector<unsigned char>>> vEvoRecords;
+    //! Stake modifier of the base block (null before UPGRADE_V3_4)
+    uint256 nStakeModifier;
+    //! Value of the Sapling shielded pool at the base block
+    CAmount nSaplingPoolValue{0};
+    //! Number of transactions in the chain up to the base block
+    unsigned int nChainTx{0};
+
+    SERIALIZE_METHODS(SnapshotShieldedState, obj) { READWRITE(obj.hashBestAnchor, obj.vAnchors, obj.vNullifiers, obj.vEvoRecords, obj.nStakeModifier, obj.nSaplingPoolValue, obj.nChainTx); }
+
+    uint256 GetHash() const;
+};
+
+/**
+ * Write the chainstate at pindexBase, the best block of coinsdb, to file, and fill metadata.
+ * The caller makes sure nothing gets written to the databases meanwhile.
+ */
+bool DumpUTXOSnapshot(CCoinsViewDB& coinsdb, CDBWrapper& evodb, const CBlockIndex* pindexBase, CAutoFile& file,
+                      SnapshotMetadata& metadata);
+
+/**
+ * Read a snapshot, and check that its content matches its metadata, and that its
+ * headers chain from the genesis block to the base block.
+ * On success, file is positioned after the metadata again, ready for LoadSnapshotHeaders.
+ */
+bool VerifyUTXOSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotShieldedState& shielded,
+                        CCoinsStats& stats, std::string& strError);
+
+/**
+ * Add the headers of a snapshot checked by VerifyUTXOSnapshot to the block index,
+ * the base block last. On success, file is positioned at the coins, ready for LoadUTXOSnapshot.
+ */
+bool LoadSnapshotHeaders(CAutoFile& file, const SnapshotMetadata& metadata, CValidationState& state);
+
+/**
+ * Load the coins and the shielded state of a snapshot, after LoadSnapshotHeaders.
+ * The coins are written to coinsdb in parts, and the last ones, with the Sapling
+ * state, through coinsTip (on top of coinsdb), which is flushed to complete the
+ * transition to the snapshot block. The blocks below it are not available, so an
+ * interrupted load leaves a chainstate to rebuild with -reindex-chainstate.
+ */
+bool LoadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, const SnapshotShieldedState& shielded,
+                      CCoinsViewDB& coinsdb, CCoinsViewCache& coinsTip, CDBWrapper& evodb);
+
+#endif // TrumpCoin_UTXO_SNAPSHOT_H
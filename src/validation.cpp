@@ -22,6 +22,7 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "consensus/zerocoin_verify.h"
+#include "cuckoocache.h"
 #include "evo/specialtx.h"
 #include "flatfile.h"
 #include "guiinterface.h"
@@ -36,6 +37,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -82,6 +84,7 @@ RecursiveMutex cs_main;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
+CBlockIndex* pindexSnapshotBase = NULL;
 
 // Best block section
 Mutex g_best_block_mutex;
@@ -90,13 +93,21 @@ uint256 g_best_block;
 int64_t g_best_block_time = 0;
 
 int nScriptCheckThreads = 0;
+bool fBatchScriptChecks = DEFAULT_BATCH_SCRIPTCHECKS;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
 bool fTxIndex = true;
+bool fCoinStatsIndex = DEFAULT_COINSTATSINDEX;
+bool fMapBlockFiles = DEFAULT_MMAP_BLOCKS;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 size_t nCoinCacheUsage = 5000 * 300;
 
+/** Commitment to the UTXO set at hashCoinsCommitment (-coinstatsindex), protected by cs_main.
+ *  It is kept up to date while hashCoinsCommitment is the chainstate's best block. */
+static CCoinsCommitment coinsCommitment;
+static uint256 hashCoinsCommitment;
+
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -162,6 +173,9 @@ RecursiveMutex cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
 
+/** Mappings of the block files before nLastBlockFile, which are complete (-mmapblocks), unless written to since */
+static FlatFileMapCache mapBlockFiles(MAX_MAPPED_BLOCKFILES);
+
 /**
      * Every received block is assigned a unique and increasing identifier, so we
      * know which one to give priority in case of a fork.
@@ -209,6 +223,7 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 std::unique_ptr<CZerocoinDB> zerocoinDB;
 std::unique_ptr<CSporkDB> pSporkDB;
 std::unique_ptr<AccumulatorCache> accumulatorCache;
+std::unique_ptr<StakeModifierCache> stakeModifierCache;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -589,13 +604,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         if (fCLTVIsActivated)
             flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
-        PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
+        auto precomTxData = std::make_shared<PrecomputedTransactionData>(tx);
+        if (!CheckInputs(tx, state, view, true, flags, true, false, *precomTxData)) {
             return false;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
+        // Check again against the consensus-critical script verification flags
+        // of the next block, in case of bugs in the standard flags that cause
         // transactions to pass as valid when they're actually invalid. For
         // instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
@@ -603,10 +618,12 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
-        if (fCLTVIsActivated)
-            flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
+        //
+        // Using the block flags (a superset of MANDATORY_SCRIPT_VERIFY_FLAGS) also
+        // stores the result in the script-execution cache, so that ConnectBlock
+        // doesn't need to verify the scripts again when the tx gets mined.
+        flags = GetBlockScriptFlags(chainActive.Tip());
+        if (!CheckInputs(tx, state, view, true, flags, true, true, *precomTxData)) {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                     __func__, hash.ToString(), FormatStateMessage(state));
         }
@@ -617,6 +634,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // transactions in the mempool
         bool validForFeeEstimation = IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
+        // Keep the sighash midstates, to be reused when the tx gets mined
+        entry.SetPrecomputedTxData(precomTxData);
+
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
@@ -757,6 +777,11 @@ bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos)
         return error("WriteBlockToDisk : ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
     fileout << block;
+    fileout.fclose();
+
+    // The file may have been mapped while a later one was the last, as nLastBlockFile moves
+    // backwards when reindexing
+    mapBlockFiles.Invalidate(pos.nFile);
 
     return true;
 }
@@ -765,14 +790,31 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    // The files before the one being appended to don't change anymore, read
+    // them through a mapping (dropped by WriteBlockToDisk if one is written to
+    // after all). The last one is read with stdio.
+    std::shared_ptr<const MappedFlatFile> mapped;
+    if (fMapBlockFiles && WITH_LOCK(cs_LastBlockFile, return pos.nFile < nLastBlockFile)) {
+        mapped = mapBlockFiles.Get(BlockFileSeq(), pos);
+    }
 
-    // Read block
     try {
-        filein >> block;
+        if (mapped) {
+            // Read block, straight from the mapped memory
+            Span<const unsigned char> data = mapped->GetSpan();
+            if (pos.nPos >= data.size())
+                return error("ReadBlockFromDisk : %s is out of the mapped file", pos.ToString());
+            SpanReader reader(SER_DISK, CLIENT_VERSION, data.subspan(pos.nPos));
+            reader >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+            // Read block
+            filein >> block;
+        }
     } catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1059,6 +1101,56 @@ bool CScriptCheck::operator()()
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *precomTxData), ptxTo->GetRequiredSigVersion(), &error);
 }
 
+bool CScriptCheck::CanDeferSignatures() const
+{
+    return m_tx_out.scriptPubKey.IsPayToPublicKeyHash() || m_tx_out.scriptPubKey.IsPayToColdStaking();
+}
+
+bool CScriptCheck::VerifyDeferred(CSignatureBatch& batch)
+{
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, nFlags, BatchingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *precomTxData, batch), ptxTo->GetRequiredSigVersion(), &error);
+}
+
+template <>
+bool RunChecksBatch(std::vector<CScriptCheck>& vChecks)
+{
+    if (!fBatchScriptChecks) {
+        for (CScriptCheck& check : vChecks)
+            if (!check())
+                return false;
+        return true;
+    }
+
+    CSignatureBatch batch;
+    // Deferred checks, with the range of their signatures in the batch
+    std::vector<std::pair<CScriptCheck*, std::pair<size_t, size_t>>> vDeferred;
+    vDeferred.reserve(vChecks.size());
+    for (CScriptCheck& check : vChecks) {
+        if (check.CanDeferSignatures()) {
+            const size_t nBegin = batch.size();
+            if (check.VerifyDeferred(batch)) {
+                vDeferred.emplace_back(&check, std::make_pair(nBegin, batch.size()));
+                continue;
+            }
+            // Not valid even with every signature accepted: evaluate it normally
+            batch.Truncate(nBegin);
+        }
+        if (!check())
+            return false;
+    }
+
+    if (batch.Verify())
+        return true;
+
+    // Some signature is invalid, locate the failing input(s)
+    for (auto& it : vDeferred) {
+        if (!batch.Verify(it.second.first, it.second.second) && !(*it.first)())
+            return false;
+    }
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1119,13 +1211,46 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev)
+{
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (pindexPrev && Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight, Consensus::UPGRADE_BIP65))
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return flags;
+}
+
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+
+void InitScriptExecutionCache()
+{
+    // nMaxCacheSize is unsigned. If -maxscriptcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxscriptcachesize", DEFAULT_MAX_SCRIPT_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
 
         if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs)))
             return false;
 
+        // The script-execution cache is only accessed under cs_main, no need for its own lock.
+        AssertLockHeld(cs_main);
+
+        // The txid commits to the prevouts (and so to the coins being spent, with
+        // their amounts and scripts) and to the shielded data, so (txid, flags)
+        // identifies a full execution of the transaction scripts.
+        uint256 hashCacheEntry;
+        CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+        if (fScriptChecks && scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+            return true;
+        }
+
         if (pvChecks)
             pvChecks->reserve(tx.vin.size());
 
@@ -1149,7 +1274,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 // spent being checked as a part of CScriptCheck.
 
                 // Verify signature
-                CScriptCheck check(coin.out, tx, i, flags, cacheStore, &precomTxData);
+                CScriptCheck check(coin.out, tx, i, flags, cacheSigStore, &precomTxData);
                 if (pvChecks) {
                     pvChecks->emplace_back();
                     check.swap(pvChecks->back());
@@ -1162,7 +1287,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(coin.out, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &precomTxData);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &precomTxData);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1176,6 +1301,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
+            }
         }
     }
 
@@ -1256,6 +1387,14 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const FlatFilePos& pos, const uint2
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("%s: no undo data available for block %s", __func__, pindex->GetBlockHash().ToString());
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1434,6 +1573,16 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+// Every job verifies all the proofs of a single transaction, which is far
+// more expensive than a script check, so workers take one job at a time.
+static CCheckQueue<CSaplingProofCheck> saplingcheckqueue(1);
+
+void ThreadSaplingProofCheck()
+{
+    util::ThreadRename("trumpcoin-saplingch");
+    saplingcheckqueue.Thread();
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeProcessSpecial = 0;
 static int64_t nTimeConnect = 0;
@@ -1516,11 +1665,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
-    // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
-    bool fCLTVIsActivated = false;
-    if (fScriptChecks && pindex->pprev) {
-        fCLTVIsActivated = consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_BIP65);
-    }
+    // Script verification flags of this block
+    const unsigned int flags = GetBlockScriptFlags(pindex->pprev);
+
+    // Shared with the mempool entries of the transactions already validated there.
+    // Declared before the queue controls, as the checks reference it until they are done.
+    std::vector<std::shared_ptr<PrecomputedTransactionData>> precomTxData;
+    precomTxData.reserve(block.vtx.size());
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
@@ -1542,8 +1693,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     SaplingMerkleTree sapling_tree;
     assert(view.GetSaplingAnchorAt(view.GetBestAnchor(), sapling_tree));
 
-    std::vector<PrecomputedTransactionData> precomTxData;
-    precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
     bool fInitialBlockDownload = IsInitialBlockDownload();
     bool fSaplingMaintenance =  (block.nTime > sporkManager.GetSporkValue(SPORK_20_SAPLING_MAINTENANCE));
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
@@ -1583,8 +1732,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
         }
 
-        // Cache the sig ser hashes
-        precomTxData.emplace_back(tx);
+        // Cache the sig ser hashes (reusing the ones computed on mempool acceptance, if any)
+        std::shared_ptr<PrecomputedTransactionData> txPrecomData;
+        if (!tx.IsCoinBase() && !tx.IsCoinStake()) {
+            txPrecomData = mempool.GetPrecomputedTxData(tx.GetHash());
+        }
+        precomTxData.emplace_back(txPrecomData ? txPrecomData : std::make_shared<PrecomputedTransactionData>(tx));
 
         CAmount txValueOut = tx.GetValueOut();
         if (!tx.IsCoinBase()) {
@@ -1594,15 +1747,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             nValueIn += txValueIn;
 
             std::vector<CScriptCheck> vChecks;
-            unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
-            if (fCLTVIsActivated)
-                flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, *precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
+
         nValueOut += txValueOut;
 
         CTxUndo undoDummy;
@@ -1766,6 +1916,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
         int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
         cacheSize += evoDb->GetMemoryUsage();
+        // Changes still being written in background, coins scripts included
+        cacheSize += pcoinsdbview->DynamicMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now
         // (not in the middle of a block processing).
@@ -1808,6 +1960,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             // Flush zerocoin accumulator checkpoints cache
             if (accumulatorCache) accumulatorCache->Flush();
+            // Flush the blocks holding the old stake modifiers
+            if (stakeModifierCache) stakeModifierCache->Flush();
 
             nLastWrite = nNow;
         }
@@ -1823,15 +1977,42 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
+            // With -backgroundflush, the coins are written on a dedicated thread,
+            // unless the flush is required to complete (e.g. on shutdown).
+            // The UTXO set commitment is written atomically with the coins
+            if (fCoinStatsIndex && hashCoinsCommitment == pcoinsTip->GetBestBlock())
+                pcoinsdbview->SetCommitment(coinsCommitment);
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
-            if (!evoDb->CommitRootTransaction()) {
-                return AbortNode(state, "Failed to commit EvoDB");
-            }
+            // The EvoDB changes of the same blocks (and its best block) are written once
+            // the coins are: an interrupted coins write is replayed on startup from the
+            // old EvoDB state, as ReplayBlocks processes the special txs again.
+            evoDb->DetachRootTransaction();
+            pcoinsdbview->AfterWrite([]() {
+                if (!evoDb->WritePendingTransaction()) {
+                    AbortNode("Failed to commit EvoDB");
+                }
+            });
+            if (mode == FLUSH_STATE_ALWAYS && !pcoinsdbview->WaitForWrite())
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
-            // Update money supply on memory, reading data from disk
+            // Update money supply on memory
             if (!ShutdownRequested() && !IsInitialBlockDownload()) {
-                MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
+                const int nHeight = chainActive.Height();
+                if (fCoinStatsIndex && hashCoinsCommitment == pcoinsTip->GetBestBlock()) {
+                    // Kept up to date block by block, no need to read the coins
+                    MoneySupply.Update(coinsCommitment.nTotalAmount, nHeight);
+                } else {
+                    // Read from disk once written, on the scheduler thread: a scan on the
+                    // writer thread would hold up the next write, and cs_main with it.
+                    CCoinsViewDB* pcoinsdb = pcoinsdbview.get();
+                    pcoinsdb->AfterWrite([pcoinsdb, nHeight]() {
+                        CallFunctionInValidationInterfaceQueue([pcoinsdb, nHeight]() {
+                            CCoinsViewCache view(pcoinsdb);
+                            MoneySupply.Update(view.GetTotalAmount(), nHeight);
+                        });
+                    });
+                }
             }
         }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -1900,6 +2081,17 @@ void static UpdateTip(CBlockIndex* pindexNew)
     }
 }
 
+/** Store the commitment to the UTXO set as of pindex (-coinstatsindex) */
+static void WriteBlockCoinsStats(const CBlockIndex* pindex, CCoinsCommitment& commitment)
+{
+    CBlockCoinsStats stats;
+    commitment.muhash.Finalize(stats.hashMuHash);
+    stats.nTransactionOutputs = commitment.nTransactionOutputs;
+    stats.nTotalAmount = commitment.nTotalAmount;
+    if (!pblocktree->WriteBlockCoinsStats(pindex->GetBlockHash(), stats))
+        LogPrintf("%s: Failed to write the UTXO set commitment of block %s\n", __func__, pindex->GetBlockHash().ToString());
+}
+
 /** Disconnect chainActive's tip.
   * After calling, the mempool will be in an inconsistent state, with
   * transactions from disconnected blocks being added to disconnectpool.  You
@@ -1929,11 +2121,23 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
         CCoinsViewCache view(pcoinsTip.get());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
+        // Undo the changes of the block in a copy of the UTXO set commitment
+        CCoinsCommitment commitment;
+        const bool fCommit = fCoinStatsIndex && hashCoinsCommitment == view.GetBestBlock();
+        if (fCommit) {
+            commitment = coinsCommitment;
+            view.SetCommitment(&commitment);
+        }
         if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
         dbTx->Commit();
+        if (fCommit) {
+            coinsCommitment = commitment;
+            hashCoinsCommitment = pindexDelete->pprev->GetBlockHash();
+            WriteBlockCoinsStats(pindexDelete->pprev, coinsCommitment);
+        }
     }
     LogPrint(BCLog::BENCHMARK, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     const uint256& saplingAnchorAfterDisconnect = pcoinsTip->GetBestAnchor();
@@ -2055,6 +2259,13 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
         auto dbTx = evoDb->BeginTransaction();
 
         CCoinsViewCache view(pcoinsTip.get());
+        // Apply the changes of the block to a copy of the UTXO set commitment
+        CCoinsCommitment commitment;
+        const bool fCommit = fCoinStatsIndex && hashCoinsCommitment == view.GetBestBlock();
+        if (fCommit) {
+            commitment = coinsCommitment;
+            view.SetCommitment(&commitment);
+        }
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, false);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
@@ -2068,6 +2279,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
         bool flushed = view.Flush();
         assert(flushed);
         dbTx->Commit();
+        if (fCommit) {
+            coinsCommitment = commitment;
+            hashCoinsCommitment = pindexNew->GetBlockHash();
+            WriteBlockCoinsStats(pindexNew, coinsCommitment);
+        }
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -2449,6 +2665,24 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/** Set the proof-of-stake flag and the stake modifier of a block index entry. Both depend on the
+ *  block transactions, so headers accepted ahead of the block data get them when it arrives. */
+static void SetBlockStakeModifier(CBlockIndex* pindex, const CBlock& block)
+{
+    if (block.IsProofOfStake())
+        pindex->SetProofOfStake();
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (!consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+        // compute and set new V1 stake modifier (entropy bits)
+        pindex->SetNewStakeModifier();
+
+    } else {
+        // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+        pindex->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+    }
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2471,22 +2705,12 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
-
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        if (!block.vtx.empty())
+            SetBlockStakeModifier(pindexNew, block);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
-        pindexBestHeader = pindexNew;
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -2521,6 +2745,9 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
+    // The best header only follows the blocks whose stake was checked, a header alone is cheap to make up
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+        pindexBestHeader = pindexNew;
 
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
@@ -2709,7 +2936,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // because we receive the wrong transactions for it.
 
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !block.fPrechecked) {
         bool mutated;
         uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -2811,7 +3038,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             REJECT_INVALID, "bad-blk-sigops", true);
 
     // Check PoS signature.
-    if (fCheckSig && !CheckBlockSignature(block)) {
+    if (fCheckSig && !block.fPrechecked && !CheckBlockSignature(block)) {
         return state.DoS(100, error("%s : bad proof-of-stake block signature", __func__),
                          REJECT_INVALID, "bad-PoS-sig", true);
     }
@@ -2911,6 +3138,10 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     if (pcheckpoint && nHeight < pcheckpoint->nHeight)
         return state.DoS(0, error("%s : forked chain older than last checkpoint (height %d)", __func__, nHeight));
 
+    // Nor forks of the blocks up to a loaded UTXO snapshot base, which can't be disconnected
+    if (pindexSnapshotBase && nHeight <= pindexSnapshotBase->nHeight && pindexSnapshotBase->GetAncestor(nHeight - 1) != pindexPrev)
+        return state.DoS(0, error("%s : forked chain older than the loaded UTXO snapshot (height %d)", __func__, nHeight));
+
     // Reject outdated version blocks
     if ((block.nVersion < 3 && nHeight >= 1) ||
         (block.nVersion < 4 && consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_ZC)) ||
@@ -2931,14 +3162,27 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
     const CChainParams& chainparams = Params();
 
+    const bool fInitialBlockDownload = IsInitialBlockDownload();
+    // With script check threads, the Sapling proofs of the shielded transactions are
+    // verified in parallel, still before the block is stored.
+    const bool fParallelProofs = nScriptCheckThreads > 0;
+    CCheckQueueControl<CSaplingProofCheck> saplingControl(fParallelProofs ? &saplingcheckqueue : nullptr);
+
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
         // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fInitialBlockDownload, !fParallelProofs)) {
             return false;
         }
 
+        if (fParallelProofs && tx->hasSaplingData()) {
+            std::vector<CSaplingProofCheck> vSaplingChecks(1);
+            CSaplingProofCheck check(*tx, 100);
+            check.swap(vSaplingChecks.back());
+            saplingControl.Add(vSaplingChecks);
+        }
+
         if (!IsFinalTx(tx, nHeight, block.GetBlockTime())) {
             return state.DoS(10, false, REJECT_INVALID, "bad-txns-nonfinal", false, "non-final transaction");
         }
@@ -2968,6 +3212,16 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
         }
     }
 
+    if (!saplingControl.Wait()) {
+        // Verify the proofs again, in order, to reject the block for the first invalid one
+        for (const auto& tx : block.vtx) {
+            if (tx->hasSaplingData() && !ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fInitialBlockDownload)) {
+                return false;
+            }
+        }
+        return state.DoS(100, error("%s: Sapling CheckQueue failed", __func__), REJECT_INVALID, "bad-txns-sapling-proofs-invalid");
+    }
+
     return true;
 }
 
@@ -3240,6 +3494,12 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!GetPrevIndex(block, &pindexPrev, state))
         return false;
 
+    // The stake of a block is checked against the stake modifier of its parent, which
+    // a header received ahead of its block data doesn't have yet.
+    if (pindexPrev && !(pindexPrev->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)))
+        return state.DoS(0, error("%s : prev block %s not yet received", __func__, block.hashPrevBlock.GetHex()), 0,
+                         "prevblk-no-data");
+
     if (block.GetHash() != consensus.hashGenesisBlock && !CheckWork(block, pindexPrev))
         return state.DoS(100, false, REJECT_INVALID);
 
@@ -3253,13 +3513,20 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
         return false;
 
-    if (pindex->nStatus & BLOCK_HAVE_DATA) {
+    // Blocks below a loaded UTXO snapshot are not stored either
+    if (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID)) {
         // TODO: deal better with duplicate blocks.
         // return state.DoS(20, error("AcceptBlock() : already have block %d %s", pindex->nHeight, pindex->GetBlockHash().ToString()), REJECT_DUPLICATE, "duplicate");
         LogPrintf("%s : already have block %d %s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
         return true;
     }
 
+    if (pindex->pprev && pindex->vStakeModifier.empty()) {
+        // The header was accepted ahead of the block data
+        SetBlockStakeModifier(pindex, block);
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     if (!CheckBlock(block, state) || !ContextualCheckBlock(block, state, pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3413,6 +3680,56 @@ bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFile
     return true;
 }
 
+/**
+ * A header received ahead of its block must not fork the active chain deeper than -maxreorg, nor
+ * off the last checkpoint: its block would be refused, and the header alone proves little.
+ */
+static bool CheckHeaderFork(const CBlockHeader& header, const CBlockIndex* pindexPrev, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint();
+    if (pcheckpoint && pindexPrev->nHeight >= pcheckpoint->nHeight && pindexPrev->GetAncestor(pcheckpoint->nHeight) != pcheckpoint)
+        return state.DoS(100, error("%s : header %s forks before the last checkpoint", __func__, header.GetHash().GetHex()),
+                         REJECT_CHECKPOINT, "bad-fork-prior-to-checkpoint");
+
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+    if (pindexFork && chainActive.Height() - pindexFork->nHeight >= gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH))
+        return state.DoS(10, error("%s : header %s forks deeper than the max reorganization depth (height %d)", __func__,
+                                   header.GetHash().GetHex(), pindexFork->nHeight),
+                         REJECT_INVALID, "bad-fork-too-deep");
+    return true;
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex)
+{
+    LOCK(cs_main);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const CBlockHeader& header : headers) {
+        // AcceptBlockHeader works on blocks, this one has no transactions
+        const CBlock block(header);
+        CBlockIndex* pindex = nullptr;
+        BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+        if (mi == mapBlockIndex.end()) {
+            CBlockIndex* pindexPrev = nullptr;
+            if (!GetPrevIndex(block, &pindexPrev, state))
+                return false;
+            if (!CheckHeaderFork(header, pindexPrev, state))
+                return false;
+            // The only proof a header carries on its own is its difficulty matching the chain
+            if (block.GetHash() != consensus.hashGenesisBlock && !CheckWork(block, pindexPrev))
+                return state.DoS(50, error("%s : incorrect difficulty for header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "bad-diffbits");
+            if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
+                return false;
+        } else if (!AcceptBlockHeader(block, state, &pindex)) {
+            return false;
+        }
+        if (ppindex)
+            *ppindex = pindex;
+    }
+    return true;
+}
+
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckBlockSig)
 {
     AssertLockHeld(cs_main);
@@ -3493,6 +3810,13 @@ bool static LoadBlockIndexDB(std::string& strError)
     if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
         return false;
 
+    if (stakeModifierCache && !stakeModifierCache->Load([](const uint256& hash) -> const CBlockIndex* {
+            BlockMap::const_iterator it = mapBlockIndex.find(hash);
+            return it == mapBlockIndex.end() ? nullptr : it->second;
+        })) {
+        return false;
+    }
+
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
@@ -3510,7 +3834,11 @@ bool static LoadBlockIndexDB(std::string& strError)
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        if (pindex->IsAssumedValid()) {
+            // nChainTx and nChainSaplingValue are unknown below a loaded UTXO snapshot base (the highest
+            // of these blocks), and read from disk at it
+            pindexSnapshotBase = pindex;
+        } else if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3531,13 +3859,13 @@ bool static LoadBlockIndexDB(std::string& strError)
                 pindex->nChainSaplingValue = pindex->nSaplingValue;
             }
         }
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == NULL))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) || pindex->IsAssumedValid()) && (pindex->nChainTx || pindex->pprev == NULL))
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) || pindex->IsAssumedValid()) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
 
@@ -3613,6 +3941,11 @@ bool LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end()) {
         return false;
     }
+    if (!(it->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID))) {
+        // The coins of a UTXO snapshot, loaded without the blocks below it being marked
+        return error("%s: the chainstate is at block %s, not available nor part of a loaded UTXO snapshot", __func__,
+                     it->second->GetBlockHash().GetHex());
+    }
     chainActive.SetTip(it->second);
 
     PruneBlockIndexCandidates();
@@ -3626,6 +3959,99 @@ bool LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool ActivateSnapshotChain(CBlockIndex* pindexBase, const uint256& nStakeModifier, CAmount nSaplingPoolValue, unsigned int nChainTx)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexBase->nHeight > 0 && pcoinsTip->GetBestBlock() == pindexBase->GetBlockHash());
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    std::vector<CBlockIndex*> vChain(pindexBase->nHeight);
+    for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+        vChain[pindex->nHeight - 1] = pindex;
+    }
+    for (CBlockIndex* pindex : vChain) {
+        // The block data is never downloaded: the transaction counts and shielded values stay
+        // unknown (nChainTx 0, nChainSaplingValue nullopt), but the totals at the base, and the
+        // stake fields are set from the block index alone, as proof-of-stake is enforced from
+        // UPGRADE_POS on. Past UPGRADE_V3_4, only the stake modifier of the base is needed, to
+        // check the stake of the next block.
+        pindex->nStatus |= BLOCK_ASSUMED_VALID;
+        if (consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_POS))
+            pindex->SetProofOfStake();
+        if (!consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+            pindex->SetNewStakeModifier();
+        } else if (pindex == pindexBase) {
+            pindex->SetStakeModifier(nStakeModifier);
+        }
+        setDirtyBlockIndex.insert(pindex);
+    }
+    pindexBase->nChainTx = nChainTx;
+    pindexBase->nChainSaplingValue = nSaplingPoolValue;
+    pindexSnapshotBase = pindexBase;
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexBase->nChainWork)
+        pindexBestHeader = pindexBase;
+    {
+        LOCK(cs_nBlockSequenceId);
+        pindexBase->nSequenceId = nBlockSequenceId++;
+    }
+    setBlockIndexCandidates.insert(pindexBase);
+
+    if (!LoadChainTip(Params())) {
+        return false;
+    }
+    CValidationState state;
+    return FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+}
+
+bool LoadCoinsCommitment()
+{
+    LOCK(cs_main);
+    if (!fCoinStatsIndex) return true;
+
+    const uint256 hashBestBlock = pcoinsTip->GetBestBlock();
+    if (pcoinsdbview->ReadCommitment(hashCoinsCommitment, coinsCommitment) && hashCoinsCommitment == hashBestBlock) {
+        LogPrintf("%s: UTXO set commitment loaded at block %s\n", __func__, hashBestBlock.GetHex());
+        return true;
+    }
+
+    // Enabled for the first time, or the chainstate moved without following
+    // the commitment (e.g. when blocks got replayed): scan the UTXO set.
+    coinsCommitment = CCoinsCommitment();
+    if (hashBestBlock.IsNull()) {
+        // Empty chainstate
+        hashCoinsCommitment = hashBestBlock;
+        return true;
+    }
+    hashCoinsCommitment.SetNull();
+
+    LogPrintf("%s: Computing the UTXO set commitment at block %s...\n", __func__, hashBestBlock.GetHex());
+    uiInterface.InitMessage(_("Computing UTXO set commitment..."));
+    CValidationState state;
+    if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+        return false;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    while (pcursor->Valid()) {
+        if (ShutdownRequested()) return false;
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        coinsCommitment.Add(key, coin);
+        pcursor->Next();
+    }
+    hashCoinsCommitment = hashBestBlock;
+
+    BlockMap::const_iterator it = mapBlockIndex.find(hashBestBlock);
+    if (it != mapBlockIndex.end()) WriteBlockCoinsStats(it->second, coinsCommitment);
+    // Store it, not to scan again on the next start
+    return FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+}
+
+bool GetBlockCoinsStats(const CBlockIndex* pindex, CBlockCoinsStats& stats)
+{
+    return pblocktree->ReadBlockCoinsStats(pindex->GetBlockHash(), stats);
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -3672,6 +4098,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainHeight - nCheckDepth)
             break;
+        // Nothing to check below a loaded UTXO snapshot
+        if (pindex->IsAssumedValid())
+            break;
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3829,6 +4258,17 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
     return true;
 }
 
+bool IsSnapshotLoadInterrupted(CCoinsView* view)
+{
+    LOCK(cs_main);
+
+    std::vector<uint256> hashHeads = view->GetHeadBlocks();
+    const uint256 hashBestBlock = hashHeads.empty() ? view->GetBestBlock() : hashHeads[0];
+    if (hashBestBlock.IsNull()) return false;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashBestBlock);
+    return it != mapBlockIndex.end() && !(it->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID));
+}
+
 // May NOT be used after any connections are up as much
 // of the peer-processing logic assumes a consistent
 // block index state
@@ -3839,10 +4279,12 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    pindexSnapshotBase = NULL;
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    mapBlockFiles.Clear();
     nBlockSequenceId = 1;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
@@ -3910,25 +4352,67 @@ bool LoadGenesisBlock()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+//! Bytes of an external block file read ahead of the block being imported
+static const unsigned int BLOCK_IMPORT_READ_AHEAD = 8 * MAX_BLOCK_SIZE_CURRENT;
+//! Maximum number of blocks read ahead of the block being imported
+static const size_t BLOCK_IMPORT_MAX_PENDING = 1024;
 
-    // Block checked event listener
-    BlockStateCatcher stateCatcher(UINT256_ZERO);
-    stateCatcher.registerEvent();
+/**
+ * Reads the blocks of an external block file ahead of LoadExternalBlockFile.
+ * A reader thread locates the blocks in the file and copies their bytes, a pool
+ * of worker threads deserializes them and verifies what CheckBlock can verify
+ * without cs_main (merkle root and block signature), and the importing thread
+ * takes them back in file order.
+ */
+class CBlockFileReadAhead
+{
+public:
+    struct Entry {
+        //! Position of the block in the file
+        uint64_t nPos{0};
+        //! Where to resume the scan if the block can't be deserialized
+        uint64_t nRewind{0};
+        CDataStream ssBlock{SER_DISK, CLIENT_VERSION};
+        //! Null if the block couldn't be deserialized
+        std::shared_ptr<const CBlock> pblock;
+        bool fReady{false};
+    };
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+private:
+    CBufferedFile blkdat;
+
+    boost::mutex mutex;
+    boost::condition_variable condReader;
+    boost::condition_variable condWorker;
+    boost::condition_variable condImporter;
+    //! Blocks read ahead, in file order
+    std::deque<std::shared_ptr<Entry>> queueRead;
+    //! Blocks waiting for a worker
+    std::deque<std::shared_ptr<Entry>> queueCheck;
+    //! Position the reader has to restart from
+    bool fRewind{false};
+    uint64_t nRewindPos{0};
+    bool fEof{false};
+    //! The reader thread gave up on the file
+    bool fFailed{false};
+    bool fStop{false};
+
+    boost::thread_group threads;
+
+    // The buffer must be able to rewind to any block still queued.
+    bool CanReadAhead(uint64_t nPos) const
+    {
+        return queueRead.empty() || (queueRead.size() < BLOCK_IMPORT_MAX_PENDING &&
+                                     nPos - queueRead.front()->nRewind <= BLOCK_IMPORT_READ_AHEAD);
+    }
 
+    //! Locate and copy the next block, starting the scan at nRewind. Null at the end of the file.
+    std::shared_ptr<Entry> ReadNext(uint64_t& nRewind)
+    {
+        while (true) {
             blkdat.SetPos(nRewind);
+            if (blkdat.eof())
+                break;
             nRewind++;         // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
             unsigned int nSize = 0;
@@ -3950,29 +4434,191 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
             }
             try {
                 // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
+                auto entry = std::make_shared<Entry>();
+                entry->nPos = blkdat.GetPos();
+                entry->nRewind = nRewind;
+                blkdat.SetLimit(entry->nPos + nSize);
+                entry->ssBlock.resize(nSize);
+                blkdat.read(entry->ssBlock.data(), nSize);
                 nRewind = blkdat.GetPos();
+                return entry;
+            } catch (const std::exception& e) {
+                LogPrintf("%s : I/O error - %s\n", __func__, e.what());
+            }
+        }
+        return nullptr;
+    }
+
+    void ThreadRead()
+    {
+        util::ThreadRename("trumpcoin-blkread");
+        uint64_t nRewind = blkdat.GetPos();
+        try {
+            while (true) {
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condReader.wait(lock, [&] { return fStop || fRewind || (!fEof && CanReadAhead(nRewind)); });
+                    if (fStop)
+                        return;
+                    if (fRewind) {
+                        nRewind = nRewindPos;
+                        fRewind = false;
+                        fEof = false;
+                    }
+                }
+                std::shared_ptr<Entry> entry = ReadNext(nRewind);
+
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (fRewind) {
+                    // the importer dropped everything past the rewind position
+                    continue;
+                }
+                if (!entry) {
+                    fEof = true;
+                    condImporter.notify_all();
+                    continue;
+                }
+                queueRead.push_back(entry);
+                queueCheck.push_back(entry);
+                condWorker.notify_one();
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Read error - %s\n", __func__, e.what());
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fFailed = true;
+            condImporter.notify_all();
+        }
+    }
+
+    void ThreadCheck()
+    {
+        util::ThreadRename("trumpcoin-blkcheck");
+        while (true) {
+            std::shared_ptr<Entry> entry;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condWorker.wait(lock, [&] { return fStop || !queueCheck.empty(); });
+                if (fStop)
+                    return;
+                entry = queueCheck.front();
+                queueCheck.pop_front();
+            }
+
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            try {
+                entry->ssBlock >> *pblock;
+                bool mutated;
+                if (pblock->hashMerkleRoot == BlockMerkleRoot(*pblock, &mutated) && !mutated && CheckBlockSignature(*pblock))
+                    pblock->fPrechecked = true;
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize error - %s\n", __func__, e.what());
+                pblock.reset();
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            entry->pblock = pblock;
+            entry->fReady = true;
+            condImporter.notify_all();
+        }
+    }
+
+public:
+    CBlockFileReadAhead(FILE* fileIn, int nWorkers) :
+        blkdat(fileIn, BLOCK_IMPORT_READ_AHEAD + 3 * MAX_BLOCK_SIZE_CURRENT, BLOCK_IMPORT_READ_AHEAD + 2 * MAX_BLOCK_SIZE_CURRENT, SER_DISK, CLIENT_VERSION)
+    {
+        threads.create_thread(std::bind(&CBlockFileReadAhead::ThreadRead, this));
+        for (int i = 0; i < nWorkers; i++) {
+            threads.create_thread(std::bind(&CBlockFileReadAhead::ThreadCheck, this));
+        }
+    }
+
+    ~CBlockFileReadAhead()
+    {
+        boost::this_thread::disable_interruption di;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condReader.notify_all();
+        condWorker.notify_all();
+        threads.join_all();
+    }
+
+    CBlockFileReadAhead(const CBlockFileReadAhead&) = delete;
+    CBlockFileReadAhead& operator=(const CBlockFileReadAhead&) = delete;
+
+    //! Wait for the next block of the file. Null at the end of the file.
+    //! A block that couldn't be deserialized stays queued until Rewind.
+    std::shared_ptr<const Entry> Next()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        condImporter.wait(lock, [&] {
+            return (!queueRead.empty() && queueRead.front()->fReady) || (queueRead.empty() && ((fEof && !fRewind) || fFailed));
+        });
+        if (queueRead.empty())
+            return nullptr;
+        std::shared_ptr<const Entry> entry = queueRead.front();
+        if (entry->pblock) {
+            queueRead.pop_front();
+            condReader.notify_one();
+        }
+        return entry;
+    }
+
+    //! Drop the blocks read ahead and restart the scan from nPos
+    void Rewind(uint64_t nPos)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queueRead.clear();
+        queueCheck.clear();
+        fRewind = true;
+        nRewindPos = nPos;
+        condReader.notify_one();
+    }
+};
+
+bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
+{
+    // Map of disk positions for blocks with unknown parent (only used for reindex)
+    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+    int64_t nStart = GetTimeMillis();
+
+    // Block checked event listener
+    BlockStateCatcher stateCatcher(UINT256_ZERO);
+    stateCatcher.registerEvent();
+
+    int nLoaded = 0;
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBlockFileReadAhead reader(fileIn, std::max(nScriptCheckThreads, 1));
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            std::shared_ptr<const CBlockFileReadAhead::Entry> entry = reader.Next();
+            if (!entry)
+                break;
+            if (!entry->pblock) {
+                reader.Rewind(entry->nRewind);
+                continue;
+            }
+            try {
+                const std::shared_ptr<const CBlock>& block_ptr = entry->pblock;
+                if (dbp)
+                    dbp->nPos = entry->nPos;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                uint256 hash = block_ptr->GetHash();
+                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block_ptr->hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                            hash.GetHex(), block.hashPrevBlock.GetHex());
+                            hash.GetHex(), block_ptr->hashPrevBlock.GetHex());
                     if (dbp)
-                        mapBlocksUnknownParent.emplace(block.hashPrevBlock, *dbp);
+                        mapBlocksUnknownParent.emplace(block_ptr->hashPrevBlock, *dbp);
                     continue;
                 }
 
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                    stateCatcher.setBlockHash(block_ptr->GetHash());
+                    stateCatcher.setBlockHash(hash);
                     if (ProcessNewBlock(block_ptr, dbp)) {
                         nLoaded++;
                     }
@@ -3992,13 +4638,13 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
                     std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
                         std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        std::shared_ptr<CBlock> child_ptr = std::make_shared<CBlock>();
+                        if (ReadBlockFromDisk(*child_ptr, it->second)) {
+                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, child_ptr->GetHash().ToString(),
                                 head.ToString());
-                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                            if (ProcessNewBlock(block_ptr, &it->second)) {
+                            if (ProcessNewBlock(child_ptr, &it->second)) {
                                 nLoaded++;
-                                queue.emplace_back(block.GetHash());
+                                queue.emplace_back(child_ptr->GetHash());
                             }
                         }
                         range.first++;
@@ -4059,10 +4705,10 @@ void static CheckBlockIndex()
     while (pindex != NULL) {
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstMissing == NULL && !(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID))) pindexFirstMissing = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN && !pindex->IsAssumedValid()) pindexFirstNotChainValid = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS && !pindex->IsAssumedValid()) pindexFirstNotScriptsValid = pindex;
 
         // Begin: actual consistency checks.
         if (pindex->pprev == NULL) {
@@ -4075,7 +4721,12 @@ void static CheckBlockIndex()
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
         // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // Below a loaded UTXO snapshot base, nChainTx is unknown.
+        if (pindex->IsAssumedValid() && pindex != pindexSnapshotBase) {
+            assert(pindex->nChainTx == 0 && !pindex->nChainSaplingValue);
+        } else {
+            assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                         // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        }
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
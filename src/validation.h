@@ -17,6 +17,7 @@
 
 #include "amount.h"
 #include "chain.h"
+#include "checkqueue.h"
 #include "coins.h"
 #include "consensus/validation.h"
 #include "fs.h"
@@ -39,16 +40,20 @@
 
 class AccumulatorCache;
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
+struct CBlockCoinsStats;
 class CBudgetManager;
 class CCoinsViewDB;
 class CZerocoinDB;
 class CSporkDB;
+class StakeModifierCache;
 class CBloomFilter;
 class CInv;
 class CConnman;
 class CNode;
 class CScriptCheck;
+class CSignatureBatch;
 
 struct PrecomputedTransactionData;
 
@@ -68,6 +73,12 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
+/** Default for -mmapblocks */
+static const bool DEFAULT_MMAP_BLOCKS = true;
+/** Number of complete block files kept mapped with -mmapblocks (in address space, not memory) */
+static const size_t MAX_MAPPED_BLOCKFILES = sizeof(void*) > 4 ? 16 : 0;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
@@ -87,8 +98,25 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Default for -batchscriptchecks, deferring the signatures of script-check batches */
+static const bool DEFAULT_BATCH_SCRIPTCHECKS = false;
+/** Default for -maxscriptcachesize, maximum megabytes of the script execution cache */
+static const int64_t DEFAULT_MAX_SCRIPT_CACHE_SIZE = 16;
+/** Number of blocks that can be requested at any given time from a single peer, before its limit adapts. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the per-peer limit: it grows with every requested block a peer delivers and halves when it stalls. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** Maximum total size of the blocks received ahead of their parent, which are kept in memory until it arrives. */
+static const size_t MAX_BLOCKS_AWAITING_PARENT_SIZE = 64 * 1024 * 1024;
+/** Maximum depth of a block we serve as a cmpctblock; deeper ones are sent in full, their transactions are long gone from mempools. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of a block whose transactions we serve individually in a blocktxn message. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers asked to announce new blocks with cmpctblock messages (BIP152 high-bandwidth mode). */
+static const unsigned int MAX_HIGH_BANDWIDTH_CMPCT_PEERS = 3;
+/** Version of the compact block encoding announced in sendcmpct messages. */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -99,6 +127,9 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** How far ahead of the active chain headers are accepted. Until its block is validated, the
+ *  stake of a proof-of-stake header can't be checked, only its difficulty. */
+static const int MAX_HEADERS_AHEAD = 4 * BLOCK_DOWNLOAD_WINDOW;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -138,7 +169,10 @@ extern int64_t g_best_block_time;
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
+extern bool fBatchScriptChecks;
 extern bool fTxIndex;
+extern bool fCoinStatsIndex;
+extern bool fMapBlockFiles;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
@@ -152,9 +186,15 @@ extern std::map<uint256, int64_t> mapRejectedBlocks;
 
 extern CMoneySupply MoneySupply;
 
-/** Best header we've seen so far (used for getheaders queries' starting points). */
+/**
+ * Best header we've seen so far (used for getheaders queries' starting points), of a block whose stake
+ * was checked: not of a header received ahead of its block.
+ */
 extern CBlockIndex* pindexBestHeader;
 
+/** Base block of the chainstate loaded from a UTXO snapshot, if any: the blocks up to it are assumed valid. */
+extern CBlockIndex* pindexSnapshotBase;
+
 /**
  * Process an incoming block. This only returns after the best known valid
  * block is made active. Note that it does not, however, guarantee that the
@@ -173,6 +213,19 @@ extern CBlockIndex* pindexBestHeader;
  */
 bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp);
 
+/**
+ * Process incoming block headers.
+ *
+ * The headers must be in order, each one extending the previous. A header accepted ahead of its
+ * block data gets its stake modifier (which commits to the coinstake) once the block is accepted.
+ *
+ * @param[in]   headers    The headers to add to the block index.
+ * @param[out]  state      This may be set to an Error state if any error occurred processing them
+ * @param[out]  ppindex    If set, the pointer will be set to point to the last new block index object for the given headers
+ * @return True if all the headers were accepted
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex = nullptr);
+
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
@@ -188,12 +241,26 @@ bool LoadGenesisBlock();
 bool LoadBlockIndex(std::string& strError);
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
+/**
+ * Make pindexBase, the best block of a chainstate loaded from a UTXO snapshot, the chain tip.
+ * The blocks up to it are marked BLOCK_ASSUMED_VALID, and never downloaded: their transaction
+ * counts and shielded values are unknown, only the totals at the base come with the snapshot.
+ */
+bool ActivateSnapshotChain(CBlockIndex* pindexBase, const uint256& nStakeModifier, CAmount nSaplingPoolValue, unsigned int nChainTx);
+/** Set up the commitment to the UTXO set of the chain tip (-coinstatsindex), computing it if the chainstate has none. */
+bool LoadCoinsCommitment();
+/** The commitment to the UTXO set as of a block connected with -coinstatsindex */
+bool GetBlockCoinsStats(const CBlockIndex* pindex, CBlockCoinsStats& stats);
 /** Unload database information */
 void UnloadBlockIndex();
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the Sapling proofs checking thread */
+void ThreadSaplingProofCheck();
+/** Initializes the script-execution cache */
+void InitScriptExecutionCache();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -246,8 +313,13 @@ CAmount GetShieldedTxMinFee(const CTransaction& tx);
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ * Transactions whose scripts were already fully verified with the same flags (see
+ * cacheFullScriptStore) are found in the script-execution cache and not checked again.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+
+/** Script verification flags enforced by consensus on the block following pindexPrev */
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight, bool fSkipInvalid = false);
@@ -295,6 +367,11 @@ public:
 
     bool operator()();
 
+    //! Whether the script is single-signature, so that deferring its signature never needs a re-evaluation
+    bool CanDeferSignatures() const;
+    //! Evaluate the script assuming the signatures valid, queuing them in the batch
+    bool VerifyDeferred(CSignatureBatch& batch);
+
     void swap(CScriptCheck& check)
     {
         std::swap(ptxTo, check.ptxTo);
@@ -309,11 +386,21 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * With -batchscriptchecks, the scripts of a worker's batch are evaluated
+ * first and their signatures verified afterwards, all together. A batch
+ * with an invalid signature falls back to the individual checks to locate
+ * the failing input.
+ */
+template <>
+bool RunChecksBatch(std::vector<CScriptCheck>& vChecks);
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -344,6 +431,9 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/** Whether view is the chainstate of a UTXO snapshot whose loading was interrupted: its (new) best block isn't available. */
+bool IsSnapshotLoadInterrupted(CCoinsView* view);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -371,6 +461,9 @@ extern std::unique_ptr<CZerocoinDB> zerocoinDB;
 /** In-memory cache for the zerocoin accumulators */
 extern std::unique_ptr<AccumulatorCache> accumulatorCache;
 
+/** Cache of the blocks holding the old stake modifiers, persisted in the block tree database */
+extern std::unique_ptr<StakeModifierCache> stakeModifierCache;
+
 /** Global variable that points to the spork database (protected by cs_main) */
 extern std::unique_ptr<CSporkDB> pSporkDB;
 
@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 72000;
+static const int PROTOCOL_VERSION = 72002;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -23,6 +23,12 @@ static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 72000;
 //! Version where BIP155 was introduced
 static const int MIN_BIP155_PROTOCOL_VERSION = 70923;
 
+//! Version where headers-first block download was introduced (getheaders is answered with headers)
+static const int HEADERS_FIRST_VERSION = 72001;
+
+//! short-id-based block download starts with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 72002;
+
 // Make sure that none of the values above collide with
 // `ADDRV2_FORMAT`.
 
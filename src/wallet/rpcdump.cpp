@@ -28,6 +28,14 @@
 #include <univalue.h>
 
 
+//! The blocks up to a loaded UTXO snapshot base, which a rescan would read, were never downloaded
+static void EnsureRescanAvailable()
+{
+    if (WITH_LOCK(cs_main, return pindexSnapshotBase != nullptr)) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled with a chainstate loaded from a UTXO snapshot");
+    }
+}
+
 int64_t static DecodeDumpTime(const std::string& str)
 {
     static const boost::posix_time::ptime epoch = boost::posix_time::from_time_t(0);
@@ -112,6 +120,9 @@ UniValue importprivkey(const JSONRPCRequest& request)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     const bool fStakingAddress = (request.params.size() > 3 ? request.params[3].get_bool() : false);
 
@@ -237,6 +248,9 @@ UniValue importaddress(const JSONRPCRequest& request)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     // Whether to import a p2sh version, too
     const bool fP2SH = (request.params.size() > 3 ? request.params[3].get_bool() : false);
@@ -303,6 +317,9 @@ UniValue importpubkey(const JSONRPCRequest& request)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     if (!IsHex(request.params[0].get_str()))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey must be a hex string");
@@ -359,6 +376,7 @@ UniValue importwallet(const JSONRPCRequest& request)
     if (!reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    EnsureRescanAvailable();
 
     int64_t nTimeBegin = 0;
     bool fGood = true;
@@ -1030,6 +1048,9 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     int64_t now = 0;
     bool fRunScan = false;
@@ -1210,6 +1231,7 @@ UniValue bip38decrypt(const JSONRPCRequest& request)
     if (!reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    EnsureRescanAvailable();
 
     CPubKey pubkey = key.GetPubKey();
     assert(key.VerifyPubKey(pubkey));
@@ -1297,6 +1319,9 @@ UniValue importsaplingkey(const JSONRPCRequest& request)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     UniValue result(UniValue::VOBJ);
     CBlockIndex* pindexRescan{nullptr};
@@ -1399,6 +1424,9 @@ UniValue importsaplingviewingkey(const JSONRPCRequest& request)
     if (fRescan && !reserver.reserve()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
+    if (fRescan) {
+        EnsureRescanAvailable();
+    }
 
     UniValue result(UniValue::VOBJ);
     CBlockIndex* pindexRescan{nullptr};
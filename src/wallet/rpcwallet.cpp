@@ -4387,10 +4387,9 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
         obj.pushKV("haveconnections", (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) > 0));
         obj.pushKV("mnsync", !patriotnodeSync.NotCompleted());
         obj.pushKV("walletunlocked", !pwallet->IsLocked());
-        std::vector<CStakeableOutput> vCoins;
-        pwallet->StakeableCoins(&vCoins);
-        obj.pushKV("stakeablecoins", (int)vCoins.size());
-        obj.pushKV("stakingbalance", ValueFromAmount(pwallet->GetStakingBalance(fColdStaking)));
+        CAmount nStakeableValue = 0;
+        obj.pushKV("stakeablecoins", (int)pwallet->CountStakeableCoins(&nStakeableValue));
+        obj.pushKV("stakingbalance", ValueFromAmount(nStakeableValue));
         obj.pushKV("stakesplitthreshold", ValueFromAmount(pwallet->nStakeSplitThreshold));
         CStakerStatus* ss = pwallet->pStakerStatus;
         if (ss) {
@@ -4702,6 +4701,11 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
             }
         }
+
+        // The blocks up to a loaded UTXO snapshot base were never downloaded
+        if (pindexSnapshotBase && pindexStart->nHeight <= pindexSnapshotBase->nHeight) {
+            throw JSONRPCError(RPC_MISC_ERROR, strprintf("Can't rescan the blocks up to the loaded UTXO snapshot base (height %d)", pindexSnapshotBase->nHeight));
+        }
     }
 
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, reserver, true);
@@ -0,0 +1,84 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakeablecoins.h"
+
+/** Lowest entry of the schedule at nHeight */
+static std::pair<int, COutPoint> ScheduleBegin(int nHeight)
+{
+    return {nHeight, COutPoint(UINT256_ZERO, 0)};
+}
+
+void StakeableCoinsIndex::Add(const COutPoint& outpoint, int nHeightFrom, CAmount nValue, bool fCold)
+{
+    Remove(outpoint);
+    const Coin coin{nHeightFrom, nValue, fCold};
+    m_coins.emplace(outpoint, coin);
+    m_schedule.emplace(nHeightFrom, outpoint);
+    if (nHeightFrom <= m_height) CountCoin(coin, 1);
+}
+
+void StakeableCoinsIndex::Remove(const COutPoint& outpoint)
+{
+    auto it = m_coins.find(outpoint);
+    if (it == m_coins.end()) return;
+    const Coin& coin = it->second;
+    if (coin.nHeightFrom <= m_height) CountCoin(coin, -1);
+    m_schedule.erase({coin.nHeightFrom, outpoint});
+    m_coins.erase(it);
+}
+
+void StakeableCoinsIndex::SetHeight(int nHeight)
+{
+    if (nHeight > m_height) {
+        CountRange(m_height, nHeight, 1);
+    } else if (nHeight < m_height) {
+        CountRange(nHeight, m_height, -1);
+    }
+    m_height = nHeight;
+}
+
+void StakeableCoinsIndex::Clear(int nHeight)
+{
+    m_coins.clear();
+    m_schedule.clear();
+    m_height = nHeight;
+    m_count[0] = m_count[1] = 0;
+    m_value[0] = m_value[1] = 0;
+}
+
+size_t StakeableCoinsIndex::Count(bool fIncludeCold) const
+{
+    return m_count[0] + (fIncludeCold ? m_count[1] : 0);
+}
+
+CAmount StakeableCoinsIndex::GetValue(bool fIncludeCold) const
+{
+    return m_value[0] + (fIncludeCold ? m_value[1] : 0);
+}
+
+std::vector<COutPoint> StakeableCoinsIndex::GetCoins(bool fIncludeCold) const
+{
+    std::vector<COutPoint> vCoins;
+    vCoins.reserve(Count(fIncludeCold));
+    const auto itEnd = m_schedule.lower_bound(ScheduleBegin(m_height + 1));
+    for (auto it = m_schedule.begin(); it != itEnd; ++it) {
+        if (fIncludeCold || !m_coins.at(it->second).fCold) vCoins.push_back(it->second);
+    }
+    return vCoins;
+}
+
+void StakeableCoinsIndex::CountRange(int nHeightLow, int nHeightHigh, int nSign)
+{
+    const auto itEnd = m_schedule.lower_bound(ScheduleBegin(nHeightHigh + 1));
+    for (auto it = m_schedule.lower_bound(ScheduleBegin(nHeightLow + 1)); it != itEnd; ++it) {
+        CountCoin(m_coins.at(it->second), nSign);
+    }
+}
+
+void StakeableCoinsIndex::CountCoin(const Coin& coin, int nSign)
+{
+    m_count[coin.fCold] += nSign;
+    m_value[coin.fCold] += nSign * coin.nValue;
+}
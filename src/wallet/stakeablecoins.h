@@ -0,0 +1,70 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TrumpCoin_WALLET_STAKEABLECOINS_H
+#define TrumpCoin_WALLET_STAKEABLECOINS_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * Index of the coins of a wallet which can stake, by the height from which they're deep and mature
+ * enough to.
+ *
+ * The wallet adds and removes the coins as its transactions change. The count and value of the coins
+ * stakeable at the current height are updated as the height moves, only going through the coins
+ * whose height is crossed.
+ */
+class StakeableCoinsIndex
+{
+public:
+    /** Index a coin, stakeable from nHeightFrom, replacing its previous entry */
+    void Add(const COutPoint& outpoint, int nHeightFrom, CAmount nValue, bool fCold);
+
+    /** Remove a coin from the index (if it's there) */
+    void Remove(const COutPoint& outpoint);
+
+    /** Move to the height nHeight */
+    void SetHeight(int nHeight);
+
+    /** Remove all the coins, and move to the height nHeight */
+    void Clear(int nHeight);
+
+    /** Number and total value of the coins stakeable at the current height */
+    size_t Count(bool fIncludeCold) const;
+    CAmount GetValue(bool fIncludeCold) const;
+
+    /** Coins stakeable at the current height, by height from which they are */
+    std::vector<COutPoint> GetCoins(bool fIncludeCold) const;
+
+    /** Number of coins in the index, stakeable or not yet */
+    size_t Size() const { return m_coins.size(); }
+
+private:
+    struct Coin {
+        int nHeightFrom;
+        CAmount nValue;
+        bool fCold;
+    };
+
+    /** Count (or uncount, for nSign = -1) the coins stakeable from a height in (nHeightLow, nHeightHigh] */
+    void CountRange(int nHeightLow, int nHeightHigh, int nSign);
+    void CountCoin(const Coin& coin, int nSign);
+
+    std::map<COutPoint, Coin> m_coins;
+    /** The coins by height from which they're stakeable */
+    std::set<std::pair<int, COutPoint>> m_schedule;
+
+    int m_height{0};
+    //! Number and value of the coins stakeable at m_height, regular coins and cold ones
+    size_t m_count[2]{0, 0};
+    CAmount m_value[2]{0, 0};
+};
+
+#endif // TrumpCoin_WALLET_STAKEABLECOINS_H
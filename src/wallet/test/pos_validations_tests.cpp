@@ -9,6 +9,7 @@
 #include "util/blockstatecatcher.h"
 #include "blocksignature.h"
 #include "consensus/merkle.h"
+#include "kernel.h"
 #include "primitives/block.h"
 #include "script/sign.h"
 #include "test/util/blocksutil.h"
@@ -437,4 +438,120 @@ BOOST_FIXTURE_TEST_CASE(created_on_fork_tests, TestPoSChainSetup)
     BOOST_CHECK(ProcessNewBlock(pblockI, nullptr));
 }
 
+// The stakeable coins, going through the whole wallet
+static std::set<COutPoint> ScanStakeableCoins(CWallet* pwallet)
+{
+    std::vector<COutput> vCoins;
+    CWallet::AvailableCoinsFilter coinsFilter;
+    coinsFilter.fIncludeDelegated = false;
+    coinsFilter.minDepth = Params().GetConsensus().nStakeMinDepth;
+    pwallet->AvailableCoins(&vCoins, nullptr, coinsFilter);
+    std::set<COutPoint> setCoins;
+    for (const COutput& coin : vCoins) {
+        setCoins.emplace(coin.tx->GetHash(), coin.i);
+    }
+    return setCoins;
+}
+
+// The stakeable coins, from the index of the wallet
+static std::set<COutPoint> GetStakeableCoins(CWallet* pwallet)
+{
+    std::vector<CStakeableOutput> vCoins;
+    pwallet->StakeableCoins(&vCoins);
+    std::set<COutPoint> setCoins;
+    CAmount nValue = 0;
+    for (const CStakeableOutput& coin : vCoins) {
+        BOOST_CHECK(setCoins.emplace(coin.tx->GetHash(), coin.i).second);
+        BOOST_CHECK(coin.nDepth >= Params().GetConsensus().nStakeMinDepth);
+        nValue += coin.tx->tx->vout[coin.i].nValue;
+    }
+    CAmount nIndexValue = 0;
+    BOOST_CHECK_EQUAL(pwallet->CountStakeableCoins(&nIndexValue), vCoins.size());
+    BOOST_CHECK_EQUAL(nIndexValue, nValue);
+    return setCoins;
+}
+
+BOOST_FIXTURE_TEST_CASE(stakeable_coins_tests, TestPoSChainSetup)
+{
+    CWallet* pwallet = pwalletMain.get();
+    std::set<COutPoint> setCoins = GetStakeableCoins(pwallet);
+    BOOST_CHECK(!setCoins.empty());
+    BOOST_CHECK(setCoins == ScanStakeableCoins(pwallet));
+
+    // Locked coins don't stake
+    const COutPoint lockedCoin = *setCoins.begin();
+    WITH_LOCK(pwallet->cs_wallet, pwallet->LockCoin(lockedCoin));
+    BOOST_CHECK_EQUAL(GetStakeableCoins(pwallet).count(lockedCoin), 0U);
+    BOOST_CHECK_EQUAL(pwallet->CountStakeableCoins(), setCoins.size() - 1);
+    WITH_LOCK(pwallet->cs_wallet, pwallet->UnlockCoin(lockedCoin));
+    BOOST_CHECK(GetStakeableCoins(pwallet) == setCoins);
+
+    // Spent coins neither, from the time the spending transaction is in the wallet
+    auto dest = pwallet->getNewAddress("").getObjResult();
+    CTransaction tx = CreateAndCommitTx(pwallet, *dest, 100 * COIN);
+    setCoins = GetStakeableCoins(pwallet);
+    for (const CTxIn& txin : tx.vin) {
+        BOOST_CHECK_EQUAL(setCoins.count(txin.prevout), 0U);
+    }
+    BOOST_CHECK(setCoins == ScanStakeableCoins(pwallet));
+
+    // The coins become stakeable (or stop being) as the blocks are connected (or disconnected)
+    std::vector<std::shared_ptr<CBlock>> vBlocks;
+    for (int i = 0; i < 5; i++) {
+        vBlocks.emplace_back(CreateBlockInternal(pwallet, i == 0 ? std::vector<CMutableTransaction>{CMutableTransaction(tx)} : std::vector<CMutableTransaction>{}));
+        BOOST_CHECK(ProcessNewBlock(vBlocks.back(), nullptr));
+        SyncWithValidationInterfaceQueue();
+        BOOST_CHECK(GetStakeableCoins(pwallet) == ScanStakeableCoins(pwallet));
+    }
+    const std::set<COutPoint> setCoinsTip = GetStakeableCoins(pwallet);
+    BOOST_CHECK(setCoinsTip.count(COutPoint(tx.GetHash(), 0)) || setCoinsTip.count(COutPoint(tx.GetHash(), 1)));
+
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return mapBlockIndex.at(vBlocks.front()->GetHash()))));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(GetStakeableCoins(pwallet) == ScanStakeableCoins(pwallet));
+    BOOST_CHECK(GetStakeableCoins(pwallet) != setCoinsTip);
+}
+
+BOOST_FIXTURE_TEST_CASE(kernel_engine_tests, TestPoSChainSetup)
+{
+    std::vector<CStakeableOutput> availableCoins;
+    BOOST_CHECK(pwalletMain->StakeableCoins(&availableCoins));
+    const CBlockIndex* pindexPrev = WITH_LOCK(cs_main, return chainActive.Tip());
+    const unsigned int nBits = pindexPrev->nBits;
+
+    std::vector<CPivStake> vInputs;
+    CStakeKernelEngine engine;
+    engine.Reset(pindexPrev, nBits);
+    for (const CStakeableOutput& coin : availableCoins) {
+        vInputs.emplace_back(coin.tx->tx->vout[coin.i], COutPoint(coin.tx->GetHash(), coin.i), coin.pindex);
+        engine.AddInput(&vInputs.back());
+    }
+    BOOST_CHECK(engine.IsPreparedFor(pindexPrev, nBits));
+    BOOST_CHECK(!engine.IsPreparedFor(pindexPrev->pprev, nBits));
+    BOOST_CHECK_EQUAL(engine.Size(), availableCoins.size());
+
+    for (int nTime = pindexPrev->nTime + 1; nTime < (int) pindexPrev->nTime + 10 * 15; nTime += 15) {
+        // The kernels are the ones of the regular validation
+        int nFirst = -1;
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            CStakeKernel stakeKernel(pindexPrev, &vInputs[i], nBits, nTime);
+            BOOST_CHECK(engine.GetHash(i, nTime) == stakeKernel.GetHash());
+            if (nFirst < 0 && stakeKernel.CheckKernelHash(true)) nFirst = i;
+        }
+        BOOST_CHECK_EQUAL(engine.Search(nTime, 0, engine.Size()), nFirst);
+        BOOST_CHECK_EQUAL(engine.Search(nTime, 0, engine.Size(), 4), nFirst);
+        if (nFirst < 0) continue;
+
+        // The searches skip the disabled inputs, and stay in their range
+        BOOST_CHECK_EQUAL(engine.Search(nTime, 0, nFirst), -1);
+        CStakeKernelEngine engine2(engine);
+        engine2.Disable(nFirst);
+        BOOST_CHECK_EQUAL(engine2.CountEnabled(), engine.Size() - 1);
+        const int nNext = engine2.Search(nTime, 0, engine.Size());
+        BOOST_CHECK(nNext < 0 || nNext > nFirst);
+        BOOST_CHECK_EQUAL(engine.Search(nTime, nFirst + 1, engine.Size()), nNext);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -917,6 +917,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx> & item : mapWallet)
             item.second.MarkDirty();
+        fStakeableCoinsDirty = true;
     }
 }
 
@@ -976,6 +977,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    UpdateStakeableCoins(wtx);
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1197,6 +1200,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             assert(!wtx.InMempool());
             wtx.setAbandoned();
             wtx.MarkDirty();
+            fStakeableCoinsDirty = true;
             batch.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1257,6 +1261,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             wtx.m_confirm.block_height = conflicting_height;
             wtx.setConflicted();
             wtx.MarkDirty();
+            fStakeableCoinsDirty = true;
             batch.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1459,8 +1464,10 @@ void CWallet::EraseFromWallet(const uint256& hash)
 {
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             WalletBatch(*database).EraseTx(hash);
+            fStakeableCoinsDirty = true;
+        }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
@@ -2688,49 +2695,104 @@ static void ApproximateBestSubset(const std::vector<std::pair<CAmount, std::pair
     }
 }
 
-bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
+static bool IncludeColdStakes()
 {
-    const bool fIncludeColdStaking = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE) &&
-                                     gArgs.GetBoolArg("-coldstaking", DEFAULT_COLDSTAKING);
-
-    if (pCoins) pCoins->clear();
+    return !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE) &&
+           gArgs.GetBoolArg("-coldstaking", DEFAULT_COLDSTAKING);
+}
 
-    LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
+void CWallet::UpdateStakeableCoin(const CWalletTx& wtx, unsigned int n)
+{
+    AssertLockHeld(cs_wallet);
+    if (fStakeableCoinsDirty) return; // rebuilt at the next read
 
-        // Check if the tx is selectable
-        int nDepth = 0;
-        bool safeTx = false;
-        if (!CheckTXAvailability(pcoin, true, nDepth, safeTx))
-            continue;
+    // Only the coins of the main chain stake, once they're deep and mature enough
+    const COutPoint outpoint(wtx.GetHash(), n);
+    const CTxOut& output = wtx.tx->vout[n];
+    if (!wtx.isConfirmed() || output.nValue <= 0 || IsSpent(outpoint) || IsLockedCoin(outpoint.hash, n)) {
+        stakeableCoins.Remove(outpoint);
+        return;
+    }
 
-        // Check min depth requirement for stake inputs
-        if (nDepth < Params().GetConsensus().nStakeMinDepth) continue;
+    // Regular coins, and cold ones staked on behalf of their owner. Not the delegated ones.
+    const isminetype mine = IsMine(output);
+    const bool fCold = mine == ISMINE_COLD;
+    if (!(mine & ISMINE_SPENDABLE) && !(fCold && HasDelegator(output))) {
+        stakeableCoins.Remove(outpoint);
+        return;
+    }
 
-        const CBlockIndex* pindex = nullptr;
-        for (unsigned int index = 0; index < pcoin->tx->vout.size(); index++) {
+    const Consensus::Params& consensus = Params().GetConsensus();
+    int nDepthMin = consensus.nStakeMinDepth;
+    if (wtx.IsCoinBase() || wtx.IsCoinStake()) {
+        nDepthMin = std::max(nDepthMin, consensus.nCoinbaseMaturity + 1);
+    }
+    stakeableCoins.Add(outpoint, wtx.m_confirm.block_height + nDepthMin - 1, output.nValue, fCold);
+}
 
-            auto res = CheckOutputAvailability(
-                    pcoin->tx->vout[index],
-                    index,
-                    wtxid,
-                    nullptr, // coin control
-                    false,   // fIncludeDelegated
-                    fIncludeColdStaking,
-                    false,
-                    false);   // fIncludeLocked
+void CWallet::UpdateStakeableCoins(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (fStakeableCoinsDirty) return;
 
-            if (!res.available || !res.spendable) continue;
+    for (unsigned int n = 0; n < wtx.tx->vout.size(); n++) {
+        UpdateStakeableCoin(wtx, n);
+    }
+    // The coins it spends
+    if (wtx.tx->HasZerocoinSpendInputs()) return;
+    for (const CTxIn& txin : wtx.tx->vin) {
+        auto it = mapWallet.find(txin.prevout.hash);
+        if (it != mapWallet.end() && txin.prevout.n < it->second.tx->vout.size()) {
+            UpdateStakeableCoin(it->second, txin.prevout.n);
+        }
+    }
+}
 
-            // found valid coin
-            if (!pCoins) return true;
-            if (!pindex) pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
-            pCoins->emplace_back(pcoin, (int) index, nDepth, pindex);
+void CWallet::SyncStakeableCoins()
+{
+    AssertLockHeld(cs_wallet);
+    if (fStakeableCoinsDirty) {
+        int64_t nTimeStart = GetTimeMicros();
+        stakeableCoins.Clear(m_last_block_processed_height);
+        fStakeableCoinsDirty = false;
+        for (const auto& it : mapWallet) {
+            const CWalletTx& wtx = it.second;
+            for (unsigned int n = 0; n < wtx.tx->vout.size(); n++) {
+                UpdateStakeableCoin(wtx, n);
+            }
         }
+        LogPrint(BCLog::STAKING, "%s: indexed %d coins in %.2fms\n", __func__,
+                 stakeableCoins.Size(), (GetTimeMicros() - nTimeStart) * 0.001);
+    }
+    stakeableCoins.SetHeight(m_last_block_processed_height);
+}
+
+bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
+{
+    const bool fIncludeColdStaking = IncludeColdStakes();
+
+    if (pCoins) pCoins->clear();
+
+    LOCK2(cs_main, cs_wallet);
+    SyncStakeableCoins();
+    if (!pCoins) return stakeableCoins.Count(fIncludeColdStaking) > 0;
+
+    for (const COutPoint& outpoint : stakeableCoins.GetCoins(fIncludeColdStaking)) {
+        const CWalletTx* pcoin = &mapWallet.at(outpoint.hash);
+        const CBlockIndex* pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
+        pCoins->emplace_back(pcoin, (int) outpoint.n, pcoin->GetDepthInMainChain(), pindex);
     }
-    return (pCoins && !pCoins->empty());
+    return !pCoins->empty();
+}
+
+size_t CWallet::CountStakeableCoins(CAmount* pnValue)
+{
+    const bool fIncludeColdStaking = IncludeColdStakes();
+
+    LOCK(cs_wallet);
+    SyncStakeableCoins();
+    if (pnValue) *pnValue = stakeableCoins.GetValue(fIncludeColdStaking);
+    return stakeableCoins.Count(fIncludeColdStaking);
 }
 
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
@@ -3304,6 +3366,39 @@ int CWallet::GetLastBlockHeightLockWallet() const
     return WITH_LOCK(cs_wallet, return m_last_block_processed_height;);
 }
 
+void CWallet::PrepareStakeKernels(const CBlockIndex* pindexPrev,
+                                  unsigned int nBits,
+                                  const std::vector<CStakeableOutput>& availableCoins) const
+{
+    AssertLockHeld(cs_stake_kernels);
+
+    // The kernels are kept as long as the block and the coins are the same
+    // (the spent coins are disabled in the kernels as they're erased from availableCoins)
+    if (stakeKernels.IsPreparedFor(pindexPrev, nBits) && stakeKernels.CountEnabled() == availableCoins.size()) {
+        auto itCoin = availableCoins.begin();
+        size_t nIndex = 0;
+        for (; nIndex < stakeKernels.Size(); nIndex++) {
+            if (!stakeKernels.IsEnabled(nIndex)) continue;
+            if (vStakeKernelOutpoints[nIndex] != COutPoint(itCoin->tx->GetHash(), itCoin->i)) break;
+            itCoin++;
+        }
+        if (nIndex == stakeKernels.Size()) return;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    stakeKernels.Reset(pindexPrev, nBits);
+    vStakeKernelOutpoints.clear();
+    vStakeKernelOutpoints.reserve(availableCoins.size());
+    for (const CStakeableOutput& coin : availableCoins) {
+        COutPoint outPoint(coin.tx->GetHash(), coin.i);
+        CPivStake stakeInput(coin.tx->tx->vout[coin.i], outPoint, coin.pindex);
+        stakeKernels.AddInput(&stakeInput);
+        vStakeKernelOutpoints.push_back(outPoint);
+    }
+    LogPrint(BCLog::STAKING, "%s: computed %d kernels in %.2fms\n", __func__,
+             stakeKernels.Size(), (GetTimeMicros() - nTimeStart) * 0.001);
+}
+
 bool CWallet::CreateCoinStake(
         const CBlockIndex* pindexPrev,
         unsigned int nBits,
@@ -3312,11 +3407,6 @@ bool CWallet::CreateCoinStake(
         std::vector<CStakeableOutput>* availableCoins,
         bool stopOnNewBlock) const
 {
-    // shuffle coins
-    if (availableCoins && Params().IsRegTestNet()) {
-        Shuffle(availableCoins->begin(), availableCoins->end(), FastRandomContext());
-    }
-
     // Mark coin stake transaction
     txNew.vin.clear();
     txNew.vout.clear();
@@ -3326,85 +3416,104 @@ bool CWallet::CreateCoinStake(
     pStakerStatus->SetLastTip(pindexPrev);
     pStakerStatus->SetLastCoins((int) availableCoins->size());
 
-    // Kernel Search
-    CAmount nCredit;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
-        COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CPivStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
-
-        // New block came in, move on
-        if (stopOnNewBlock && GetLastBlockHeightLockWallet() != pindexPrev->nHeight) return false;
-
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested()) return false;
-
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
+    // Get the new time slot
+    const bool fValidTime = GetStakeTime(pindexPrev, nTxNewTime);
+    pStakerStatus->SetLastTime(nTxNewTime);
+    if (!fValidTime) return false;
 
-        nCredit = 0;
+    // New block came in, move on
+    if (stopOnNewBlock && GetLastBlockHeightLockWallet() != pindexPrev->nHeight) return false;
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested()) return false;
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+    LOCK(cs_stake_kernels);
+    PrepareStakeKernels(pindexPrev, nBits, *availableCoins);
 
-        if (!fKernelFound) {
-            it++;
-            continue;
-        }
+    // Kernel Search.
+    // On regtest, where every coin meets the target, start from a random coin to stake them all in turn.
+    const size_t nCoins = stakeKernels.Size();
+    const size_t nStart = Params().IsRegTestNet() && nCoins > 0 ? GetRand(nCoins) : 0;
+    const std::pair<size_t, size_t> vRanges[] = {{nStart, nCoins}, {0, nStart}};
+    CAmount nCredit;
+    bool fKernelFound = false;
+    int nAttempts = 0;
+    for (const auto& range : vRanges) {
+        size_t nBegin = range.first;
+        while (!fKernelFound && nBegin < range.second) {
+            const int nFound = stakeKernels.Search(nTxNewTime, nBegin, range.second, GetNumCores());
+            nAttempts += (int) ((nFound < 0 ? range.second : nFound + 1) - nBegin);
+            if (nFound < 0) break;
+            nBegin = nFound + 1;
+
+            // Only the winning coin is looked up in the wallet
+            const COutPoint& outPoint = vStakeKernelOutpoints[nFound];
+            auto it = std::find_if(availableCoins->begin(), availableCoins->end(), [&outPoint](const CStakeableOutput& coin) {
+                return coin.i == (int) outPoint.n && coin.tx->GetHash() == outPoint.hash;
+            });
+            assert(it != availableCoins->end());
+
+            // Make sure the stake input hasn't been spent since last check
+            if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
+                // remove it from the available coins
+                stakeKernels.Disable(nFound);
+                availableCoins->erase(it);
+                continue;
+            }
 
-        // Found a kernel
-        LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+            CPivStake stakeInput(it->tx->tx->vout[it->i],
+                                 outPoint,
+                                 it->pindex);
+            if (!CStakeKernel(pindexPrev, &stakeInput, nBits, nTxNewTime).CheckKernelHash(true)) {
+                LogPrintf("%s : precomputed kernel mismatch for %s\n", __func__, outPoint.ToString());
+                continue;
+            }
 
-        // Add block reward to the credit
-        nCredit += GetBlockValue(pindexPrev->nHeight + 1);
+            // Found a kernel
+            LogPrintf("CreateCoinStake : kernel found\n");
+            nCredit = stakeInput.GetValue();
 
-        // Create the output transaction(s)
-        std::vector<CTxOut> vout;
-        if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
-            LogPrintf("%s : failed to create output\n", __func__);
-            it++;
-            continue;
-        }
-        txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-        // Set output amount
-        int outputs = (int) txNew.vout.size() - 1;
-        CAmount nRemaining = nCredit;
-        if (outputs > 1) {
-            // Split the stake across the outputs
-            CAmount nShare = nRemaining / outputs;
-            for (int i = 1; i < outputs; i++) {
-                // loop through all but the last one.
-                txNew.vout[i].nValue = nShare;
-                nRemaining -= nShare;
+            // Add block reward to the credit
+            nCredit += GetBlockValue(pindexPrev->nHeight + 1);
+
+            // Create the output transaction(s)
+            std::vector<CTxOut> vout;
+            if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
+                LogPrintf("%s : failed to create output\n", __func__);
+                continue;
             }
-        }
-        // put the remaining on the last output (which all into the first if only one output)
-        txNew.vout[outputs].nValue += nRemaining;
+            txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
+
+            // Set output amount
+            int outputs = (int) txNew.vout.size() - 1;
+            CAmount nRemaining = nCredit;
+            if (outputs > 1) {
+                // Split the stake across the outputs
+                CAmount nShare = nRemaining / outputs;
+                for (int i = 1; i < outputs; i++) {
+                    // loop through all but the last one.
+                    txNew.vout[i].nValue = nShare;
+                    nRemaining -= nShare;
+                }
+            }
+            // put the remaining on the last output (which all into the first if only one output)
+            txNew.vout[outputs].nValue += nRemaining;
 
-        // Set coinstake input
-        txNew.vin.emplace_back(stakeInput.GetTxIn());
+            // Set coinstake input
+            txNew.vin.emplace_back(stakeInput.GetTxIn());
 
-        // Limit size
-        unsigned int nBytes = ::GetSerializeSize(txNew, PROTOCOL_VERSION);
-        if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
-            return error("%s : exceeded coinstake size limit", __func__);
+            // Limit size
+            unsigned int nBytes = ::GetSerializeSize(txNew, PROTOCOL_VERSION);
+            if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
+                return error("%s : exceeded coinstake size limit", __func__);
 
-        break;
+            fKernelFound = true;
+        }
+        if (fKernelFound) break;
     }
+
+    // update staker status (attempts)
+    pStakerStatus->SetLastTries(nAttempts);
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
 
     return fKernelFound;
@@ -3580,6 +3689,8 @@ bool CWallet::SetAddressBook(const CWDestination& address, const std::string& st
         mapAddressBook[address].name = strName;
         if (!strPurpose.empty()) /* update purpose only if requested */
             mapAddressBook[address].purpose = strPurpose;
+        // The delegators decide which cold coins are staked
+        if (strPurpose == AddressBook::AddressBookPurpose::DELEGATOR) fStakeableCoinsDirty = true;
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
             mapAddressBook.at(address).purpose, (fUpdated ? CT_UPDATED : CT_NEW));
@@ -3601,6 +3712,7 @@ bool CWallet::DelAddressBook(const CWDestination& address, const CChainParams::B
             WalletBatch(*database).EraseDestData(strAddress, item.first);
         }
         mapAddressBook.erase(address);
+        if (purpose == AddressBook::AddressBookPurpose::DELEGATOR) fStakeableCoinsDirty = true;
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, purpose, CT_DELETED);
@@ -3882,18 +3994,24 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    stakeableCoins.Remove(output);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    auto it = mapWallet.find(output.hash);
+    if (it != mapWallet.end() && output.n < it->second.tx->vout.size()) {
+        UpdateStakeableCoin(it->second, output.n);
+    }
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    fStakeableCoinsDirty = true;
 }
 
 bool CWallet::IsLockedCoin(const uint256& hash, unsigned int n) const
@@ -4308,6 +4426,12 @@ CWallet* CWallet::CreateWalletFromFile(const std::string& name, const fs::path&
                 pindexRescan->GetBlockTime() < (walletInstance->nTimeFirstKey - TIMESTAMP_WINDOW)) {
             pindexRescan = chainActive.Next(pindexRescan);
         }
+        // The blocks up to a loaded UTXO snapshot base were never downloaded
+        if (pindexRescan && pindexSnapshotBase && pindexRescan->nHeight <= pindexSnapshotBase->nHeight) {
+            UIError(strprintf(_("The wallet needs to be rescanned from block %d, below the base of the loaded UTXO snapshot (block %d)."),
+                              pindexRescan->nHeight, pindexSnapshotBase->nHeight));
+            return nullptr;
+        }
         const int64_t nWalletRescanTime = GetTimeMillis();
         {
             WalletRescanReserver reserver(walletInstance);
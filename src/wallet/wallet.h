@@ -29,6 +29,7 @@
 #include "validationinterface.h"
 #include "script/ismine.h"
 #include "wallet/scriptpubkeyman.h"
+#include "wallet/stakeablecoins.h"
 #include "sapling/saplingscriptpubkeyman.h"
 #include "validation.h"
 #include "wallet/walletdb.h"
@@ -674,6 +675,30 @@ private:
     //! Destination --> label/purpose mapping.
     std::map<CWDestination, AddressBook::CAddressBookData> mapAddressBook;
 
+    //! Kernels of the stakeable coins, computed once per block and searched at each time slot
+    mutable Mutex cs_stake_kernels;
+    mutable CStakeKernelEngine stakeKernels GUARDED_BY(cs_stake_kernels);
+    //! Outpoints of the coins of stakeKernels, by kernel index
+    mutable std::vector<COutPoint> vStakeKernelOutpoints GUARDED_BY(cs_stake_kernels);
+
+    //! Coins which can stake, kept up to date as the transactions of the wallet change
+    StakeableCoinsIndex stakeableCoins GUARDED_BY(cs_wallet);
+    //! Whether stakeableCoins is to be rebuilt from mapWallet: at load, and after changes
+    //! not followed one by one (abandoned and conflicted transactions, imported keys)
+    bool fStakeableCoinsDirty GUARDED_BY(cs_wallet){true};
+
+    /** Re-evaluate whether an output of wtx can stake, in stakeableCoins */
+    void UpdateStakeableCoin(const CWalletTx& wtx, unsigned int n) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Re-evaluate the outputs of wtx, and the ones it spends, in stakeableCoins */
+    void UpdateStakeableCoins(const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Bring stakeableCoins to the last block processed, rebuilding it if it's dirty */
+    void SyncStakeableCoins() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /** Compute the kernels of availableCoins, unless they're already computed for this block */
+    void PrepareStakeKernels(const CBlockIndex* pindexPrev,
+                             unsigned int nBits,
+                             const std::vector<CStakeableOutput>& availableCoins) const EXCLUSIVE_LOCKS_REQUIRED(cs_stake_kernels);
+
 public:
 
     static const CAmount DEFAULT_STAKE_SPLIT_THRESHOLD = 500 * COIN;
@@ -835,6 +860,8 @@ public:
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     //! >> Available coins (staking)
     bool StakeableCoins(std::vector<CStakeableOutput>* pCoins = nullptr);
+    //! Number of stakeable coins, and their total value if pnValue is set
+    size_t CountStakeableCoins(CAmount* pnValue = nullptr);
     //! >> Available coins (P2CS)
     void GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const;
 
@@ -7,11 +7,18 @@
 
 #include "zmqconfig.h"
 
+#include <atomic>
+#include <memory>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** Default for -zmqpub<topic>hwm, the number of messages of a notifier waiting to be sent */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 class CZMQAbstractNotifier
 {
 public:
@@ -28,17 +35,33 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetHighWaterMark() const { return nHighWaterMark; }
+    void SetHighWaterMark(int hwm) { nHighWaterMark = hwm; }
+    /** Messages waiting to be sent, and dropped because the high-water mark was reached */
+    int64_t GetQueued() const { return nQueued; }
+    uint64_t GetDropped() const { return nDropped; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** The new tip, pblock is the block when it's still in memory, nullptr otherwise. */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
+    /** A transaction added to the mempool, or connected or disconnected with a block */
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
+    /** Mempool and chain events, with the number of mempool events published so far */
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence);
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const uint256 &hash);
+
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nHighWaterMark{DEFAULT_ZMQ_SNDHWM};
+    std::atomic<int64_t> nQueued{0};
+    std::atomic<uint64_t> nDropped{0};
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -4,11 +4,16 @@
 
 #include "zmqnotificationinterface.h"
 #include "zmqpublishnotifier.h"
+#include "zmqpublisher.h"
 
+#include "chain.h"
 #include "version.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "util/system.h"
 
+CZMQNotificationInterface* g_zmq_notification_interface = nullptr;
+
 void zmqError(const char *str)
 {
     LogPrint(BCLog::ZMQ, "Error: %s, errno=%s\n", str, zmq_strerror(errno));
@@ -38,6 +43,8 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubhashtxremoved"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionRemovedNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -49,6 +56,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(entry.first);
             notifier->SetAddress(address);
+            notifier->SetHighWaterMark(std::max<int64_t>(gArgs.GetArg(arg + "hwm", DEFAULT_ZMQ_SNDHWM), 1));
             notifiers.push_back(notifier);
         }
     }
@@ -82,10 +90,19 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    // Room in the queue for every notifier to reach its high-water mark
+    size_t nQueueSize = 0;
+    for (const CZMQAbstractNotifier* notifier : notifiers)
+    {
+        nQueueSize += notifier->GetHighWaterMark();
+    }
+    publisher.reset(new CZMQPublisher(nQueueSize));
+
     std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin();
     for (; i!=notifiers.end(); ++i)
     {
         CZMQAbstractNotifier *notifier = *i;
+        static_cast<CZMQAbstractPublishNotifier*>(notifier)->SetPublisher(publisher.get());
         if (notifier->Initialize(pcontext))
         {
             LogPrint(BCLog::ZMQ, "Notifier %s ready (address = %s)\n", notifier->GetType(), notifier->GetAddress());
@@ -102,6 +119,7 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    publisher->Start();
     return true;
 }
 
@@ -111,6 +129,10 @@ void CZMQNotificationInterface::Shutdown()
     LogPrint(BCLog::ZMQ, "Shutdown notification interface\n");
     if (pcontext)
     {
+        // Send what's queued, the sockets can't be closed while the publisher thread uses them
+        if (publisher)
+            publisher->Stop();
+
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -123,59 +145,102 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
+std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetActiveNotifiers() const
+{
+    std::list<const CZMQAbstractNotifier*> result;
+    for (const CZMQAbstractNotifier* n : notifiers) {
+        result.push_back(n);
+    }
+    return result;
+}
+
+namespace {
+
+template <typename Function>
+void ForEachNotifier(std::list<CZMQAbstractNotifier*>& notifiers, const Function& func)
+{
+    for (CZMQAbstractNotifier* notifier : notifiers) {
+        // The socket of a notifier is used by the publisher thread, a notifier which failed to
+        // build its message is kept rather than shut down from here.
+        if (!func(notifier)) {
+            LogPrint(BCLog::ZMQ, "Notifier %s failed (address = %s)\n", notifier->GetType(), notifier->GetAddress());
+        }
+    }
+}
+
+} // anon namespace
+
 void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
 {
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs_last_block);
+        pblock.swap(m_last_block);
+    }
+
     if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
         return;
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    // The tip is the last block connected, its serialization doesn't need to read it back from disk
+    if (pblock && pblock->GetHash() != pindexNew->GetBlockHash())
+        pblock.reset();
+
+    ForEachNotifier(notifiers, [pindexNew, &pblock](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlock(pindexNew, pblock);
+    });
+}
+
+void CZMQNotificationInterface::NotifyTransaction(const CTransaction& tx)
+{
+    ForEachNotifier(notifiers, [&tx](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransaction(tx);
+    });
 }
 
 void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
 {
-    // Used by BlockConnected and BlockDisconnected as well, because they're
-    // all the same external callback.
     const CTransaction& tx = *ptx;
+    const uint64_t mempool_sequence = ++nMempoolSequence;
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    ForEachNotifier(notifiers, [&tx, mempool_sequence](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransaction(tx) && notifier->NotifyTransactionAcceptance(tx, mempool_sequence);
+    });
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason)
+{
+    const CTransaction& tx = *ptx;
+    // Removals for a block don't count, they aren't published in the sequence
+    const uint64_t mempool_sequence = reason == MemPoolRemovalReason::BLOCK ? nMempoolSequence : ++nMempoolSequence;
+
+    ForEachNotifier(notifiers, [&tx, reason, mempool_sequence](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionRemoval(tx, reason, mempool_sequence);
+    });
 }
 
 void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction added in the block
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(*ptx);
     }
+
+    ForEachNotifier(notifiers, [pindexConnected](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockConnect(pindexConnected);
+    });
+
+    LOCK(cs_last_block);
+    m_last_block = pblock;
 }
 
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction removed in block disconnection
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(*ptx);
     }
+
+    ForEachNotifier(notifiers, [&blockHash](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockDisconnect(blockHash);
+    });
 }
@@ -5,13 +5,16 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
 #include <list>
+#include <memory>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class CZMQPublisher;
 
 class CZMQNotificationInterface : public CValidationInterface
 {
@@ -20,12 +23,15 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    std::list<const CZMQAbstractNotifier*> GetActiveNotifiers() const;
+
 protected:
     bool Initialize();
     void Shutdown();
 
     // CValidationInterface
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -33,8 +39,20 @@ protected:
 private:
     CZMQNotificationInterface();
 
+    void NotifyTransaction(const CTransaction& tx);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    std::unique_ptr<CZMQPublisher> publisher;
+
+    /** Number of the mempool acceptances and removals published, for the subscribers to notice gaps */
+    uint64_t nMempoolSequence{0};
+
+    Mutex cs_last_block;
+    /** The block last connected, kept for UpdatedBlockTip not to read it back from disk */
+    std::shared_ptr<const CBlock> m_last_block GUARDED_BY(cs_last_block);
 };
 
+extern CZMQNotificationInterface* g_zmq_notification_interface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
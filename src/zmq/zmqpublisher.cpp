@@ -0,0 +1,77 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmqpublisher.h"
+#include "zmqpublishnotifier.h"
+
+#include "util/system.h"
+
+#include <functional>
+
+/** How long the publisher thread sleeps at most, in case a wake up was missed */
+static constexpr std::chrono::milliseconds PUBLISHER_POLL_INTERVAL{100};
+
+CZMQPublisher::~CZMQPublisher()
+{
+    Stop();
+}
+
+void CZMQPublisher::Start()
+{
+    m_stop = false;
+    m_thread_publish = std::thread(&TraceThread<std::function<void()>>, "zmqpub",
+                                   std::function<void()>(std::bind(&CZMQPublisher::ThreadPublish, this)));
+}
+
+void CZMQPublisher::Stop()
+{
+    if (!m_thread_publish.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread_publish.join();
+}
+
+bool CZMQPublisher::Enqueue(CZMQMessage& msg)
+{
+    if (!ring.TryPush(msg)) return false;
+    // Pairs with the fence of the publisher thread before it checks the queue a last time: either
+    // it sees the message, or we see it waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond.notify_one();
+    }
+    return true;
+}
+
+void CZMQPublisher::ThreadPublish()
+{
+    CZMQMessage msg;
+    while (true) {
+        while (ring.TryPop(msg)) {
+            msg.notifier->Publish(msg);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop) break;
+        m_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.TryPop(msg)) {
+            m_waiting = false;
+            lock.unlock();
+            msg.notifier->Publish(msg);
+            continue;
+        }
+        m_cond.wait_for(lock, PUBLISHER_POLL_INTERVAL);
+        m_waiting = false;
+    }
+
+    // Messages queued while stopping
+    while (ring.TryPop(msg)) {
+        msg.notifier->Publish(msg);
+    }
+}
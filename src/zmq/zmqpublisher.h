@@ -0,0 +1,146 @@
+// Copyright (c) 2021 The TrumpCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ZMQ_ZMQPUBLISHER_H
+#define BITCOIN_ZMQ_ZMQPUBLISHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CZMQAbstractPublishNotifier;
+
+/**
+ * Bounded lock-free queue, for any number of producers and consumers.
+ *
+ * Every cell carries a sequence number telling whether it's free for the producer claiming the
+ * position, or filled for the consumer claiming it; producers and consumers only contend on the
+ * atomic position they advance.
+ */
+template <typename T>
+class LockFreeRing
+{
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+    static size_t RoundUpPowerOfTwo(size_t n)
+    {
+        size_t capacity = 2;
+        while (capacity < n) capacity <<= 1;
+        return capacity;
+    }
+
+public:
+    /** The capacity is rounded up to a power of two. */
+    explicit LockFreeRing(size_t capacity) : cells(new Cell[RoundUpPowerOfTwo(capacity)]), mask(RoundUpPowerOfTwo(capacity) - 1)
+    {
+        for (size_t i = 0; i <= mask; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeRing(const LockFreeRing&) = delete;
+    LockFreeRing& operator=(const LockFreeRing&) = delete;
+
+    size_t Capacity() const { return mask + 1; }
+
+    /** Append an element, returns false (leaving value untouched) if the queue is full. */
+    bool TryPush(T& value)
+    {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Take the oldest element, returns false if the queue is empty. */
+    bool TryPop(T& value)
+    {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/** A notification ready to be sent: the notifier's topic, its body and its sequence number */
+struct CZMQMessage {
+    CZMQAbstractPublishNotifier* notifier{nullptr};
+    const char* command{nullptr};
+    std::vector<unsigned char> data;
+    uint32_t nSequence{0};
+};
+
+/**
+ * Sends the notifications from a dedicated thread, for the validation callbacks not to wait for
+ * slow subscribers. The notifiers serialize their messages and enqueue them in a lock-free ring;
+ * the publisher thread is the only one to use the ZMQ sockets until it's stopped.
+ */
+class CZMQPublisher
+{
+private:
+    LockFreeRing<CZMQMessage> ring;
+
+    std::thread m_thread_publish;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    /** Whether the publisher thread is about to wait, producers only take the mutex to wake it up then */
+    std::atomic<bool> m_waiting{false};
+    std::atomic<bool> m_stop{false};
+
+    void ThreadPublish();
+
+public:
+    explicit CZMQPublisher(size_t capacity) : ring(capacity) {}
+    ~CZMQPublisher();
+
+    void Start();
+    /** Send the messages still queued and stop the publisher thread. */
+    void Stop();
+
+    /** Queue a message, returns false if the queue is full. */
+    bool Enqueue(CZMQMessage& msg);
+};
+
+#endif // BITCOIN_ZMQ_ZMQPUBLISHER_H
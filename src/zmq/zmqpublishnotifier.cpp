@@ -3,10 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqpublishnotifier.h"
+#include "zmqpublisher.h"
 
 #include "chainparams.h"
 #include "util/system.h"
 #include "crypto/common.h"
+#include "txmempool.h"      // MemPoolRemovalReason
 #include "validation.h"     // cs_main
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
@@ -15,6 +17,8 @@ static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
+static const char *MSG_HASHTXREMOVED = "hashtxremoved";
+static const char *MSG_SEQUENCE   = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -72,7 +76,15 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &nHighWaterMark, sizeof(nHighWaterMark));
+        if (rc!=0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -127,22 +139,46 @@ void CZMQAbstractPublishNotifier::Shutdown()
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
 {
-    assert(psocket);
+    assert(psocket && publisher);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
+    /* dropped messages consume a sequence number too, for the subscribers to notice them */
+    CZMQMessage msg;
+    msg.nSequence = nSequence++;
+
+    if (nQueued >= nHighWaterMark)
+    {
+        nDropped++;
+        LogPrint(BCLog::ZMQ, "Drop %s message, high water mark of %d messages reached\n", command, nHighWaterMark);
+        return true;
+    }
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    msg.notifier = this;
+    msg.command = command;
+    msg.data.assign((const unsigned char*)data, (const unsigned char*)data + size);
+
+    nQueued++;
+    if (!publisher->Enqueue(msg))
+    {
+        nQueued--;
+        nDropped++;
+        LogPrint(BCLog::ZMQ, "Drop %s message, publisher queue full\n", command);
+    }
 
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+void CZMQAbstractPublishNotifier::Publish(const CZMQMessage& msg)
+{
+    assert(psocket);
+
+    /* send three parts, command & data & a LE 4byte sequence number */
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], msg.nSequence);
+    zmq_send_multipart(psocket, msg.command, strlen(msg.command), msg.data.data(), msg.data.size(), msgseq, (size_t)sizeof(uint32_t), (void*)0);
+    nQueued--;
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& /*pblock*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint(BCLog::ZMQ, "Publish hashblock %s\n", hash.GetHex());
@@ -162,11 +198,16 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
 {
     LogPrint(BCLog::ZMQ, "Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    if (pblock)
+    {
+        ss << *pblock;
+    }
+    else
     {
         LOCK(cs_main);
         CBlock block;
@@ -190,3 +231,51 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishHashTransactionRemovedNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t /*mempool_sequence*/)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "Publish hashtxremoved %s\n", hash.GetHex());
+    /* the transaction hash followed by the removal reason */
+    unsigned char data[33];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = (unsigned char)reason;
+    return SendMessage(MSG_HASHTXREMOVED, data, sizeof(data));
+}
+
+// The hash, a label and for the mempool events the LE 8byte mempool sequence number
+static bool SendSequenceMsg(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, const uint64_t* mempool_sequence = nullptr)
+{
+    LogPrint(BCLog::ZMQ, "Publish sequence %s %c\n", hash.GetHex(), label);
+    unsigned char data[sizeof(uint256) + sizeof(label) + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    if (mempool_sequence)
+        WriteLE64(&data[33], *mempool_sequence);
+    return notifier.SendMessage(MSG_SEQUENCE, data, mempool_sequence ? sizeof(data) : sizeof(uint256) + sizeof(label));
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    return SendSequenceMsg(*this, pindex->GetBlockHash(), /* Block (C)onnect */ 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    return SendSequenceMsg(*this, hash, /* Block (D)isconnect */ 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    return SendSequenceMsg(*this, transaction.GetHash(), /* Mempool (A)cceptance */ 'A', &mempool_sequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    // The transactions of a connected block are implied by its (C)onnect message
+    if (reason == MemPoolRemovalReason::BLOCK)
+        return true;
+    return SendSequenceMsg(*this, transaction.GetHash(), /* Mempool (R)emoval */ 'R', &mempool_sequence);
+}
@@ -8,22 +8,31 @@
 #include "zmqabstractnotifier.h"
 
 class CBlockIndex;
+class CZMQPublisher;
+struct CZMQMessage;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence{0}; // upcounting per message sequence number
+    uint32_t nSequence{0}; // upcounting per message sequence number, dropped messages included
+    CZMQPublisher* publisher{nullptr};
 
 public:
 
-    /* send zmq multipart message
+    /* queue zmq multipart message, to be sent by the publisher thread
        parts:
           * command
           * data
           * message sequence number
+       the message is dropped if the high-water mark of the notifier is reached
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
+    /* send a queued message, from the publisher thread */
+    void Publish(const CZMQMessage& msg);
+
+    void SetPublisher(CZMQPublisher* p) { publisher = p; }
+
     bool Initialize(void *pcontext);
     void Shutdown();
 };
@@ -31,7 +40,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -43,7 +52,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,4 +61,19 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishHashTransactionRemovedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence);
+};
+
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnect(const uint256 &hash);
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence);
+    bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
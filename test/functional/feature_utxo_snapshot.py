@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The TrumpCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test bootstrapping a node from a UTXO set snapshot (dumptxoutset, loadtxoutset).
+
+node0 mines a chain and dumps its chainstate, node1 starts from scratch, unconnected.
+
+- node1 loads only the snapshots of its chain parameters (-snapshotparams on regtest),
+  and only untampered ones, while at the genesis block, without wallets
+- once loaded, node1 is at the snapshot base with node0's UTXO set, without the blocks below it,
+  whose transaction counts and shielded values are unknown
+- node1 syncs the blocks after the base from node0, before and after a restart
+- node1 can't start with a wallet to rescan, nor with -blockfilterindex or -reindex-chainstate
+"""
+
+import os
+
+from test_framework.test_framework import TrumpCoinTestFramework
+from test_framework.test_node import ErrorMatch
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+)
+
+SNAPSHOT_HEIGHT = 150
+
+
+class UTXOSnapshotTest(TrumpCoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        # node1 is connected once the snapshot is loaded
+        self.setup_nodes()
+
+    def check_same_txoutset(self):
+        expected = self.nodes[0].gettxoutsetinfo()
+        info = self.nodes[1].gettxoutsetinfo()
+        for key in ['height', 'bestblock', 'transactions', 'txouts', 'hash_serialized_2', 'total_amount']:
+            assert_equal(info[key], expected[key])
+
+    def sync_from_node0(self, nblocks):
+        self.nodes[0].generate(nblocks)
+        connect_nodes(self.nodes[1], 0)
+        self.sync_blocks()
+        assert_equal(self.nodes[1].getbestblockhash(), self.nodes[0].getbestblockhash())
+        self.check_same_txoutset()
+
+    def run_test(self):
+        node0 = self.nodes[0]
+
+        self.log.info("Dump the chainstate of node0")
+        node0.generate(SNAPSHOT_HEIGHT)
+        dump = node0.dumptxoutset("utxo.dat")
+        assert_equal(dump['base_height'], SNAPSHOT_HEIGHT)
+        assert_equal(dump['base_hash'], node0.getbestblockhash())
+        assert_equal(dump['txoutset_hash'], node0.gettxoutsetinfo()['hash_serialized_2'])
+        assert_raises_rpc_error(-8, "already exists", node0.dumptxoutset, "utxo.dat")
+        snapshot_path = dump['path']
+        snapshot_params = "-snapshotparams=%d:%s:%s:%s" % (
+            SNAPSHOT_HEIGHT, dump['base_hash'], dump['txoutset_hash'], dump['shieldedstate_hash'])
+
+        self.log.info("Check that only the trusted snapshots are loaded")
+        assert_raises_rpc_error(-1, "No snapshot is trusted on this network", self.nodes[1].loadtxoutset, snapshot_path)
+        self.restart_node(1, [snapshot_params])
+        assert_raises_rpc_error(-1, "can't be loaded with wallets", self.nodes[1].loadtxoutset, snapshot_path)
+        self.restart_node(1, [snapshot_params, "-disablewallet"])
+        node1 = self.nodes[1]
+        with open(snapshot_path, 'rb') as f:
+            data = bytearray(f.read())
+        data[-1] ^= 0x01
+        tampered_path = os.path.join(node1.datadir, "tampered.dat")
+        with open(tampered_path, 'wb') as f:
+            f.write(data)
+        assert_raises_rpc_error(-8, "Invalid snapshot", node1.loadtxoutset, tampered_path)
+        assert_equal(node1.getblockcount(), 0)
+
+        self.log.info("Load the snapshot")
+        result = node1.loadtxoutset(snapshot_path)
+        assert_equal(result['coins_loaded'], dump['coins_written'])
+        assert_equal(result['base_hash'], dump['base_hash'])
+        assert_equal(result['base_height'], SNAPSHOT_HEIGHT)
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        self.check_same_txoutset()
+        assert_raises_rpc_error(-1, "must be at the genesis block", node1.loadtxoutset, snapshot_path)
+
+        # The headers came with the snapshot, the blocks below the base never do
+        block_hash = node1.getblockhash(SNAPSHOT_HEIGHT // 2)
+        header = node1.getblockheader(block_hash)
+        expected = node0.getblockheader(block_hash)
+        assert_equal(header.pop('shield_pool_value'), {})
+        expected.pop('shield_pool_value')
+        assert_equal(header, expected)
+        assert_raises_rpc_error(-32603, "Can't read block from disk", node1.getblock, block_hash)
+        # Only the shielded pool value of the base is known
+        pool_value = node0.getblockheader(dump['base_hash'])['shield_pool_value']
+        assert_equal(node1.getblockheader(dump['base_hash'])['shield_pool_value'], {'chainValue': pool_value['chainValue']})
+
+        self.log.info("Sync the blocks after the snapshot base")
+        self.sync_from_node0(10)
+        assert_equal(node1.getblockcount(), SNAPSHOT_HEIGHT + 10)
+
+        self.log.info("Restart node1, and sync more blocks")
+        self.restart_node(1, ["-disablewallet"])
+        assert_equal(self.nodes[1].getbestblockhash(), node0.getbestblockhash())
+        self.check_same_txoutset()
+        self.sync_from_node0(5)
+        assert_equal(self.nodes[1].getblockcount(), SNAPSHOT_HEIGHT + 15)
+
+        self.log.info("Check that node1 doesn't start with what needs the blocks below the base")
+        self.stop_node(1)
+        self.nodes[1].assert_start_raises_init_error([], "below the base of the loaded UTXO snapshot", match=ErrorMatch.PARTIAL_REGEX)
+        self.nodes[1].assert_start_raises_init_error(["-disablewallet", "-blockfilterindex"], "loaded from a UTXO snapshot", match=ErrorMatch.PARTIAL_REGEX)
+        self.start_node(1, ["-disablewallet"])
+        assert_equal(self.nodes[1].getbestblockhash(), node0.getbestblockhash())
+
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()
@@ -75,7 +75,16 @@ class ZMQTest (TrumpCoinTestFramework):
         self.rawblock = ZMQSubscriber(socket, b"rawblock")
         self.rawtx = ZMQSubscriber(socket, b"rawtx")
 
-        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]], []]
+        # The sequence notifications on their own socket, not to depend on their order with the others.
+        self.sequence_address = "tcp://127.0.0.1:28333"
+        sequence_socket = self.zmq_context.socket(zmq.SUB)
+        sequence_socket.set(zmq.RCVTIMEO, 60000)
+        sequence_socket.connect(self.sequence_address)
+        self.sequence = ZMQSubscriber(sequence_socket, b"sequence")
+
+        self.zmq_address = address
+        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]] +
+                           ["-zmqpubsequence=%s" % self.sequence_address, "-zmqpubsequencehwm=2000"], []]
         self.add_nodes(self.num_nodes, self.extra_args)
         self.start_nodes()
         time.sleep(10)
@@ -127,5 +136,32 @@ class ZMQTest (TrumpCoinTestFramework):
         hex = self.rawtx.receive()
         assert_equal(payment_txid, bytes_to_hex_str(hash256(hex)))
 
+        self.log.info("Check the sequence notifications")
+        for x in range(num_blocks):
+            body = self.sequence.receive()
+            # Block (C)onnect, without mempool sequence number
+            assert_equal(len(body), 33)
+            assert_equal(genhashes[x], bytes_to_hex_str(body[:32]))
+            assert_equal(body[32:], b"C")
+        body = self.sequence.receive()
+        # Mempool (A)cceptance, with the mempool sequence number
+        assert_equal(payment_txid, bytes_to_hex_str(body[:32]))
+        assert_equal(body[32:33], b"A")
+        assert_equal(struct.unpack('<Q', body[33:])[0], 1)
+
+        self.log.info("Check getzmqnotifications")
+        notifications = self.nodes[0].getzmqnotifications()
+        assert_equal(sorted(n["type"] for n in notifications),
+                     ["pubhashblock", "pubhashtx", "pubrawblock", "pubrawtx", "pubsequence"])
+        for n in notifications:
+            if n["type"] == "pubsequence":
+                assert_equal(n["address"], self.sequence_address)
+                assert_equal(n["hwm"], 2000)
+            else:
+                assert_equal(n["address"], self.zmq_address)
+                assert_equal(n["hwm"], 1000)
+            assert_equal(n["dropped"], 0)
+        assert_equal(self.nodes[1].getzmqnotifications(), [])
+
 if __name__ == '__main__':
     ZMQTest().main()
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Bitcoin Core developers
+# Copyright (c) 2021 The TrumpCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the compact block filters served over P2P (BIP 157) and by getblockfilter.
+
+node0 runs with -blockfilterindex -peerblockfilters, node1 with neither.
+
+- node0 signals NODE_COMPACT_FILTERS, node1 doesn't
+- getcfcheckpt, getcfheaders and getcfilters are answered with the filters of the
+  active chain, and of a stale block
+- the filter headers chain as BIP 157 specifies, and agree with getblockfilter
+- invalid requests, and requests to a node not serving filters, get the peer disconnected
+"""
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.messages import (
+    NODE_COMPACT_FILTERS,
+    hash256,
+    msg_getcfcheckpt,
+    msg_getcfheaders,
+    msg_getcfilters,
+    ser_uint256,
+    uint256_from_str,
+)
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import TrumpCoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    disconnect_nodes,
+    wait_until,
+)
+
+FILTER_TYPE_BASIC = 0
+
+
+class CFiltersClient(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        # Received cfilter messages, in order
+        self.cfilters = []
+
+    def pop_cfilters(self):
+        cfilters = self.cfilters
+        self.cfilters = []
+        return cfilters
+
+    def on_cfilter(self, message):
+        self.cfilters.append(message)
+
+
+def compute_last_header(prev_header, hashes):
+    """Compute the last filter header from a starting header and a sequence of filter hashes."""
+    header = ser_uint256(prev_header)
+    for filter_hash in hashes:
+        header = hash256(ser_uint256(filter_hash) + header)
+    return uint256_from_str(header)
+
+
+class CompactFiltersTest(TrumpCoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-blockfilterindex", "-peerblockfilters"],
+            [],
+        ]
+
+    def filter_indexed(self, blockhash):
+        try:
+            self.nodes[0].getblockfilter(blockhash)
+            return True
+        except JSONRPCException:
+            return False
+
+    def run_test(self):
+        # Node 0 supports COMPACT_FILTERS, node 1 does not
+        node0 = self.nodes[0].add_p2p_connection(CFiltersClient())
+        node1 = self.nodes[1].add_p2p_connection(CFiltersClient())
+        assert node0.nServices & NODE_COMPACT_FILTERS != 0
+        assert node1.nServices & NODE_COMPACT_FILTERS == 0
+        assert int(self.nodes[0].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_FILTERS != 0
+        assert int(self.nodes[1].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_FILTERS == 0
+
+        # A stale block on node0: node1's longer branch replaces it
+        disconnect_nodes(self.nodes[0], 1)
+        stale_block_hash = self.nodes[0].generate(1)[0]
+        self.nodes[1].generate(2)
+        connect_nodes(self.nodes[0], 1)
+        self.sync_blocks()
+        assert_equal(self.nodes[0].getblock(stale_block_hash)['confirmations'], -1)
+
+        stop_height = self.nodes[0].getblockcount()
+        stop_hash = self.nodes[0].getbestblockhash()
+        wait_until(lambda: self.filter_indexed(stop_hash), timeout=60)
+        stop_hash = int(stop_hash, 16)
+
+        self.log.info("Check that getcfcheckpt has a header every CFCHECKPT_INTERVAL blocks, none here")
+        node0.send_and_ping(msg_getcfcheckpt(filter_type=FILTER_TYPE_BASIC, stop_hash=stop_hash))
+        response = node0.last_message['cfcheckpt']
+        assert_equal(response.filter_type, FILTER_TYPE_BASIC)
+        assert_equal(response.stop_hash, stop_hash)
+        assert_equal(response.headers, [])
+
+        self.log.info("Check that getcfheaders chains the filter hashes of the active chain")
+        node0.send_and_ping(msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=1, stop_hash=stop_hash))
+        response = node0.last_message['cfheaders']
+        assert_equal(response.filter_type, FILTER_TYPE_BASIC)
+        assert_equal(response.stop_hash, stop_hash)
+        assert_equal(len(response.hashes), stop_height)
+        genesis_filter = self.nodes[0].getblockfilter(self.nodes[0].getblockhash(0))
+        assert_equal(response.prev_header, int(genesis_filter['header'], 16))
+        last_header = compute_last_header(response.prev_header, response.hashes)
+        assert_equal(last_header, int(self.nodes[0].getblockfilter(self.nodes[0].getbestblockhash())['header'], 16))
+
+        self.log.info("Check that getcfheaders serves the stale block")
+        stale_prev_hash = self.nodes[0].getblockheader(stale_block_hash)['previousblockhash']
+        stale_height = self.nodes[0].getblockheader(stale_block_hash)['height']
+        node0.send_and_ping(msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=stale_height, stop_hash=int(stale_block_hash, 16)))
+        response = node0.last_message['cfheaders']
+        assert_equal(response.stop_hash, int(stale_block_hash, 16))
+        assert_equal(len(response.hashes), 1)
+        assert_equal(response.prev_header, int(self.nodes[0].getblockfilter(stale_prev_hash)['header'], 16))
+        stale_filter = self.nodes[0].getblockfilter(stale_block_hash)
+        assert_equal(compute_last_header(response.prev_header, response.hashes), int(stale_filter['header'], 16))
+
+        self.log.info("Check that getcfilters serves the filters of getblockfilter, in order")
+        start_height = stop_height - 9
+        node0.send_and_ping(msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=start_height, stop_hash=stop_hash))
+        cfilters = node0.pop_cfilters()
+        assert_equal(len(cfilters), 10)
+        for height, cfilter in zip(range(start_height, stop_height + 1), cfilters):
+            block_hash = self.nodes[0].getblockhash(height)
+            assert_equal(cfilter.filter_type, FILTER_TYPE_BASIC)
+            assert_equal(cfilter.block_hash, int(block_hash, 16))
+            assert_equal(cfilter.filter_data.hex(), self.nodes[0].getblockfilter(block_hash)['filter'])
+
+        node0.send_and_ping(msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=stale_height, stop_hash=int(stale_block_hash, 16)))
+        cfilters = node0.pop_cfilters()
+        assert_equal(len(cfilters), 1)
+        assert_equal(cfilters[0].block_hash, int(stale_block_hash, 16))
+        assert_equal(cfilters[0].filter_data.hex(), stale_filter['filter'])
+        assert_equal(uint256_from_str(hash256(cfilters[0].filter_data)), response.hashes[0])
+
+        self.log.info("Check that getblockfilter fails on unknown filter types and blocks, and without the index")
+        assert_raises_rpc_error(-5, "Unknown filtertype", self.nodes[0].getblockfilter, stale_block_hash, "unknown")
+        assert_raises_rpc_error(-5, "Block not found", self.nodes[0].getblockfilter, "%064x" % 0)
+        assert_raises_rpc_error(-1, "Index is not enabled for filtertype basic", self.nodes[1].getblockfilter, stale_block_hash)
+
+        self.log.info("Check that a node without -peerblockfilters disconnects the peers asking for filters")
+        for request in [
+            msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=1, stop_hash=stop_hash),
+            msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=1, stop_hash=stop_hash),
+            msg_getcfcheckpt(filter_type=FILTER_TYPE_BASIC, stop_hash=stop_hash),
+        ]:
+            peer = self.nodes[1].add_p2p_connection(P2PInterface())
+            peer.send_message(request)
+            peer.wait_for_disconnect()
+        self.nodes[1].disconnect_p2ps()
+
+        self.log.info("Check that invalid requests get the peer disconnected")
+        for request in [
+            # Unknown filter type
+            msg_getcfcheckpt(filter_type=255, stop_hash=stop_hash),
+            # Unknown stop block
+            msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=1, stop_hash=0),
+            # Start height after the stop block
+            msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=stop_height + 1, stop_hash=stop_hash),
+        ]:
+            peer = self.nodes[0].add_p2p_connection(P2PInterface())
+            peer.send_message(request)
+            peer.wait_for_disconnect()
+
+
+if __name__ == '__main__':
+    CompactFiltersTest().main()
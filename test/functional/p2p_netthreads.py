@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The TrumpCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test serving the peer sockets from several network threads (-netthreads).
+
+node0 and node1 run with -netthreads=4, node0 with many test peers, spread over its threads.
+
+- the number of threads is capped, and the socket backend logged
+- blocks and transactions reach all the peers, whichever thread serves them
+- peers disconnecting and new ones connecting are served as well
+"""
+
+from test_framework.messages import MSG_BLOCK, MSG_TX
+from test_framework.mininode import P2PInterface, mininode_lock
+from test_framework.test_framework import TrumpCoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+    wait_until,
+)
+
+NUM_PEERS = 24
+
+
+class AnnouncementsReceiver(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        # Hashes of the blocks and transactions announced by inv
+        self.announced = set()
+
+    def on_inv(self, message):
+        for i in message.inv:
+            if i.type in [MSG_BLOCK, MSG_TX]:
+                self.announced.add(i.hash)
+        super().on_inv(message)
+
+
+class NetThreadsTest(TrumpCoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-netthreads=4"], ["-netthreads=4"]]
+
+    def wait_for_announcement(self, hash_hex):
+        h = int(hash_hex, 16)
+        for p2p in self.nodes[0].p2ps:
+            wait_until(lambda: h in p2p.announced, timeout=60, lock=mininode_lock)
+
+    def wait_for_peer_count(self, count):
+        wait_until(lambda: len(self.nodes[0].getpeerinfo()) == count, timeout=30)
+
+    def relay_block_and_tx(self):
+        block_hash = self.nodes[1].generate(1)[0]
+        self.sync_blocks()
+        self.wait_for_announcement(block_hash)
+
+        txid = self.nodes[1].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        self.sync_mempools()
+        self.wait_for_announcement(txid)
+
+    def run_test(self):
+        self.log.info("Check the number of threads serving the sockets")
+        with self.nodes[0].assert_debug_log(["Serving peer sockets with 16 thread(s) using "]):
+            self.restart_node(0, ["-netthreads=100"])
+        with self.nodes[0].assert_debug_log(["Serving peer sockets with 4 thread(s) using "]):
+            self.restart_node(0, ["-netthreads=4"])
+        connect_nodes(self.nodes[0], 1)
+        self.sync_blocks()
+
+        self.log.info("Connect %d peers" % NUM_PEERS)
+        for _ in range(NUM_PEERS):
+            self.nodes[0].add_p2p_connection(AnnouncementsReceiver())
+        self.wait_for_peer_count(NUM_PEERS + 1)
+        for p2p in self.nodes[0].p2ps:
+            p2p.sync_with_ping()
+
+        self.log.info("Relay a block and a transaction to all the peers")
+        self.relay_block_and_tx()
+
+        self.log.info("Disconnect every other peer, and connect new ones")
+        remaining = []
+        for i, p2p in enumerate(self.nodes[0].p2ps):
+            if i % 2:
+                p2p.peer_disconnect()
+                p2p.wait_for_disconnect()
+            else:
+                remaining.append(p2p)
+        self.nodes[0].p2ps = remaining
+        self.wait_for_peer_count(len(remaining) + 1)
+        for p2p in self.nodes[0].p2ps:
+            p2p.sync_with_ping()
+
+        for _ in range(NUM_PEERS // 2):
+            self.nodes[0].add_p2p_connection(AnnouncementsReceiver())
+        self.wait_for_peer_count(NUM_PEERS + 1)
+        assert_equal(len(self.nodes[0].p2ps), NUM_PEERS)
+        self.relay_block_and_tx()
+
+        self.log.info("Reconnect the other node")
+        disconnect_nodes(self.nodes[0], 1)
+        self.wait_for_peer_count(NUM_PEERS)
+        block_hash = self.nodes[1].generate(1)[0]
+        connect_nodes(self.nodes[0], 1)
+        self.sync_blocks()
+        self.wait_for_announcement(block_hash)
+        for p2p in self.nodes[0].p2ps:
+            p2p.sync_with_ping()
+
+
+if __name__ == '__main__':
+    NetThreadsTest().main()
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The TrumpCoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test transaction relay through set reconciliation.
+
+Nodes 0 to 2 run with -txreconciliation, node 3 without:
+node0 <-- node1 <-- node2 <-- node3
+
+- the peers supporting it negotiate reconciliation, the others keep flooding
+- a transaction reaches the inbound peers of a node through reconciliation
+- transactions still reach the nodes which don't reconcile
+"""
+
+from test_framework.test_framework import TrumpCoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+
+class TxReconciliationTest(TrumpCoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 4
+        self.extra_args = [["-txreconciliation"]] * 3 + [[]]
+
+    def peer_info(self, node, other):
+        peers = [p for p in self.nodes[node].getpeerinfo() if "testnode%d" % other in p['subver']]
+        assert_equal(len(peers), 1)
+        return peers[0]
+
+    def send_txs(self, node, count):
+        return [self.nodes[node].sendtoaddress(self.nodes[node].getnewaddress(), 1) for _ in range(count)]
+
+    def run_test(self):
+        self.log.info("Check which connections reconcile transactions")
+        for node, other in [(0, 1), (1, 0), (1, 2), (2, 1)]:
+            assert self.peer_info(node, other)['txreconciliation']
+        for node, other in [(2, 3), (3, 2)]:
+            assert not self.peer_info(node, other)['txreconciliation']
+
+        self.log.info("Relay transactions to an inbound reconciling peer")
+        # node1 is node0's only peer, an inbound one: node0 leaves the transactions to the
+        # reconciliations node1 initiates.
+        txids = self.send_txs(0, 5)
+        self.sync_mempools()
+        for node in self.nodes:
+            assert all(txid in node.getrawmempool() for txid in txids)
+
+        # node0 answered node1's requests with sketches, and flooded nothing to it
+        wait_until(lambda: 'sketch' in self.peer_info(0, 1)['bytessent_per_msg'])
+        assert 'reqtxiblt' in self.peer_info(1, 0)['bytessent_per_msg']
+        assert 'reconcildiff' in self.peer_info(1, 0)['bytessent_per_msg']
+        assert 'reqtxiblt' not in self.peer_info(0, 1)['bytessent_per_msg']
+        assert 'inv' not in self.peer_info(0, 1)['bytessent_per_msg']
+
+        self.log.info("Relay transactions from a node which doesn't reconcile")
+        txids = self.send_txs(3, 5)
+        self.sync_mempools()
+        for node in self.nodes:
+            assert all(txid in node.getrawmempool() for txid in txids)
+
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
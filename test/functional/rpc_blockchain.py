@@ -48,6 +48,7 @@ class BlockchainTest(TrumpCoinTestFramework):
             'blocks',
             'chain',
             'chainwork',
+            'coinsflush',
             'difficulty',
             'headers',
             'initial_block_downloading',
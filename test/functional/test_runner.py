@@ -128,10 +128,14 @@ BASE_SCRIPTS= [
     'rpc_blockchain.py',                        # ~ 50 sec
     'wallet_resendwallettransactions.py',
     'feature_asmap.py',
+    'feature_utxo_snapshot.py',
     'wallet_disable.py',                        # ~ 50 sec
     'wallet_autocombine.py',                    # ~ 49 sec
     'mining_v5_upgrade.py',                     # ~ 48 sec
     'p2p_mempool.py',                           # ~ 46 sec
+    'p2p_txreconciliation.py',
+    'p2p_blockfilters.py',
+    'p2p_netthreads.py',
     'rpc_named_arguments.py',                   # ~ 45 sec
     'feature_filelock.py',
     'feature_help.py',                          # ~ 30 sec